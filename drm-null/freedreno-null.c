@@ -0,0 +1,591 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * A null implementation of (the parts of) libdrm_freedreno that fdre uses,
+ * so fdre can run, and be benchmarked, without a GPU.  Buffers are plain
+ * anonymous memory at fake gpu addresses, and nothing is ever executed.
+ *
+ * Submitted cmdstream, plus all the buffers it (directly or via IBs)
+ * references, is recorded in the same .rd format that libwrap writes,
+ * so the result can be decoded with cffdump.  The rd_start()/rd_end()
+ * hooks from redump.h are implemented here, so the RD_START() in the
+ * tests picks the file name, same as when running under libwrap.
+ *
+ * Environment variables:
+ *   FD_NULL_GPU_ID  - gpu-id to report (default NULL_GPU_ID)
+ *   FD_NULL_RD      - set to 0 to skip recording, ie. for benchmarking
+ *   TESTNUM         - same as for libwrap
+ */
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+
+#include <freedreno_drmif.h>
+#include <freedreno_ringbuffer.h>
+
+#include "util.h"
+#include "redump.h"
+
+#ifndef NULL_GPU_ID
+#  define NULL_GPU_ID 320
+#endif
+
+/* fake gpu address space that buffers are allocated from: */
+#define GPUADDR_BASE   0x10000000
+#define GPUADDR_END    0xf0000000
+
+struct fd_device {
+	int refcnt;
+	uint32_t gpu_id;
+	uint32_t next_gpuaddr;
+	uint32_t next_handle;
+	uint32_t serial;       /* incremented for each recorded submit */
+	uint32_t gen;
+};
+
+struct fd_pipe {
+	struct fd_device *dev;
+	enum fd_pipe_id id;
+	uint32_t timestamp;
+};
+
+struct null_ringbuffer;
+
+struct fd_bo {
+	struct fd_device *dev;
+	int refcnt;
+	uint32_t size, handle, gpuaddr;
+	void *map;
+
+	/* if the bo backs a ringbuffer, it's cmds can reference other bo's: */
+	struct null_ringbuffer *ring;
+
+	/* last submit this bo was recorded for: */
+	uint32_t serial;
+
+	/* to avoid adding the same bo to a ring's list over and over: */
+	struct null_ringbuffer *last_ring;
+	uint32_t last_gen;
+};
+
+struct null_ringbuffer {
+	struct fd_ringbuffer base;
+	struct fd_bo *bo;
+
+	/* bo's referenced since the last reset, holding a reference: */
+	struct fd_bo **bos;
+	uint32_t nr_bos, max_bos;
+	uint32_t gen;          /* new value from dev->gen on each reset */
+};
+
+struct fd_ringmarker {
+	struct fd_ringbuffer *ring;
+	uint32_t *cur;
+};
+
+static inline struct null_ringbuffer * to_null_ringbuffer(struct fd_ringbuffer *x)
+{
+	return (struct null_ringbuffer *)x;
+}
+
+/*
+ * .rd recording:
+ */
+
+static int rd_fd = -1;
+
+static uint32_t null_gpu_id(void)
+{
+	const char *str = getenv("FD_NULL_GPU_ID");
+	return str ? strtol(str, NULL, 0) : NULL_GPU_ID;
+}
+
+static bool null_record(void)
+{
+	static int val = -1;
+	if (val == -1) {
+		const char *str = getenv("FD_NULL_RD");
+		val = str ? strtol(str, NULL, 0) : 1;
+	}
+	return val;
+}
+
+void rd_start(const char *name, const char *fmt, ...)
+{
+	char buf[256];
+	static int cnt = 0;
+	int n = cnt++;
+	const char *testnum;
+	uint32_t gpu_id = null_gpu_id();
+	va_list args;
+
+	if (!null_record())
+		return;
+
+	rd_end();
+
+	testnum = getenv("TESTNUM");
+	if (testnum)
+		n = strtol(testnum, NULL, 0);
+
+	snprintf(buf, sizeof(buf), "%s-%04d.rd", name, n);
+
+	rd_fd = open(buf, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+	if (rd_fd < 0) {
+		ERROR_MSG("could not open %s: %s", buf, strerror(errno));
+		return;
+	}
+
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	rd_write_section(RD_TEST, buf, strlen(buf));
+	rd_write_section(RD_GPU_ID, &gpu_id, sizeof(gpu_id));
+}
+
+void rd_end(void)
+{
+	if (rd_fd >= 0)
+		close(rd_fd);
+	rd_fd = -1;
+}
+
+static void rd_write(const void *buf, int sz)
+{
+	const char *ptr = buf;
+
+	while (sz > 0) {
+		int ret = write(rd_fd, ptr, sz);
+		if (ret < 0) {
+			ERROR_MSG("write failed: %s", strerror(errno));
+			rd_end();
+			return;
+		}
+		ptr += ret;
+		sz -= ret;
+	}
+}
+
+void rd_write_section(enum rd_sect_type type, const void *buf, int sz)
+{
+	uint32_t hdr[2] = { type, sz };
+
+	if (rd_fd < 0)
+		return;
+
+	rd_write(hdr, sizeof(hdr));
+	rd_write(buf, sz);
+}
+
+static void record_bo(struct fd_device *dev, struct fd_bo *bo)
+{
+	uint32_t i;
+
+	if (bo->serial == dev->serial)
+		return;
+	bo->serial = dev->serial;
+
+	rd_write_section(RD_GPUADDR, (uint32_t[2]){
+		bo->gpuaddr, bo->size,
+	}, 8);
+	rd_write_section(RD_BUFFER_CONTENTS, bo->map, bo->size);
+
+	/* and everything referenced by cmds in the bo, incl. IB targets: */
+	if (bo->ring)
+		for (i = 0; i < bo->ring->nr_bos; i++)
+			record_bo(dev, bo->ring->bos[i]);
+}
+
+/*
+ * device/pipe:
+ */
+
+struct fd_device * fd_device_new(int fd)
+{
+	struct fd_device *dev = calloc(1, sizeof(*dev));
+
+	if (!dev)
+		return NULL;
+
+	/* there is no real device, so nothing to do with fd */
+	dev->refcnt = 1;
+	dev->gpu_id = null_gpu_id();
+	dev->next_gpuaddr = GPUADDR_BASE;
+
+	return dev;
+}
+
+struct fd_device * fd_device_ref(struct fd_device *dev)
+{
+	dev->refcnt++;
+	return dev;
+}
+
+void fd_device_del(struct fd_device *dev)
+{
+	if (--dev->refcnt == 0)
+		free(dev);
+}
+
+struct fd_pipe * fd_pipe_new(struct fd_device *dev, enum fd_pipe_id id)
+{
+	struct fd_pipe *pipe = calloc(1, sizeof(*pipe));
+
+	if (!pipe)
+		return NULL;
+
+	pipe->dev = fd_device_ref(dev);
+	pipe->id = id;
+
+	return pipe;
+}
+
+void fd_pipe_del(struct fd_pipe *pipe)
+{
+	fd_device_del(pipe->dev);
+	free(pipe);
+}
+
+int fd_pipe_get_param(struct fd_pipe *pipe, enum fd_param_id param,
+		uint64_t *value)
+{
+	uint32_t gpu_id = pipe->dev->gpu_id;
+
+	switch (param) {
+	case FD_DEVICE_ID:
+		*value = gpu_id;
+		return 0;
+	case FD_GMEM_SIZE:
+		if (gpu_id >= 330)
+			*value = 0x100000;
+		else if (gpu_id >= 300)
+			*value = 0x80000;
+		else
+			*value = 0x40000;
+		return 0;
+	default:
+		ERROR_MSG("invalid param id: %d", param);
+		return -1;
+	}
+}
+
+int fd_pipe_wait(struct fd_pipe *pipe, uint32_t timestamp)
+{
+	/* nothing is ever actually executed, so always idle */
+	return 0;
+}
+
+/*
+ * bo:
+ */
+
+struct fd_bo * fd_bo_new(struct fd_device *dev, uint32_t size, uint32_t flags)
+{
+	struct fd_bo *bo;
+
+	/* gpu addresses are never reused, so once the fake address space
+	 * is used up, fail rather than hand out addresses which alias
+	 * live bo's.  (The remaining space is page aligned, so if size
+	 * fits then so does the aligned size.)
+	 */
+	if (size > (GPUADDR_END - dev->next_gpuaddr)) {
+		ERROR_MSG("out of gpu address space for %u byte bo", size);
+		return NULL;
+	}
+
+	bo = calloc(1, sizeof(*bo));
+	if (!bo)
+		return NULL;
+
+	size = ALIGN(size, 0x1000);
+
+	/* anonymous mapping, so large buffers don't cost anything until
+	 * they are touched, and start out zero'd like a real bo:
+	 */
+	bo->map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bo->map == MAP_FAILED) {
+		ERROR_MSG("could not allocate %u bytes", size);
+		free(bo);
+		return NULL;
+	}
+
+	bo->dev = fd_device_ref(dev);
+	bo->refcnt = 1;
+	bo->size = size;
+	bo->handle = ++dev->next_handle;
+	bo->gpuaddr = dev->next_gpuaddr;
+
+	dev->next_gpuaddr += size;
+
+	return bo;
+}
+
+struct fd_bo * fd_bo_from_fbdev(struct fd_pipe *pipe, int fbfd, uint32_t size)
+{
+	return fd_bo_new(pipe->dev, size, 0);
+}
+
+struct fd_bo * fd_bo_from_name(struct fd_device *dev, uint32_t name)
+{
+	ERROR_MSG("flink names are not supported");
+	return NULL;
+}
+
+struct fd_bo * fd_bo_ref(struct fd_bo *bo)
+{
+	bo->refcnt++;
+	return bo;
+}
+
+void fd_bo_del(struct fd_bo *bo)
+{
+	if (--bo->refcnt > 0)
+		return;
+
+	munmap(bo->map, bo->size);
+	fd_device_del(bo->dev);
+	free(bo);
+}
+
+uint32_t fd_bo_handle(struct fd_bo *bo)
+{
+	return bo->handle;
+}
+
+uint32_t fd_bo_size(struct fd_bo *bo)
+{
+	return bo->size;
+}
+
+void * fd_bo_map(struct fd_bo *bo)
+{
+	return bo->map;
+}
+
+int fd_bo_cpu_prep(struct fd_bo *bo, struct fd_pipe *pipe, uint32_t op)
+{
+	return 0;
+}
+
+void fd_bo_cpu_fini(struct fd_bo *bo)
+{
+}
+
+/*
+ * ringbuffer:
+ */
+
+struct fd_ringbuffer * fd_ringbuffer_new(struct fd_pipe *pipe, uint32_t size)
+{
+	struct null_ringbuffer *ring = calloc(1, sizeof(*ring));
+
+	if (!ring)
+		return NULL;
+
+	ring->bo = fd_bo_new(pipe->dev, size, 0);
+	if (!ring->bo) {
+		free(ring);
+		return NULL;
+	}
+
+	ring->bo->ring = ring;
+	ring->gen = ++pipe->dev->gen;
+
+	ring->base.size = size;
+	ring->base.pipe = pipe;
+	ring->base.start = ring->bo->map;
+	ring->base.end = &(ring->base.start[size/4]);
+	ring->base.cur = ring->base.last_start = ring->base.start;
+
+	return &ring->base;
+}
+
+static void drop_bos(struct null_ringbuffer *ring)
+{
+	uint32_t i;
+
+	for (i = 0; i < ring->nr_bos; i++)
+		fd_bo_del(ring->bos[i]);
+	ring->nr_bos = 0;
+	ring->gen = ++ring->base.pipe->dev->gen;
+}
+
+void fd_ringbuffer_del(struct fd_ringbuffer *ring)
+{
+	struct null_ringbuffer *null_ring = to_null_ringbuffer(ring);
+
+	drop_bos(null_ring);
+	null_ring->bo->ring = NULL;
+	fd_bo_del(null_ring->bo);
+	free(null_ring->bos);
+	free(null_ring);
+}
+
+void fd_ringbuffer_reset(struct fd_ringbuffer *ring)
+{
+	drop_bos(to_null_ringbuffer(ring));
+	ring->cur = ring->last_start = ring->start;
+}
+
+/* submit the cmds between start and ring->cur: */
+static int flush(struct fd_ringbuffer *ring, uint32_t *start)
+{
+	struct null_ringbuffer *null_ring = to_null_ringbuffer(ring);
+	struct fd_device *dev = ring->pipe->dev;
+	uint32_t sizedwords = ring->cur - start;
+
+	if ((rd_fd >= 0) && sizedwords) {
+		dev->serial++;
+		record_bo(dev, null_ring->bo);
+		rd_write_section(RD_CMDSTREAM_ADDR, (uint32_t[2]){
+			null_ring->bo->gpuaddr + (start - ring->start) * 4,
+			sizedwords,
+		}, 8);
+	}
+
+	ring->last_start = ring->cur;
+	ring->last_timestamp = ++ring->pipe->timestamp;
+
+	return 0;
+}
+
+int fd_ringbuffer_flush(struct fd_ringbuffer *ring)
+{
+	return flush(ring, ring->last_start);
+}
+
+uint32_t fd_ringbuffer_timestamp(struct fd_ringbuffer *ring)
+{
+	return ring->last_timestamp;
+}
+
+static void add_bo(struct null_ringbuffer *ring, struct fd_bo *bo)
+{
+	if ((bo->last_ring == ring) && (bo->last_gen == ring->gen))
+		return;
+
+	if (ring->nr_bos == ring->max_bos) {
+		ring->max_bos = max(2 * ring->max_bos, 64);
+		ring->bos = realloc(ring->bos, ring->max_bos * sizeof(ring->bos[0]));
+		assert(ring->bos);
+	}
+
+	ring->bos[ring->nr_bos++] = fd_bo_ref(bo);
+	bo->last_ring = ring;
+	bo->last_gen = ring->gen;
+}
+
+static void emit_reloc(struct fd_ringbuffer *ring, struct fd_bo *bo,
+		uint32_t offset, uint32_t or, int32_t shift)
+{
+	uint32_t addr = bo->gpuaddr + offset;
+
+	if (shift < 0)
+		addr >>= -shift;
+	else
+		addr <<= shift;
+
+	add_bo(to_null_ringbuffer(ring), bo);
+	(*ring->cur++) = addr | or;
+}
+
+static void emit_reloc_ring(struct fd_ringbuffer *ring,
+		struct fd_ringmarker *target)
+{
+	struct null_ringbuffer *target_ring = to_null_ringbuffer(target->ring);
+
+	emit_reloc(ring, target_ring->bo,
+			(target->cur - target->ring->start) * 4, 0, 0);
+}
+
+/* fdre-a2xx is still built against an older libdrm, before struct
+ * fd_reloc was added and fd_ringbuffer_emit_reloc_ring() grew the
+ * end marker, so implement whichever version of the API we got:
+ */
+#ifdef FD_RELOC_READ
+void fd_ringbuffer_reloc(struct fd_ringbuffer *ring,
+		const struct fd_reloc *reloc)
+{
+	emit_reloc(ring, reloc->bo, reloc->offset, reloc->or, reloc->shift);
+}
+
+void fd_ringbuffer_emit_reloc_ring(struct fd_ringbuffer *ring,
+		struct fd_ringmarker *target, struct fd_ringmarker *end)
+{
+	emit_reloc_ring(ring, target);
+}
+#else
+void fd_ringbuffer_emit_reloc(struct fd_ringbuffer *ring,
+		struct fd_bo *bo, uint32_t offset, uint32_t or)
+{
+	emit_reloc(ring, bo, offset, or, 0);
+}
+
+void fd_ringbuffer_emit_reloc_ring(struct fd_ringbuffer *ring,
+		struct fd_ringmarker *target)
+{
+	emit_reloc_ring(ring, target);
+}
+#endif
+
+/*
+ * ringmarker:
+ */
+
+struct fd_ringmarker * fd_ringmarker_new(struct fd_ringbuffer *ring)
+{
+	struct fd_ringmarker *marker = calloc(1, sizeof(*marker));
+
+	if (!marker)
+		return NULL;
+
+	marker->ring = ring;
+	marker->cur = ring->cur;
+
+	return marker;
+}
+
+void fd_ringmarker_del(struct fd_ringmarker *marker)
+{
+	free(marker);
+}
+
+void fd_ringmarker_mark(struct fd_ringmarker *marker)
+{
+	marker->cur = marker->ring->cur;
+}
+
+uint32_t fd_ringmarker_dwords(struct fd_ringmarker *start,
+		struct fd_ringmarker *end)
+{
+	return end->cur - start->cur;
+}
+
+int fd_ringmarker_flush(struct fd_ringmarker *marker)
+{
+	return flush(marker->ring, marker->cur);
+}
@@ -45,13 +45,30 @@ static uint32_t reg_fetch_dst_swiz(struct ir_register *reg);
 static uint32_t reg_alu_dst_swiz(struct ir_register *reg);
 static uint32_t reg_alu_src_swiz(struct ir_register *reg);
 
-/* simple allocator to carve allocations out of an up-front allocated heap,
- * so that we can free everything easily in one shot.
+/* simple allocator to carve allocations out of a list of heap chunks,
+ * so that we can free everything easily in one shot.  Chunks are
+ * allocated on demand, so small shaders don't pay for the large ones.
  */
 static void * ir_alloc(struct ir_shader *shader, int sz)
 {
-	void *ptr = &shader->heap[shader->heap_idx];
-	shader->heap_idx += ALIGN(sz, 4);
+	void *ptr;
+
+	sz = ALIGN(sz, sizeof(uint64_t));
+
+	if ((shader->heap_end - shader->heap_ptr) < sz) {
+		int chunk_sz = max(sz, HEAP_CHUNK_SIZE);
+		struct ir_heap_chunk *chunk =
+				calloc(1, sizeof(*chunk) + chunk_sz);
+		assert(chunk);
+		chunk->next = shader->chunks;
+		shader->chunks = chunk;
+		shader->heap_ptr = (char *)chunk->heap;
+		shader->heap_end = shader->heap_ptr + chunk_sz;
+	}
+
+	ptr = shader->heap_ptr;
+	shader->heap_ptr += sz;
+
 	return ptr;
 }
 
@@ -76,6 +93,11 @@ struct ir_shader * ir_shader_create(void)
 void ir_shader_destroy(struct ir_shader *shader)
 {
 	DEBUG_MSG("");
+	while (shader->chunks) {
+		struct ir_heap_chunk *chunk = shader->chunks;
+		shader->chunks = chunk->next;
+		free(chunk);
+	}
 	free(shader);
 }
 
@@ -132,11 +132,21 @@ struct ir_varying {
 	int num;            /* number of registers */
 };
 
+/* the heap is a list of chunks, allocated as needed, from which all
+ * the objects belonging to the shader are carved out:
+ */
+#define HEAP_CHUNK_SIZE (16 * 1024)
+
+struct ir_heap_chunk {
+	struct ir_heap_chunk *next;
+	uint64_t heap[];
+};
+
 struct ir_shader {
 	unsigned cfs_count;
 	struct ir_cf *cfs[64];
-	uint32_t heap[100 * 4096];
-	unsigned heap_idx;
+	struct ir_heap_chunk *chunks;
+	char *heap_ptr, *heap_end;
 
 	/* @ headers: */
 	uint32_t attributes_count;
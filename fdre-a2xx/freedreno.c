@@ -129,6 +129,11 @@ struct fd_state {
 		 */
 		uint16_t bin_h, nbins_y;
 		uint16_t bin_w, nbins_x;
+		/* buffers (GL_x_BUFFER_BIT) cleared or drawn to since the
+		 * last flush, and not invalidated since.  Only these need
+		 * to be resolved back to memory:
+		 */
+		GLbitfield resolve;
 	} render_target;
 
 	struct {
@@ -336,6 +341,9 @@ struct fd_state * fd_init(void)
 	state = calloc(1, sizeof(*state));
 	assert(state);
 
+#ifdef HAVE_NULL_DRM
+	state->ws = fd_winsys_null_open();
+#else
 #ifdef HAVE_X11
 	state->ws = fd_winsys_dri2_open();
 	if (!state->ws)
@@ -343,6 +351,7 @@ struct fd_state * fd_init(void)
 #endif
 	if (!state->ws)
 		state->ws = fd_winsys_fbdev_open();
+#endif
 
 	fd_pipe_get_param(state->ws->pipe, FD_GMEM_SIZE, &val);
 	state->gmemsize_bytes = val;
@@ -665,6 +674,7 @@ int fd_clear(struct fd_state *state, GLbitfield mask)
 	uint32_t reg;
 
 	state->dirty = true;
+	state->render_target.resolve |= mask;
 
 	emit_shader_const(ring, 0x9c, (struct fd_shader_const[]) {
 			{ .format = COLORX_8, .bo = state->solid_const, .sz = 48 },
@@ -739,10 +749,14 @@ int fd_clear(struct fd_state *state, GLbitfield mask)
 
 	OUT_PKT3(ring, CP_SET_CONSTANT, 2);
 	OUT_RING(ring, CP_REG(REG_A2XX_RB_COLOR_MASK));
-	OUT_RING(ring, A2XX_RB_COLOR_MASK_WRITE_RED |
-			A2XX_RB_COLOR_MASK_WRITE_GREEN |
-			A2XX_RB_COLOR_MASK_WRITE_BLUE |
-			A2XX_RB_COLOR_MASK_WRITE_ALPHA);
+	reg = 0;
+	if (mask & GL_COLOR_BUFFER_BIT) {
+		reg |= A2XX_RB_COLOR_MASK_WRITE_RED |
+				A2XX_RB_COLOR_MASK_WRITE_GREEN |
+				A2XX_RB_COLOR_MASK_WRITE_BLUE |
+				A2XX_RB_COLOR_MASK_WRITE_ALPHA;
+	}
+	OUT_RING(ring, reg);
 
 	OUT_PKT3(ring, CP_SET_CONSTANT, 2);
 	OUT_RING(ring, CP_REG(REG_A2XX_PA_SU_SC_MODE_CNTL));
@@ -803,6 +817,16 @@ int fd_clear(struct fd_state *state, GLbitfield mask)
 	OUT_RING(ring, CP_REG(REG_A2XX_RB_COPY_CONTROL));
 	OUT_RING(ring, 0x00000000);
 
+	if (!(mask & GL_COLOR_BUFFER_BIT)) {
+		/* draws don't set the color mask, so restore it: */
+		OUT_PKT3(ring, CP_SET_CONSTANT, 2);
+		OUT_RING(ring, CP_REG(REG_A2XX_RB_COLOR_MASK));
+		OUT_RING(ring, A2XX_RB_COLOR_MASK_WRITE_RED |
+				A2XX_RB_COLOR_MASK_WRITE_GREEN |
+				A2XX_RB_COLOR_MASK_WRITE_BLUE |
+				A2XX_RB_COLOR_MASK_WRITE_ALPHA);
+	}
+
 	OUT_PKT3(ring, CP_SET_CONSTANT, 2);
 	OUT_RING(ring, CP_REG(REG_A2XX_RB_DEPTHCONTROL));
 	OUT_RING(ring, state->rb_depthcontrol);
@@ -835,6 +859,16 @@ int fd_clear(struct fd_state *state, GLbitfield mask)
 	return 0;
 }
 
+/* the current contents of the buffers in mask are no longer needed, so
+ * they don't have to be resolved back to memory (unless they are
+ * cleared or drawn to again before the flush):
+ */
+int fd_invalidate(struct fd_state *state, GLbitfield mask)
+{
+	state->render_target.resolve &= ~mask;
+	return 0;
+}
+
 int fd_cull(struct fd_state *state, GLenum mode)
 {
 	state->cull_mode = mode;
@@ -1369,6 +1403,25 @@ static void emit_cacheflush(struct fd_state *state)
 	}
 }
 
+/* the buffers that a draw with the current state writes: */
+static GLbitfield draw_buffers(struct fd_state *state)
+{
+	GLbitfield buffers = GL_COLOR_BUFFER_BIT;
+
+	/* note: nothing checks the depth/stencil bits yet, fd_flush()
+	 * only ever resolves the color buffer:
+	 */
+	if ((state->rb_depthcontrol & A2XX_RB_DEPTHCONTROL_Z_ENABLE) &&
+			(state->rb_depthcontrol & A2XX_RB_DEPTHCONTROL_Z_WRITE_ENABLE))
+		buffers |= GL_DEPTH_BUFFER_BIT;
+
+	if ((state->rb_depthcontrol & A2XX_RB_DEPTHCONTROL_STENCIL_ENABLE) &&
+			(state->rb_stencilrefmask & A2XX_RB_STENCILREFMASK_STENCILWRITEMASK__MASK))
+		buffers |= GL_STENCIL_BUFFER_BIT;
+
+	return buffers;
+}
+
 static int draw_impl(struct fd_state *state, GLenum mode,
 		GLint first, GLsizei count, GLenum type, const GLvoid *indices)
 {
@@ -1410,6 +1463,7 @@ static int draw_impl(struct fd_state *state, GLenum mode,
 	 */
 
 	state->dirty = true;
+	state->render_target.resolve |= draw_buffers(state);
 
 	OUT_PKT3(ring, CP_SET_CONSTANT, 2);
 	OUT_RING(ring, CP_REG(REG_A2XX_PA_SC_AA_MASK));
@@ -1552,17 +1606,24 @@ int fd_flush(struct fd_state *state)
 {
 	struct fd_surface *surface = state->render_target.surface;
 	struct fd_ringbuffer *ring;
+	bool resolve;
 
 	if (!state->dirty)
 		return 0;
 
 	fd_ringmarker_mark(state->draw_end);
 
+	/* the depth/stencil buffers only ever live in GMEM, so only the
+	 * color buffer can need to be transferred back to system memory:
+	 */
+	resolve = !!(state->render_target.resolve & GL_COLOR_BUFFER_BIT);
+
 	if ((state->render_target.nbins_x == 1) &&
 			(state->render_target.nbins_y == 1)) {
 		/* no binning needed, just emit the primary ringbuffer: */
 		ring = state->ring;
-		emit_gmem2mem(state, ring, surface, 0, 0);
+		if (resolve)
+			emit_gmem2mem(state, ring, surface, 0, 0);
 	} else {
 		/* binning required, build cmds to setup for each tile in
 		 * the tile ringbuffer, w/ IB's to the primary ringbuffer:
@@ -1604,7 +1665,8 @@ int fd_flush(struct fd_state *state)
 				OUT_IB  (ring, state->draw_start, state->draw_end);
 
 				/* emit gmem2mem to transfer tile back to system memory: */
-				emit_gmem2mem(state, ring, surface, xoff, yoff);
+				if (resolve)
+					emit_gmem2mem(state, ring, surface, xoff, yoff);
 
 				xoff += bin_w;
 			}
@@ -1621,6 +1683,7 @@ int fd_flush(struct fd_state *state)
 	fd_ringmarker_mark(state->draw_start);
 
 	state->dirty = false;
+	state->render_target.resolve = 0;
 
 	return 0;
 }
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir-a3xx.h"
+
+/*
+ * Basic blocks, and register liveness (at component granularity), for
+ * the passes which need to know what is live where.
+ */
+
+static void set_comps(uint64_t *set, const int *comps, unsigned n)
+{
+	unsigned i;
+	for (i = 0; i < n; i++)
+		set[comps[i] / 64] |= 1ULL << (comps[i] % 64);
+}
+
+static void set_range(uint64_t *set, struct ir3_register *rstart, int num)
+{
+	int i, c = rstart->num + ((rstart->flags & IR3_REG_HALF) ? IR3_NUM_REGS : 0);
+	for (i = 0; (i < num) && ((c + i) < (2 * IR3_NUM_REGS)); i++)
+		set[(c + i) / 64] |= 1ULL << ((c + i) % 64);
+}
+
+static int find_blocks(struct ir3_shader *shader, struct ir3_liveness *live)
+{
+	struct ir3_instruction **instrs = shader->instrs;
+	unsigned i, ninstrs = live->ninstrs;
+	bool *leader = calloc(ninstrs + 1, sizeof(*leader));
+	int ret = 0;
+
+	leader[0] = leader[ninstrs] = true;
+	for (i = 0; i < ninstrs; i++) {
+		struct ir3_instruction *instr = instrs[i];
+		if (instr->category != 0)
+			continue;
+		if ((instr->opc == OPC_BR) || (instr->opc == OPC_JUMP)) {
+			int t = (int)i + instr->cat0.immed;
+			if ((t < 0) || (t > ninstrs)) {
+				WARN_MSG("branch target out of range at %u", i);
+				ret = -1;
+				break;
+			}
+			leader[t] = true;
+			leader[i + 1] = true;
+		} else if (instr->opc == OPC_END) {
+			leader[i + 1] = true;
+		} else if ((instr->opc == OPC_CALL) || (instr->opc == OPC_RET)) {
+			WARN_MSG("subroutines are not supported");
+			ret = -1;
+			break;
+		}
+	}
+
+	live->blocks = calloc(ninstrs, sizeof(live->blocks[0]));
+	live->block_of = calloc(ninstrs + 1, sizeof(live->block_of[0]));
+
+	for (i = 0; (ret == 0) && (i < ninstrs); i++) {
+		struct ir3_block *block;
+		struct ir3_instruction *last;
+
+		if (!leader[i])
+			continue;
+
+		block = &live->blocks[live->nblocks];
+		block->start = i;
+		for (block->end = i + 1; !leader[block->end]; block->end++)
+			;
+		live->block_of[i] = live->nblocks++;
+
+		last = instrs[block->end - 1];
+		if ((last->category == 0) && (last->opc == OPC_END)) {
+			block->succs[block->nsuccs++] = ninstrs;
+		} else if ((last->category == 0) && ((last->opc == OPC_BR) ||
+				(last->opc == OPC_JUMP))) {
+			block->succs[block->nsuccs++] = block->end - 1 +
+					last->cat0.immed;
+			if (last->opc == OPC_BR)
+				block->succs[block->nsuccs++] = block->end;
+		} else {
+			block->succs[block->nsuccs++] = block->end;
+		}
+	}
+
+	free(leader);
+
+	return ret;
+}
+
+static void compute_liveness(struct ir3_shader *shader,
+		struct ir3_liveness *live)
+{
+	uint64_t *exit = live->live_in[live->ninstrs];
+	int comps[IR3_MAX_ACCESS];
+	unsigned i, j, n;
+	bool progress;
+
+	/* the outputs (and varyings, which are outputs of the vertex
+	 * shader) are live at the end, as are the default output regs:
+	 */
+	for (i = 0; i < shader->outs_count; i++)
+		set_range(exit, shader->outs[i]->rstart, shader->outs[i]->num);
+	for (i = 0; i < shader->varyings_count; i++)
+		set_range(exit, shader->varyings[i]->rstart,
+				shader->varyings[i]->num);
+	exit[0] |= 0xf;                            /* r0 */
+	exit[(63 * 4) / 64] |= 0xfULL << ((63 * 4) % 64);  /* r63 */
+
+	for (i = 0; i < live->ninstrs; i++) {
+		struct ir3_instruction *instr = shader->instrs[i];
+		n = ir3_instr_dsts(instr, comps);
+		set_comps(live->defs[i], comps, n);
+		n = ir3_instr_srcs(instr, comps, NULL);
+		set_comps(live->uses[i], comps, n);
+
+		/* a relative register read could read any full register: */
+		for (j = 1; j < instr->regs_count; j++) {
+			unsigned flags = instr->regs[j]->flags;
+			if ((flags & IR3_REG_RELATIV) && !(flags & IR3_REG_CONST))
+				memset(live->uses[i], 0xff, IR3_NUM_REGS / 8);
+		}
+	}
+
+	do {
+		progress = false;
+		for (i = live->nblocks; i-- > 0; ) {
+			struct ir3_block *block = &live->blocks[i];
+			uint64_t set[IR3_LIVE_WORDS] = {0};
+
+			for (j = 0; j < block->nsuccs; j++)
+				for (n = 0; n < IR3_LIVE_WORDS; n++)
+					set[n] |= live->live_in[block->succs[j]][n];
+
+			for (j = block->end; j-- > block->start; ) {
+				memcpy(live->live_out[j], set, sizeof(set));
+				for (n = 0; n < IR3_LIVE_WORDS; n++) {
+					set[n] = (set[n] & ~live->defs[j][n]) | live->uses[j][n];
+					progress |= (set[n] != live->live_in[j][n]);
+				}
+				memcpy(live->live_in[j], set, sizeof(set));
+			}
+		}
+	} while (progress);
+}
+
+struct ir3_liveness * ir3_liveness_create(struct ir3_shader *shader)
+{
+	struct ir3_liveness *live = calloc(1, sizeof(*live));
+
+	live->ninstrs = shader->instrs_count;
+
+	if (find_blocks(shader, live)) {
+		ir3_liveness_destroy(live);
+		return NULL;
+	}
+
+	live->defs = calloc(live->ninstrs, sizeof(live->defs[0]));
+	live->uses = calloc(live->ninstrs, sizeof(live->uses[0]));
+	live->live_in = calloc(live->ninstrs + 1, sizeof(live->live_in[0]));
+	live->live_out = calloc(live->ninstrs, sizeof(live->live_out[0]));
+
+	compute_liveness(shader, live);
+
+	return live;
+}
+
+void ir3_liveness_destroy(struct ir3_liveness *live)
+{
+	free(live->live_out);
+	free(live->live_in);
+	free(live->uses);
+	free(live->defs);
+	free(live->block_of);
+	free(live->blocks);
+	free(live);
+}
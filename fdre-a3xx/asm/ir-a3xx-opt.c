@@ -0,0 +1,603 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir-a3xx.h"
+
+/*
+ * Peephole passes.  These work on the shader as written, and keep the
+ * existing nop's (other than padding where a removed instruction was
+ * covering some ALU latency) and (sy)/(ss) flags, other than the sync
+ * pass which recomputes the latter.
+ */
+
+static bool is_dst(struct ir3_instruction *instr, unsigned n)
+{
+	int comps[IR3_MAX_ACCESS];
+	return (n == 0) && (ir3_instr_dsts(instr, comps) > 0);
+}
+
+static bool has_relativ(struct ir3_instruction *instr)
+{
+	unsigned n;
+	for (n = 0; n < instr->regs_count; n++)
+		if (instr->regs[n]->flags & IR3_REG_RELATIV)
+			return true;
+	return false;
+}
+
+static bool is_flow(struct ir3_instruction *instr)
+{
+	return (instr->category == 0) && (instr->opc != OPC_NOP);
+}
+
+/* branch targets, and (jp) flags: */
+static bool * find_targets(struct ir3_shader *shader)
+{
+	bool *target = calloc(shader->instrs_count + 1, sizeof(*target));
+	unsigned i;
+
+	for (i = 0; i < shader->instrs_count; i++) {
+		struct ir3_instruction *instr = shader->instrs[i];
+		if ((instr->category == 0) && ((instr->opc == OPC_BR) ||
+				(instr->opc == OPC_JUMP) || (instr->opc == OPC_CALL))) {
+			int t = (int)i + instr->cat0.immed;
+			if ((t >= 0) && (t <= shader->instrs_count))
+				target[t] = true;
+		}
+		if (instr->flags & IR3_INSTR_JP)
+			target[i] = true;
+	}
+
+	return target;
+}
+
+/* the passes which depend on liveness can't know which registers a
+ * relative register access touches, and without any outputs nothing
+ * would be live at the end, so leave those shaders alone:
+ */
+static bool liveness_usable(struct ir3_shader *shader, const char *pass)
+{
+	unsigned i, n;
+
+	if (!shader->outs_count && !shader->varyings_count) {
+		WARN_MSG("%s: skipped, shader has no outputs", pass);
+		return false;
+	}
+
+	for (i = 0; i < shader->instrs_count; i++) {
+		struct ir3_instruction *instr = shader->instrs[i];
+		for (n = 0; n < instr->regs_count; n++) {
+			unsigned flags = instr->regs[n]->flags;
+			if ((flags & IR3_REG_RELATIV) && !(flags & IR3_REG_CONST)) {
+				WARN_MSG("%s: skipped, relative register access at %u",
+						pass, i);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Dead write elimination: remove instructions which only write values
+ * that are never read.
+ */
+
+static bool can_remove(struct ir3_instruction *instr)
+{
+	int comps[IR3_MAX_ACCESS];
+
+	if (ir3_instr_is_barrier(instr) || has_relativ(instr))
+		return false;
+
+	switch (instr->category) {
+	case 0:
+		return false;
+	case 2:
+		/* (ei) on bary.f also marks the end of the inputs: */
+		if (instr->regs[0]->flags & IR3_REG_EI)
+			return false;
+		break;
+	}
+
+	/* (stores have no dst, so they stay too) */
+	return ir3_instr_dsts(instr, comps) > 0;
+}
+
+int ir3_shader_dce(struct ir3_shader *shader)
+{
+	int comps[IR3_MAX_ACCESS];
+	bool progress = true;
+	unsigned i, j, n;
+
+	if (!liveness_usable(shader, "dce"))
+		return 0;
+
+	/* removing one instruction may make the ones feeding it dead: */
+	while (progress) {
+		struct ir3_liveness *live = ir3_liveness_create(shader);
+		bool *remove;
+
+		if (!live)
+			return 0;
+
+		progress = false;
+		remove = calloc(shader->instrs_count, sizeof(*remove));
+
+		for (i = 0; i < shader->instrs_count; i++) {
+			struct ir3_instruction *instr = shader->instrs[i];
+
+			if (!can_remove(instr))
+				continue;
+
+			remove[i] = true;
+			n = ir3_instr_dsts(instr, comps);
+			for (j = 0; j < n; j++)
+				if (ir3_comp_in(live->live_out[i], comps[j]))
+					remove[i] = false;
+
+			progress |= remove[i];
+		}
+
+		if (progress)
+			ir3_shader_compact(shader, remove);
+
+		free(remove);
+		ir3_liveness_destroy(live);
+	}
+
+	return 0;
+}
+
+/*
+ * Mov coalescing: for a plain 'mov rX, rY', read rY directly in the
+ * instructions which follow (within the block) instead of rX, and
+ * drop the mov.
+ */
+
+static bool is_plain_mov(struct ir3_instruction *instr)
+{
+	struct ir3_register *dst, *src;
+
+	if ((instr->category != 1) || (instr->repeat) || (instr->regs_count != 2))
+		return false;
+	if (instr->cat1.src_type != instr->cat1.dst_type)
+		return false;
+	if (instr->flags & IR3_INSTR_UL)
+		return false;
+
+	dst = instr->regs[0];
+	src = instr->regs[1];
+
+	if (dst->flags & ~(IR3_REG_R | IR3_REG_HALF))
+		return false;
+	if (src->flags & ~(IR3_REG_R | IR3_REG_HALF))
+		return false;
+	if ((dst->flags ^ src->flags) & IR3_REG_HALF)
+		return false;
+
+	/* leave a0/p0 alone: */
+	if (((dst->num >> 2) == REG_A0) || ((dst->num >> 2) == REG_P0) ||
+			((src->num >> 2) == REG_A0) || ((src->num >> 2) == REG_P0))
+		return false;
+
+	return true;
+}
+
+/* try to coalesce the mov at instrs[i], within [i, end): */
+static bool coalesce(struct ir3_shader *shader, struct ir3_liveness *live,
+		unsigned i, unsigned end)
+{
+	struct ir3_instruction *mov = shader->instrs[i];
+	struct ir3_register *uses[64];
+	int comps[IR3_MAX_ACCESS], x, y;
+	unsigned j, k, n, m, nuses = 0;
+	bool done = false;
+
+	ir3_instr_dsts(mov, comps);
+	x = comps[0];
+	ir3_instr_srcs(mov, comps, NULL);
+	y = comps[0];
+
+	for (j = i + 1; (j < end) && !done; j++) {
+		struct ir3_instruction *instr = shader->instrs[j];
+
+		/* the flow control which ends the block may read it: */
+		if (is_flow(instr) || ir3_instr_is_barrier(instr)) {
+			if (ir3_comp_in(live->live_in[j], x))
+				return false;
+			done = true;
+			break;
+		}
+
+		for (n = 0; n < instr->regs_count; n++) {
+			if (is_dst(instr, n))
+				continue;
+			m = ir3_instr_reg_comps(instr, n, comps);
+			for (k = 0; k < m; k++) {
+				if (comps[k] != x)
+					continue;
+				/* only plain ALU srcs, which read at issue: */
+				if ((m != 1) || (instr->category < 1) ||
+						(instr->category > 3) ||
+						(instr->regs[n]->flags & IR3_REG_R) ||
+						(nuses == ARRAY_SIZE(uses)))
+					return false;
+				uses[nuses++] = instr->regs[n];
+			}
+		}
+
+		m = ir3_instr_dsts(instr, comps);
+		for (k = 0; k < m; k++) {
+			/* rX is overwritten, so no further uses: */
+			if (comps[k] == x)
+				done = true;
+			/* rY is overwritten, so rX had better be dead: */
+			if ((comps[k] == y) && ir3_comp_in(live->live_out[j], x) &&
+					!done)
+				return false;
+			if (comps[k] == y)
+				done = true;
+		}
+	}
+
+	if (!done && ir3_comp_in(live->live_out[end - 1], x))
+		return false;
+
+	for (k = 0; k < nuses; k++)
+		uses[k]->num = mov->regs[1]->num;
+
+	return true;
+}
+
+int ir3_shader_movc(struct ir3_shader *shader)
+{
+	bool progress = true;
+	unsigned b, i;
+
+	if (!liveness_usable(shader, "movc"))
+		return 0;
+
+	while (progress) {
+		struct ir3_liveness *live = ir3_liveness_create(shader);
+		bool *remove;
+
+		if (!live)
+			return 0;
+
+		progress = false;
+		remove = calloc(shader->instrs_count, sizeof(*remove));
+
+		for (b = 0; b < live->nblocks; b++) {
+			struct ir3_block *block = &live->blocks[b];
+			for (i = block->start; i < block->end; i++) {
+				if (!is_plain_mov(shader->instrs[i]))
+					continue;
+				/* one at a time, since the liveness is now stale: */
+				if (coalesce(shader, live, i, block->end)) {
+					remove[i] = progress = true;
+					break;
+				}
+			}
+		}
+
+		if (progress)
+			ir3_shader_compact(shader, remove);
+
+		free(remove);
+		ir3_liveness_destroy(live);
+	}
+
+	return 0;
+}
+
+/*
+ * Fold sequences of the same ALU instruction on consecutive components
+ * into a single (rptN) instruction, using (r) for the srcs which also
+ * increment.
+ */
+
+#define MAX_RPT 3
+
+/* can 'b' be iteration 'k' of a repeat of 'a'? 'inc' says which of a's
+ * srcs increment, which is decided by the first one:
+ */
+static bool can_fold(struct ir3_instruction *a, struct ir3_instruction *b,
+		unsigned k, bool *inc)
+{
+	unsigned n;
+
+	if ((a->category != b->category) || (a->opc != b->opc) ||
+			(a->regs_count != b->regs_count) || b->repeat)
+		return false;
+	if ((a->category < 1) || (a->category > 3))
+		return false;
+	if (b->flags)
+		return false;
+	if (has_relativ(b))
+		return false;
+
+	switch (a->category) {
+	case 1:
+		if ((a->cat1.src_type != b->cat1.src_type) ||
+				(a->cat1.dst_type != b->cat1.dst_type))
+			return false;
+		break;
+	case 2:
+		if (a->cat2.condition != b->cat2.condition)
+			return false;
+		break;
+	}
+
+	for (n = 0; n < a->regs_count; n++) {
+		struct ir3_register *ra = a->regs[n], *rb = b->regs[n];
+		bool same;
+
+		if (ra->flags != rb->flags)
+			return false;
+
+		if (n == 0) {
+			if ((ra->flags & IR3_REG_EI) || (rb->num != ra->num + k))
+				return false;
+			continue;
+		}
+
+		if (ra->flags & IR3_REG_IMMED) {
+			if (rb->iim_val != ra->iim_val)
+				return false;
+			continue;
+		}
+
+		same = (rb->num == ra->num);
+		if (!same && (rb->num != ra->num + k))
+			return false;
+
+		if (k == 1)
+			inc[n] = !same;
+		else if (inc[n] == same)
+			return false;
+
+		/* reading what an earlier iteration wrote: */
+		if (!(rb->flags & IR3_REG_CONST) &&
+				(rb->num >= a->regs[0]->num) && (rb->num < a->regs[0]->num + k))
+			return false;
+	}
+
+	return true;
+}
+
+int ir3_shader_rpt(struct ir3_shader *shader)
+{
+	bool *target = find_targets(shader);
+	bool *remove = calloc(shader->instrs_count, sizeof(*remove));
+	bool inc[ARRAY_SIZE(shader->instrs[0]->regs)], progress = false;
+	unsigned i, k, n;
+
+	for (i = 0; i < shader->instrs_count; i = i + k) {
+		struct ir3_instruction *a = shader->instrs[i];
+
+		k = 1;
+
+		if (a->repeat || has_relativ(a) || (a->flags & IR3_INSTR_UL))
+			continue;
+
+		for (; (k <= MAX_RPT) && ((i + k) < shader->instrs_count); k++) {
+			if (target[i + k] ||
+					!can_fold(a, shader->instrs[i + k], k, inc))
+				break;
+		}
+
+		if (k == 1)
+			continue;
+
+		a->repeat = k - 1;
+		for (n = 1; n < a->regs_count; n++) {
+			if (inc[n])
+				a->regs[n]->flags |= IR3_REG_R;
+			else
+				a->regs[n]->flags &= ~IR3_REG_R;
+		}
+		for (n = 1; n < k; n++)
+			remove[i + n] = true;
+		progress = true;
+	}
+
+	if (progress)
+		ir3_shader_compact(shader, remove);
+
+	free(remove);
+	free(target);
+
+	return 0;
+}
+
+/*
+ * Redundant (sy)/(ss) removal: recompute the flags, so that we only
+ * wait on a tex/mem or SFU result right before it is needed.
+ */
+
+struct sync_state {
+	uint64_t sy[IR3_LIVE_WORDS], ss[IR3_LIVE_WORDS], ss_war[IR3_LIVE_WORDS];
+	bool any_sy, any_ss;
+};
+
+static void set_comp(uint64_t *set, int comp)
+{
+	set[comp / 64] |= 1ULL << (comp % 64);
+}
+
+static void sync_instr(struct sync_state *state,
+		struct ir3_instruction *instr, bool update)
+{
+	int comps[IR3_MAX_ACCESS];
+	unsigned i, n;
+	bool sy = false, ss = false;
+
+	n = ir3_instr_srcs(instr, comps, NULL);
+	for (i = 0; i < n; i++) {
+		sy |= ir3_comp_in(state->sy, comps[i]);
+		ss |= ir3_comp_in(state->ss, comps[i]);
+	}
+
+	n = ir3_instr_dsts(instr, comps);
+	for (i = 0; i < n; i++) {
+		sy |= ir3_comp_in(state->sy, comps[i]);
+		ss |= ir3_comp_in(state->ss, comps[i]) ||
+				ir3_comp_in(state->ss_war, comps[i]);
+	}
+
+	if (ir3_instr_is_barrier(instr)) {
+		sy |= state->any_sy;
+		ss |= state->any_ss;
+	}
+
+	if (update) {
+		instr->flags &= ~(IR3_INSTR_SY | IR3_INSTR_SS);
+		if (sy)
+			instr->flags |= IR3_INSTR_SY;
+		if (ss)
+			instr->flags |= IR3_INSTR_SS;
+	}
+
+	if (sy) {
+		memset(state->sy, 0, sizeof(state->sy));
+		state->any_sy = false;
+	}
+
+	if (ss) {
+		memset(state->ss, 0, sizeof(state->ss));
+		memset(state->ss_war, 0, sizeof(state->ss_war));
+		state->any_ss = false;
+	}
+
+	/* SFU instructions may read their srcs late: */
+	if (instr->category == 4) {
+		n = ir3_instr_srcs(instr, comps, NULL);
+		for (i = 0; i < n; i++)
+			set_comp(state->ss_war, comps[i]);
+		state->any_ss = true;
+	}
+
+	n = ir3_instr_dsts(instr, comps);
+	for (i = 0; i < n; i++) {
+		if (instr->category == 4) {
+			set_comp(state->ss, comps[i]);
+		} else if ((instr->category == 5) || (instr->category == 6)) {
+			set_comp(state->sy, comps[i]);
+			state->any_sy = true;
+		}
+	}
+
+	/* stores have no dst, but still need to be waited on: */
+	if (instr->category == 6)
+		state->any_sy = true;
+}
+
+/* merge 'src' into 'dst', returns true if that changed anything: */
+static bool merge_state(struct sync_state *dst, const struct sync_state *src)
+{
+	bool progress = false;
+	unsigned i;
+
+	for (i = 0; i < IR3_LIVE_WORDS; i++) {
+		progress |= !!(src->sy[i] & ~dst->sy[i]);
+		progress |= !!(src->ss[i] & ~dst->ss[i]);
+		progress |= !!(src->ss_war[i] & ~dst->ss_war[i]);
+		dst->sy[i] |= src->sy[i];
+		dst->ss[i] |= src->ss[i];
+		dst->ss_war[i] |= src->ss_war[i];
+	}
+
+	progress |= (src->any_sy && !dst->any_sy) || (src->any_ss && !dst->any_ss);
+	dst->any_sy |= src->any_sy;
+	dst->any_ss |= src->any_ss;
+
+	return progress;
+}
+
+int ir3_shader_sync(struct ir3_shader *shader)
+{
+	struct ir3_liveness *live = ir3_liveness_create(shader);
+	struct sync_state *in, state;
+	unsigned b, i;
+	bool progress = true;
+
+	if (!live)
+		return 0;
+
+	/* what may be in flight at the start of each block: */
+	in = calloc(live->nblocks, sizeof(*in));
+
+	while (progress) {
+		progress = false;
+		for (b = 0; b < live->nblocks; b++) {
+			struct ir3_block *block = &live->blocks[b];
+
+			state = in[b];
+			for (i = block->start; i < block->end; i++)
+				sync_instr(&state, shader->instrs[i], false);
+
+			for (i = 0; i < block->nsuccs; i++) {
+				unsigned s = block->succs[i];
+				if (s < live->ninstrs)
+					progress |= merge_state(&in[live->block_of[s]], &state);
+			}
+		}
+	}
+
+	for (b = 0; b < live->nblocks; b++) {
+		struct ir3_block *block = &live->blocks[b];
+		state = in[b];
+		for (i = block->start; i < block->end; i++)
+			sync_instr(&state, shader->instrs[i], true);
+	}
+
+	free(in);
+	ir3_liveness_destroy(live);
+
+	return 0;
+}
+
+/*
+ * The pass table:
+ */
+
+const struct ir3_pass ir3_passes[] = {
+	{ "movc",  ir3_shader_movc,  "coalesce plain movs into their uses" },
+	{ "dce",   ir3_shader_dce,   "remove instructions whose results are unused" },
+	{ "rpt",   ir3_shader_rpt,   "fold sequences of instructions into (rptN)" },
+	{ "sync",  ir3_shader_sync,  "remove redundant (sy)/(ss) flags" },
+	{ "sched", ir3_shader_sched, "schedule instructions to hide latency" },
+	{ "ra",    ir3_shader_ra,    "rename registers to compact the footprint" },
+	{ NULL },
+};
+
+const struct ir3_pass * ir3_pass_find(const char *name)
+{
+	const struct ir3_pass *pass;
+	for (pass = ir3_passes; pass->name; pass++)
+		if (!strcmp(pass->name, name))
+			return pass;
+	return NULL;
+}
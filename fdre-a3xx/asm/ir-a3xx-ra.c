@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir-a3xx.h"
+
+/*
+ * Register renaming:
+ *
+ * The registers are split up into webs (a def, the uses it reaches,
+ * and any other defs reaching the same uses), and each web is then
+ * assigned the lowest register which doesn't conflict with the webs
+ * that are live at the same time, to compact the register footprint.
+ * This works on whole vec4 registers, so components don't move.
+ *
+ * Registers which something outside of the shader program cares about
+ * are left alone: anything live at the start of the shader (inputs),
+ * the outputs and varyings (and r0/r63, which are the default position
+ * of gl_Position/gl_FragColor and gl_PointSize), a0/p0, and registers
+ * accessed as a range which spans more than one vec4.
+ */
+
+/* vec4 registers, half registers after the full ones: */
+#define FILE_REGS (IR3_NUM_REGS / 4)
+#define NREGS     (2 * FILE_REGS)
+
+/* is any component of register 'r' in the set? */
+static bool reg_in(const uint64_t *set, int r)
+{
+	return (set[(r * 4) / 64] >> ((r * 4) % 64)) & 0xf;
+}
+
+static bool is_special(int r)
+{
+	r %= FILE_REGS;
+	return (r == REG_A0) || (r == REG_P0);
+}
+
+struct ra_web {
+	int parent;
+	int reg;               /* original register */
+	int color;             /* assigned register, or -1 */
+	bool pinned, used;
+	int *adj;              /* interfering webs */
+	unsigned nadj, adj_sz;
+};
+
+struct ra_ctx {
+	struct ir3_shader *shader;
+	struct ir3_liveness *live;
+	unsigned ninstrs;
+
+	struct ra_web *webs;
+	unsigned nwebs, webs_sz, next;
+	bool final;
+
+	/* current web of each register, while walking a block: */
+	int cur[NREGS];
+	/* per component, webs with an async write or (SFU) read still in
+	 * flight:
+	 */
+	int pend_sy[NREGS * 4], pend_ss_dst[NREGS * 4], pend_ss_src[NREGS * 4];
+
+	/* web of each instrs[i]->regs[n], or -1 to leave it alone: */
+	int *opweb;
+};
+
+static int find(struct ra_ctx *ctx, int w)
+{
+	while (ctx->webs[w].parent != w)
+		w = ctx->webs[w].parent = ctx->webs[ctx->webs[w].parent].parent;
+	return w;
+}
+
+static void join(struct ra_ctx *ctx, int a, int b)
+{
+	a = find(ctx, a);
+	b = find(ctx, b);
+	/* the lower # is the root, so block entries stay roots: */
+	if (a < b)
+		ctx->webs[b].parent = a;
+	else if (b < a)
+		ctx->webs[a].parent = b;
+}
+
+static int new_web(struct ra_ctx *ctx, int reg)
+{
+	struct ra_web *web;
+
+	/* the second walk re-creates the same webs, in the same order: */
+	if (ctx->final)
+		return ctx->next++;
+
+	if (ctx->nwebs == ctx->webs_sz) {
+		ctx->webs_sz = max(2 * ctx->webs_sz, 64);
+		ctx->webs = realloc(ctx->webs, ctx->webs_sz * sizeof(ctx->webs[0]));
+	}
+
+	web = &ctx->webs[ctx->nwebs];
+	memset(web, 0, sizeof(*web));
+	web->parent = ctx->nwebs;
+	web->reg = reg;
+	web->color = -1;
+
+	ctx->next = ++ctx->nwebs;
+
+	return web->parent;
+}
+
+static void add_adj(struct ra_web *web, int w)
+{
+	if (web->nadj == web->adj_sz) {
+		web->adj_sz = max(2 * web->adj_sz, 8);
+		web->adj = realloc(web->adj, web->adj_sz * sizeof(web->adj[0]));
+	}
+	web->adj[web->nadj++] = w;
+}
+
+static void interfere(struct ra_ctx *ctx, int a, int b)
+{
+	if ((a < 0) || (b < 0))
+		return;
+
+	a = find(ctx, a);
+	b = find(ctx, b);
+
+	/* only webs in the same register file compete: */
+	if ((a == b) || ((ctx->webs[a].reg < FILE_REGS) !=
+			(ctx->webs[b].reg < FILE_REGS)))
+		return;
+
+	add_adj(&ctx->webs[a], b);
+	add_adj(&ctx->webs[b], a);
+}
+
+static void pin(struct ra_ctx *ctx, int w)
+{
+	ctx->webs[find(ctx, w)].pinned = true;
+}
+
+static bool is_async(struct ir3_instruction *instr)
+{
+	return (instr->category == 5) || (instr->category == 6);
+}
+
+/* the registers touched by instrs[i]->regs[n], returns the count: */
+static unsigned op_regs(struct ir3_instruction *instr, unsigned n,
+		int *regs)
+{
+	int comps[IR3_MAX_ACCESS];
+	unsigned i, j, m, cnt = 0;
+
+	m = ir3_instr_reg_comps(instr, n, comps);
+	for (i = 0; i < m; i++) {
+		int r = comps[i] / 4;
+		for (j = 0; j < cnt; j++)
+			if (regs[j] == r)
+				break;
+		if (j == cnt)
+			regs[cnt++] = r;
+	}
+
+	return cnt;
+}
+
+static bool is_dst(struct ir3_instruction *instr, unsigned n)
+{
+	int comps[IR3_MAX_ACCESS];
+	return (n == 0) && (ir3_instr_dsts(instr, comps) > 0);
+}
+
+/* walk the shader, tracking the current web of each register.  The
+ * first walk builds the webs, and the second (final) walk, once the
+ * webs are complete, records the interference and the web of each
+ * operand:
+ */
+static void walk(struct ra_ctx *ctx)
+{
+	struct ir3_instruction **instrs = ctx->shader->instrs;
+	int regs[IR3_MAX_ACCESS], comps[IR3_MAX_ACCESS];
+	unsigned b, c, i, j, k, n, m, r;
+
+	ctx->next = ctx->live->nblocks * NREGS;
+
+	for (c = 0; c < NREGS * 4; c++)
+		ctx->pend_sy[c] = ctx->pend_ss_dst[c] = ctx->pend_ss_src[c] = -1;
+
+	for (b = 0; b < ctx->live->nblocks; b++) {
+		struct ir3_block *block = &ctx->live->blocks[b];
+
+		for (r = 0; r < NREGS; r++)
+			ctx->cur[r] = (b * NREGS) + r;
+
+		for (i = block->start; i < block->end; i++) {
+			struct ir3_instruction *instr = instrs[i];
+			int *opweb = &ctx->opweb[i * 4];
+
+			if (ctx->final && (instr->flags & IR3_INSTR_SY))
+				for (c = 0; c < NREGS * 4; c++)
+					ctx->pend_sy[c] = -1;
+			if (ctx->final && (instr->flags & IR3_INSTR_SS))
+				for (c = 0; c < NREGS * 4; c++)
+					ctx->pend_ss_dst[c] = ctx->pend_ss_src[c] = -1;
+
+			/* srcs: */
+			for (n = 0; n < instr->regs_count; n++) {
+				if (is_dst(instr, n))
+					continue;
+				m = op_regs(instr, n, regs);
+				opweb[n] = (m == 1) ? ctx->cur[regs[0]] : -1;
+				for (k = 0; ctx->final && (k < m); k++) {
+					int w = ctx->cur[regs[k]];
+					ctx->webs[find(ctx, w)].used = true;
+					if ((m > 1) || is_special(regs[k]))
+						pin(ctx, w);
+				}
+				if (ctx->final && (instr->category == 4)) {
+					m = ir3_instr_reg_comps(instr, n, comps);
+					for (k = 0; k < m; k++)
+						ctx->pend_ss_src[comps[k]] = ctx->cur[comps[k] / 4];
+				}
+			}
+
+			if (!is_dst(instr, 0))
+				continue;
+
+			/* dst, which starts a new web unless other components of
+			 * the register are live through the instruction:
+			 */
+			m = op_regs(instr, 0, regs);
+			for (k = 0; k < m; k++) {
+				bool through = false;
+				r = regs[k];
+				for (j = 0; j < 4; j++) {
+					unsigned c = (r * 4) + j;
+					uint64_t bit = 1ULL << (c % 64);
+					if ((ctx->live->live_out[i][c / 64] & bit) &&
+							!(ctx->live->defs[i][c / 64] & bit))
+						through = true;
+				}
+				if (!through)
+					ctx->cur[r] = new_web(ctx, r);
+			}
+			opweb[0] = (m == 1) ? ctx->cur[regs[0]] : -1;
+
+			if (!ctx->final)
+				continue;
+
+			for (k = 0; k < m; k++) {
+				int d = ctx->cur[regs[k]];
+
+				ctx->webs[find(ctx, d)].used = true;
+				if ((m > 1) || is_special(regs[k]))
+					pin(ctx, d);
+
+				/* everything live after the def: */
+				for (r = 0; r < NREGS; r++)
+					if ((r != regs[k]) && reg_in(ctx->live->live_out[i], r))
+						interfere(ctx, d, ctx->cur[r]);
+
+				/* a late write or read must not see our value: */
+				for (c = 0; c < NREGS * 4; c++) {
+					interfere(ctx, d, ctx->pend_sy[c]);
+					interfere(ctx, d, ctx->pend_ss_dst[c]);
+					interfere(ctx, d, ctx->pend_ss_src[c]);
+				}
+
+				/* with (rpt), or tex/mem, the srcs may be read after
+				 * the dst is (partially) written:
+				 */
+				if (instr->repeat || is_async(instr))
+					for (n = 1; n < instr->regs_count; n++)
+						interfere(ctx, d, opweb[n]);
+			}
+
+			m = ir3_instr_reg_comps(instr, 0, comps);
+			for (k = 0; k < m; k++) {
+				if (is_async(instr))
+					ctx->pend_sy[comps[k]] = ctx->cur[comps[k] / 4];
+				else if (instr->category == 4)
+					ctx->pend_ss_dst[comps[k]] = ctx->cur[comps[k] / 4];
+			}
+		}
+
+		/* connect the webs live across the edges out of the block: */
+		for (j = 0; j < block->nsuccs; j++) {
+			unsigned s = block->succs[j];
+			for (r = 0; r < NREGS; r++) {
+				if (!reg_in(ctx->live->live_in[s], r))
+					continue;
+				if (s == ctx->ninstrs) {
+					if (ctx->final)
+						pin(ctx, ctx->cur[r]);
+				} else {
+					join(ctx, ctx->cur[r],
+							(ctx->live->block_of[s] * NREGS) + r);
+				}
+			}
+		}
+	}
+}
+
+static int color(struct ra_ctx *ctx, int w)
+{
+	struct ra_web *web = &ctx->webs[w];
+	uint64_t used = (1ULL << REG_A0) | (1ULL << REG_P0);
+	unsigned i;
+	int c;
+
+	if (web->color >= 0)
+		return 0;
+
+	for (i = 0; i < web->nadj; i++) {
+		c = ctx->webs[web->adj[i]].color;
+		if (c >= 0)
+			used |= 1ULL << c;
+	}
+
+	for (c = 0; c < FILE_REGS; c++)
+		if (!(used & (1ULL << c)))
+			break;
+
+	if (c == FILE_REGS)
+		return -1;
+
+	web->color = c;
+
+	return 0;
+}
+
+int ir3_shader_ra(struct ir3_shader *shader)
+{
+	struct ir3_instruction **instrs = shader->instrs;
+	struct ra_ctx *ctx;
+	int full, half, new_full = 0, new_half = 0;
+	unsigned i, n;
+	int ret = 0;
+
+	for (i = 0; i < shader->instrs_count; i++) {
+		for (n = 0; n < instrs[i]->regs_count; n++) {
+			struct ir3_register *reg = instrs[i]->regs[n];
+			if ((reg->flags & IR3_REG_RELATIV) &&
+					!(reg->flags & IR3_REG_CONST)) {
+				WARN_MSG("not renaming, relative register access at %u", i);
+				return 0;
+			}
+		}
+	}
+
+	ctx = calloc(1, sizeof(*ctx));
+	ctx->shader = shader;
+	ctx->ninstrs = shader->instrs_count;
+
+	if (!ctx->ninstrs)
+		goto out;
+
+	ctx->live = ir3_liveness_create(shader);
+	if (!ctx->live) {
+		WARN_MSG("not renaming registers");
+		goto out;
+	}
+	ctx->opweb = malloc(ctx->ninstrs * 4 * sizeof(ctx->opweb[0]));
+
+	/* a web for each register at the start of each block, then the
+	 * webs started by defs:
+	 */
+	for (i = 0; i < ctx->live->nblocks * NREGS; i++)
+		new_web(ctx, i % NREGS);
+
+	walk(ctx);
+	ctx->final = true;
+	walk(ctx);
+
+	/* the inputs keep their registers: */
+	for (i = 0; i < NREGS; i++)
+		if (reg_in(ctx->live->live_in[0], i))
+			pin(ctx, i);
+
+	for (i = 0; i < ctx->nwebs; i++) {
+		struct ra_web *web = &ctx->webs[i];
+		if ((find(ctx, i) == i) && web->pinned)
+			web->color = web->reg % FILE_REGS;
+	}
+
+	/* then the rest, in program order: */
+	for (i = 0; (ret == 0) && (i < ctx->ninstrs); i++) {
+		for (n = 0; n < instrs[i]->regs_count; n++) {
+			int w = ctx->opweb[(i * 4) + n];
+			if ((w >= 0) && color(ctx, find(ctx, w))) {
+				WARN_MSG("out of registers, not renaming");
+				ret = -1;
+				break;
+			}
+		}
+	}
+
+	if (ret) {
+		ret = 0;
+		goto out;
+	}
+
+	/* only keep the result if it is actually an improvement: */
+	ir3_shader_regs(shader, &full, &half);
+
+	for (i = 0; i < ctx->ninstrs; i++) {
+		for (n = 0; n < instrs[i]->regs_count; n++) {
+			int w = ctx->opweb[(i * 4) + n];
+			struct ra_web *web;
+			if (w < 0)
+				continue;
+			web = &ctx->webs[find(ctx, w)];
+			if (is_special(web->reg))
+				continue;
+			if (web->reg < FILE_REGS)
+				new_full = max(new_full, web->color + 1);
+			else
+				new_half = max(new_half, web->color + 1);
+		}
+	}
+
+	if ((new_full > full) || (new_half > half))
+		goto out;
+
+	for (i = 0; i < ctx->ninstrs; i++) {
+		for (n = 0; n < instrs[i]->regs_count; n++) {
+			struct ir3_register *reg = instrs[i]->regs[n];
+			int w = ctx->opweb[(i * 4) + n];
+			if (w < 0)
+				continue;
+			reg->num = (ctx->webs[find(ctx, w)].color << 2) |
+					(reg->num & 0x3);
+		}
+	}
+
+out:
+	for (i = 0; i < ctx->nwebs; i++)
+		free(ctx->webs[i].adj);
+	free(ctx->webs);
+	free(ctx->opweb);
+	if (ctx->live)
+		ir3_liveness_destroy(ctx->live);
+	free(ctx);
+
+	return ret;
+}
+
+/*
+ * Register footprint, and occupancy estimate:
+ */
+
+void ir3_shader_regs(struct ir3_shader *shader, int *full, int *half)
+{
+	int comps[IR3_MAX_ACCESS];
+	unsigned i, j, n;
+
+	*full = *half = 0;
+
+	/* the attributes are fetched into registers outside of the shader
+	 * program, so they count too:
+	 */
+	for (i = 0; i < shader->attributes_count; i++) {
+		struct ir3_attribute *a = shader->attributes[i];
+		*full = max(*full, ((a->rstart->num + a->num - 1) >> 2) + 1);
+	}
+
+	for (i = 0; i < shader->instrs_count; i++) {
+		struct ir3_instruction *instr = shader->instrs[i];
+		for (n = 0; n < instr->regs_count; n++) {
+			unsigned m = ir3_instr_reg_comps(instr, n, comps);
+			for (j = 0; j < m; j++) {
+				int r = comps[j] / 4;
+				if (is_special(r))
+					continue;
+				if (r < FILE_REGS)
+					*full = max(*full, r + 1);
+				else
+					*half = max(*half, r - FILE_REGS + 1);
+			}
+		}
+	}
+}
+
+/* Guessed: the register file has room for 96 vec4 registers per thread
+ * in a pair of waves, and two half registers take the space of one full
+ * one.  With up to 16 waves per SP:
+ */
+#define REG_FILE_VEC4 96
+#define MAX_WAVES     16
+
+unsigned ir3_shader_waves(int full, int half)
+{
+	int regs = max(max(full, (half + 1) / 2), 1);
+	return min(MAX_WAVES, 2 * (REG_FILE_VEC4 / regs));
+}
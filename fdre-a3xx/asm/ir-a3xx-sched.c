@@ -0,0 +1,660 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir-a3xx.h"
+#include "instr-latency.h"
+
+/*
+ * Instruction scheduling:
+ *
+ * Instructions are scheduled within basic blocks, using a dependency
+ * DAG and a simple list scheduler, which prefers the instruction with
+ * the longest (latency weighted) path to the end of the block.  This
+ * lets independent ALU instructions fill in the latency of texture
+ * fetches and SFU instructions.
+ *
+ * Any nop's and (sy)/(ss) in the source are discarded, and afterwards
+ * the shader is legalized: the minimum (sy)/(ss) flags are set, and
+ * nop's are inserted where there is nothing to cover ALU latency.
+ */
+
+/* all the register components, full and half: */
+#define NCOMPS (2 * IR3_NUM_REGS)
+
+static bool is_alu(struct ir3_instruction *instr)
+{
+	return (1 <= instr->category) && (instr->category <= 3);
+}
+
+static bool is_nop(struct ir3_instruction *instr)
+{
+	return (instr->category == 0) && (instr->opc == OPC_NOP);
+}
+
+static bool is_branch(struct ir3_instruction *instr)
+{
+	return (instr->category == 0) && ((instr->opc == OPC_BR) ||
+			(instr->opc == OPC_JUMP) || (instr->opc == OPC_CALL));
+}
+
+static bool is_mad(struct ir3_instruction *instr)
+{
+	if (instr->category != 3)
+		return false;
+
+	switch (instr->opc) {
+	case OPC_MAD_U16:
+	case OPC_MADSH_U16:
+	case OPC_MAD_S16:
+	case OPC_MADSH_M16:
+	case OPC_MAD_U24:
+	case OPC_MAD_S24:
+	case OPC_MAD_F16:
+	case OPC_MAD_F32:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* # of delay slots required between an ALU instruction writing 'comp'
+ * and 'consumer' reading it as src 'n'.  The results of SFU, tex, and
+ * mem instructions are instead handled with (ss)/(sy).
+ */
+static unsigned delay_slots(int comp, struct ir3_instruction *consumer,
+		int n)
+{
+	if (comp == IR3_A0_COMP)
+		return 6;
+	if (!is_alu(consumer))
+		return 6;
+	/* 3rd src to mad is not needed on the first cycle: */
+	if (is_mad(consumer) && (n == 3))
+		return 1;
+	return 3;
+}
+
+/* result latency of 'instr', as seen by the scheduler: */
+static unsigned latency(struct ir3_instruction *instr, int comp,
+		struct ir3_instruction *consumer, int n)
+{
+	switch (instr->category) {
+	case 4:
+		return SFU_LATENCY;
+	case 5:
+	case 6:
+		return TEX_LATENCY;
+	default:
+		return delay_slots(comp, consumer, n);
+	}
+}
+
+/*
+ * Cycle estimate:
+ */
+
+unsigned ir3_shader_cycles(struct ir3_shader *shader)
+{
+	unsigned i, cycle = 0, tex_ready = 0, sfu_ready = 0;
+
+	for (i = 0; i < shader->instrs_count; i++) {
+		struct ir3_instruction *instr = shader->instrs[i];
+		unsigned cnt = 1 + instr->repeat;
+
+		if (instr->flags & IR3_INSTR_SY)
+			stall(&cycle, &tex_ready);
+		if (instr->flags & IR3_INSTR_SS)
+			stall(&cycle, &sfu_ready);
+
+		if (instr->category == 4)
+			sfu_ready = cycle + cnt + SFU_LATENCY;
+		else if ((instr->category == 5) || (instr->category == 6))
+			tex_ready = cycle + cnt + TEX_LATENCY;
+
+		cycle += cnt;
+	}
+
+	return cycle;
+}
+
+/*
+ * Dependency DAG:
+ */
+
+struct sched_edge {
+	unsigned to;
+	unsigned delay;
+};
+
+struct sched_node {
+	struct ir3_instruction *instr;
+	unsigned idx;          /* original index in the shader */
+	bool scheduled;
+	struct sched_edge *succs;
+	unsigned nsuccs, succs_sz;
+	unsigned npreds;       /* # of not yet scheduled predecessors */
+	unsigned earliest;     /* earliest cycle to schedule w/out stalling */
+	unsigned depth;        /* critical path to the end of the block */
+};
+
+struct sched_ctx {
+	struct sched_node *nodes;
+	unsigned nnodes;
+
+	/* the scheduled order, indices into nodes[]: */
+	unsigned *order;
+
+	/* per register component, the last writer and the readers since: */
+	int writer[NCOMPS];
+	unsigned *readers[NCOMPS];
+	unsigned nreaders[NCOMPS], readers_sz[NCOMPS];
+
+	int last_barrier, last_mem;
+};
+
+static void add_edge(struct sched_ctx *ctx, int from, unsigned to,
+		unsigned delay)
+{
+	struct sched_node *node;
+	unsigned i;
+
+	if ((from < 0) || (from == to))
+		return;
+
+	node = &ctx->nodes[from];
+
+	/* merge with an existing edge: */
+	for (i = 0; i < node->nsuccs; i++) {
+		if (node->succs[i].to == to) {
+			node->succs[i].delay = max(node->succs[i].delay, delay);
+			return;
+		}
+	}
+
+	if (node->nsuccs == node->succs_sz) {
+		node->succs_sz = max(2 * node->succs_sz, 4);
+		node->succs = realloc(node->succs,
+				node->succs_sz * sizeof(node->succs[0]));
+	}
+
+	node->succs[node->nsuccs++] = (struct sched_edge){ to, delay };
+	ctx->nodes[to].npreds++;
+}
+
+static void add_reader(struct sched_ctx *ctx, int comp, unsigned idx)
+{
+	if (ctx->nreaders[comp] == ctx->readers_sz[comp]) {
+		ctx->readers_sz[comp] = max(2 * ctx->readers_sz[comp], 4);
+		ctx->readers[comp] = realloc(ctx->readers[comp],
+				ctx->readers_sz[comp] * sizeof(ctx->readers[comp][0]));
+	}
+	ctx->readers[comp][ctx->nreaders[comp]++] = idx;
+}
+
+static void build_dag(struct sched_ctx *ctx)
+{
+	int comps[IR3_MAX_ACCESS], srcn[IR3_MAX_ACCESS];
+	unsigned i, j, k, n;
+
+	for (i = 0; i < NCOMPS; i++) {
+		ctx->writer[i] = -1;
+		ctx->nreaders[i] = 0;
+	}
+	ctx->last_barrier = ctx->last_mem = -1;
+
+	for (i = 0; i < ctx->nnodes; i++) {
+		struct ir3_instruction *instr = ctx->nodes[i].instr;
+
+		if (ir3_instr_is_barrier(instr)) {
+			/* everything before has to come before: */
+			for (j = max(ctx->last_barrier, 0); j < i; j++)
+				add_edge(ctx, j, i, 0);
+			ctx->last_barrier = i;
+		} else {
+			add_edge(ctx, ctx->last_barrier, i, 0);
+		}
+
+		/* keep memory accesses in order: */
+		if (instr->category == 6) {
+			add_edge(ctx, ctx->last_mem, i, 0);
+			ctx->last_mem = i;
+		}
+
+		/* read after write: */
+		n = ir3_instr_srcs(instr, comps, srcn);
+		for (j = 0; j < n; j++) {
+			int w = ctx->writer[comps[j]];
+			if (w >= 0)
+				add_edge(ctx, w, i, latency(ctx->nodes[w].instr,
+						comps[j], instr, srcn[j]));
+			add_reader(ctx, comps[j], i);
+		}
+
+		/* write after read, and write after write: */
+		n = ir3_instr_dsts(instr, comps);
+		for (j = 0; j < n; j++) {
+			int c = comps[j], w = ctx->writer[c];
+			for (k = 0; k < ctx->nreaders[c]; k++)
+				add_edge(ctx, ctx->readers[c][k], i, 0);
+			/* a late result from an earlier tex/SFU instruction must
+			 * not land on top of ours:
+			 */
+			if ((w >= 0) && !is_alu(ctx->nodes[w].instr))
+				add_edge(ctx, w, i, latency(ctx->nodes[w].instr,
+						c, instr, 0));
+			else
+				add_edge(ctx, w, i, 0);
+			ctx->writer[c] = i;
+			ctx->nreaders[c] = 0;
+		}
+	}
+
+	/* critical path lengths, edges only go forward: */
+	for (i = ctx->nnodes; i-- > 0; ) {
+		struct sched_node *node = &ctx->nodes[i];
+		unsigned cnt = node->instr->repeat + 1;
+
+		node->depth = cnt;
+		for (j = 0; j < node->nsuccs; j++) {
+			struct sched_edge *e = &node->succs[j];
+			node->depth = max(node->depth,
+					cnt + e->delay + ctx->nodes[e->to].depth);
+		}
+	}
+}
+
+/* schedule the block's instructions, ie. fill in order[]: */
+static void sched_block(struct sched_ctx *ctx)
+{
+	unsigned i, j, cycle = 0;
+
+	build_dag(ctx);
+
+	for (i = 0; i < ctx->nnodes; i++) {
+		struct sched_node *best = NULL;
+
+		/* prefer the deepest instruction which can issue without
+		 * stalling, otherwise the one which stalls the least:
+		 */
+		for (j = 0; j < ctx->nnodes; j++) {
+			struct sched_node *node = &ctx->nodes[j];
+			bool ready, best_ready;
+
+			if (node->scheduled || node->npreds)
+				continue;
+
+			if (!best) {
+				best = node;
+				continue;
+			}
+
+			ready = node->earliest <= cycle;
+			best_ready = best->earliest <= cycle;
+
+			if (ready && best_ready) {
+				if (node->depth > best->depth)
+					best = node;
+			} else if (ready || best_ready) {
+				if (ready)
+					best = node;
+			} else if ((node->earliest < best->earliest) ||
+					((node->earliest == best->earliest) &&
+							(node->depth > best->depth))) {
+				best = node;
+			}
+		}
+
+		assert(best);
+
+		cycle = max(cycle, best->earliest) + best->instr->repeat + 1;
+
+		for (j = 0; j < best->nsuccs; j++) {
+			struct sched_node *succ = &ctx->nodes[best->succs[j].to];
+			succ->earliest = max(succ->earliest,
+					cycle + best->succs[j].delay);
+			succ->npreds--;
+		}
+
+		best->scheduled = true;
+		ctx->order[i] = best - ctx->nodes;
+	}
+
+	for (i = 0; i < ctx->nnodes; i++)
+		free(ctx->nodes[i].succs);
+	for (i = 0; i < NCOMPS; i++)
+		free(ctx->readers[i]);
+	memset(ctx->readers, 0, sizeof(ctx->readers));
+	memset(ctx->readers_sz, 0, sizeof(ctx->readers_sz));
+}
+
+/*
+ * Legalize, ie. (sy)/(ss) flags and nop's:
+ */
+
+struct legalize_ctx {
+	/* cycle at which the ALU result in each component was written: */
+	unsigned written[NCOMPS];
+	bool alu_written[NCOMPS];
+	/* async results not yet waited on: */
+	bool needs_sy[NCOMPS], needs_ss[NCOMPS], needs_ss_war[NCOMPS];
+	bool any_sy, any_ss;
+	/* cycle at which the pending async results have all landed: */
+	unsigned tex_ready, sfu_ready;
+	unsigned cycle;
+};
+
+static void insert_nops(struct ir3_shader *shader,
+		struct legalize_ctx *ctx, unsigned ready)
+{
+	while (ctx->cycle < ready) {
+		struct ir3_instruction *nop = ir3_instr_create(shader, 0, OPC_NOP);
+		nop->repeat = min(ready - ctx->cycle, 8) - 1;
+		ctx->cycle += nop->repeat + 1;
+	}
+}
+
+static void legalize_instr(struct ir3_shader *shader,
+		struct legalize_ctx *ctx, struct ir3_instruction *instr)
+{
+	int comps[IR3_MAX_ACCESS], srcn[IR3_MAX_ACCESS];
+	unsigned i, n, ready = 0;
+	bool sy = false, ss = false;
+
+	instr->flags &= ~(IR3_INSTR_SY | IR3_INSTR_SS);
+
+	n = ir3_instr_srcs(instr, comps, srcn);
+	for (i = 0; i < n; i++) {
+		int c = comps[i];
+		sy |= ctx->needs_sy[c];
+		ss |= ctx->needs_ss[c];
+		if (ctx->alu_written[c])
+			ready = max(ready, ctx->written[c] +
+					delay_slots(c, instr, srcn[i]) + 1);
+	}
+
+	n = ir3_instr_dsts(instr, comps);
+	for (i = 0; i < n; i++) {
+		int c = comps[i];
+		sy |= ctx->needs_sy[c];
+		ss |= ctx->needs_ss[c] || ctx->needs_ss_war[c];
+	}
+
+	/* barriers (flow control, etc) wait for everything, except that
+	 * end does not need to wait for ALU results:
+	 */
+	if (ir3_instr_is_barrier(instr)) {
+		sy |= ctx->any_sy;
+		ss |= ctx->any_ss;
+		for (i = 0; i < NCOMPS; i++)
+			if (ctx->alu_written[i] && (instr->opc != OPC_END))
+				ready = max(ready, ctx->written[i] + 6 + 1);
+	}
+
+	/* the (sy)/(ss) stall may already cover the ALU latency: */
+	if (sy) {
+		instr->flags |= IR3_INSTR_SY;
+		memset(ctx->needs_sy, 0, sizeof(ctx->needs_sy));
+		ctx->any_sy = false;
+		stall(&ctx->cycle, &ctx->tex_ready);
+	}
+
+	if (ss) {
+		instr->flags |= IR3_INSTR_SS;
+		memset(ctx->needs_ss, 0, sizeof(ctx->needs_ss));
+		memset(ctx->needs_ss_war, 0, sizeof(ctx->needs_ss_war));
+		ctx->any_ss = false;
+		stall(&ctx->cycle, &ctx->sfu_ready);
+	}
+
+	insert_nops(shader, ctx, ready);
+
+	/* SFU instructions may read their srcs late: */
+	if (instr->category == 4) {
+		n = ir3_instr_srcs(instr, comps, NULL);
+		for (i = 0; i < n; i++)
+			ctx->needs_ss_war[comps[i]] = true;
+		ctx->any_ss = true;
+	}
+
+	n = ir3_instr_dsts(instr, comps);
+	for (i = 0; i < n; i++) {
+		int c = comps[i];
+		ctx->alu_written[c] = is_alu(instr);
+		ctx->written[c] = ctx->cycle + min(i, instr->repeat);
+		if (instr->category == 4) {
+			ctx->needs_ss[c] = true;
+		} else if ((instr->category == 5) || (instr->category == 6)) {
+			ctx->needs_sy[c] = true;
+			ctx->any_sy = true;
+		}
+	}
+
+	/* stores have no dst, but still need to be waited on: */
+	if (instr->category == 6)
+		ctx->any_sy = true;
+
+	ctx->cycle += instr->repeat + 1;
+
+	if (instr->category == 4)
+		ctx->sfu_ready = ctx->cycle + SFU_LATENCY;
+	else if ((instr->category == 5) || (instr->category == 6))
+		ctx->tex_ready = ctx->cycle + TEX_LATENCY;
+
+	ir3_shader_append(shader, instr);
+}
+
+int ir3_shader_sched(struct ir3_shader *shader)
+{
+	struct ir3_instruction **instrs = shader->instrs;
+	unsigned ninstrs = shader->instrs_count;
+	struct sched_ctx *ctx;
+	struct legalize_ctx *lctx;
+	bool *target;
+	int *start, *fixups, nfixups = 0;
+	unsigned i, j, k;
+
+	/* find the branch targets, which start new blocks: */
+	target = calloc(ninstrs + 1, sizeof(*target));
+	for (i = 0; i < ninstrs; i++) {
+		struct ir3_instruction *instr = instrs[i];
+		if (is_branch(instr)) {
+			int t = (int)i + instr->cat0.immed;
+			if ((t < 0) || (t > ninstrs)) {
+				ERROR_MSG("branch target out of range at %u: %d", i, t);
+				free(target);
+				return -1;
+			}
+			target[t] = true;
+		}
+		if (instr->flags & IR3_INSTR_JP)
+			target[i] = true;
+	}
+
+	/* the index of each block in the new instruction list, and the
+	 * (new) index of each branch, to fix up the offsets after:
+	 */
+	start = calloc(ninstrs + 1, sizeof(*start));
+	fixups = calloc(ninstrs, sizeof(*fixups));
+
+	ctx = calloc(1, sizeof(*ctx));
+	ctx->nodes = calloc(ninstrs, sizeof(ctx->nodes[0]));
+	ctx->order = calloc(ninstrs, sizeof(ctx->order[0]));
+	lctx = calloc(1, sizeof(*lctx));
+
+	/* the instructions get re-added to the shader in the new order: */
+	shader->instrs = NULL;
+	shader->instrs_count = shader->instrs_sz = 0;
+
+	for (i = 0; i < ninstrs; i = j) {
+		/* gather a block, dropping nop's: */
+		ctx->nnodes = 0;
+		for (j = i; j < ninstrs; j++) {
+			struct ir3_instruction *instr = instrs[j];
+
+			if ((j > i) && target[j])
+				break;
+
+			/* the (jp) flags get set again below: */
+			instr->flags &= ~IR3_INSTR_JP;
+
+			if (!is_nop(instr)) {
+				struct sched_node *node = &ctx->nodes[ctx->nnodes++];
+				memset(node, 0, sizeof(*node));
+				node->instr = instr;
+				node->idx = j;
+			}
+
+			/* flow control ends the block: */
+			if ((instr->category == 0) && !is_nop(instr)) {
+				j++;
+				break;
+			}
+		}
+
+		sched_block(ctx);
+
+		start[i] = shader->instrs_count;
+
+		for (k = 0; k < ctx->nnodes; k++) {
+			struct sched_node *node = &ctx->nodes[ctx->order[k]];
+
+			legalize_instr(shader, lctx, node->instr);
+
+			if (is_branch(node->instr)) {
+				fixups[nfixups++] = shader->instrs_count - 1;
+				node->instr->cat0.immed += node->idx;  /* absolute, for now */
+			}
+		}
+	}
+
+	start[ninstrs] = shader->instrs_count;
+
+	for (i = 0; i < nfixups; i++) {
+		struct ir3_instruction *instr = shader->instrs[fixups[i]];
+		instr->cat0.immed = start[instr->cat0.immed] - fixups[i];
+	}
+
+	for (i = 0; i < ninstrs; i++)
+		if (target[i] && (start[i] < shader->instrs_count))
+			shader->instrs[start[i]]->flags |= IR3_INSTR_JP;
+
+	free(lctx);
+	free(ctx->order);
+	free(ctx->nodes);
+	free(ctx);
+	free(instrs);
+	free(target);
+	free(start);
+	free(fixups);
+
+	return 0;
+}
+
+/*
+ * Removing instructions, for the other passes:
+ */
+
+void ir3_shader_compact(struct ir3_shader *shader, const bool *remove)
+{
+	struct ir3_instruction **instrs = shader->instrs;
+	unsigned ninstrs = shader->instrs_count;
+	unsigned *old_cycle, *newidx, *pos;
+	unsigned wr_old[NCOMPS], wr_new[NCOMPS];
+	bool alu[NCOMPS] = {0};
+	int comps[IR3_MAX_ACCESS], srcn[IR3_MAX_ACCESS];
+	unsigned i, j, n, flags = 0, cycle = 0;
+
+	old_cycle = calloc(ninstrs, sizeof(*old_cycle));
+	newidx = calloc(ninstrs + 1, sizeof(*newidx));
+	pos = calloc(ninstrs, sizeof(*pos));
+
+	for (i = 0; i < ninstrs; i++) {
+		old_cycle[i] = cycle;
+		cycle += instrs[i]->repeat + 1;
+	}
+
+	shader->instrs = NULL;
+	shader->instrs_count = shader->instrs_sz = 0;
+
+	for (i = 0, cycle = 0; i < ninstrs; i++) {
+		struct ir3_instruction *instr = instrs[i];
+		unsigned ready = 0;
+
+		/* branches to a removed instruction land on the next one: */
+		newidx[i] = shader->instrs_count;
+
+		if (remove[i]) {
+			flags |= instr->flags &
+					(IR3_INSTR_SY | IR3_INSTR_SS | IR3_INSTR_JP);
+			continue;
+		}
+
+		instr->flags |= flags;
+		flags = 0;
+
+		/* an ALU result can't be read any sooner than it needs to be,
+		 * or than it was before:
+		 */
+		n = ir3_instr_srcs(instr, comps, srcn);
+		for (j = 0; j < n; j++) {
+			int c = comps[j];
+			if (alu[c])
+				ready = max(ready, wr_new[c] + min(old_cycle[i] - wr_old[c],
+						delay_slots(c, instr, srcn[j]) + 1));
+		}
+
+		while (cycle < ready) {
+			struct ir3_instruction *nop = ir3_instr_create(shader, 0, OPC_NOP);
+			nop->repeat = min(ready - cycle, 8) - 1;
+			cycle += nop->repeat + 1;
+		}
+
+		pos[i] = shader->instrs_count;
+		ir3_shader_append(shader, instr);
+
+		n = ir3_instr_dsts(instr, comps);
+		for (j = 0; j < n; j++) {
+			int c = comps[j];
+			alu[c] = is_alu(instr);
+			wr_new[c] = cycle + min(j, instr->repeat);
+			wr_old[c] = old_cycle[i] + min(j, instr->repeat);
+		}
+
+		cycle += instr->repeat + 1;
+	}
+
+	newidx[ninstrs] = shader->instrs_count;
+
+	for (i = 0; i < ninstrs; i++) {
+		if (!remove[i] && is_branch(instrs[i])) {
+			int t = (int)i + instrs[i]->cat0.immed;
+			if ((t >= 0) && (t <= ninstrs))
+				instrs[i]->cat0.immed = (int)newidx[t] - (int)pos[i];
+		}
+	}
+
+	free(instrs);
+	free(old_cycle);
+	free(newidx);
+	free(pos);
+}
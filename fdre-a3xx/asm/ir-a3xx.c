@@ -32,13 +32,30 @@
 #include "util.h"
 #include "instr-a3xx.h"
 
-/* simple allocator to carve allocations out of an up-front allocated heap,
- * so that we can free everything easily in one shot.
+/* simple allocator to carve allocations out of a list of heap chunks,
+ * so that we can free everything easily in one shot.  Chunks are
+ * allocated on demand, so small shaders don't pay for the large ones.
  */
 static void * ir3_alloc(struct ir3_shader *shader, int sz)
 {
-	void *ptr = &shader->heap[shader->heap_idx];
-	shader->heap_idx += ALIGN(sz, 4);
+	void *ptr;
+
+	sz = ALIGN(sz, sizeof(uint64_t));
+
+	if ((shader->heap_end - shader->heap_ptr) < sz) {
+		int chunk_sz = max(sz, HEAP_CHUNK_SIZE);
+		struct ir3_heap_chunk *chunk =
+				calloc(1, sizeof(*chunk) + chunk_sz);
+		assert(chunk);
+		chunk->next = shader->chunks;
+		shader->chunks = chunk;
+		shader->heap_ptr = (char *)chunk->heap;
+		shader->heap_end = shader->heap_ptr + chunk_sz;
+	}
+
+	ptr = shader->heap_ptr;
+	shader->heap_ptr += sz;
+
 	return ptr;
 }
 
@@ -63,6 +80,12 @@ struct ir3_shader * ir3_shader_create(void)
 void ir3_shader_destroy(struct ir3_shader *shader)
 {
 	DEBUG_MSG("");
+	while (shader->chunks) {
+		struct ir3_heap_chunk *chunk = shader->chunks;
+		shader->chunks = chunk->next;
+		free(chunk);
+	}
+	free(shader->instrs);
 	free(shader);
 }
 
@@ -684,11 +707,22 @@ struct ir3_instruction * ir3_instr_create(struct ir3_shader *shader,
 	instr->shader = shader;
 	instr->category = category;
 	instr->opc = opc;
-	assert(shader->instrs_count < ARRAY_SIZE(shader->instrs));
-	shader->instrs[shader->instrs_count++] = instr;
+	ir3_shader_append(shader, instr);
 	return instr;
 }
 
+void ir3_shader_append(struct ir3_shader *shader,
+		struct ir3_instruction *instr)
+{
+	if (shader->instrs_count == shader->instrs_sz) {
+		shader->instrs_sz = max(2 * shader->instrs_sz, 64);
+		shader->instrs = realloc(shader->instrs,
+				shader->instrs_sz * sizeof(shader->instrs[0]));
+		assert(shader->instrs);
+	}
+	shader->instrs[shader->instrs_count++] = instr;
+}
+
 struct ir3_register * ir3_reg_create(struct ir3_instruction *instr,
 		int num, int flags)
 {
@@ -697,3 +731,158 @@ struct ir3_register * ir3_reg_create(struct ir3_instruction *instr,
 	instr->regs[instr->regs_count++] = reg;
 	return reg;
 }
+
+static int add_comps(struct ir3_register *reg, unsigned first, unsigned cnt,
+		int *comps, int n)
+{
+	unsigned i;
+
+	if (reg->flags & (IR3_REG_CONST | IR3_REG_IMMED | IR3_REG_RELATIV))
+		return n;
+
+	for (i = first; (i < (first + cnt)) && (n < IR3_MAX_ACCESS); i++) {
+		unsigned num = reg->num + i;
+		if (num >= IR3_NUM_REGS)
+			break;
+		comps[n++] = num + ((reg->flags & IR3_REG_HALF) ? IR3_NUM_REGS : 0);
+	}
+
+	return n;
+}
+
+static bool is_store(struct ir3_instruction *instr)
+{
+	if (instr->category != 6)
+		return false;
+
+	switch (instr->opc) {
+	case OPC_STG:
+	case OPC_STP:
+	case OPC_STL:
+	case OPC_STLW:
+	case OPC_STI:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool is_load(struct ir3_instruction *instr)
+{
+	if (instr->category != 6)
+		return false;
+
+	switch (instr->opc) {
+	case OPC_LDG:
+	case OPC_LDP:
+	case OPC_LDL:
+	case OPC_LDLW:
+	case OPC_LDLV:
+	case OPC_PREFETCH:
+		return true;
+	default:
+		return false;
+	}
+}
+
+int ir3_instr_reg_comps(struct ir3_instruction *instr, unsigned n,
+		int *comps)
+{
+	struct ir3_register *reg = instr->regs[n];
+	unsigned i, cnt = 1, ret = 0;
+
+	if ((n == 0) && (instr->category != 0) && !is_store(instr)) {
+		/* tex instructions write the components in the wrmask: */
+		if (instr->category == 5) {
+			for (i = 0; i < 4; i++)
+				if ((reg->wrmask ? reg->wrmask : 0xf) & (1 << i))
+					ret = add_comps(reg, i, 1, comps, ret);
+			return ret;
+		}
+
+		if (instr->category == 6)
+			return add_comps(reg, 0, max(instr->cat6.iim_val, 1), comps, 0);
+
+		/* destination registers are always incremented in repeat: */
+		return add_comps(reg, 0, instr->repeat + 1, comps, 0);
+	}
+
+	if (reg->flags & IR3_REG_R)
+		cnt = instr->repeat + 1;
+
+	/* value being stored: */
+	if (is_store(instr) && (n == 1))
+		cnt = max(instr->cat6.iim_val, 1);
+
+	/* tex coordinates, and then lod/bias/etc (which we don't decode,
+	 * so assume the rest of the vec4):
+	 */
+	if ((instr->category == 5) && (n == 1))
+		cnt = 2 + !!(instr->flags & IR3_INSTR_3D) +
+				!!(instr->flags & IR3_INSTR_A) +
+				!!(instr->flags & IR3_INSTR_S) +
+				!!(instr->flags & IR3_INSTR_P);
+	if ((instr->category == 5) && (n == 2))
+		cnt = 4 - (reg->num & 0x3);
+
+	return add_comps(reg, 0, cnt, comps, 0);
+}
+
+int ir3_instr_dsts(struct ir3_instruction *instr, int *comps)
+{
+	if ((instr->category == 0) || !instr->regs_count || is_store(instr))
+		return 0;
+
+	return ir3_instr_reg_comps(instr, 0, comps);
+}
+
+int ir3_instr_srcs(struct ir3_instruction *instr, int *comps, int *srcn)
+{
+	int tmp[IR3_MAX_ACCESS];
+	unsigned i, j, m, n = 0;
+
+	for (i = 0; i < instr->regs_count; i++) {
+		struct ir3_register *reg = instr->regs[i];
+		unsigned first = n;
+
+		if ((i == 0) && (instr->category != 0) && !is_store(instr))
+			continue;
+
+		/* relative access reads the address register: */
+		if (reg->flags & IR3_REG_RELATIV) {
+			if (n < IR3_MAX_ACCESS)
+				comps[n++] = IR3_A0_COMP;
+		} else {
+			m = ir3_instr_reg_comps(instr, i, tmp);
+			for (j = 0; (j < m) && (n < IR3_MAX_ACCESS); j++)
+				comps[n++] = tmp[j];
+		}
+
+		if (srcn)
+			for (j = first; j < n; j++)
+				srcn[j] = (instr->category == 0) ? i + 1 : i;
+	}
+
+	return n;
+}
+
+bool ir3_instr_is_barrier(struct ir3_instruction *instr)
+{
+	unsigned i;
+
+	/* flow control (anything other than nop), and (ul), which marks
+	 * the last use of the varyings:
+	 */
+	if ((instr->category == 0) && (instr->opc != OPC_NOP))
+		return true;
+	if (instr->flags & IR3_INSTR_UL)
+		return true;
+	if ((instr->category == 6) && !is_load(instr) && !is_store(instr))
+		return true;
+
+	for (i = 0; i < instr->regs_count; i++)
+		if (instr->regs[i]->flags & IR3_REG_RELATIV)
+			return true;
+
+	return false;
+}
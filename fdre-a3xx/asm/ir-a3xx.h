@@ -124,6 +124,12 @@ struct ir3_instruction {
 	int line;
 };
 
+/* bump whenever a change to the encoder, or to the IR and limits below,
+ * means that shaders assembled by an earlier version can't be reused
+ * (fdre keeps assembled shaders in an on-disk cache):
+ */
+#define IR3_ASM_VERSION 1
+
 /* somewhat arbitrary limits.. */
 #define MAX_ATTRIBUTES 16
 #define MAX_CONSTS     32
@@ -131,7 +137,7 @@ struct ir3_instruction {
 #define MAX_UNIFORMS   32
 #define MAX_VARYINGS   16
 #define MAX_BUFS       16
-#define MAX_OUTS       2
+#define MAX_OUTS       4
 
 struct ir3_attribute {
 	const char *name;
@@ -172,14 +178,21 @@ struct ir3_out {
 	int num;                      /* number of registers */
 };
 
-/* this is just large to cope w/ the large test *.asm: */
-#define MAX_INSTRS 10240
+/* the heap is a list of chunks, allocated as needed, from which all
+ * the objects belonging to the shader are carved out:
+ */
+#define HEAP_CHUNK_SIZE (16 * 1024)
+
+struct ir3_heap_chunk {
+	struct ir3_heap_chunk *next;
+	uint64_t heap[];
+};
 
 struct ir3_shader {
-	unsigned instrs_count;
-	struct ir3_instruction *instrs[MAX_INSTRS];
-	uint32_t heap[128 * MAX_INSTRS];
-	unsigned heap_idx;
+	unsigned instrs_count, instrs_sz;
+	struct ir3_instruction **instrs;
+	struct ir3_heap_chunk *chunks;
+	char *heap_ptr, *heap_end;
 
 	/* @ headers: */
 	uint32_t attributes_count;
@@ -209,6 +222,8 @@ struct ir3_shader {
 
 struct ir3_shader * ir3_shader_create(void);
 void ir3_shader_destroy(struct ir3_shader *shader);
+void ir3_shader_append(struct ir3_shader *shader,
+		struct ir3_instruction *instr);
 int ir3_shader_assemble(struct ir3_shader *shader,
 		uint32_t *dwords, uint32_t sizedwords,
 		struct ir3_shader_info *info);
@@ -233,4 +248,90 @@ struct ir3_instruction * ir3_instr_create(struct ir3_shader *shader, int categor
 struct ir3_register * ir3_reg_create(struct ir3_instruction *instr,
 		int num, int flags);
 
+/* register components read/written by an instruction, for the optional
+ * passes.  Components are numbered (n << 2) | comp, like reg->num, with
+ * half registers offset by IR3_NUM_REGS since they are a separate file.
+ * For the sources, 'srcn' (if not NULL) gets the src # (1..3) of each:
+ */
+#define IR3_NUM_REGS   (64 * 4)
+#define IR3_MAX_ACCESS 32
+
+/* a0.x, which is a half register, read by relative accesses: */
+#define IR3_A0_COMP    ((REG_A0 << 2) + IR3_NUM_REGS)
+
+int ir3_instr_dsts(struct ir3_instruction *instr, int *comps);
+int ir3_instr_srcs(struct ir3_instruction *instr, int *comps, int *srcn);
+/* and the components accessed by a single one of instr->regs[]: */
+int ir3_instr_reg_comps(struct ir3_instruction *instr, unsigned n,
+		int *comps);
+
+/* instructions which the passes shouldn't reorder or remove (flow
+ * control, relative addressing, etc):
+ */
+bool ir3_instr_is_barrier(struct ir3_instruction *instr);
+
+/* basic blocks, and the register components live before/after each
+ * instruction, as bitsets indexed like the components above:
+ */
+#define IR3_LIVE_WORDS (2 * IR3_NUM_REGS / 64)
+
+struct ir3_block {
+	unsigned start, end;       /* instrs [start, end) */
+	/* instruction # of the successors, instrs_count being the exit: */
+	unsigned succs[2];
+	unsigned nsuccs;
+};
+
+struct ir3_liveness {
+	unsigned ninstrs, nblocks;
+	struct ir3_block *blocks;
+	int *block_of;             /* block # of each block's first instr */
+	uint64_t (*defs)[IR3_LIVE_WORDS], (*uses)[IR3_LIVE_WORDS];
+	/* live_in[ninstrs] is what is live at the end of the shader: */
+	uint64_t (*live_in)[IR3_LIVE_WORDS], (*live_out)[IR3_LIVE_WORDS];
+};
+
+static inline bool ir3_comp_in(const uint64_t *set, int comp)
+{
+	return (set[comp / 64] >> (comp % 64)) & 1;
+}
+
+/* returns NULL for shaders with subroutines, or bogus branches: */
+struct ir3_liveness * ir3_liveness_create(struct ir3_shader *shader);
+void ir3_liveness_destroy(struct ir3_liveness *live);
+
+/* optional passes, to run between parsing and ir3_shader_assemble(): */
+int ir3_shader_sched(struct ir3_shader *shader);
+int ir3_shader_ra(struct ir3_shader *shader);
+int ir3_shader_dce(struct ir3_shader *shader);
+int ir3_shader_movc(struct ir3_shader *shader);
+int ir3_shader_rpt(struct ir3_shader *shader);
+int ir3_shader_sync(struct ir3_shader *shader);
+
+struct ir3_pass {
+	const char *name;
+	int (*run)(struct ir3_shader *shader);
+	const char *desc;
+};
+
+/* all the passes, terminated by a NULL name: */
+extern const struct ir3_pass ir3_passes[];
+const struct ir3_pass * ir3_pass_find(const char *name);
+
+/* remove the instructions flagged in 'remove' (one per instruction),
+ * moving their (sy)/(ss)/(jp) flags to the next instruction, fixing up
+ * the branches, and adding nop's where an ALU result would otherwise
+ * now be read too early:
+ */
+void ir3_shader_compact(struct ir3_shader *shader, const bool *remove);
+
+/* estimated # of cycles to run the shader (same model as pgmdump): */
+unsigned ir3_shader_cycles(struct ir3_shader *shader);
+
+/* # of full/half registers used by the shader (including attributes),
+ * and the estimated # of waves in flight which that allows:
+ */
+void ir3_shader_regs(struct ir3_shader *shader, int *full, int *half);
+unsigned ir3_shader_waves(int full, int half);
+
 #endif /* IR3_H_ */
@@ -34,18 +34,119 @@
 #include "ir-a3xx.h"
 #include "util.h"
 
+#define MAX_PASSES 32
+
+/* the passes run by -O, in order: */
+static const char *default_passes[] = { "movc", "dce", "rpt", "sync" };
+
+static void usage(const char *name)
+{
+	const struct ir3_pass *pass;
+
+	ERROR_MSG("usage: %s [-O] [--pass NAME].. [--sched] [--ra] [--cycles] "
+			"[infile] [outfile]", name);
+	for (pass = ir3_passes; pass->name; pass++)
+		printf("  %-6s  %s\n", pass->name, pass->desc);
+}
+
+static void count_sync(struct ir3_shader *shader, unsigned *sy, unsigned *ss)
+{
+	unsigned i;
+
+	*sy = *ss = 0;
+	for (i = 0; i < shader->instrs_count; i++) {
+		if (shader->instrs[i]->flags & IR3_INSTR_SY)
+			(*sy)++;
+		if (shader->instrs[i]->flags & IR3_INSTR_SS)
+			(*ss)++;
+	}
+}
+
+static int run_pass(struct ir3_shader *shader, const struct ir3_pass *pass,
+		bool cycles)
+{
+	unsigned count = shader->instrs_count, c = ir3_shader_cycles(shader);
+	unsigned sy, ss, new_sy, new_ss;
+
+	count_sync(shader, &sy, &ss);
+
+	if (pass->run(shader)) {
+		ERROR_MSG("%s pass failed", pass->name);
+		return -1;
+	}
+
+	count_sync(shader, &new_sy, &new_ss);
+
+	printf("%s: %u -> %u instrs (%+d), (sy) %u -> %u, (ss) %u -> %u",
+			pass->name, count, shader->instrs_count,
+			(int)shader->instrs_count - (int)count, sy, new_sy, ss, new_ss);
+	if (cycles)
+		printf(", cycles %u -> %u", c, ir3_shader_cycles(shader));
+	printf("\n");
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	struct ir3_shader *shader;
 	struct ir3_shader_info info;
 	static char src[256 * 1024];
-	static uint32_t dwords[64 * 1024];
-	static int sizedwords;
-	char *infile, *outfile;
+	uint32_t *dwords;
+	int sizedwords;
+	char *prog = argv[0], *infile, *outfile;
+	const struct ir3_pass *passes[MAX_PASSES];
+	unsigned i, npasses = 0, before = 0;
+	bool ra = false, cycles = false;
+	int full, half, new_full, new_half;
 	int fd, ret;
 
+	/* lame argument parsing: */
+
+	while (1) {
+		const char *name = NULL;
+
+		if ((argc > 2) && !strcmp(argv[1], "--pass")) {
+			name = argv[2];
+			argv++;
+			argc--;
+		} else if ((argc > 1) && !strcmp(argv[1], "--sched")) {
+			name = "sched";
+		} else if ((argc > 1) && !strcmp(argv[1], "--ra")) {
+			name = "ra";
+		} else if ((argc > 1) && !strcmp(argv[1], "-O")) {
+			for (i = 0; i < ARRAY_SIZE(default_passes); i++)
+				if (npasses < MAX_PASSES)
+					passes[npasses++] = ir3_pass_find(default_passes[i]);
+			argv++;
+			argc--;
+			continue;
+		} else if ((argc > 1) && !strcmp(argv[1], "--cycles")) {
+			/* report estimated cycles before/after the passes: */
+			cycles = true;
+			argv++;
+			argc--;
+			continue;
+		} else {
+			break;
+		}
+
+		if (!ir3_pass_find(name)) {
+			ERROR_MSG("unknown pass: %s", name);
+			usage(prog);
+			return -1;
+		}
+
+		if (npasses < MAX_PASSES)
+			passes[npasses++] = ir3_pass_find(name);
+		ra |= !strcmp(name, "ra");
+
+		argv++;
+		argc--;
+	}
+
 	if (argc != 3) {
-		ERROR_MSG("usage: %s [infile] [outfile]", argv[0]);
+		usage(prog);
 		return -1;
 	}
 
@@ -73,25 +174,54 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
-	sizedwords = ir3_shader_assemble(shader, dwords, ARRAY_SIZE(dwords), &info);
+	before = ir3_shader_cycles(shader);
+	ir3_shader_regs(shader, &full, &half);
+
+	for (i = 0; i < npasses; i++)
+		if (run_pass(shader, passes[i], cycles))
+			return -1;
+
+	if (cycles)
+		printf("cycles: %u -> %u\n", before, ir3_shader_cycles(shader));
+
+	if (ra) {
+		ir3_shader_regs(shader, &new_full, &new_half);
+		printf("regs: full %d -> %d, half %d -> %d, ~%u -> %u waves\n",
+				full, new_full, half, new_half,
+				ir3_shader_waves(full, half),
+				ir3_shader_waves(new_full, new_half));
+	}
+
+	/* each instruction is 64bits, padded out to groups of four: */
+	sizedwords = 2 * ALIGN(shader->instrs_count, 4);
+	dwords = calloc(sizedwords, 4);
+
+	sizedwords = ir3_shader_assemble(shader, dwords, sizedwords, &info);
 	if (sizedwords <= 0) {
 		ERROR_MSG("assembler failed");
-		return -1;
+		goto fail;
 	}
 
 	fd = open(outfile, O_WRONLY| O_TRUNC | O_CREAT, 0644);
 	if (fd < 0) {
 		ERROR_MSG("could not open '%s': %s", outfile, strerror(errno));
-		return -1;
+		goto fail;
 	}
 
 	ret = write(fd, dwords, sizedwords * 4);
+	close(fd);
 	if (ret <= 0) {
 		ERROR_MSG("could not write '%s': %s", outfile, strerror(errno));
-		return -1;
+		goto fail;
 	}
 
 	ir3_shader_destroy(shader);
+	free(dwords);
 
 	return 0;
+
+fail:
+	ir3_shader_destroy(shader);
+	free(dwords);
+	return -1;
 }
@@ -14,3 +14,16 @@ for f in tests/*.asm; do
 	diff $f $disfile > /dev/null || meld $f $disfile
 done
 
+# the optional passes (-O), checked against the expected result:
+for f in tests/opt/*.asm; do
+	o3file=${f%%.asm}.co3
+	disfile=${f%%.asm}.dasm
+	expfile=${f%%.asm}.expected
+	./fdasm -O $f $o3file > /dev/null
+	if [ $? != 0 ]; then
+		echo "assembler failed at: $f"
+		exit 1
+	fi
+	../../pgmdump $o3file | grep "\[" | sed 's/[0-9]*\[[0-9a-f]*x_[0-9a-f]*x\] //' > $disfile
+	diff $expfile $disfile > /dev/null || meld $expfile $disfile
+done
@@ -0,0 +1,5 @@
+; without any outputs, nothing is known to be live at the end, so -O
+; must leave the shader alone rather than removing everything:
+mov.f32f32 r1.x, c0.x
+add.f r1.y, r1.x, c0.y
+end
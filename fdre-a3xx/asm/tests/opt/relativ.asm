@@ -0,0 +1,9 @@
+; the writes to r2.x/r2.y, and the mova, are read through r<a0.x + 8>,
+; so -O must not remove them:
+@out(r1.x) gl_FragColor
+mova a0.x, hr2.x
+mov.f32f32 r2.x, c0.x
+add.f r2.y, r2.x, c0.y
+(rpt5)nop
+mov.f32f32 r1.x, r<a0.x + 8>
+end
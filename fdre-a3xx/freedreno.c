@@ -33,6 +33,7 @@
 #include "ir-a3xx.h"
 #include "ws.h"
 #include "bmp.h"
+#include "gmem.h"
 
 static inline void
 emit_marker(struct fd_ringbuffer *ring, int scratch_idx)
@@ -42,6 +43,81 @@ emit_marker(struct fd_ringbuffer *ring, int scratch_idx)
 	OUT_RING(ring, ++marker_cnt);
 }
 
+/* groups of draw state, which are only re-emitted by draw_impl() when
+ * they have changed since the last draw:
+ */
+enum fd_dirty {
+	FD_DIRTY_PROG       = 0x001,   /* shader program */
+	FD_DIRTY_CONST      = 0x002,   /* uniforms and bufs */
+	FD_DIRTY_VTX        = 0x004,   /* attributes */
+	FD_DIRTY_TEX        = 0x008,   /* samplers and textures */
+	FD_DIRTY_RASTER     = 0x010,   /* PC_PRIM_VTX_CNTL/GRAS_SU_MODE_CONTROL */
+	FD_DIRTY_ZSA        = 0x020,   /* depth/stencil */
+	FD_DIRTY_BLEND      = 0x040,   /* RB_MRT control/blend */
+	FD_DIRTY_VIEWPORT   = 0x080,   /* viewport and clip */
+	FD_DIRTY_RENDER     = 0x100,   /* RB_RENDER_CONTROL */
+	FD_DIRTY_ALL        = 0x1ff,
+
+	/* the state which affects vertex positions, which is all that the
+	 * draw cmds for the binning pass need:
+	 */
+	FD_DIRTY_BINNING    = FD_DIRTY_PROG | FD_DIRTY_CONST | FD_DIRTY_VTX |
+			FD_DIRTY_RASTER | FD_DIRTY_VIEWPORT,
+};
+
+/* key for cached texture/sampler state, everything which goes into
+ * the pre-baked CP_LOAD_STATE's:
+ */
+struct fd_tex_key {
+	enum a3xx_tex_filter min_filter, mag_filter;
+	enum a3xx_tex_clamp clamp_s, clamp_t;
+	int samplers_count;
+	struct fd_surface *tex[16];
+};
+
+#define NUM_RINGS 4
+
+#define MAX_BATCH_READS 16
+
+/* the cmds for one render target, recorded into a ring set of their own,
+ * so that switching render targets does not require a flush.  Pending
+ * batches are flushed together, each after the batches rendering to the
+ * surfaces it samples from, and after the batches sampling from the
+ * surfaces it renders to:
+ */
+struct fd_batch {
+	bool active;
+	unsigned ring;          /* index into state->rings[] */
+	uint32_t seqno;         /* otherwise, flushed in creation order */
+	uint32_t deps;          /* mask of batches to flush before this one */
+
+	/* surfaces sampled from by the draw cmds: */
+	struct fd_surface *reads[MAX_BATCH_READS];
+	unsigned nr_reads;
+
+	/* color buffers rendered to: */
+	struct fd_surface *cbufs[MAX_CBUFS];
+	uint32_t nr_cbufs;
+	/* bin layout, from fd_gmem_layout(): */
+	uint16_t bin_h, nbins_y;
+	uint16_t bin_w, nbins_x;
+	/* offset of the color and depth/stencil buffers in GMEM: */
+	uint32_t cbuf_base[MAX_CBUFS], zsbuf_base, zsbuf_cpp;
+	/* use hw binning, rather than replaying all the draw cmds
+	 * for every bin:
+	 */
+	bool binning;
+	/* each VSC pipe covers a w x h block of bins, starting at bin x,y: */
+	struct {
+		uint32_t x, y, w, h;
+	} pipe[MAX_PIPES];
+	/* buffers (GL_x_BUFFER_BIT) cleared or drawn to, and not
+	 * invalidated since.  Only these need to be resolved back
+	 * to memory:
+	 */
+	GLbitfield resolve;
+};
+
 struct fd_state {
 
 	struct fd_winsys *ws;
@@ -52,13 +128,49 @@ struct fd_state {
 	uint32_t gmemsize_bytes;
 	uint32_t device_id;
 
-	/* cmdstream buffer with render commands: */
+	/* pool of cmdstream buffers, so the next frame can be built while
+	 * the gpu is still busy with the previous ones.  Each is fenced
+	 * with the timestamp of its last flush, and only waited on when
+	 * it is reused:
+	 */
+	struct {
+		struct fd_ringbuffer *ring, *binning;
+		struct fd_ringmarker *draw_start, *draw_end;
+		struct fd_ringmarker *binning_start, *binning_end;
+		uint32_t timestamp;
+	} rings[NUM_RINGS];
+	unsigned cur_ring;
+
+	/* current cmdstream buffer with render commands: */
 	struct fd_ringbuffer *ring;
 	struct fd_ringmarker *draw_start, *draw_end;
 
+	/* and the draw cmds for the binning pass, which only need the
+	 * state that affects vertex positions, in a separate cmdstream
+	 * buffer:
+	 */
+	struct fd_ringbuffer *binning_ring;
+	struct fd_ringmarker *binning_start, *binning_end;
+
+	/* the binning pass writes the visibility stream for each VSC pipe
+	 * to its bo:
+	 */
+	struct fd_bo *vsc_bo[MAX_PIPES];
+
+	/* not yet flushed batches, and the one for the current render
+	 * target (if there have been any cmds for it yet):
+	 */
+	struct fd_batch batches[NUM_RINGS];
+	struct fd_batch *batch;
+	uint32_t batch_seqno;
+
+	/* the render target which the gpu was last setup for, so the setup
+	 * can be skipped when the next batch flushed renders to it again:
+	 */
 	struct {
-		struct fd_bo *bo;
-	} vsc_pipe[8];
+		struct fd_surface *cbufs[MAX_CBUFS];
+		uint32_t nr_cbufs, zsbuf_cpp;
+	} setup;
 
 	/* program used internally for blits/fills */
 	struct fd_program *solid_program;
@@ -69,6 +181,22 @@ struct fd_state {
 	/* buffers for private memory for vert/frag shaders: */
 	struct fd_bo *vs_pvt_mem, *fs_pvt_mem;
 
+	/* streaming upload buffer for indices, client side attributes and
+	 * uniforms, sub-allocated from a few big bo's.  Each chunk is fenced
+	 * with the timestamp of the last flush that used it, and chunks are
+	 * used round-robin.  If all the chunks are still used by not yet
+	 * flushed cmds, a new one is added:
+	 */
+	struct {
+		struct fd_upload_chunk {
+			struct fd_bo *bo;
+			uint32_t timestamp;
+			bool pending;      /* used by not yet flushed cmds */
+		} *chunks;
+		unsigned nchunks, cur;
+		uint32_t off;
+	} upload;
+
 	/* shader program: */
 	struct fd_program *program;
 
@@ -84,19 +212,25 @@ struct fd_state {
 		enum a3xx_tex_clamp clamp_s, clamp_t;
 
 		struct fd_parameters params;
+
+		/* recently used sampler/texture state: */
+		struct {
+			struct fd_tex_key key;
+			struct fd_stateobj obj;
+		} cache[8];
+		unsigned cache_next;
 	} textures;
 
 	/* buffer related params: */
 	struct fd_parameters bufs;
 
 	struct {
-		/* render target: */
-		struct fd_surface *surface;
-		/* for now just keep things simple and split the
-		 * render target into horizontal strips:
+		/* render target, which is also the first of the color
+		 * buffers bound for MRT:
 		 */
-		uint16_t bin_h, nbins_y;
-		uint16_t bin_w, nbins_x;
+		struct fd_surface *surface;
+		struct fd_surface *cbufs[MAX_CBUFS];
+		uint32_t nr_cbufs;
 	} render_target;
 
 	struct {
@@ -105,8 +239,12 @@ struct fd_state {
 		float depth;
 	} clear;
 
-	/* have there been any render cmds since last flush? */
-	bool dirty;
+	/* state groups (FD_DIRTY_x) that need to be emitted on next draw,
+	 * and the vertex offset the current vertex fetch state was emitted
+	 * with:
+	 */
+	uint32_t dirty_state;
+	uint32_t vtx_first;
 
 	struct {
 		struct {
@@ -169,6 +307,192 @@ static enum a3xx_tex_fmt color2fmt[] = {
 
 /* ************************************************************************* */
 
+#define UPLOAD_CHUNK_SIZE  0x40000
+#define UPLOAD_ALIGN       32
+
+static int add_upload_chunk(struct fd_state *state, unsigned idx,
+		uint32_t size)
+{
+	struct fd_upload_chunk *chunk, *chunks;
+	struct fd_bo *bo;
+
+	chunks = realloc(state->upload.chunks,
+			(state->upload.nchunks + 1) * sizeof(*chunk));
+	if (!chunks) {
+		ERROR_MSG("could not grow upload chunks");
+		return -1;
+	}
+	state->upload.chunks = chunks;
+
+	bo = fd_bo_new(state->dev, max(size, UPLOAD_CHUNK_SIZE),
+			DRM_FREEDRENO_GEM_TYPE_KMEM);
+	if (!bo) {
+		ERROR_MSG("could not allocate upload chunk");
+		return -1;
+	}
+
+	chunk = &chunks[idx];
+	memmove(chunk + 1, chunk,
+			(state->upload.nchunks - idx) * sizeof(*chunk));
+	state->upload.nchunks++;
+
+	chunk->bo = bo;
+	chunk->timestamp = 0;
+	chunk->pending = false;
+
+	return 0;
+}
+
+/* sub-allocate size bytes from the upload buffer, returning a cpu ptr
+ * to write the contents to, or NULL if out of memory.  The data is
+ * valid until it has been used by the next flush.
+ */
+void * fd_upload(struct fd_state *state, uint32_t size,
+		struct fd_bo **bo, uint32_t *offset)
+{
+	struct fd_upload_chunk *chunk;
+
+	size = ALIGN(size, UPLOAD_ALIGN);
+
+	if (!state->upload.nchunks) {
+		if (add_upload_chunk(state, 0, size))
+			return NULL;
+		state->upload.cur = 0;
+		state->upload.off = 0;
+	}
+
+	chunk = &state->upload.chunks[state->upload.cur];
+
+	if ((state->upload.off + size) > fd_bo_size(chunk->bo)) {
+		unsigned next = (state->upload.cur + 1) % state->upload.nchunks;
+
+		chunk = &state->upload.chunks[next];
+
+		if (chunk->pending || (size > fd_bo_size(chunk->bo))) {
+			/* we can't wait for cmds we haven't flushed yet: */
+			next = state->upload.cur + 1;
+			if (add_upload_chunk(state, next, size))
+				return NULL;
+			chunk = &state->upload.chunks[next];
+		} else if (chunk->timestamp) {
+			fd_pipe_wait(state->pipe, chunk->timestamp);
+		}
+
+		state->upload.cur = next;
+		state->upload.off = 0;
+	}
+
+	chunk->pending = true;
+
+	*bo = chunk->bo;
+	*offset = state->upload.off;
+
+	state->upload.off += size;
+
+	return (uint8_t *)fd_bo_map(chunk->bo) + *offset;
+}
+
+/* fence the upload chunks used by the cmds just flushed: */
+static void upload_fence(struct fd_state *state, uint32_t timestamp)
+{
+	unsigned i;
+
+	for (i = 0; i < state->upload.nchunks; i++) {
+		struct fd_upload_chunk *chunk = &state->upload.chunks[i];
+		if (chunk->pending) {
+			chunk->timestamp = timestamp;
+			chunk->pending = false;
+		}
+	}
+}
+
+static void set_ring(struct fd_state *state, unsigned n)
+{
+	state->cur_ring = n;
+
+	state->ring = state->rings[n].ring;
+	state->draw_start = state->rings[n].draw_start;
+	state->draw_end = state->rings[n].draw_end;
+
+	state->binning_ring = state->rings[n].binning;
+	state->binning_start = state->rings[n].binning_start;
+	state->binning_end = state->rings[n].binning_end;
+}
+
+/* the not yet flushed batch recording to ring n, if any: */
+static struct fd_batch * ring_batch(struct fd_state *state, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(state->batches); i++)
+		if (state->batches[i].active && (state->batches[i].ring == n))
+			return &state->batches[i];
+
+	return NULL;
+}
+
+/* called after the current ring is flushed, to fence it: */
+static void fence_ring(struct fd_state *state)
+{
+	uint32_t timestamp = fd_ringbuffer_timestamp(state->ring);
+	unsigned i;
+
+	state->rings[state->cur_ring].timestamp = timestamp;
+
+	/* the upload buffer may still be used by other batches, which
+	 * are flushed later:
+	 */
+	for (i = 0; i < ARRAY_SIZE(state->batches); i++)
+		if (state->batches[i].active)
+			return;
+
+	upload_fence(state, timestamp);
+}
+
+/* switch to the next ring in the pool which isn't in use by a batch,
+ * waiting for the gpu only if it is still busy with that ring's
+ * previous contents:
+ */
+static void next_ring(struct fd_state *state)
+{
+	unsigned i, n = state->cur_ring;
+
+	for (i = 1; i <= NUM_RINGS; i++) {
+		n = (state->cur_ring + i) % NUM_RINGS;
+		if (!ring_batch(state, n))
+			break;
+	}
+
+	assert(i <= NUM_RINGS);
+
+	if (state->rings[n].timestamp)
+		fd_pipe_wait(state->pipe, state->rings[n].timestamp);
+
+	set_ring(state, n);
+
+	fd_ringbuffer_reset(state->ring);
+	fd_ringmarker_mark(state->draw_start);
+
+	fd_ringbuffer_reset(state->binning_ring);
+	fd_ringmarker_mark(state->binning_start);
+}
+
+/* wait for all previously flushed rendering to complete: */
+int fd_finish(struct fd_state *state)
+{
+	unsigned i;
+
+	fd_flush(state);
+
+	for (i = 0; i < NUM_RINGS; i++) {
+		if (state->rings[i].timestamp)
+			fd_pipe_wait(state->pipe, state->rings[i].timestamp);
+		state->rings[i].timestamp = 0;
+	}
+
+	return 0;
+}
+
 static void emit_mem_write(struct fd_state *state, struct fd_bo *bo,
 		const void *data, uint32_t sizedwords)
 {
@@ -202,6 +526,11 @@ static const float init_shader_const[] = {
 		+1.000000
 };
 
+/* the binning pass writes the size of each pipe's visibility stream
+ * to solid_const, after the vertices:
+ */
+#define VSC_SIZE_OFFSET  sizeof(init_shader_const)
+
 /* ************************************************************************* */
 
 struct fd_state * fd_init(void)
@@ -215,6 +544,9 @@ struct fd_state * fd_init(void)
 	state = calloc(1, sizeof(*state));
 	assert(state);
 
+#ifdef HAVE_NULL_DRM
+	state->ws = fd_winsys_null_open();
+#else
 #ifdef HAVE_X11
 	state->ws = fd_winsys_dri2_open();
 	if (!state->ws)
@@ -222,18 +554,23 @@ struct fd_state * fd_init(void)
 #endif
 	if (!state->ws)
 		state->ws = fd_winsys_fbdev_open();
+#endif
 
 	if (state->ws) {
 		state->dev  = state->ws->dev;
 		state->pipe = state->ws->pipe;
 	} else {
 		/* well, we can still do compute.. */
+#ifdef HAVE_NULL_DRM
+		int fd = -1;   /* null device doesn't need one */
+#else
 		int fd = drmOpen("msm", NULL);
 		if (fd < 0) {
 			ERROR_MSG("could not open msm device: %d (%s)",
 					fd, strerror(errno));
 			goto fail;
 		}
+#endif
 
 		state->dev = fd_device_new(fd);
 		state->pipe = fd_pipe_new(state->dev, FD_PIPE_3D);
@@ -245,9 +582,19 @@ struct fd_state * fd_init(void)
 	fd_pipe_get_param(state->pipe, FD_DEVICE_ID, &val);
 	state->device_id = val;
 
-	state->ring = fd_ringbuffer_new(state->pipe, 0x10000);
-	state->draw_start = fd_ringmarker_new(state->ring);
-	state->draw_end = fd_ringmarker_new(state->ring);
+	for (i = 0; i < NUM_RINGS; i++) {
+		struct fd_ringbuffer *ring = fd_ringbuffer_new(state->pipe, 0x10000);
+		state->rings[i].ring = ring;
+		state->rings[i].draw_start = fd_ringmarker_new(ring);
+		state->rings[i].draw_end = fd_ringmarker_new(ring);
+
+		ring = fd_ringbuffer_new(state->pipe, 0x10000);
+		state->rings[i].binning = ring;
+		state->rings[i].binning_start = fd_ringmarker_new(ring);
+		state->rings[i].binning_end = fd_ringmarker_new(ring);
+	}
+
+	set_ring(state, 0);
 
 	state->solid_const = fd_bo_new(state->dev, 0x1000,
 			DRM_FREEDRENO_GEM_TYPE_KMEM);
@@ -311,6 +658,8 @@ struct fd_state * fd_init(void)
 	state->clear.depth = 1;
 	state->clear.stencil = 0;
 
+	state->dirty_state = FD_DIRTY_ALL;
+
 	for (i = 0; i < ARRAY_SIZE(state->rb_mrt); i++) {
 		state->rb_mrt[i].blendcontrol =
 				A3XX_RB_MRT_BLEND_CONTROL_RGB_SRC_FACTOR(FACTOR_ONE) |
@@ -336,22 +685,58 @@ fail:
 
 void fd_fini(struct fd_state *state)
 {
+	unsigned i;
+
+	/* batches rendering to other surfaces may still be pending too, so
+	 * flush everything before the upload chunks they use go away:
+	 */
+	fd_flush(state);
 	fd_surface_del(state, state->render_target.surface);
-	fd_ringbuffer_del(state->ring);
+
+	if (state->program)
+		fd_program_del(state->program);
+	if (state->solid_program)
+		fd_program_del(state->solid_program);
+	for (i = 0; i < ARRAY_SIZE(state->textures.cache); i++)
+		fd_stateobj_del(&state->textures.cache[i].obj);
+
+	for (i = 0; i < state->upload.nchunks; i++)
+		fd_bo_del(state->upload.chunks[i].bo);
+	free(state->upload.chunks);
+	for (i = 0; i < NUM_RINGS; i++) {
+		if (!state->rings[i].ring)
+			continue;
+		fd_ringmarker_del(state->rings[i].draw_start);
+		fd_ringmarker_del(state->rings[i].draw_end);
+		fd_ringbuffer_del(state->rings[i].ring);
+		fd_ringmarker_del(state->rings[i].binning_start);
+		fd_ringmarker_del(state->rings[i].binning_end);
+		fd_ringbuffer_del(state->rings[i].binning);
+	}
+	for (i = 0; i < ARRAY_SIZE(state->vsc_bo); i++)
+		if (state->vsc_bo[i])
+			fd_bo_del(state->vsc_bo[i]);
 	if (state->ws)
 		state->ws->destroy(state->ws);
 	free(state);
 }
 
+uint32_t fd_device_id(struct fd_state *state)
+{
+	return state->device_id;
+}
+
 /* ************************************************************************* */
 
 int fd_vertex_shader_attach_asm(struct fd_state *state, const char *src)
 {
+	state->dirty_state |= FD_DIRTY_PROG;
 	return fd_program_attach_asm(state->program, FD_SHADER_VERTEX, src);
 }
 
 int fd_fragment_shader_attach_asm(struct fd_state *state, const char *src)
 {
+	state->dirty_state |= FD_DIRTY_PROG;
 	return fd_program_attach_asm(state->program, FD_SHADER_FRAGMENT, src);
 }
 
@@ -364,6 +749,7 @@ int fd_link(struct fd_state *state)
 int fd_set_program(struct fd_state *state, struct fd_program *program)
 {
 	state->program = program;
+	state->dirty_state |= FD_DIRTY_PROG;
 	return fd_link(state);
 }
 
@@ -386,17 +772,29 @@ int fd_attribute_bo(struct fd_state *state, const char *name,
 		return -1;
 	p->fmt  = fmt;
 	p->bo   = bo;
+	p->offset = 0;
+	state->dirty_state |= FD_DIRTY_VTX;
 	return 0;
 }
 
+/* note: the data is copied, so can be modified after this returns, but
+ * should be re-attached after the next flush:
+ */
 int fd_attribute_pointer(struct fd_state *state, const char *name,
 		enum a3xx_vtx_fmt fmt, uint32_t count, const void *data)
 {
 	uint32_t size = fmt2size(fmt) * count;
-	struct fd_bo *bo = fd_bo_new(state->dev, size,
-			DRM_FREEDRENO_GEM_TYPE_KMEM);
-	memcpy(fd_bo_map(bo), data, size);
-	return fd_attribute_bo(state, name, fmt, bo);
+	struct fd_param *p = find_param(&state->attributes, name);
+	void *ptr;
+	if (!p)
+		return -1;
+	ptr = fd_upload(state, size, &p->bo, &p->offset);
+	if (!ptr)
+		return -1;
+	memcpy(ptr, data, size);
+	p->fmt  = fmt;
+	state->dirty_state |= FD_DIRTY_VTX;
+	return 0;
 }
 
 int fd_uniform_attach(struct fd_state *state, const char *name,
@@ -409,6 +807,7 @@ int fd_uniform_attach(struct fd_state *state, const char *name,
 	p->size  = size;
 	p->count = count;
 	p->data  = data;
+	state->dirty_state |= FD_DIRTY_CONST;
 	return 0;
 }
 
@@ -420,6 +819,7 @@ int fd_set_texture(struct fd_state *state, const char *name,
 	if (!p)
 		return -1;
 	p->tex = tex;
+	state->dirty_state |= FD_DIRTY_TEX;
 	return 0;
 }
 
@@ -429,12 +829,74 @@ int fd_set_buf(struct fd_state *state, const char *name, struct fd_bo *bo)
 	if (!p)
 		return -1;
 	p->bo = bo;
+	state->dirty_state |= FD_DIRTY_CONST;
 	return 0;
 }
 
+struct fd_ringbuffer * fd_stateobj_begin(struct fd_state *state,
+		struct fd_stateobj *obj, uint32_t size)
+{
+	if (!obj->dwords) {
+		obj->dwords = malloc(size);
+		obj->size = size;
+	}
+
+	memset(&obj->baking, 0, sizeof(obj->baking));
+	obj->baking.size = obj->size;
+	obj->baking.start = obj->baking.last_start = obj->dwords;
+	obj->baking.cur = obj->dwords;
+	obj->baking.end = obj->dwords + (obj->size / 4);
+
+	obj->sizedwords = 0;
+	obj->in_ring = false;
+
+	return &obj->baking;
+}
+
+void fd_stateobj_end(struct fd_stateobj *obj)
+{
+	obj->sizedwords = obj->baking.cur - obj->dwords;
+}
+
+void fd_stateobj_emit_ib(struct fd_state *state, struct fd_stateobj *obj,
+		struct fd_ringbuffer *ring)
+{
+	if (!obj->ring) {
+		obj->ring = fd_ringbuffer_new(state->pipe, obj->size);
+		obj->start = fd_ringmarker_new(obj->ring);
+		obj->end = fd_ringmarker_new(obj->ring);
+	}
+
+	/* note: re-baking a state object is only safe if it is not
+	 * referenced by any not yet flushed cmds:
+	 */
+	if (!obj->in_ring) {
+		fd_ringbuffer_reset(obj->ring);
+		fd_ringmarker_mark(obj->start);
+		memcpy(obj->ring->cur, obj->dwords, obj->sizedwords * 4);
+		obj->ring->cur += obj->sizedwords;
+		fd_ringmarker_mark(obj->end);
+		obj->in_ring = true;
+	}
+
+	OUT_IB(ring, obj->start, obj->end);
+}
+
+void fd_stateobj_del(struct fd_stateobj *obj)
+{
+	if (obj->ring) {
+		fd_ringmarker_del(obj->start);
+		fd_ringmarker_del(obj->end);
+		fd_ringbuffer_del(obj->ring);
+	}
+	free(obj->dwords);
+	memset(obj, 0, sizeof(*obj));
+}
+
 static void emit_draw_indx(struct fd_ringbuffer *ring, enum pc_di_primtype primtype,
 		enum pc_di_index_size index_size, uint32_t count,
-		struct fd_bo *indx_bo, uint32_t idx_offset, uint32_t idx_size)
+		struct fd_bo *indx_bo, uint32_t idx_offset, uint32_t idx_size,
+		enum pc_di_vis_cull_mode vismode)
 {
 	enum pc_di_src_sel src_sel = indx_bo ? DI_SRC_SEL_DMA : DI_SRC_SEL_AUTO_INDEX;
 
@@ -454,7 +916,7 @@ static void emit_draw_indx(struct fd_ringbuffer *ring, enum pc_di_primtype primt
 
 	OUT_PKT3(ring, CP_DRAW_INDX, indx_bo ? 5 : 3);
 	OUT_RING(ring, 0x00000000);   /* viz query info. */
-	OUT_RING(ring, DRAW(primtype, src_sel, index_size, IGNORE_VISIBILITY));
+	OUT_RING(ring, DRAW(primtype, src_sel, index_size, vismode));
 	OUT_RING(ring, count);        /* NumIndices */
 	if (indx_bo) {
 		OUT_RELOC(ring, indx_bo, idx_offset, 0);
@@ -462,8 +924,7 @@ static void emit_draw_indx(struct fd_ringbuffer *ring, enum pc_di_primtype primt
 	}
 }
 
-static void emit_mrt(struct fd_state *state,
-		struct fd_ringbuffer *ring, struct fd_surface *surface)
+static void emit_mrt(struct fd_state *state, struct fd_ringbuffer *ring)
 {
 	int i;
 
@@ -475,12 +936,14 @@ static void emit_mrt(struct fd_state *state,
 	}
 }
 
-/* emit cmdstream to blit from GMEM back to the surface */
-static void emit_gmem2mem(struct fd_state *state,
-		struct fd_ringbuffer *ring, struct fd_surface *surface,
-		uint32_t xoff, uint32_t yoff)
+/* emit cmdstream to blit from GMEM back to the color buffers */
+static void emit_gmem2mem(struct fd_state *state, struct fd_batch *batch,
+		struct fd_ringbuffer *ring, uint32_t xoff, uint32_t yoff)
 {
-	fd_program_emit_state(state->solid_program, 0,
+	int i;
+
+	fd_program_emit_state(state->solid_program,
+			FD_PROGRAM_ALL | FD_PROGRAM_IB, 0,
 			NULL, &state->solid_attributes, NULL, ring);
 
 	OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
@@ -524,18 +987,23 @@ static void emit_gmem2mem(struct fd_state *state,
 			A3XX_GRAS_SC_CONTROL_MSAA_SAMPLES(MSAA_ONE) |
 			A3XX_GRAS_SC_CONTROL_RASTER_MODE(1));
 
-	OUT_PKT0(ring, REG_A3XX_RB_COPY_CONTROL, 4);
-	OUT_RING(ring, A3XX_RB_COPY_CONTROL_MSAA_RESOLVE(MSAA_ONE) |
-			A3XX_RB_COPY_CONTROL_MODE(RB_COPY_RESOLVE) |
-			A3XX_RB_COPY_CONTROL_GMEM_BASE(0));
-	OUT_RELOCS(ring, surface->bo, 0, 0, -1);     /* RB_COPY_DEST_BASE */
-	OUT_RING(ring, A3XX_RB_COPY_DEST_PITCH_PITCH(surface->pitch * surface->cpp));
-	OUT_RING(ring, A3XX_RB_COPY_DEST_INFO_TILE(LINEAR) |
-			A3XX_RB_COPY_DEST_INFO_FORMAT(surface->color) |
-			A3XX_RB_COPY_DEST_INFO_COMPONENT_ENABLE(0xf) |
-			A3XX_RB_COPY_DEST_INFO_ENDIAN(ENDIAN_NONE));
-
-	emit_draw_indx(ring, DI_PT_RECTLIST, INDEX_SIZE_IGN, 2, NULL, 0, 0);
+	for (i = 0; i < batch->nr_cbufs; i++) {
+		struct fd_surface *cbuf = batch->cbufs[i];
+
+		OUT_PKT0(ring, REG_A3XX_RB_COPY_CONTROL, 4);
+		OUT_RING(ring, A3XX_RB_COPY_CONTROL_MSAA_RESOLVE(MSAA_ONE) |
+				A3XX_RB_COPY_CONTROL_MODE(RB_COPY_RESOLVE) |
+				A3XX_RB_COPY_CONTROL_GMEM_BASE(batch->cbuf_base[i]));
+		OUT_RELOCS(ring, cbuf->bo, 0, 0, -1);    /* RB_COPY_DEST_BASE */
+		OUT_RING(ring, A3XX_RB_COPY_DEST_PITCH_PITCH(cbuf->pitch * cbuf->cpp));
+		OUT_RING(ring, A3XX_RB_COPY_DEST_INFO_TILE(LINEAR) |
+				A3XX_RB_COPY_DEST_INFO_FORMAT(cbuf->color) |
+				A3XX_RB_COPY_DEST_INFO_COMPONENT_ENABLE(0xf) |
+				A3XX_RB_COPY_DEST_INFO_ENDIAN(ENDIAN_NONE));
+
+		emit_draw_indx(ring, DI_PT_RECTLIST, INDEX_SIZE_IGN, 2, NULL, 0, 0,
+				IGNORE_VISIBILITY);
+	}
 
 	OUT_PKT0(ring, REG_A3XX_RB_MODE_CONTROL, 1);
 	OUT_RING(ring, A3XX_RB_MODE_CONTROL_RENDER_MODE(RB_RENDERING_PASS) |
@@ -549,7 +1017,7 @@ static void emit_gmem2mem(struct fd_state *state,
 	OUT_PKT0(ring, REG_A3XX_GRAS_SU_MODE_CONTROL, 1);
 	OUT_RING(ring, state->gras_su_mode_control);
 
-	emit_mrt(state, ring, surface);
+	emit_mrt(state, ring);
 
 	OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
 	OUT_RING(ring, state->rb_stencil_control);
@@ -565,107 +1033,382 @@ static void emit_gmem2mem(struct fd_state *state,
 	OUT_RING(ring, A3XX_GRAS_CL_CLIP_CNTL_IJ_PERSP_CENTER);
 }
 
-/* color in RGBA */
-void fd_clear_color(struct fd_state *state, float color[4])
-{
-	state->clear.color[0] = color[0];
-	state->clear.color[1] = color[1];
-	state->clear.color[2] = color[2];
-	state->clear.color[3] = color[3];
-}
+/* ************************************************************************* */
+/* batches */
 
-void fd_clear_stencil(struct fd_state *state, uint32_t s)
+static void flush_batches(struct fd_state *state, uint32_t mask);
+
+static bool has_surface(struct fd_surface **surfaces, unsigned n,
+		struct fd_surface *surface)
 {
-	state->clear.stencil = s;
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		if (surfaces[i] == surface)
+			return true;
+
+	return false;
 }
 
-void fd_clear_depth(struct fd_state *state, float depth)
+/* does batch a (directly or indirectly) have to be flushed after b? */
+static bool batch_depends(struct fd_state *state, struct fd_batch *a,
+		struct fd_batch *b)
 {
-	state->clear.depth = depth;
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(state->batches); i++) {
+		if (!(a->deps & (1 << i)))
+			continue;
+		if ((&state->batches[i] == b) ||
+				batch_depends(state, &state->batches[i], b))
+			return true;
+	}
+
+	return false;
 }
 
-int fd_clear(struct fd_state *state, GLbitfield mask)
+static void attach_render_target(struct fd_state *state,
+		struct fd_batch *batch)
 {
-	struct fd_ringbuffer *ring = state->ring;
+	struct fd_surface *surface = batch->cbufs[0];
+	struct fd_gmem_params params = {
+			.width = surface->width,
+			.height = surface->height,
+			.gmem_size = state->gmemsize_bytes,
+			.max_bin_w = 256,
+			/* TODO a320 needs some additional workaround around the
+			 * binning pass, so for now it is not used there:
+			 */
+			.binning = (state->device_id != 320),
+	};
+	struct fd_gmem_layout layout;
 	int i;
 
-	state->dirty = true;
+	for (i = 0; i < batch->nr_cbufs; i++)
+		params.cbuf_cpp[i] = color2cpp[batch->cbufs[i]->color];
 
-	OUT_PKT3(ring, CP_REG_RMW, 3);
-	OUT_RING(ring, REG_A3XX_RB_RENDER_CONTROL);
-	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH__MASK);
-	OUT_RING(ring, 0x2000 | /* XXX */
-			A3XX_RB_RENDER_CONTROL_ALPHA_TEST_FUNC(FUNC_NEVER));
+	/* see emit_setup() for the depth/stencil formats: */
+	if (state->rb_stencil_control & A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE)
+		params.zsbuf_cpp = 4;
+	else if (state->rb_depth_control & A3XX_RB_DEPTH_CONTROL_Z_ENABLE)
+		params.zsbuf_cpp = 2;
 
-	if (mask & GL_DEPTH_BUFFER_BIT) {
-		OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
-		OUT_RING(ring, A3XX_RB_DEPTH_CONTROL_Z_WRITE_ENABLE |
-				A3XX_RB_DEPTH_CONTROL_Z_ENABLE |
-				A3XX_RB_DEPTH_CONTROL_ZFUNC(FUNC_ALWAYS));
+	batch->zsbuf_cpp = params.zsbuf_cpp;
 
-		OUT_PKT0(ring, REG_A3XX_GRAS_CL_VPORT_ZOFFSET, 2);
-		OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZOFFSET(0.0));
-		OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZSCALE(state->clear.depth));
+	if (fd_gmem_layout(&params, &layout)) {
+		ERROR_MSG("render target does not fit in gmem");
+		return;
 	}
 
-	if (mask & GL_STENCIL_BUFFER_BIT) {
-		OUT_PKT0(ring, REG_A3XX_RB_STENCILREFMASK, 1);
-		OUT_RING(ring, A3XX_RB_STENCILREFMASK_STENCILREF(state->clear.stencil) |
-				A3XX_RB_STENCILREFMASK_STENCILMASK(state->clear.stencil) |
-				A3XX_RB_STENCILREFMASK_STENCILWRITEMASK(0xff));
-
-		OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
-		OUT_RING(ring, A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE |
-				A3XX_RB_STENCIL_CONTROL_FUNC(FUNC_ALWAYS) |
-				A3XX_RB_STENCIL_CONTROL_FAIL(STENCIL_KEEP) |
-				A3XX_RB_STENCIL_CONTROL_ZPASS(STENCIL_REPLACE) |
-				A3XX_RB_STENCIL_CONTROL_ZFAIL(STENCIL_KEEP) |
-				A3XX_RB_STENCIL_CONTROL_FUNC_BF(FUNC_NEVER) |
-				A3XX_RB_STENCIL_CONTROL_FAIL_BF(STENCIL_KEEP) |
-				A3XX_RB_STENCIL_CONTROL_ZPASS_BF(STENCIL_KEEP) |
-				A3XX_RB_STENCIL_CONTROL_ZFAIL_BF(STENCIL_KEEP));
+	batch->nbins_x = layout.nbins_x;
+	batch->nbins_y = layout.nbins_y;
+	batch->bin_w = layout.bin_w;
+	batch->bin_h = layout.bin_h;
+	for (i = 0; i < MAX_CBUFS; i++)
+		batch->cbuf_base[i] = layout.cbuf_base[i];
+	batch->zsbuf_base = layout.zsbuf_base;
+	batch->binning = layout.binning;
+
+	for (i = 0; i < ARRAY_SIZE(batch->pipe); i++) {
+		batch->pipe[i].x = layout.pipe[i].x;
+		batch->pipe[i].y = layout.pipe[i].y;
+		batch->pipe[i].w = layout.pipe[i].w;
+		batch->pipe[i].h = layout.pipe[i].h;
 	}
+}
 
-	for (i = 0; i < 4; i++) {
-		OUT_PKT0(ring, REG_A3XX_RB_MRT_CONTROL(i), 1);
-		OUT_RING(ring, A3XX_RB_MRT_CONTROL_ROP_CODE(ROP_COPY) |
-				A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS) |
-				A3XX_RB_MRT_CONTROL_COMPONENT_ENABLE(0xf));
+/* get the batch for the current render target, switching back to its
+ * not yet flushed batch or else starting a new one:
+ */
+/* find the not yet flushed batch rendering to the current render
+ * target, if any:
+ */
+static struct fd_batch * find_batch(struct fd_state *state)
+{
+	struct fd_surface **cbufs = state->render_target.cbufs;
+	uint32_t nr_cbufs = state->render_target.nr_cbufs;
+	unsigned i;
 
-		OUT_PKT0(ring, REG_A3XX_RB_MRT_BLEND_CONTROL(i), 1);
-		OUT_RING(ring, A3XX_RB_MRT_BLEND_CONTROL_RGB_SRC_FACTOR(FACTOR_ONE) |
-				A3XX_RB_MRT_BLEND_CONTROL_RGB_BLEND_OPCODE(BLEND_DST_PLUS_SRC) |
-				A3XX_RB_MRT_BLEND_CONTROL_RGB_DEST_FACTOR(FACTOR_ZERO) |
-				A3XX_RB_MRT_BLEND_CONTROL_ALPHA_SRC_FACTOR(FACTOR_ONE) |
-				A3XX_RB_MRT_BLEND_CONTROL_ALPHA_BLEND_OPCODE(BLEND_DST_PLUS_SRC) |
-				A3XX_RB_MRT_BLEND_CONTROL_ALPHA_DEST_FACTOR(FACTOR_ZERO) |
-				A3XX_RB_MRT_BLEND_CONTROL_CLAMP_ENABLE);
+	for (i = 0; i < ARRAY_SIZE(state->batches); i++) {
+		struct fd_batch *b = &state->batches[i];
+		if (b->active && (b->nr_cbufs == nr_cbufs) &&
+				!memcmp(b->cbufs, cbufs, nr_cbufs * sizeof(cbufs[0])))
+			return b;
 	}
 
-	fd_program_emit_state(state->solid_program, 0,
-			&state->solid_uniforms, &state->solid_attributes,
-			NULL, ring);
-
-	emit_draw_indx(ring, DI_PT_RECTLIST, INDEX_SIZE_IGN, 2, NULL, 0, 0);
-
-	return 0;
+	return NULL;
 }
 
-int fd_cull(struct fd_state *state, GLenum mode)
+static struct fd_batch * get_batch(struct fd_state *state)
 {
-	state->cull_mode = mode;
-	return 0;
-}
+	struct fd_surface **cbufs = state->render_target.cbufs;
+	uint32_t nr_cbufs = state->render_target.nr_cbufs;
+	struct fd_batch *batch;
+	unsigned i;
 
-int fd_depth_func(struct fd_state *state, GLenum depth_func)
-{
-	state->rb_depth_control &= ~A3XX_RB_DEPTH_CONTROL_ZFUNC__MASK;
+	if (state->batch)
+		return state->batch;
+
+	if (!nr_cbufs || has_surface(cbufs, nr_cbufs, NULL)) {
+		ERROR_MSG("no render target");
+		return NULL;
+	}
+
+	batch = find_batch(state);
+
+	/* if another batch has already sampled from the render target,
+	 * it must not see what is rendered from now on.  There is no
+	 * mem2gmem, so like after any other flush, the new batch starts
+	 * out with undefined GMEM contents:
+	 */
+	for (i = 0; batch && (i < ARRAY_SIZE(state->batches)); i++) {
+		if (state->batches[i].active &&
+				(state->batches[i].deps & (1 << (batch - state->batches)))) {
+			flush_batches(state, 1 << (batch - state->batches));
+			batch = NULL;
+		}
+	}
+
+	if (batch) {
+		set_ring(state, batch->ring);
+	} else {
+		/* start the new batch in a ring that isn't used by another: */
+		if (ring_batch(state, state->cur_ring)) {
+			for (i = 0; i < ARRAY_SIZE(state->batches); i++)
+				if (!state->batches[i].active)
+					break;
+			if (i == ARRAY_SIZE(state->batches))
+				flush_batches(state, ~0);
+			else
+				next_ring(state);
+		}
+
+		for (i = 0; i < ARRAY_SIZE(state->batches); i++)
+			if (!state->batches[i].active)
+				break;
+
+		batch = &state->batches[i];
+		memset(batch, 0, sizeof(*batch));
+		batch->active = true;
+		batch->ring = state->cur_ring;
+		batch->seqno = state->batch_seqno++;
+		batch->nr_cbufs = nr_cbufs;
+		memcpy(batch->cbufs, cbufs, nr_cbufs * sizeof(cbufs[0]));
+
+		attach_render_target(state, batch);
+
+		/* batches sampling from the surfaces rendered to must see
+		 * their previous contents:
+		 */
+		for (i = 0; i < ARRAY_SIZE(state->batches); i++) {
+			struct fd_batch *b = &state->batches[i];
+			unsigned n;
+
+			if (!b->active || (b == batch))
+				continue;
+
+			for (n = 0; n < nr_cbufs; n++)
+				if (has_surface(b->reads, b->nr_reads, cbufs[n]))
+					batch->deps |= (1 << i);
+		}
+	}
+
+	state->batch = batch;
+
+	/* the cmds in another ring can't inherit any state: */
+	state->dirty_state = FD_DIRTY_ALL;
+
+	return batch;
+}
+
+/* track the surfaces sampled by the current program, so the batches
+ * rendering to them are flushed before the current batch.  Returns
+ * true if the current batch had to be flushed instead, because the
+ * other batch also had to be flushed after it:
+ */
+static bool batch_reads(struct fd_state *state)
+{
+	struct fd_batch *batch = state->batch;
+	struct ir3_sampler **samplers;
+	int n, samplers_count;
+	unsigned i;
+
+	samplers = fd_program_samplers(state->program,
+			FD_SHADER_FRAGMENT, &samplers_count);
+
+	for (n = 0; n < samplers_count; n++) {
+		struct fd_param *p = find_param(&state->textures.params,
+				samplers[n]->name);
+		struct fd_surface *tex = p->tex;
+
+		if (!tex)
+			continue;
+
+		for (i = 0; i < ARRAY_SIZE(state->batches); i++) {
+			struct fd_batch *b = &state->batches[i];
+
+			if (!b->active || (b == batch) ||
+					!has_surface(b->cbufs, b->nr_cbufs, tex))
+				continue;
+
+			if (batch_depends(state, b, batch)) {
+				flush_batches(state, 1 << i);
+				return true;
+			}
+
+			batch->deps |= (1 << i);
+		}
+
+		if (has_surface(batch->reads, batch->nr_reads, tex))
+			continue;
+
+		if (batch->nr_reads == ARRAY_SIZE(batch->reads)) {
+			flush_batches(state, 1 << (batch - state->batches));
+			return true;
+		}
+
+		batch->reads[batch->nr_reads++] = tex;
+	}
+
+	return false;
+}
+
+/* color in RGBA */
+void fd_clear_color(struct fd_state *state, float color[4])
+{
+	state->clear.color[0] = color[0];
+	state->clear.color[1] = color[1];
+	state->clear.color[2] = color[2];
+	state->clear.color[3] = color[3];
+}
+
+void fd_clear_stencil(struct fd_state *state, uint32_t s)
+{
+	state->clear.stencil = s;
+}
+
+void fd_clear_depth(struct fd_state *state, float depth)
+{
+	state->clear.depth = depth;
+}
+
+int fd_clear(struct fd_state *state, GLbitfield mask)
+{
+	struct fd_batch *batch = get_batch(state);
+	struct fd_ringbuffer *ring = state->ring;
+	int i;
+
+	if (!batch)
+		return -1;
+
+	batch->resolve |= mask;
+
+	OUT_PKT3(ring, CP_REG_RMW, 3);
+	OUT_RING(ring, REG_A3XX_RB_RENDER_CONTROL);
+	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH__MASK);
+	OUT_RING(ring, 0x2000 | /* XXX */
+			A3XX_RB_RENDER_CONTROL_ALPHA_TEST_FUNC(FUNC_NEVER));
+
+	if (mask & GL_DEPTH_BUFFER_BIT) {
+		OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
+		OUT_RING(ring, A3XX_RB_DEPTH_CONTROL_Z_WRITE_ENABLE |
+				A3XX_RB_DEPTH_CONTROL_Z_ENABLE |
+				A3XX_RB_DEPTH_CONTROL_ZFUNC(FUNC_ALWAYS));
+
+		OUT_PKT0(ring, REG_A3XX_GRAS_CL_VPORT_ZOFFSET, 2);
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZOFFSET(0.0));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZSCALE(state->clear.depth));
+	}
+
+	if (mask & GL_STENCIL_BUFFER_BIT) {
+		OUT_PKT0(ring, REG_A3XX_RB_STENCILREFMASK, 1);
+		OUT_RING(ring, A3XX_RB_STENCILREFMASK_STENCILREF(state->clear.stencil) |
+				A3XX_RB_STENCILREFMASK_STENCILMASK(state->clear.stencil) |
+				A3XX_RB_STENCILREFMASK_STENCILWRITEMASK(0xff));
+
+		OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
+		OUT_RING(ring, A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE |
+				A3XX_RB_STENCIL_CONTROL_FUNC(FUNC_ALWAYS) |
+				A3XX_RB_STENCIL_CONTROL_FAIL(STENCIL_KEEP) |
+				A3XX_RB_STENCIL_CONTROL_ZPASS(STENCIL_REPLACE) |
+				A3XX_RB_STENCIL_CONTROL_ZFAIL(STENCIL_KEEP) |
+				A3XX_RB_STENCIL_CONTROL_FUNC_BF(FUNC_NEVER) |
+				A3XX_RB_STENCIL_CONTROL_FAIL_BF(STENCIL_KEEP) |
+				A3XX_RB_STENCIL_CONTROL_ZPASS_BF(STENCIL_KEEP) |
+				A3XX_RB_STENCIL_CONTROL_ZFAIL_BF(STENCIL_KEEP));
+	}
+
+	for (i = 0; i < 4; i++) {
+		OUT_PKT0(ring, REG_A3XX_RB_MRT_CONTROL(i), 1);
+		OUT_RING(ring, A3XX_RB_MRT_CONTROL_ROP_CODE(ROP_COPY) |
+				A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS) |
+				A3XX_RB_MRT_CONTROL_COMPONENT_ENABLE(
+						(mask & GL_COLOR_BUFFER_BIT) ? 0xf : 0));
+
+		OUT_PKT0(ring, REG_A3XX_RB_MRT_BLEND_CONTROL(i), 1);
+		OUT_RING(ring, A3XX_RB_MRT_BLEND_CONTROL_RGB_SRC_FACTOR(FACTOR_ONE) |
+				A3XX_RB_MRT_BLEND_CONTROL_RGB_BLEND_OPCODE(BLEND_DST_PLUS_SRC) |
+				A3XX_RB_MRT_BLEND_CONTROL_RGB_DEST_FACTOR(FACTOR_ZERO) |
+				A3XX_RB_MRT_BLEND_CONTROL_ALPHA_SRC_FACTOR(FACTOR_ONE) |
+				A3XX_RB_MRT_BLEND_CONTROL_ALPHA_BLEND_OPCODE(BLEND_DST_PLUS_SRC) |
+				A3XX_RB_MRT_BLEND_CONTROL_ALPHA_DEST_FACTOR(FACTOR_ZERO) |
+				A3XX_RB_MRT_BLEND_CONTROL_CLAMP_ENABLE);
+	}
+
+	fd_program_emit_state(state->solid_program, FD_PROGRAM_ALL, 0,
+			&state->solid_uniforms, &state->solid_attributes,
+			NULL, ring);
+
+	/* clears are not in the binning pass, so must ignore the
+	 * visibility stream:
+	 */
+	emit_draw_indx(ring, DI_PT_RECTLIST, INDEX_SIZE_IGN, 2, NULL, 0, 0,
+			IGNORE_VISIBILITY);
+
+	/* the clear has clobbered pretty much everything: */
+	state->dirty_state = FD_DIRTY_ALL;
+
+	return 0;
+}
+
+/* the current contents of the buffers in mask are no longer needed, so
+ * they don't have to be resolved back to memory (unless they are
+ * cleared or drawn to again before the flush):
+ */
+int fd_invalidate(struct fd_state *state, GLbitfield mask)
+{
+	struct fd_batch *batch = state->batch;
+
+	/* after fd_make_current() the batch is only looked up by the next
+	 * clear or draw.  If there is none, nothing has been rendered to
+	 * the render target since the last flush, so nothing to skip:
+	 */
+	if (!batch)
+		batch = find_batch(state);
+	if (batch)
+		batch->resolve &= ~mask;
+
+	return 0;
+}
+
+int fd_cull(struct fd_state *state, GLenum mode)
+{
+	state->cull_mode = mode;
+	return 0;
+}
+
+int fd_depth_func(struct fd_state *state, GLenum depth_func)
+{
+	state->rb_depth_control &= ~A3XX_RB_DEPTH_CONTROL_ZFUNC__MASK;
 	state->rb_depth_control |= A3XX_RB_DEPTH_CONTROL_ZFUNC(g2a(depth_func));
+	state->dirty_state |= FD_DIRTY_ZSA;
 	return 0;
 }
 
 int fd_enable(struct fd_state *state, GLenum cap)
 {
+	int i;
+
 	/* note: some of this code makes assumptions that mode/func/etc is
 	 * set before enabling, and that the previous state was disabled.
 	 * But this isn't really intended to be a robust GL implementation,
@@ -682,23 +1425,31 @@ int fd_enable(struct fd_state *state, GLenum cap)
 				(state->cull_mode == GL_FRONT_AND_BACK)) {
 			state->gras_su_mode_control |= A3XX_GRAS_SU_MODE_CONTROL_CULL_BACK;
 		}
+		state->dirty_state |= FD_DIRTY_RASTER;
 		return 0;
 	case GL_POLYGON_OFFSET_FILL:
 		state->gras_su_mode_control |= A3XX_GRAS_SU_MODE_CONTROL_POLY_OFFSET;
+		state->dirty_state |= FD_DIRTY_RASTER;
 		return 0;
 	case GL_BLEND:
-		state->rb_mrt[0].control |= (A3XX_RB_MRT_CONTROL_BLEND | A3XX_RB_MRT_CONTROL_BLEND2);
+		for (i = 0; i < ARRAY_SIZE(state->rb_mrt); i++)
+			state->rb_mrt[i].control |= (A3XX_RB_MRT_CONTROL_BLEND | A3XX_RB_MRT_CONTROL_BLEND2);
+		state->dirty_state |= FD_DIRTY_BLEND;
 		return 0;
 	case GL_DEPTH_TEST:
 		state->rb_depth_control |= (A3XX_RB_DEPTH_CONTROL_Z_ENABLE |
 				A3XX_RB_DEPTH_CONTROL_Z_TEST_ENABLE);
+		state->dirty_state |= FD_DIRTY_ZSA;
 		return 0;
 	case GL_STENCIL_TEST:
 		state->rb_stencil_control |= (A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE |
 				A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE_BF);
+		state->dirty_state |= FD_DIRTY_ZSA;
 		return 0;
 	case GL_DITHER:
-		state->rb_mrt[0].control |= A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS);
+		for (i = 0; i < ARRAY_SIZE(state->rb_mrt); i++)
+			state->rb_mrt[i].control |= A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS);
+		state->dirty_state |= FD_DIRTY_BLEND;
 		return 0;
 	default:
 		ERROR_MSG("unsupported cap: 0x%04x", cap);
@@ -708,27 +1459,37 @@ int fd_enable(struct fd_state *state, GLenum cap)
 
 int fd_disable(struct fd_state *state, GLenum cap)
 {
+	int i;
+
 	switch (cap) {
 	case GL_CULL_FACE:
 		state->gras_su_mode_control &=
 			~(A3XX_GRAS_SU_MODE_CONTROL_CULL_FRONT | A3XX_GRAS_SU_MODE_CONTROL_CULL_BACK);
+		state->dirty_state |= FD_DIRTY_RASTER;
 		return 0;
 	case GL_POLYGON_OFFSET_FILL:
 		state->gras_su_mode_control &= ~A3XX_GRAS_SU_MODE_CONTROL_POLY_OFFSET;
+		state->dirty_state |= FD_DIRTY_RASTER;
 		return 0;
 	case GL_BLEND:
-		state->rb_mrt[0].control &= ~(A3XX_RB_MRT_CONTROL_BLEND | A3XX_RB_MRT_CONTROL_BLEND2);
+		for (i = 0; i < ARRAY_SIZE(state->rb_mrt); i++)
+			state->rb_mrt[i].control &= ~(A3XX_RB_MRT_CONTROL_BLEND | A3XX_RB_MRT_CONTROL_BLEND2);
+		state->dirty_state |= FD_DIRTY_BLEND;
 		return 0;
 	case GL_DEPTH_TEST:
 		state->rb_depth_control &= ~(A3XX_RB_DEPTH_CONTROL_Z_ENABLE |
 				A3XX_RB_DEPTH_CONTROL_Z_TEST_ENABLE);
+		state->dirty_state |= FD_DIRTY_ZSA;
 		return 0;
 	case GL_STENCIL_TEST:
 		state->rb_stencil_control &= ~(A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE |
 				A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE_BF);
+		state->dirty_state |= FD_DIRTY_ZSA;
 		return 0;
 	case GL_DITHER:
-		state->rb_mrt[0].control &= ~A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS);
+		for (i = 0; i < ARRAY_SIZE(state->rb_mrt); i++)
+			state->rb_mrt[i].control &= ~A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS);
+		state->dirty_state |= FD_DIRTY_BLEND;
 		return 0;
 	default:
 		ERROR_MSG("unsupported cap: 0x%04x", cap);
@@ -739,6 +1500,7 @@ int fd_disable(struct fd_state *state, GLenum cap)
 int fd_blend_func(struct fd_state *state, GLenum sfactor, GLenum dfactor)
 {
 	uint32_t bc = 0;
+	int i;
 
 	switch (sfactor) {
 	case GL_ZERO:
@@ -832,7 +1594,9 @@ int fd_blend_func(struct fd_state *state, GLenum sfactor, GLenum dfactor)
 		return -1;
 	}
 
-	state->rb_mrt[0].blendcontrol = bc;
+	for (i = 0; i < ARRAY_SIZE(state->rb_mrt); i++)
+		state->rb_mrt[i].blendcontrol = bc;
+	state->dirty_state |= FD_DIRTY_BLEND;
 
 	return 0;
 }
@@ -852,6 +1616,7 @@ int fd_stencil_func(struct fd_state *state, GLenum func,
 	state->rb_stencil_control |=
 			A3XX_RB_STENCIL_CONTROL_FUNC(g2a(func)) |
 			A3XX_RB_STENCIL_CONTROL_FUNC_BF(g2a(func));
+	state->dirty_state |= FD_DIRTY_ZSA;
 	return 0;
 }
 
@@ -910,6 +1675,7 @@ int fd_stencil_op(struct fd_state *state, GLenum sfail,
 			A3XX_RB_STENCIL_CONTROL_FAIL_BF(rbsfail) |
 			A3XX_RB_STENCIL_CONTROL_ZPASS_BF(rbzpass) |
 			A3XX_RB_STENCIL_CONTROL_ZFAIL_BF(rbzfail);
+	state->dirty_state |= FD_DIRTY_ZSA;
 	return 0;
 }
 
@@ -917,6 +1683,7 @@ int fd_stencil_mask(struct fd_state *state, GLuint mask)
 {
 	state->rb_stencilrefmask &= ~A3XX_RB_STENCILREFMASK_STENCILWRITEMASK__MASK;
 	state->rb_stencilrefmask |= A3XX_RB_STENCILREFMASK_STENCILWRITEMASK(mask);
+	state->dirty_state |= FD_DIRTY_ZSA;
 	return 0;
 }
 
@@ -955,6 +1722,8 @@ static int set_clamp(enum a3xx_tex_clamp *clamp, GLint param)
 
 int fd_tex_param(struct fd_state *state, GLenum name, GLint param)
 {
+	state->dirty_state |= FD_DIRTY_TEX;
+
 	switch (name) {
 	default:
 	case GL_TEXTURE_MAG_FILTER:
@@ -970,51 +1739,41 @@ int fd_tex_param(struct fd_state *state, GLenum name, GLint param)
 	}
 }
 
-static void emit_textures(struct fd_state *state)
+/* bake the sampler and texture state, which unlike the mipaddrs does
+ * not need relocs:
+ */
+static void emit_tex_state(struct fd_ringbuffer *ring, struct fd_tex_key *key,
+		int dst_off)
 {
-	struct fd_ringbuffer *ring = state->ring;
-	struct ir3_sampler **samplers;
-	int n, samplers_count;
-
-	/* this dst_off should align w/ values in TPL1_TP_FS_TEX_OFFSET:
-	 */
-	int dst_off = 16;
-
-	samplers = fd_program_samplers(state->program,
-			FD_SHADER_FRAGMENT, &samplers_count);
-
-	if (!samplers_count)
-		return;
+	int n;
 
 	/* emit sampler state: */
-	OUT_PKT3(ring, CP_LOAD_STATE, 2 + (2 * samplers_count));
+	OUT_PKT3(ring, CP_LOAD_STATE, 2 + (2 * key->samplers_count));
 	OUT_RING(ring, CP_LOAD_STATE_0_DST_OFF(dst_off) |
 			CP_LOAD_STATE_0_STATE_SRC(SS_DIRECT) |
 			CP_LOAD_STATE_0_STATE_BLOCK(SB_FRAG_TEX) |
-			CP_LOAD_STATE_0_NUM_UNIT(samplers_count));
+			CP_LOAD_STATE_0_NUM_UNIT(key->samplers_count));
 	OUT_RING(ring, CP_LOAD_STATE_1_STATE_TYPE(ST_SHADER) |
 			CP_LOAD_STATE_1_EXT_SRC_ADDR(0));
-	for (n = 0; n < samplers_count; n++) {
-		OUT_RING(ring, A3XX_TEX_SAMP_0_XY_MAG(state->textures.mag_filter) |
-				A3XX_TEX_SAMP_0_XY_MIN(state->textures.min_filter) |
-				A3XX_TEX_SAMP_0_WRAP_S(state->textures.clamp_s) |
-				A3XX_TEX_SAMP_0_WRAP_T(state->textures.clamp_t) |
+	for (n = 0; n < key->samplers_count; n++) {
+		OUT_RING(ring, A3XX_TEX_SAMP_0_XY_MAG(key->mag_filter) |
+				A3XX_TEX_SAMP_0_XY_MIN(key->min_filter) |
+				A3XX_TEX_SAMP_0_WRAP_S(key->clamp_s) |
+				A3XX_TEX_SAMP_0_WRAP_T(key->clamp_t) |
 				A3XX_TEX_SAMP_0_WRAP_R(A3XX_TEX_REPEAT));
 		OUT_RING(ring, 0x00000000);
 	}
 
 	/* emit texture state: */
-	OUT_PKT3(ring, CP_LOAD_STATE, 2 + (4 * samplers_count));
+	OUT_PKT3(ring, CP_LOAD_STATE, 2 + (4 * key->samplers_count));
 	OUT_RING(ring, CP_LOAD_STATE_0_DST_OFF(dst_off) |
 			CP_LOAD_STATE_0_STATE_SRC(SS_DIRECT) |
 			CP_LOAD_STATE_0_STATE_BLOCK(SB_FRAG_TEX) |
-			CP_LOAD_STATE_0_NUM_UNIT(samplers_count));
+			CP_LOAD_STATE_0_NUM_UNIT(key->samplers_count));
 	OUT_RING(ring, CP_LOAD_STATE_1_STATE_TYPE(ST_CONSTANTS) |
 			CP_LOAD_STATE_1_EXT_SRC_ADDR(0));
-	for (n = 0; n < samplers_count; n++) {
-		struct fd_param *p = find_param(&state->textures.params,
-				samplers[n]->name);
-		struct fd_surface *tex = p->tex;
+	for (n = 0; n < key->samplers_count; n++) {
+		struct fd_surface *tex = key->tex[n];
 		OUT_RING(ring, 0x00c00000 | // XXX
 				A3XX_TEX_CONST_0_SWIZ_X(A3XX_TEX_X) |
 				A3XX_TEX_CONST_0_SWIZ_Y(A3XX_TEX_Y) |
@@ -1028,6 +1787,61 @@ static void emit_textures(struct fd_state *state)
 				A3XX_TEX_CONST_2_PITCH(tex->pitch * tex->cpp));
 		OUT_RING(ring, 0x00000000);
 	}
+}
+
+static struct fd_stateobj * get_tex_state(struct fd_state *state,
+		struct ir3_sampler **samplers, int samplers_count, int dst_off)
+{
+	struct fd_tex_key key;
+	unsigned i;
+	int n;
+
+	assert(samplers_count <= ARRAY_SIZE(key.tex));
+
+	memset(&key, 0, sizeof(key));
+	key.min_filter = state->textures.min_filter;
+	key.mag_filter = state->textures.mag_filter;
+	key.clamp_s = state->textures.clamp_s;
+	key.clamp_t = state->textures.clamp_t;
+	key.samplers_count = samplers_count;
+	for (n = 0; n < samplers_count; n++) {
+		struct fd_param *p = find_param(&state->textures.params,
+				samplers[n]->name);
+		key.tex[n] = p->tex;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(state->textures.cache); i++) {
+		if (state->textures.cache[i].obj.sizedwords &&
+				!memcmp(&state->textures.cache[i].key, &key, sizeof(key)))
+			return &state->textures.cache[i].obj;
+	}
+
+	i = state->textures.cache_next++ % ARRAY_SIZE(state->textures.cache);
+	state->textures.cache[i].key = key;
+	emit_tex_state(fd_stateobj_begin(state, &state->textures.cache[i].obj,
+			0x1000), &key, dst_off);
+	fd_stateobj_end(&state->textures.cache[i].obj);
+
+	return &state->textures.cache[i].obj;
+}
+
+static void emit_textures(struct fd_state *state, struct fd_ringbuffer *ring)
+{
+	struct ir3_sampler **samplers;
+	int n, samplers_count;
+
+	/* this dst_off should align w/ values in TPL1_TP_FS_TEX_OFFSET:
+	 */
+	int dst_off = 16;
+
+	samplers = fd_program_samplers(state->program,
+			FD_SHADER_FRAGMENT, &samplers_count);
+
+	if (!samplers_count)
+		return;
+
+	OUT_STATEOBJ(ring, get_tex_state(state, samplers,
+			samplers_count, dst_off));
 
 	/* emit mipaddrs: */
 	OUT_PKT3(ring, CP_LOAD_STATE, 2 + (14 * samplers_count));
@@ -1120,7 +1934,8 @@ static void emit_query(struct fd_state *state, bool flush)
 	OUT_PKT0(ring, REG_A3XX_RB_SAMPLE_COUNT_CONTROL, 1);
 	OUT_RING(ring, A3XX_RB_SAMPLE_COUNT_CONTROL_COPY);
 
-	emit_draw_indx(ring, DI_PT_POINTLIST_A2XX, INDEX_SIZE_IGN, 0, NULL, 0, 0);
+	emit_draw_indx(ring, DI_PT_POINTLIST_A2XX, INDEX_SIZE_IGN, 0, NULL, 0, 0,
+			IGNORE_VISIBILITY);
 
 	OUT_PKT3(ring, CP_EVENT_WRITE, 1);
 	OUT_RING(ring, ZPASS_DONE);
@@ -1138,47 +1953,27 @@ static void emit_query(struct fd_state *state, bool flush)
 	}
 }
 
-static int draw_impl(struct fd_state *state, GLenum mode,
-		GLint first, GLsizei count, GLenum type, const GLvoid *indices)
+/* emit the dirty state groups for a draw, to either the draw cmds or the
+ * binning pass draw cmds:
+ */
+static void emit_state(struct fd_state *state, struct fd_ringbuffer *ring,
+		uint32_t dirty, uint32_t first)
 {
-	struct fd_ringbuffer *ring = state->ring;
-	enum pc_di_index_size idx_type = INDEX_SIZE_IGN;
-	struct fd_bo *indx_bo = NULL;
-	uint32_t idx_size, stride_in_vpc;
-
-	if (indices) {
-		switch (type) {
-		case GL_UNSIGNED_BYTE:
-			idx_type = INDEX_SIZE_8_BIT;
-			idx_size = count;
-			break;
-		case GL_UNSIGNED_SHORT:
-			idx_type = INDEX_SIZE_16_BIT;
-			idx_size = 2 * count;
-			break;
-		case GL_UNSIGNED_INT:
-			idx_type = INDEX_SIZE_32_BIT;
-			idx_size = 4 * count;
-			break;
-		default:
-			ERROR_MSG("invalid type");
-			return -1;
-		}
-
-		indx_bo = fd_bo_new(state->dev, idx_size,
-				DRM_FREEDRENO_GEM_TYPE_KMEM);
-		memcpy(fd_bo_map(indx_bo), indices, idx_size);
-
-	} else {
-		idx_type = INDEX_SIZE_IGN;
-		idx_size = 0;
+	uint32_t stride_in_vpc, mask = 0;
+
+	if (dirty & FD_DIRTY_PROG)
+		mask |= FD_PROGRAM_SHADER;
+	if (dirty & FD_DIRTY_VTX)
+		mask |= FD_PROGRAM_VTX;
+	if (dirty & FD_DIRTY_CONST)
+		mask |= FD_PROGRAM_CONST;
+
+	if (mask) {
+		fd_program_emit_state(state->program, mask, first,
+				&state->uniforms, &state->attributes,
+				&state->bufs, ring);
 	}
 
-	state->dirty = true;
-
-	fd_program_emit_state(state->program, first, &state->uniforms,
-			&state->attributes, &state->bufs, ring);
-
 	/*
 	 * +----------- max outloc
 	 * |    +------ next outloc (max outloc + size of that varying.. ie,
@@ -1222,64 +2017,183 @@ static int draw_impl(struct fd_state *state, GLenum mode,
 	 * driver never uses value of 1, so possibly 0 (no varying), or minimum
 	 * of 2..
 	 */
-	stride_in_vpc = ALIGN(fd_program_outloc(state->program) - 8, 4) / 4;
-	if (stride_in_vpc > 0)
-		stride_in_vpc = max(stride_in_vpc, 2);
-	OUT_PKT0(ring, REG_A3XX_PC_PRIM_VTX_CNTL, 1);
-	OUT_RING(ring, A3XX_PC_PRIM_VTX_CNTL_STRIDE_IN_VPC(stride_in_vpc) |
-			state->pc_prim_vtx_cntl);
+	if (dirty & FD_DIRTY_RASTER) {
+		stride_in_vpc = ALIGN(fd_program_outloc(state->program) - 8, 4) / 4;
+		if (stride_in_vpc > 0)
+			stride_in_vpc = max(stride_in_vpc, 2);
+		OUT_PKT0(ring, REG_A3XX_PC_PRIM_VTX_CNTL, 1);
+		OUT_RING(ring, A3XX_PC_PRIM_VTX_CNTL_STRIDE_IN_VPC(stride_in_vpc) |
+				state->pc_prim_vtx_cntl);
+
+		OUT_PKT0(ring, REG_A3XX_GRAS_SU_MODE_CONTROL, 1);
+		OUT_RING(ring, state->gras_su_mode_control);
+	}
 
-	OUT_PKT0(ring, REG_A3XX_GRAS_SU_MODE_CONTROL, 1);
-	OUT_RING(ring, state->gras_su_mode_control);
+	if (dirty & FD_DIRTY_ZSA) {
+		OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
+		OUT_RING(ring, state->rb_depth_control);
+	}
 
-	OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
-	OUT_RING(ring, state->rb_depth_control);
+	if (dirty & FD_DIRTY_RENDER) {
+		OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
+		OUT_RING(ring, 0x00000000);
 
-	OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
-	OUT_RING(ring, 0x00000000);
+		OUT_PKT3(ring, CP_REG_RMW, 3);
+		OUT_RING(ring, REG_A3XX_RB_RENDER_CONTROL);
+		OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH__MASK);
+		OUT_RING(ring, A3XX_RB_RENDER_CONTROL_ENABLE_GMEM |
+				A3XX_RB_RENDER_CONTROL_FACENESS |
+				A3XX_RB_RENDER_CONTROL_XCOORD |
+				A3XX_RB_RENDER_CONTROL_YCOORD |
+				A3XX_RB_RENDER_CONTROL_ZCOORD |
+				A3XX_RB_RENDER_CONTROL_WCOORD |
+				state->rb_render_control);
+	}
 
-	OUT_PKT3(ring, CP_REG_RMW, 3);
-	OUT_RING(ring, REG_A3XX_RB_RENDER_CONTROL);
-	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH__MASK);
-	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_ENABLE_GMEM |
-			A3XX_RB_RENDER_CONTROL_FACENESS |
-			A3XX_RB_RENDER_CONTROL_XCOORD |
-			A3XX_RB_RENDER_CONTROL_YCOORD |
-			A3XX_RB_RENDER_CONTROL_ZCOORD |
-			A3XX_RB_RENDER_CONTROL_WCOORD |
-			state->rb_render_control);
+	if (dirty & FD_DIRTY_VIEWPORT) {
+		OUT_PKT0(ring, REG_A3XX_GRAS_CL_CLIP_CNTL, 1);
+		OUT_RING(ring, A3XX_GRAS_CL_CLIP_CNTL_IJ_PERSP_CENTER |
+				A3XX_GRAS_CL_CLIP_CNTL_ZCOORD |
+				A3XX_GRAS_CL_CLIP_CNTL_WCOORD);
+
+		OUT_PKT0(ring, REG_A3XX_GRAS_CL_VPORT_XOFFSET, 6);
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_XOFFSET(state->viewport.offset.x));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_XSCALE(state->viewport.scale.x));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_YOFFSET(state->viewport.offset.y));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_YSCALE(state->viewport.scale.y));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZOFFSET(state->viewport.offset.z));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZSCALE(state->viewport.scale.z));
+	}
 
-	OUT_PKT0(ring, REG_A3XX_GRAS_CL_CLIP_CNTL, 1);
-	OUT_RING(ring, A3XX_GRAS_CL_CLIP_CNTL_IJ_PERSP_CENTER |
-			A3XX_GRAS_CL_CLIP_CNTL_ZCOORD |
-			A3XX_GRAS_CL_CLIP_CNTL_WCOORD);
+	if (dirty & FD_DIRTY_ZSA) {
+		OUT_PKT0(ring, REG_A3XX_RB_STENCILREFMASK, 2);
+		OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK */
+		OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK_BF */
 
-	OUT_PKT0(ring, REG_A3XX_GRAS_CL_VPORT_XOFFSET, 6);
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_XOFFSET(state->viewport.offset.x));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_XSCALE(state->viewport.scale.x));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_YOFFSET(state->viewport.offset.y));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_YSCALE(state->viewport.scale.y));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZOFFSET(state->viewport.offset.z));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZSCALE(state->viewport.scale.z));
+		OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
+		OUT_RING(ring, state->rb_stencil_control);
+	}
 
-	OUT_PKT0(ring, REG_A3XX_RB_STENCILREFMASK, 2);
-	OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK */
-	OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK_BF */
+	if (dirty & FD_DIRTY_TEX)
+		emit_textures(state, ring);
 
-	OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
-	OUT_RING(ring, state->rb_stencil_control);
+	if (dirty & FD_DIRTY_BLEND)
+		emit_mrt(state, ring);
+}
+
+/* the buffers that a draw with the current state writes: */
+static GLbitfield draw_buffers(struct fd_state *state)
+{
+	GLbitfield buffers = 0;
+	int i;
+
+	for (i = 0; i < state->render_target.nr_cbufs; i++)
+		if (state->rb_mrt[i].control & A3XX_RB_MRT_CONTROL_COMPONENT_ENABLE__MASK)
+			buffers |= GL_COLOR_BUFFER_BIT;
+
+	/* depth/stencil are tracked for completeness, but nothing reads
+	 * them back since they are never resolved to memory:
+	 */
+	if ((state->rb_depth_control & A3XX_RB_DEPTH_CONTROL_Z_ENABLE) &&
+			(state->rb_depth_control & A3XX_RB_DEPTH_CONTROL_Z_WRITE_ENABLE))
+		buffers |= GL_DEPTH_BUFFER_BIT;
+
+	if ((state->rb_stencil_control & A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE) &&
+			(state->rb_stencilrefmask & A3XX_RB_STENCILREFMASK_STENCILWRITEMASK__MASK))
+		buffers |= GL_STENCIL_BUFFER_BIT;
+
+	return buffers;
+}
+
+static int draw_impl(struct fd_state *state, GLenum mode,
+		GLint first, GLsizei count, GLenum type, const GLvoid *indices)
+{
+	enum pc_di_primtype primtype = mode2prim(mode);
+	enum pc_di_index_size idx_type = INDEX_SIZE_IGN;
+	struct fd_batch *batch = get_batch(state);
+	struct fd_bo *indx_bo = NULL;
+	uint32_t idx_offset = 0, idx_size, dirty;
+	void *ptr;
+
+	if (!batch)
+		return -1;
+
+	/* this can flush batches, so must happen before anything is
+	 * uploaded for the draw:
+	 */
+	if ((state->dirty_state & (FD_DIRTY_PROG | FD_DIRTY_TEX)) &&
+			batch_reads(state)) {
+		/* the new batch has no other batch depending on it yet,
+		 * so this can't flush again:
+		 */
+		batch = get_batch(state);
+		batch_reads(state);
+	}
 
-	emit_textures(state);
+	if (indices) {
+		switch (type) {
+		case GL_UNSIGNED_BYTE:
+			idx_type = INDEX_SIZE_8_BIT;
+			idx_size = count;
+			break;
+		case GL_UNSIGNED_SHORT:
+			idx_type = INDEX_SIZE_16_BIT;
+			idx_size = 2 * count;
+			break;
+		case GL_UNSIGNED_INT:
+			idx_type = INDEX_SIZE_32_BIT;
+			idx_size = 4 * count;
+			break;
+		default:
+			ERROR_MSG("invalid type");
+			return -1;
+		}
 
-	emit_mrt(state, ring, state->render_target.surface);
+		ptr = fd_upload(state, idx_size, &indx_bo, &idx_offset);
+		if (!ptr)
+			return -1;
+		memcpy(ptr, indices, idx_size);
+
+	} else {
+		idx_type = INDEX_SIZE_IGN;
+		idx_size = 0;
+	}
+
+	batch->resolve |= draw_buffers(state);
+
+	dirty = state->dirty_state;
+
+	/* the vertex fetch reloc's are offset by first vertex: */
+	if (first != state->vtx_first)
+		dirty |= FD_DIRTY_VTX;
+
+	/* const/vtx layout, samplers and stride_in_vpc all come from
+	 * the program:
+	 */
+	if (dirty & FD_DIRTY_PROG)
+		dirty |= FD_DIRTY_CONST | FD_DIRTY_VTX |
+				FD_DIRTY_TEX | FD_DIRTY_RASTER;
+
+	emit_state(state, state->ring, dirty, first);
+
+	if (batch->binning) {
+		emit_draw_indx(state->ring, primtype, idx_type, count,
+				indx_bo, idx_offset, idx_size, USE_VISIBILITY);
+
+		emit_state(state, state->binning_ring,
+				dirty & FD_DIRTY_BINNING, first);
+		emit_draw_indx(state->binning_ring, primtype, idx_type, count,
+				indx_bo, idx_offset, idx_size, IGNORE_VISIBILITY);
+	} else {
+		emit_draw_indx(state->ring, primtype, idx_type, count,
+				indx_bo, idx_offset, idx_size, IGNORE_VISIBILITY);
+	}
 
-	emit_draw_indx(ring, mode2prim(mode), idx_type, count,
-			indx_bo, 0, idx_size);
 	if (state->query.active)
 		emit_query(state, false);
 
-	if (indx_bo)
-		fd_bo_del(indx_bo);
+	state->dirty_state = 0;
+	state->vtx_first = first;
 
 	return 0;
 }
@@ -1299,12 +2213,18 @@ int fd_draw_arrays(struct fd_state *state, GLenum mode,
 int fd_run_compute(struct fd_state *state, uint32_t workdim,
 		uint32_t *globaloff, uint32_t *globalsize, uint32_t *localsize)
 {
-	struct fd_ringbuffer *ring = state->ring;
+	struct fd_ringbuffer *ring;
 	uint32_t local[3] = {1, 1, 1};
 	uint32_t global[3] = {1, 1, 1};
 	uint32_t off[3] = {0, 0, 0};
 	uint32_t i;
 
+	/* the kernel may read what has been rendered so far, and its cmds
+	 * are submitted directly rather than from a batch:
+	 */
+	fd_flush(state);
+	ring = state->ring;
+
 	for (i = 0; i < workdim; i++) {
 		if (globaloff)
 			off[i] = globaloff[i];
@@ -1430,17 +2350,17 @@ int fd_run_compute(struct fd_state *state, uint32_t workdim,
 	OUT_RING(ring, 0xfffcffff);
 	OUT_RING(ring, 0x00000000);
 
+	/* note: results are not available until fd_finish(): */
 	fd_ringbuffer_flush(ring);
+	fence_ring(state);
+	next_ring(state);
 
-	// TODO maybe return fence/timestamp and let app explicitly wait
-	// for timestamp, so it could better pipeline things?  Probably
-	// need to be a bit more sophisticated with ringbuffer rollover/
-	// reset..
+	state->dirty_state = FD_DIRTY_ALL;
 
-	fd_pipe_wait(state->pipe, fd_ringbuffer_timestamp(ring));
-	fd_ringbuffer_reset(state->ring);
-
-	fd_ringmarker_mark(state->draw_start);
+	/* the kernel clobbered RB_MODE_CONTROL and friends, so the next
+	 * batch can't skip the render target setup:
+	 */
+	memset(&state->setup, 0, sizeof(state->setup));
 
 	return 0;
 }
@@ -1455,10 +2375,10 @@ int fd_swap_buffers(struct fd_state *state)
 	return 0;
 }
 
-static void flush_setup(struct fd_state *state, struct fd_ringbuffer *ring)
+static void flush_setup(struct fd_state *state, struct fd_batch *batch,
+		struct fd_ringbuffer *ring)
 {
-	struct fd_surface *surface = state->render_target.surface;
-	uint32_t bin_w = state->render_target.bin_w;
+	uint32_t bin_w = batch->bin_w;
 	int i;
 
 	OUT_PKT3(ring, CP_REG_RMW, 3);
@@ -1467,108 +2387,163 @@ static void flush_setup(struct fd_state *state, struct fd_ringbuffer *ring)
 	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH(bin_w));
 
 	for (i = 0; i < 4; i++) {
-		enum a3xx_color_fmt format = (i == 0) ? surface->color : 0;
-		uint32_t pitch = (i == 0) ? (bin_w * surface->cpp) : 0;
+		struct fd_surface *cbuf = (i < batch->nr_cbufs) ?
+				batch->cbufs[i] : NULL;
+		enum a3xx_color_fmt format = cbuf ? cbuf->color : 0;
+		uint32_t pitch = cbuf ? (bin_w * cbuf->cpp) : 0;
+		uint32_t base = cbuf ? batch->cbuf_base[i] : 0;
 
 		OUT_PKT0(ring, REG_A3XX_RB_MRT_BUF_INFO(i), 2);
 		OUT_RING(ring, A3XX_RB_MRT_BUF_INFO_COLOR_FORMAT(format) |
 				A3XX_RB_MRT_BUF_INFO_COLOR_TILE_MODE(TILE_32X32) |
 				A3XX_RB_MRT_BUF_INFO_COLOR_BUF_PITCH(pitch));
-		OUT_RING(ring, A3XX_RB_MRT_BUF_BASE_COLOR_BUF_BASE(0));
+		OUT_RING(ring, A3XX_RB_MRT_BUF_BASE_COLOR_BUF_BASE(base));
 
 		OUT_PKT0(ring, REG_A3XX_SP_FS_IMAGE_OUTPUT_REG(i), 1);
 		OUT_RING(ring, A3XX_SP_FS_IMAGE_OUTPUT_REG_MRTFORMAT(format));
 	}
 }
 
-int fd_flush(struct fd_state *state)
+/* find the VSC pipe, and the slot within the pipe, of bin x,y: */
+static int bin_pipe(struct fd_batch *batch, uint32_t x, uint32_t y,
+		uint32_t *n)
 {
-	struct fd_surface *surface = state->render_target.surface;
-	struct fd_ringbuffer *ring = state->ring;
-	uint32_t i, yoff = 0;
+	int i;
 
-	if (!state->dirty)
-		return 0;
+	for (i = 0; i < ARRAY_SIZE(batch->pipe); i++) {
+		uint32_t px = batch->pipe[i].x;
+		uint32_t py = batch->pipe[i].y;
 
-	if (state->query.bo) {
-		/* TODO support for > 1 tile: */
-		assert(state->render_target.nbins_x == 1);
-		assert(state->render_target.nbins_y == 1);
+		if ((x >= px) && (x < px + batch->pipe[i].w) &&
+				(y >= py) && (y < py + batch->pipe[i].h)) {
+			*n = ((y - py) * batch->pipe[i].w) + (x - px);
+			return i;
+		}
 	}
 
-	fd_ringmarker_mark(state->draw_end);
+	assert(0);
+	return -1;
+}
 
-	flush_setup(state, ring);
+/* run the binning pass draw cmds once over the whole render target, to
+ * generate the visibility streams for each VSC pipe:
+ */
+static void emit_binning_pass(struct fd_state *state, struct fd_batch *batch,
+		struct fd_ringbuffer *ring)
+{
+	struct fd_surface *surface = batch->cbufs[0];
+	uint32_t bin_w = batch->bin_w;
+	int i;
 
-	for (i = 0; i < state->render_target.nbins_y; i++) {
-		uint32_t j, xoff = 0;
-		uint32_t bin_h = state->render_target.bin_h;
+	OUT_PKT0(ring, REG_A3XX_VSC_BIN_CONTROL, 1);
+	OUT_RING(ring, A3XX_VSC_BIN_CONTROL_BINNING_ENABLE);
 
-		/* clip bin height: */
-		bin_h = min(bin_h, surface->height - yoff);
+	OUT_PKT0(ring, REG_A3XX_GRAS_SC_CONTROL, 1);
+	OUT_RING(ring, A3XX_GRAS_SC_CONTROL_RENDER_MODE(RB_TILING_PASS) |
+			A3XX_GRAS_SC_CONTROL_MSAA_SAMPLES(MSAA_ONE) |
+			A3XX_GRAS_SC_CONTROL_RASTER_MODE(0));
 
-		for (j = 0; j < state->render_target.nbins_x; j++) {
-			uint32_t bin_w = state->render_target.bin_w;
-			uint32_t x1, y1, x2, y2;
+	OUT_PKT0(ring, REG_A3XX_RB_FRAME_BUFFER_DIMENSION, 1);
+	OUT_RING(ring, A3XX_RB_FRAME_BUFFER_DIMENSION_WIDTH(surface->width) |
+			A3XX_RB_FRAME_BUFFER_DIMENSION_HEIGHT(surface->height));
 
-			/* clip bin width: */
-			bin_w = min(bin_w, surface->width - xoff);
+	OUT_PKT0(ring, REG_A3XX_RB_RENDER_CONTROL, 1);
+	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_ALPHA_TEST_FUNC(FUNC_NEVER) |
+			A3XX_RB_RENDER_CONTROL_DISABLE_COLOR_PIPE |
+			A3XX_RB_RENDER_CONTROL_BIN_WIDTH(bin_w));
 
-			x1 = xoff;
-			y1 = yoff;
-			x2 = xoff + bin_w - 1;
-			y2 = yoff + bin_h - 1;
+	/* setup scissor/offset for whole screen: */
+	OUT_PKT0(ring, REG_A3XX_RB_WINDOW_OFFSET, 1);
+	OUT_RING(ring, A3XX_RB_WINDOW_OFFSET_X(0) |
+			A3XX_RB_WINDOW_OFFSET_Y(0));
 
-			DEBUG_MSG("bin_h=%d, yoff=%d, bin_w=%d, xoff=%d",
-					bin_h, yoff, bin_w, xoff);
+	OUT_PKT0(ring, REG_A3XX_RB_LRZ_VSC_CONTROL, 1);
+	OUT_RING(ring, A3XX_RB_LRZ_VSC_CONTROL_BINNING_ENABLE);
 
-			OUT_PKT3(ring, CP_SET_BIN, 3);
-			OUT_RING(ring, 0x00000000);
-			OUT_RING(ring, CP_SET_BIN_1_X1(x1) | CP_SET_BIN_1_Y1(y1));
-			OUT_RING(ring, CP_SET_BIN_2_X2(x2) | CP_SET_BIN_2_Y2(y2));
+	OUT_PKT0(ring, REG_A3XX_GRAS_SC_WINDOW_SCISSOR_TL, 2);
+	OUT_RING(ring, A3XX_GRAS_SC_WINDOW_SCISSOR_TL_X(0) |
+			A3XX_GRAS_SC_WINDOW_SCISSOR_TL_Y(0));
+	OUT_RING(ring, A3XX_GRAS_SC_WINDOW_SCISSOR_BR_X(surface->width - 1) |
+			A3XX_GRAS_SC_WINDOW_SCISSOR_BR_Y(surface->height - 1));
 
-			/* setup scissor/offset for current tile: */
-			OUT_PKT0(ring, REG_A3XX_RB_WINDOW_OFFSET, 1);
-			OUT_RING(ring, A3XX_RB_WINDOW_OFFSET_X(xoff) |
-					A3XX_RB_WINDOW_OFFSET_Y(yoff));
+	OUT_PKT0(ring, REG_A3XX_GRAS_SC_SCREEN_SCISSOR_TL, 2);
+	OUT_RING(ring, A3XX_GRAS_SC_SCREEN_SCISSOR_TL_X(0) |
+			A3XX_GRAS_SC_SCREEN_SCISSOR_TL_Y(0));
+	OUT_RING(ring, A3XX_GRAS_SC_SCREEN_SCISSOR_BR_X(surface->width - 1) |
+			A3XX_GRAS_SC_SCREEN_SCISSOR_BR_Y(surface->height - 1));
 
-			OUT_PKT0(ring, REG_A3XX_GRAS_SC_WINDOW_SCISSOR_TL, 2);
-			OUT_RING(ring, A3XX_GRAS_SC_WINDOW_SCISSOR_TL_X(0) |
-					A3XX_GRAS_SC_WINDOW_SCISSOR_TL_Y(0));
-			OUT_RING(ring, A3XX_GRAS_SC_WINDOW_SCISSOR_BR_X(surface->width - 1) |
-					A3XX_GRAS_SC_WINDOW_SCISSOR_BR_Y(surface->height - 1));
+	OUT_PKT0(ring, REG_A3XX_RB_MODE_CONTROL, 1);
+	OUT_RING(ring, A3XX_RB_MODE_CONTROL_RENDER_MODE(RB_TILING_PASS) |
+			A3XX_RB_MODE_CONTROL_MARB_CACHE_SPLIT_MODE |
+			A3XX_RB_MODE_CONTROL_PACKER_TIMER_ENABLE);
 
-			OUT_PKT0(ring, REG_A3XX_GRAS_SC_SCREEN_SCISSOR_TL, 2);
-			OUT_RING(ring, A3XX_GRAS_SC_SCREEN_SCISSOR_TL_X(x1) |
-					A3XX_GRAS_SC_SCREEN_SCISSOR_TL_Y(y1));
-			OUT_RING(ring, A3XX_GRAS_SC_SCREEN_SCISSOR_BR_X(x2) |
-					A3XX_GRAS_SC_SCREEN_SCISSOR_BR_Y(y2));
+	for (i = 0; i < 4; i++) {
+		OUT_PKT0(ring, REG_A3XX_RB_MRT_CONTROL(i), 1);
+		OUT_RING(ring, A3XX_RB_MRT_CONTROL_ROP_CODE(ROP_CLEAR) |
+				A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_DISABLE) |
+				A3XX_RB_MRT_CONTROL_COMPONENT_ENABLE(0));
+	}
 
-			/* emit IB to drawcmds: */
-			OUT_IB  (ring, state->draw_start, state->draw_end);
+	OUT_PKT0(ring, REG_A3XX_PC_VSTREAM_CONTROL, 1);
+	OUT_RING(ring, A3XX_PC_VSTREAM_CONTROL_SIZE(1) |
+			A3XX_PC_VSTREAM_CONTROL_N(0));
 
-			/* emit gmem2mem to transfer tile back to system memory: */
-			emit_gmem2mem(state, ring, surface, xoff, yoff);
+	/* emit IB to binning drawcmds: */
+	OUT_IB  (ring, state->binning_start, state->binning_end);
 
-			OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
-			OUT_RING(ring, 0x00000000);
+	OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
+	OUT_RING(ring, 0x00000000);
 
-			xoff += bin_w;
-		}
+	/* and then put stuff back the way it was: */
 
-		yoff += bin_h;
-	}
+	OUT_PKT0(ring, REG_A3XX_VSC_BIN_CONTROL, 1);
+	OUT_RING(ring, 0x00000000);
 
-	fd_ringmarker_flush(state->draw_end);
-	fd_ringbuffer_flush(ring);
-	fd_pipe_wait(state->pipe, fd_ringbuffer_timestamp(ring));
-	fd_ringbuffer_reset(state->ring);
+	OUT_PKT0(ring, REG_A3XX_RB_LRZ_VSC_CONTROL, 1);
+	OUT_RING(ring, 0x00000000);
 
-	fd_ringmarker_mark(state->draw_start);
+	OUT_PKT0(ring, REG_A3XX_RB_MODE_CONTROL, 2);
+	OUT_RING(ring, A3XX_RB_MODE_CONTROL_RENDER_MODE(RB_RENDERING_PASS) |
+			A3XX_RB_MODE_CONTROL_MARB_CACHE_SPLIT_MODE);
+	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_ENABLE_GMEM |
+			A3XX_RB_RENDER_CONTROL_ALPHA_TEST_FUNC(FUNC_NEVER) |
+			A3XX_RB_RENDER_CONTROL_BIN_WIDTH(bin_w));
 
-	state->dirty = false;
+	OUT_PKT0(ring, REG_A3XX_GRAS_SC_CONTROL, 1);
+	OUT_RING(ring, A3XX_GRAS_SC_CONTROL_RENDER_MODE(RB_RENDERING_PASS) |
+			A3XX_GRAS_SC_CONTROL_MSAA_SAMPLES(MSAA_ONE) |
+			A3XX_GRAS_SC_CONTROL_RASTER_MODE(0));
 
-	return 0;
+	emit_mrt(state, ring);
+
+	OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
+	OUT_RING(ring, 0x00000000);
+}
+
+/* point the CP at the visibility stream for bin x,y, so the draw cmds
+ * skip the primitives not visible in the bin:
+ */
+static void emit_bin_data(struct fd_state *state, struct fd_batch *batch,
+		struct fd_ringbuffer *ring, uint32_t x, uint32_t y)
+{
+	uint32_t n;
+	int p = bin_pipe(batch, x, y, &n);
+
+	OUT_PKT3(ring, CP_EVENT_WRITE, 1);
+	OUT_RING(ring, HLSQ_FLUSH);
+
+	OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
+	OUT_RING(ring, 0x00000000);
+
+	OUT_PKT0(ring, REG_A3XX_PC_VSTREAM_CONTROL, 1);
+	OUT_RING(ring, A3XX_PC_VSTREAM_CONTROL_SIZE(batch->pipe[p].w *
+				batch->pipe[p].h) |
+			A3XX_PC_VSTREAM_CONTROL_N(n));
+
+	OUT_PKT3(ring, CP_SET_BIN_DATA, 2);
+	OUT_RELOC(ring, state->vsc_bo[p], 0, 0);       /* BIN_DATA_ADDR */
+	OUT_RELOC(ring, state->solid_const,            /* BIN_SIZE_ADDR */
+			VSC_SIZE_OFFSET + (p * 4), 0);
 }
 
 /* ************************************************************************* */
@@ -1613,10 +2588,37 @@ struct fd_surface * fd_surface_screen(struct fd_state *state,
 
 void fd_surface_del(struct fd_state *state, struct fd_surface *surface)
 {
+	uint32_t mask = 0;
+	unsigned i;
+	int n;
+
 	if (!surface)
 		return;
+
+	/* flush the batches still rendering to or sampling from it: */
+	for (i = 0; i < ARRAY_SIZE(state->batches); i++) {
+		struct fd_batch *batch = &state->batches[i];
+		if (batch->active &&
+				(has_surface(batch->cbufs, batch->nr_cbufs, surface) ||
+				has_surface(batch->reads, batch->nr_reads, surface)))
+			mask |= (1 << i);
+	}
+	flush_batches(state, mask);
+
+	if (has_surface(state->setup.cbufs, state->setup.nr_cbufs, surface))
+		memset(&state->setup, 0, sizeof(state->setup));
+
 	if (state->render_target.surface == surface)
 		state->render_target.surface = NULL;
+	for (i = 0; i < state->render_target.nr_cbufs; i++)
+		if (state->render_target.cbufs[i] == surface)
+			state->render_target.cbufs[i] = NULL;
+	for (i = 0; i < ARRAY_SIZE(state->textures.cache); i++) {
+		struct fd_tex_key *key = &state->textures.cache[i].key;
+		for (n = 0; n < key->samplers_count; n++)
+			if (key->tex[n] == surface)
+				state->textures.cache[i].obj.sizedwords = 0;
+	}
 	fd_bo_del(surface->bo);
 	free(surface);
 }
@@ -1634,54 +2636,6 @@ void fd_surface_upload(struct fd_surface *surface, const void *data)
 	}
 }
 
-static void attach_render_target(struct fd_state *state,
-		struct fd_surface *surface)
-{
-	uint32_t nbins_x = 1, nbins_y = 1;
-	uint32_t bin_w, bin_h;
-	uint32_t cpp = color2cpp[surface->color];
-	uint32_t gmem_size = state->gmemsize_bytes;
-	uint32_t max_width = 256;
-
-	if ((state->rb_depth_control & A3XX_RB_DEPTH_CONTROL_Z_ENABLE) |
-			(state->rb_stencil_control & A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE)) {
-		gmem_size /= 2;
-	}
-
-	state->render_target.surface = surface;
-
-	bin_w = ALIGN(surface->width, 32);
-	bin_h = ALIGN(surface->height, 32);
-
-	/* first, find a bin width that satisfies the maximum width
-	 * restrictions:
-	 */
-	while (bin_w > max_width) {
-		nbins_x++;
-		bin_w = ALIGN(surface->width / nbins_x, 32);
-	}
-
-	/* then find a bin height that satisfies the memory constraints:
-	 */
-	while ((bin_w * bin_h * cpp) > gmem_size) {
-		nbins_y++;
-		bin_h = ALIGN(surface->height / nbins_y, 32);
-	}
-
-	INFO_MSG("using %d bins of size %dx%d", nbins_x*nbins_y, bin_w, bin_h);
-
-//if we use hw binning, tile sizes (in multiple of 32) need to
-//fit in 5 bits.. for now don't care because we aren't using
-//that:
-//	assert(!(bin_h/32 & ~0x1f));
-//	assert(!(bin_w/32 & ~0x1f));
-
-	state->render_target.nbins_x = nbins_x;
-	state->render_target.nbins_y = nbins_y;
-	state->render_target.bin_w = bin_w;
-	state->render_target.bin_h = bin_h;
-}
-
 static void set_viewport(struct fd_state *state, uint32_t x, uint32_t y,
 		uint32_t width, uint32_t height)
 {
@@ -1699,15 +2653,56 @@ static void set_viewport(struct fd_state *state, uint32_t x, uint32_t y,
 void fd_make_current(struct fd_state *state,
 		struct fd_surface *surface)
 {
-	struct fd_ringbuffer *ring = state->ring;
-	uint32_t bw, bh;
+	fd_make_current_mrt(state, &surface, 1);
+}
+
+/* bind up to four color buffers, of the same size, as render targets,
+ * written by the fragment shader's gl_FragData0..3 outputs.  The cmds
+ * for the previous render target are not flushed, but kept in its batch
+ * until the next fd_flush():
+ */
+void fd_make_current_mrt(struct fd_state *state,
+		struct fd_surface **cbufs, uint32_t nr_cbufs)
+{
+	struct fd_surface *surface = cbufs[0];
 	int i;
 
-	attach_render_target(state, surface);
+	if ((nr_cbufs < 1) || (nr_cbufs > MAX_CBUFS)) {
+		ERROR_MSG("invalid number of color buffers: %u", nr_cbufs);
+		return;
+	}
+
+	for (i = 1; i < nr_cbufs; i++) {
+		if ((cbufs[i]->width != surface->width) ||
+				(cbufs[i]->height != surface->height)) {
+			ERROR_MSG("color buffers must all be the same size");
+			return;
+		}
+	}
+
+	state->render_target.surface = surface;
+	for (i = 0; i < MAX_CBUFS; i++)
+		state->render_target.cbufs[i] = (i < nr_cbufs) ? cbufs[i] : NULL;
+	state->render_target.nr_cbufs = nr_cbufs;
+
+	/* the batch is looked up (or started) by the next clear or draw: */
+	state->batch = NULL;
+
 	set_viewport(state, 0, 0, surface->width, surface->height);
+	state->dirty_state |= FD_DIRTY_VIEWPORT;
+}
+
+/* setup the gpu for rendering to the batch's render target: */
+static void emit_setup(struct fd_state *state, struct fd_batch *batch,
+		struct fd_ringbuffer *ring)
+{
+	struct fd_surface *surface = batch->cbufs[0];
+	uint32_t bw = batch->bin_w, bh = batch->bin_h, zsbuf_base;
+	int i;
 
-	bw = state->render_target.bin_w;
-	bh = state->render_target.bin_h;
+	INFO_MSG("using %d bins of size %dx%d%s",
+			batch->nbins_x * batch->nbins_y, bw, bh,
+			batch->binning ? " (hw binning)" : "");
 
 	emit_mem_write(state, state->solid_const,
 			init_shader_const, ARRAY_SIZE(init_shader_const));
@@ -1747,7 +2742,7 @@ void fd_make_current(struct fd_state *state,
 	OUT_RING(ring, A3XX_RB_MODE_CONTROL_RENDER_MODE(RB_RENDERING_PASS) |
 			A3XX_RB_MODE_CONTROL_MARB_CACHE_SPLIT_MODE);
 
-	emit_mrt(state, ring, surface);
+	emit_mrt(state, ring);
 
 	OUT_PKT0(ring, REG_A3XX_GRAS_SC_CONTROL, 1);
 	OUT_RING(ring, A3XX_GRAS_SC_CONTROL_RENDER_MODE(RB_RENDERING_PASS) |
@@ -1828,37 +2823,50 @@ void fd_make_current(struct fd_state *state,
 	OUT_RING(ring, A3XX_VSC_BIN_SIZE_WIDTH(bw) |
 			A3XX_VSC_BIN_SIZE_HEIGHT(bh));
 	OUT_RELOC(ring, state->solid_const, /* VSC_SIZE_ADDRESS */
-			sizeof(init_shader_const), 0);
-
-	/* since we aren't using binning, just try to assign all bins
-	 * to same pipe for now:
-	 */
-	for (i = 0; i < 1; i++) {
-		struct fd_bo *bo = state->vsc_pipe[i].bo;
+			VSC_SIZE_OFFSET, 0);
+
+	for (i = 0; i < ARRAY_SIZE(batch->pipe); i++) {
+		struct fd_bo *bo = state->vsc_bo[i];
+		uint32_t w = batch->pipe[i].w;
+		uint32_t h = batch->pipe[i].h;
+
+		if (!w || !h) {
+			/* don't leave unused pipes configured from a previous
+			 * render target when binning:
+			 */
+			if (batch->binning) {
+				OUT_PKT0(ring, REG_A3XX_VSC_PIPE(i), 1);
+				OUT_RING(ring, 0x00000000);
+			}
+			continue;
+		}
 
 		if (!bo) {
 			bo = fd_bo_new(state->dev, 0x40000,
 					DRM_FREEDRENO_GEM_TYPE_KMEM);
-			state->vsc_pipe[i].bo = bo;
+			state->vsc_bo[i] = bo;
 		}
 
-		OUT_PKT0(ring, REG_A3XX_VSC_PIPE(0), 3);
-		OUT_RING(ring, A3XX_VSC_PIPE_CONFIG_X(0) |
-				A3XX_VSC_PIPE_CONFIG_Y(0) |
-				A3XX_VSC_PIPE_CONFIG_W(state->render_target.nbins_x) |
-				A3XX_VSC_PIPE_CONFIG_H(state->render_target.nbins_y));
-		OUT_RELOC(ring, bo, 0, 0);               /* VSC_PIPE[0].DATA_ADDRESS */
-		OUT_RING(ring, fd_bo_size(bo) - 32);     /* VSC_PIPE[0].DATA_LENGTH */
+		OUT_PKT0(ring, REG_A3XX_VSC_PIPE(i), 3);
+		OUT_RING(ring, A3XX_VSC_PIPE_CONFIG_X(batch->pipe[i].x) |
+				A3XX_VSC_PIPE_CONFIG_Y(batch->pipe[i].y) |
+				A3XX_VSC_PIPE_CONFIG_W(w) |
+				A3XX_VSC_PIPE_CONFIG_H(h));
+		OUT_RELOC(ring, bo, 0, 0);               /* VSC_PIPE[i].DATA_ADDRESS */
+		OUT_RING(ring, fd_bo_size(bo) - 32);     /* VSC_PIPE[i].DATA_LENGTH */
 	}
 
+	/* DEPTH_BASE is in units of 4 bytes: */
+	zsbuf_base = batch->zsbuf_base / 4;
+
 	OUT_PKT0(ring, REG_A3XX_RB_DEPTH_INFO, 2);
-	if (state->rb_stencil_control & A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE) {
+	if (batch->zsbuf_cpp == 4) {
 		OUT_RING(ring, A3XX_RB_DEPTH_INFO_DEPTH_FORMAT(DEPTHX_24_8) |
-				A3XX_RB_DEPTH_INFO_DEPTH_BASE(bw * bh));
+				A3XX_RB_DEPTH_INFO_DEPTH_BASE(zsbuf_base));
 		OUT_RING(ring, A3XX_RB_DEPTH_PITCH(bw * 4));
 	} else {
 		OUT_RING(ring, A3XX_RB_DEPTH_INFO_DEPTH_FORMAT(DEPTHX_16) |
-				A3XX_RB_DEPTH_INFO_DEPTH_BASE(bw * bh));
+				A3XX_RB_DEPTH_INFO_DEPTH_BASE(zsbuf_base));
 		OUT_RING(ring, A3XX_RB_DEPTH_PITCH(bw * 2));
 	}
 
@@ -1905,10 +2913,168 @@ void fd_make_current(struct fd_state *state,
 
 	OUT_PKT0(ring, REG_A3XX_GRAS_CL_CLIP_CNTL, 1);
 	OUT_RING(ring, A3XX_GRAS_CL_CLIP_CNTL_IJ_PERSP_CENTER);
+}
+
+/* submit a batch, after the batches it depends on: */
+static void flush_batch(struct fd_state *state, struct fd_batch *batch)
+{
+	struct fd_surface *surface = batch->cbufs[0];
+	struct fd_ringbuffer *ring;
+	uint32_t i, yoff = 0;
+
+	for (i = 0; i < ARRAY_SIZE(state->batches); i++)
+		if (batch->deps & (1 << i))
+			flush_batch(state, &state->batches[i]);
+
+	set_ring(state, batch->ring);
+	ring = state->ring;
+
+	if (state->query.bo) {
+		/* TODO support for > 1 tile: */
+		assert(batch->nbins_x == 1);
+		assert(batch->nbins_y == 1);
+	}
+
+	fd_ringmarker_mark(state->draw_end);
+	fd_ringmarker_mark(state->binning_end);
+
+	/* the setup is only needed if the previous batch was for a
+	 * different render target:
+	 */
+	if ((state->setup.nr_cbufs != batch->nr_cbufs) ||
+			(state->setup.zsbuf_cpp != batch->zsbuf_cpp) ||
+			memcmp(state->setup.cbufs, batch->cbufs,
+					sizeof(batch->cbufs))) {
+		emit_setup(state, batch, ring);
+		memcpy(state->setup.cbufs, batch->cbufs, sizeof(batch->cbufs));
+		state->setup.nr_cbufs = batch->nr_cbufs;
+		state->setup.zsbuf_cpp = batch->zsbuf_cpp;
+	}
+
+	flush_setup(state, batch, ring);
+
+	if (batch->binning)
+		emit_binning_pass(state, batch, ring);
+
+	for (i = 0; i < batch->nbins_y; i++) {
+		uint32_t j, xoff = 0;
+		uint32_t bin_h = batch->bin_h;
+
+		/* clip bin height: */
+		bin_h = min(bin_h, surface->height - yoff);
 
+		for (j = 0; j < batch->nbins_x; j++) {
+			uint32_t bin_w = batch->bin_w;
+			uint32_t x1, y1, x2, y2;
+
+			/* clip bin width: */
+			bin_w = min(bin_w, surface->width - xoff);
+
+			x1 = xoff;
+			y1 = yoff;
+			x2 = xoff + bin_w - 1;
+			y2 = yoff + bin_h - 1;
+
+			DEBUG_MSG("bin_h=%d, yoff=%d, bin_w=%d, xoff=%d",
+					bin_h, yoff, bin_w, xoff);
+
+			OUT_PKT3(ring, CP_SET_BIN, 3);
+			OUT_RING(ring, 0x00000000);
+			OUT_RING(ring, CP_SET_BIN_1_X1(x1) | CP_SET_BIN_1_Y1(y1));
+			OUT_RING(ring, CP_SET_BIN_2_X2(x2) | CP_SET_BIN_2_Y2(y2));
+
+			/* setup scissor/offset for current tile: */
+			OUT_PKT0(ring, REG_A3XX_RB_WINDOW_OFFSET, 1);
+			OUT_RING(ring, A3XX_RB_WINDOW_OFFSET_X(xoff) |
+					A3XX_RB_WINDOW_OFFSET_Y(yoff));
+
+			OUT_PKT0(ring, REG_A3XX_GRAS_SC_WINDOW_SCISSOR_TL, 2);
+			OUT_RING(ring, A3XX_GRAS_SC_WINDOW_SCISSOR_TL_X(0) |
+					A3XX_GRAS_SC_WINDOW_SCISSOR_TL_Y(0));
+			OUT_RING(ring, A3XX_GRAS_SC_WINDOW_SCISSOR_BR_X(surface->width - 1) |
+					A3XX_GRAS_SC_WINDOW_SCISSOR_BR_Y(surface->height - 1));
+
+			OUT_PKT0(ring, REG_A3XX_GRAS_SC_SCREEN_SCISSOR_TL, 2);
+			OUT_RING(ring, A3XX_GRAS_SC_SCREEN_SCISSOR_TL_X(x1) |
+					A3XX_GRAS_SC_SCREEN_SCISSOR_TL_Y(y1));
+			OUT_RING(ring, A3XX_GRAS_SC_SCREEN_SCISSOR_BR_X(x2) |
+					A3XX_GRAS_SC_SCREEN_SCISSOR_BR_Y(y2));
+
+			if (batch->binning)
+				emit_bin_data(state, batch, ring, j, i);
+
+			/* emit IB to drawcmds: */
+			OUT_IB  (ring, state->draw_start, state->draw_end);
+
+			/* emit gmem2mem to transfer tile back to system memory.
+			 * The depth/stencil buffers only ever live in GMEM, so
+			 * only the color buffer can need it:
+			 */
+			if (batch->resolve & GL_COLOR_BUFFER_BIT)
+				emit_gmem2mem(state, batch, ring, xoff, yoff);
+
+			OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
+			OUT_RING(ring, 0x00000000);
+
+			xoff += bin_w;
+		}
+
+		yoff += bin_h;
+	}
+
+	fd_ringmarker_flush(state->draw_end);
 	fd_ringbuffer_flush(ring);
 
-	fd_ringmarker_mark(state->draw_start);
+	batch->active = false;
+	for (i = 0; i < ARRAY_SIZE(state->batches); i++)
+		state->batches[i].deps &= ~(1 << (batch - state->batches));
+	if (state->batch == batch)
+		state->batch = NULL;
+
+	fence_ring(state);
+}
+
+/* flush the batches in mask, and the batches they depend on.  Otherwise
+ * they are flushed in the order they were started:
+ */
+static void flush_batches(struct fd_state *state, uint32_t mask)
+{
+	bool flushed = false;
+
+	while (true) {
+		struct fd_batch *batch = NULL;
+		unsigned i;
+
+		for (i = 0; i < ARRAY_SIZE(state->batches); i++) {
+			struct fd_batch *b = &state->batches[i];
+			if (b->active && (mask & (1 << i)) &&
+					(!batch || (b->seqno < batch->seqno)))
+				batch = b;
+		}
+
+		if (!batch)
+			break;
+
+		flush_batch(state, batch);
+		flushed = true;
+	}
+
+	if (!flushed)
+		return;
+
+	/* and get back to recording the current batch, or else to a
+	 * ring that a new batch can be started in:
+	 */
+	if (state->batch)
+		set_ring(state, state->batch->ring);
+	else
+		next_ring(state);
+}
+
+int fd_flush(struct fd_state *state)
+{
+	flush_batches(state, ~0);
+	return 0;
 }
 
 static int dump_hex(void *buf, uint32_t w, uint32_t h, uint32_t p, bool flt)
@@ -1965,6 +3131,10 @@ int fd_query_start(struct fd_state *state)
 	if (state->query.active)
 		return -1;
 
+	/* the query cmds are recorded with the draws: */
+	if (!get_batch(state))
+		return -1;
+
 	state->query.active = true;
 	emit_query(state, true);
 
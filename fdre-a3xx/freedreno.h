@@ -32,9 +32,12 @@
 struct fd_state;
 struct fd_surface;
 struct fd_bo;
+struct fd_ringbuffer;
+struct fd_stateobj;
 
 struct fd_state * fd_init(void);
 void fd_fini(struct fd_state *state);
+uint32_t fd_device_id(struct fd_state *state);
 
 int fd_vertex_shader_attach_asm(struct fd_state *state, const char *src);
 int fd_fragment_shader_attach_asm(struct fd_state *state, const char *src);
@@ -47,16 +50,31 @@ int fd_attribute_bo(struct fd_state *state, const char *name,
 		enum a3xx_vtx_fmt fmt, struct fd_bo * bo);
 int fd_attribute_pointer(struct fd_state *state, const char *name,
 		enum a3xx_vtx_fmt fmt, uint32_t count, const void *data);
+/* note: the uniform data is not copied, it is read when the next draw is
+ * emitted.  Since uniforms are only re-emitted after an attach, updating
+ * the data in place requires calling fd_uniform_attach() again:
+ */
 int fd_uniform_attach(struct fd_state *state, const char *name,
 		uint32_t size, uint32_t count, const void *data);
 int fd_set_texture(struct fd_state *state, const char *name,
 		struct fd_surface *tex);
 int fd_set_buf(struct fd_state *state, const char *name, struct fd_bo *bo);
 
+void * fd_upload(struct fd_state *state, uint32_t size,
+		struct fd_bo **bo, uint32_t *offset);
+
+struct fd_ringbuffer * fd_stateobj_begin(struct fd_state *state,
+		struct fd_stateobj *obj, uint32_t size);
+void fd_stateobj_end(struct fd_stateobj *obj);
+void fd_stateobj_emit_ib(struct fd_state *state, struct fd_stateobj *obj,
+		struct fd_ringbuffer *ring);
+void fd_stateobj_del(struct fd_stateobj *obj);
+
 void fd_clear_color(struct fd_state *state, float color[4]);
 void fd_clear_stencil(struct fd_state *state, uint32_t s);
 void fd_clear_depth(struct fd_state *state, float depth);
 int fd_clear(struct fd_state *state, GLbitfield mask);
+int fd_invalidate(struct fd_state *state, GLbitfield mask);
 int fd_cull(struct fd_state *state, GLenum mode);
 int fd_depth_func(struct fd_state *state, GLenum depth_func);
 int fd_enable(struct fd_state *state, GLenum cap);
@@ -78,6 +96,7 @@ int fd_run_compute(struct fd_state *state, uint32_t workdim,
 
 int fd_swap_buffers(struct fd_state *state);
 int fd_flush(struct fd_state *state);
+int fd_finish(struct fd_state *state);
 
 struct fd_surface * fd_surface_screen(struct fd_state *state,
 		uint32_t *width, uint32_t *height);
@@ -90,6 +109,8 @@ void fd_surface_upload(struct fd_surface *surface, const void *data);
 
 void fd_make_current(struct fd_state *state,
 		struct fd_surface *surface);
+void fd_make_current_mrt(struct fd_state *state,
+		struct fd_surface **cbufs, uint32_t nr_cbufs);
 int fd_dump_hex(struct fd_surface *surface);
 int fd_dump_hex_bo(struct fd_bo *bo, bool flt);
 int fd_dump_bmp(struct fd_surface *surface, const char *filename);
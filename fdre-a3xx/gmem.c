@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "util.h"
+#include "gmem.h"
+
+/* GMEM is organized in 32x32 pixel tiles, so bins are a multiple of
+ * that in each direction:
+ */
+#define BIN_ALIGN   32
+
+/* for hw binning, the bin size in tiles needs to fit in the 5 bit
+ * fields of VSC_BIN_SIZE:
+ */
+#define MAX_BINNING_BIN   (0x1f * BIN_ALIGN)
+
+/* RB_COPY_CONTROL.GMEM_BASE is in units of 16KiB, so that is the
+ * alignment for each buffer in GMEM:
+ */
+#define BASE_ALIGN  0x4000
+
+/* place each buffer in GMEM for the given bin size, returning the
+ * total GMEM size needed:
+ */
+static uint32_t layout_bufs(const struct fd_gmem_params *params,
+		struct fd_gmem_layout *layout)
+{
+	uint32_t npixels = layout->bin_w * layout->bin_h;
+	uint32_t total = 0;
+	int i;
+
+	for (i = 0; i < MAX_CBUFS; i++) {
+		layout->cbuf_base[i] = 0;
+		if (!params->cbuf_cpp[i])
+			continue;
+		total = ALIGN(total, BASE_ALIGN);
+		layout->cbuf_base[i] = total;
+		total += params->cbuf_cpp[i] * npixels;
+	}
+
+	layout->zsbuf_base = 0;
+	if (params->zsbuf_cpp) {
+		total = ALIGN(total, BASE_ALIGN);
+		layout->zsbuf_base = total;
+		total += params->zsbuf_cpp * npixels;
+	}
+
+	return total;
+}
+
+/* split the bins between the VSC pipes, each covering a block of up to
+ * tpp_x * tpp_y bins.  Returns false if there are too many bins for the
+ * visibility streams to describe:
+ */
+static bool assign_pipes(struct fd_gmem_layout *layout)
+{
+	uint32_t nbins_x = layout->nbins_x;
+	uint32_t nbins_y = layout->nbins_y;
+	uint32_t tpp_x = 1, tpp_y = 1, x = 0, y = 0;
+	int i;
+
+#define npipes(tx, ty) \
+	((((nbins_x) + (tx) - 1) / (tx)) * (((nbins_y) + (ty) - 1) / (ty)))
+
+	while (npipes(tpp_x, tpp_y) > MAX_PIPES) {
+		if ((tpp_x < nbins_x) && ((tpp_x <= tpp_y) || (tpp_y >= nbins_y)))
+			tpp_x++;
+		else
+			tpp_y++;
+	}
+
+#undef npipes
+
+	/* VSC_PIPE_CONFIG.W/H are 4 bits, and PC_VSTREAM_CONTROL.N, the
+	 * index of a bin within its pipe, is 5 bits:
+	 */
+	if ((tpp_x > 15) || (tpp_y > 15) || ((tpp_x * tpp_y) > 32))
+		return false;
+
+	for (i = 0; i < MAX_PIPES; i++) {
+		if (x >= nbins_x) {
+			x = 0;
+			y += tpp_y;
+		}
+
+		if (y >= nbins_y) {
+			layout->pipe[i].x = layout->pipe[i].y = 0;
+			layout->pipe[i].w = layout->pipe[i].h = 0;
+			continue;
+		}
+
+		layout->pipe[i].x = x;
+		layout->pipe[i].y = y;
+		layout->pipe[i].w = min(tpp_x, nbins_x - x);
+		layout->pipe[i].h = min(tpp_y, nbins_y - y);
+
+		x += tpp_x;
+	}
+
+	return true;
+}
+
+static bool can_bin(struct fd_gmem_layout *layout)
+{
+	/* binning is only worth it with more than one bin: */
+	if ((layout->nbins_x * layout->nbins_y) <= 1)
+		return false;
+
+	if ((layout->bin_w > MAX_BINNING_BIN) ||
+			(layout->bin_h > MAX_BINNING_BIN))
+		return false;
+
+	return assign_pipes(layout);
+}
+
+/* Is layout a better than layout b?  Being able to use hw binning (or
+ * needing only a single bin) matters most, since otherwise every draw
+ * is replayed for every bin.
+ * Then the number of bins, since each bin has a fixed cost and the
+ * gmem2mem for each bin is clipped to the render target (so the total
+ * resolve traffic is the same for any layout).  Then the total length
+ * of the bin edges, to avoid skinny strips which more primitives
+ * straddle.  And last the area of the bins that hangs off the edge of
+ * the render target:
+ */
+static bool better(const struct fd_gmem_params *params,
+		const struct fd_gmem_layout *a, const struct fd_gmem_layout *b)
+{
+	uint32_t nbins_a = a->nbins_x * a->nbins_y;
+	uint32_t nbins_b = b->nbins_x * b->nbins_y;
+	uint32_t edges_a = a->nbins_x * params->height +
+			a->nbins_y * params->width;
+	uint32_t edges_b = b->nbins_x * params->height +
+			b->nbins_y * params->width;
+	uint32_t area_a = nbins_a * a->bin_w * a->bin_h;
+	uint32_t area_b = nbins_b * b->bin_w * b->bin_h;
+	/* with a single bin, there is nothing to replay: */
+	bool binned_a = a->binning || (nbins_a == 1);
+	bool binned_b = b->binning || (nbins_b == 1);
+
+	if (binned_a != binned_b)
+		return binned_a;
+	if (nbins_a != nbins_b)
+		return nbins_a < nbins_b;
+	if (edges_a != edges_b)
+		return edges_a < edges_b;
+	return area_a < area_b;
+}
+
+/* find the bin layout for the render target, considering every bin
+ * width and height (in multiples of the tile size) that fits in GMEM.
+ * Returns -1 if not even a single tile fits.
+ */
+int fd_gmem_layout(const struct fd_gmem_params *params,
+		struct fd_gmem_layout *layout)
+{
+	uint32_t max_nbins_x = DIV_ROUND_UP(params->width, BIN_ALIGN);
+	uint32_t max_nbins_y = DIV_ROUND_UP(params->height, BIN_ALIGN);
+	uint32_t nbins_x, nbins_y;
+	struct fd_gmem_layout l;
+	bool found = false;
+
+	for (nbins_x = 1; nbins_x <= max_nbins_x; nbins_x++) {
+		uint32_t bin_w = ALIGN(DIV_ROUND_UP(params->width, nbins_x),
+				BIN_ALIGN);
+
+		if (bin_w > params->max_bin_w)
+			continue;
+
+		/* skip bin counts that round up to the same bin size as
+		 * a smaller count:
+		 */
+		if (DIV_ROUND_UP(params->width, bin_w) != nbins_x)
+			continue;
+
+		for (nbins_y = 1; nbins_y <= max_nbins_y; nbins_y++) {
+			uint32_t bin_h = ALIGN(DIV_ROUND_UP(params->height, nbins_y),
+					BIN_ALIGN);
+
+			if (DIV_ROUND_UP(params->height, bin_h) != nbins_y)
+				continue;
+
+			memset(&l, 0, sizeof(l));
+			l.bin_w = bin_w;
+			l.bin_h = bin_h;
+			l.nbins_x = nbins_x;
+			l.nbins_y = nbins_y;
+
+			if (layout_bufs(params, &l) > params->gmem_size)
+				continue;
+
+			l.binning = params->binning && can_bin(&l);
+
+			if (!found || better(params, &l, layout)) {
+				*layout = l;
+				found = true;
+			}
+
+			/* more bins in y only helps if it enables binning: */
+			if (l.binning || !params->binning)
+				break;
+		}
+	}
+
+	if (!found)
+		return -1;
+
+	if (!layout->binning) {
+		/* just assign all bins to same pipe: */
+		memset(layout->pipe, 0, sizeof(layout->pipe));
+		layout->pipe[0].w = layout->nbins_x;
+		layout->pipe[0].h = layout->nbins_y;
+	}
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GMEM_H_
+#define GMEM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_CBUFS  4
+#define MAX_PIPES  8
+
+/* what needs to fit in GMEM for each bin: */
+struct fd_gmem_params {
+	uint32_t width, height;         /* render target size, in pixels */
+	uint32_t cbuf_cpp[MAX_CBUFS];   /* bytes per pixel, 0 if no cbuf */
+	uint32_t zsbuf_cpp;             /* 0 if no depth/stencil */
+	uint32_t gmem_size;             /* in bytes */
+	uint32_t max_bin_w;             /* max bin width, in pixels */
+	/* if set, prefer layouts that the VSC pipes can describe: */
+	bool binning;
+};
+
+struct fd_gmem_layout {
+	uint32_t bin_w, bin_h;
+	uint32_t nbins_x, nbins_y;
+	/* offset of each buffer within GMEM, in bytes: */
+	uint32_t cbuf_base[MAX_CBUFS];
+	uint32_t zsbuf_base;
+	/* whether the bins can be split between the VSC pipes for hw
+	 * binning, and if so the bins covered by each pipe:
+	 */
+	bool binning;
+	struct {
+		uint32_t x, y, w, h;
+	} pipe[MAX_PIPES];
+};
+
+int fd_gmem_layout(const struct fd_gmem_params *params,
+		struct fd_gmem_layout *layout);
+
+#endif /* GMEM_H_ */
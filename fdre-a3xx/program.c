@@ -43,6 +43,11 @@ struct fd_shader {
 struct fd_program {
 	struct fd_state *state;
 	struct fd_shader vertex_shader, fragment_shader, compute_shader;
+
+	/* pre-baked shader state, for normal draws and for the
+	 * RB_RESOLVE_PASS (no uniforms), built on first use:
+	 */
+	struct fd_stateobj stateobj[2];
 };
 
 static struct fd_shader *get_shader(struct fd_program *program,
@@ -57,39 +62,435 @@ static struct fd_shader *get_shader(struct fd_program *program,
 	return NULL;
 }
 
+/*
+ * Assembled shader cache:
+ *
+ * The same shader source tends to get attached over and over (by each
+ * test, and in benchmark loops), so keep the assembled dwords, shader
+ * info, and IR (for the symbol tables) around, keyed by a hash of the
+ * source plus gpu id.  If $FD_SHADER_CACHE points at a directory, the
+ * cache is also stored on disk so that subsequent runs can skip the
+ * parser entirely.  On disk, the key also includes IR3_ASM_VERSION, so
+ * shaders assembled by an older assembler are not reused.  The IR
+ * belongs to the cache, which is freed along with the last program.
+ */
+
+struct fd_shader_cache_entry {
+	struct fd_shader_cache_entry *next;
+	uint64_t hash;
+	uint32_t gpu_id;
+	char *src;
+	uint32_t bin[512];
+	uint32_t sizedwords;
+	struct ir3_shader_info info;
+	struct ir3_shader *ir;
+};
+
+static struct fd_shader_cache_entry *shader_cache;
+static unsigned shader_cache_users;
+
+#define SHADER_CACHE_MAGIC   0x63736466   /* "fdsc" */
+#define SHADER_CACHE_VERSION 2
+
+static uint64_t hash_src(const char *src)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	while (*src)
+		hash = (hash ^ (uint8_t)*(src++)) * 0x100000001b3ULL;
+	return hash;
+}
+
+static char * cache_filename(struct fd_shader_cache_entry *entry)
+{
+	static char filename[1024];
+	const char *dir = getenv("FD_SHADER_CACHE");
+
+	if (!dir)
+		return NULL;
+
+	snprintf(filename, sizeof(filename), "%s/%016llx-%u-%u.sc", dir,
+			(unsigned long long)entry->hash, entry->gpu_id,
+			IR3_ASM_VERSION);
+
+	return filename;
+}
+
+/* the register #'s are stored the way the parser passes them to the
+ * ir3_xyz_create() fxns, ie. with the half-reg flag in bit 0:
+ */
+static uint32_t reg2num(struct ir3_register *reg)
+{
+	return (reg->num << 1) | !!(reg->flags & IR3_REG_HALF);
+}
+
+static void write_u32(FILE *f, uint32_t val)
+{
+	fwrite(&val, sizeof(val), 1, f);
+}
+
+static void write_str(FILE *f, const char *str)
+{
+	uint32_t len = str ? strlen(str) : 0;
+	write_u32(f, len);
+	fwrite(str, 1, len, f);
+}
+
+static int read_u32(FILE *f, uint32_t *val)
+{
+	return (fread(val, sizeof(*val), 1, f) == 1) ? 0 : -1;
+}
+
+static char * read_str(FILE *f)
+{
+	uint32_t len;
+	char *str;
+
+	if (read_u32(f, &len) || (len > 0x100000))
+		return NULL;
+
+	str = calloc(1, len + 1);
+	if (fread(str, 1, len, f) != len) {
+		free(str);
+		return NULL;
+	}
+
+	return str;
+}
+
+static void cache_store(struct fd_shader_cache_entry *entry)
+{
+	struct ir3_shader *ir = entry->ir;
+	char *filename = cache_filename(entry);
+	char tmpname[1024 + 16];
+	uint32_t i;
+	FILE *f;
+
+	if (!filename)
+		return;
+
+	/* write to a temporary file first, so a concurrent reader never
+	 * sees a partially written entry:
+	 */
+	snprintf(tmpname, sizeof(tmpname), "%s.%d", filename, getpid());
+
+	f = fopen(tmpname, "w");
+	if (!f) {
+		WARN_MSG("could not write shader cache: %s", tmpname);
+		return;
+	}
+
+	write_u32(f, SHADER_CACHE_MAGIC);
+	write_u32(f, SHADER_CACHE_VERSION);
+	write_u32(f, IR3_ASM_VERSION);
+	write_str(f, entry->src);
+
+	write_u32(f, entry->sizedwords);
+	fwrite(entry->bin, 4, entry->sizedwords, f);
+
+	write_u32(f, entry->info.max_reg);
+	write_u32(f, entry->info.max_half_reg);
+	write_u32(f, entry->info.max_const);
+
+	write_u32(f, ir->attributes_count);
+	for (i = 0; i < ir->attributes_count; i++) {
+		struct ir3_attribute *a = ir->attributes[i];
+		write_u32(f, reg2num(a->rstart));
+		write_u32(f, a->num);
+		write_str(f, a->name);
+	}
+
+	write_u32(f, ir->consts_count);
+	for (i = 0; i < ir->consts_count; i++) {
+		struct ir3_const *c = ir->consts[i];
+		write_u32(f, reg2num(c->cstart));
+		fwrite(c->val, sizeof(c->val), 1, f);
+	}
+
+	write_u32(f, ir->samplers_count);
+	for (i = 0; i < ir->samplers_count; i++) {
+		struct ir3_sampler *s = ir->samplers[i];
+		write_u32(f, s->idx);
+		write_str(f, s->name);
+	}
+
+	write_u32(f, ir->uniforms_count);
+	for (i = 0; i < ir->uniforms_count; i++) {
+		struct ir3_uniform *u = ir->uniforms[i];
+		write_u32(f, reg2num(u->cstart));
+		write_u32(f, u->num);
+		write_str(f, u->name);
+	}
+
+	write_u32(f, ir->varyings_count);
+	for (i = 0; i < ir->varyings_count; i++) {
+		struct ir3_varying *v = ir->varyings[i];
+		write_u32(f, reg2num(v->rstart));
+		write_u32(f, v->num);
+		write_str(f, v->name);
+	}
+
+	write_u32(f, ir->bufs_count);
+	for (i = 0; i < ir->bufs_count; i++) {
+		struct ir3_buf *b = ir->bufs[i];
+		write_u32(f, reg2num(b->cstart));
+		write_str(f, b->name);
+	}
+
+	write_u32(f, ir->outs_count);
+	for (i = 0; i < ir->outs_count; i++) {
+		struct ir3_out *o = ir->outs[i];
+		write_u32(f, reg2num(o->rstart));
+		write_u32(f, o->num);
+		write_str(f, o->name);
+	}
+
+	if (fclose(f) || rename(tmpname, filename)) {
+		WARN_MSG("could not write shader cache: %s", filename);
+		unlink(tmpname);
+	}
+}
+
+/* read back the symbol tables, recreating them in a fresh ir3_shader,
+ * returns non-zero on a short/corrupt file:
+ */
+static int cache_load_symbols(FILE *f, struct ir3_shader *ir)
+{
+	uint32_t i, cnt, num, n, idx;
+	float val[4];
+	char *name;
+
+	if (read_u32(f, &cnt) || (cnt > MAX_ATTRIBUTES))
+		return -1;
+	for (i = 0; i < cnt; i++) {
+		if (read_u32(f, &num) || read_u32(f, &n) || !(name = read_str(f)))
+			return -1;
+		ir3_attribute_create(ir, num, n, name);
+		free(name);
+	}
+
+	if (read_u32(f, &cnt) || (cnt > MAX_CONSTS))
+		return -1;
+	for (i = 0; i < cnt; i++) {
+		if (read_u32(f, &num) || (fread(val, sizeof(val), 1, f) != 1))
+			return -1;
+		ir3_const_create(ir, num, val[0], val[1], val[2], val[3]);
+	}
+
+	if (read_u32(f, &cnt) || (cnt > MAX_SAMPLERS))
+		return -1;
+	for (i = 0; i < cnt; i++) {
+		if (read_u32(f, &idx) || !(name = read_str(f)))
+			return -1;
+		ir3_sampler_create(ir, idx, name);
+		free(name);
+	}
+
+	if (read_u32(f, &cnt) || (cnt > MAX_UNIFORMS))
+		return -1;
+	for (i = 0; i < cnt; i++) {
+		if (read_u32(f, &num) || read_u32(f, &n) || !(name = read_str(f)))
+			return -1;
+		ir3_uniform_create(ir, num, n, name);
+		free(name);
+	}
+
+	if (read_u32(f, &cnt) || (cnt > MAX_VARYINGS))
+		return -1;
+	for (i = 0; i < cnt; i++) {
+		if (read_u32(f, &num) || read_u32(f, &n) || !(name = read_str(f)))
+			return -1;
+		ir3_varying_create(ir, num, n, name);
+		free(name);
+	}
+
+	if (read_u32(f, &cnt) || (cnt > MAX_BUFS))
+		return -1;
+	for (i = 0; i < cnt; i++) {
+		if (read_u32(f, &num) || !(name = read_str(f)))
+			return -1;
+		ir3_buf_create(ir, num, name);
+		free(name);
+	}
+
+	if (read_u32(f, &cnt) || (cnt > MAX_OUTS))
+		return -1;
+	for (i = 0; i < cnt; i++) {
+		if (read_u32(f, &num) || read_u32(f, &n) || !(name = read_str(f)))
+			return -1;
+		ir3_out_create(ir, num, n, name);
+		free(name);
+	}
+
+	return 0;
+}
+
+static int cache_load(struct fd_shader_cache_entry *entry)
+{
+	char *filename = cache_filename(entry);
+	uint32_t magic, version, asm_version, max_reg, max_half_reg, max_const;
+	char *src = NULL;
+	int ret = -1;
+	FILE *f;
+
+	if (!filename)
+		return -1;
+
+	f = fopen(filename, "r");
+	if (!f)
+		return -1;
+
+	if (read_u32(f, &magic) || (magic != SHADER_CACHE_MAGIC) ||
+			read_u32(f, &version) || (version != SHADER_CACHE_VERSION) ||
+			read_u32(f, &asm_version) || (asm_version != IR3_ASM_VERSION))
+		goto out;
+
+	/* guard against hash collisions: */
+	src = read_str(f);
+	if (!src || strcmp(src, entry->src))
+		goto out;
+
+	if (read_u32(f, &entry->sizedwords) ||
+			(entry->sizedwords > ARRAY_SIZE(entry->bin)) ||
+			(fread(entry->bin, 4, entry->sizedwords, f) != entry->sizedwords))
+		goto out;
+
+	if (read_u32(f, &max_reg) || read_u32(f, &max_half_reg) ||
+			read_u32(f, &max_const))
+		goto out;
+
+	entry->info.max_reg = max_reg;
+	entry->info.max_half_reg = max_half_reg;
+	entry->info.max_const = max_const;
+
+	entry->ir = ir3_shader_create();
+	if (cache_load_symbols(f, entry->ir)) {
+		ir3_shader_destroy(entry->ir);
+		entry->ir = NULL;
+		goto out;
+	}
+
+	ret = 0;
+
+out:
+	if (ret)
+		WARN_MSG("ignoring stale shader cache: %s", filename);
+	free(src);
+	fclose(f);
+	return ret;
+}
+
+static void cache_destroy(void)
+{
+	while (shader_cache) {
+		struct fd_shader_cache_entry *entry = shader_cache;
+		shader_cache = entry->next;
+		ir3_shader_destroy(entry->ir);
+		free(entry->src);
+		free(entry);
+	}
+}
+
+static struct fd_shader_cache_entry * cache_lookup(uint32_t gpu_id,
+		const char *src)
+{
+	struct fd_shader_cache_entry *entry;
+	uint64_t hash = hash_src(src);
+
+	for (entry = shader_cache; entry; entry = entry->next)
+		if ((entry->hash == hash) && (entry->gpu_id == gpu_id) &&
+				!strcmp(entry->src, src))
+			return entry;
+
+	entry = calloc(1, sizeof(*entry));
+	entry->hash = hash;
+	entry->gpu_id = gpu_id;
+	entry->src = strdup(src);
+
+	if (cache_load(entry)) {
+		int sizedwords;
+
+		entry->ir = fd_asm_parse(src);
+		if (!entry->ir) {
+			ERROR_MSG("parse failed");
+			goto fail;
+		}
+		sizedwords = ir3_shader_assemble(entry->ir, entry->bin,
+				ARRAY_SIZE(entry->bin), &entry->info);
+		if (sizedwords <= 0) {
+			ERROR_MSG("assembler failed");
+			goto fail;
+		}
+		entry->sizedwords = sizedwords;
+
+		cache_store(entry);
+	}
+
+	entry->next = shader_cache;
+	shader_cache = entry;
+
+	return entry;
+
+fail:
+	if (entry->ir)
+		ir3_shader_destroy(entry->ir);
+	free(entry->src);
+	free(entry);
+	return NULL;
+}
+
 struct fd_program * fd_program_new(struct fd_state *state)
 {
 	struct fd_program *program = calloc(1, sizeof(struct fd_program));
 	program->state = state;
+	shader_cache_users++;
 	return program;
 }
 
+void fd_program_del(struct fd_program *program)
+{
+	enum fd_shader_type type;
+
+	for (type = FD_SHADER_VERTEX; type <= FD_SHADER_COMPUTE; type++) {
+		struct fd_shader *shader = get_shader(program, type);
+		if (shader->bo)
+			fd_bo_del(shader->bo);
+	}
+
+	fd_stateobj_del(&program->stateobj[0]);
+	fd_stateobj_del(&program->stateobj[1]);
+
+	free(program);
+
+	/* the shaders' IR belongs to the cache: */
+	if (--shader_cache_users == 0)
+		cache_destroy();
+}
+
 int fd_program_attach_asm(struct fd_program *program,
 		enum fd_shader_type type, const char *src)
 {
 	struct fd_shader *shader = get_shader(program, type);
-	int sizedwords;
-
-	if (shader->ir)
-		ir3_shader_destroy(shader->ir);
+	struct fd_shader_cache_entry *entry;
 
+	if (shader->bo)
+		fd_bo_del(shader->bo);
 	memset(shader, 0, sizeof(*shader));
 
-	shader->ir = fd_asm_parse(src);
-	if (!shader->ir) {
-		ERROR_MSG("parse failed");
-		return -1;
-	}
-	sizedwords = ir3_shader_assemble(shader->ir, shader->bin,
-			ARRAY_SIZE(shader->bin), &shader->info);
-	if (sizedwords <= 0) {
-		ERROR_MSG("assembler failed");
+	/* the shader state needs to be re-baked: */
+	program->stateobj[0].sizedwords = 0;
+	program->stateobj[1].sizedwords = 0;
+
+	entry = cache_lookup(fd_device_id(program->state), src);
+	if (!entry)
 		return -1;
-	}
-	shader->sizedwords = sizedwords;
+
+	memcpy(shader->bin, entry->bin, entry->sizedwords * 4);
+	shader->sizedwords = entry->sizedwords;
+	shader->info = entry->info;
+	shader->ir = entry->ir;
 
 	shader->bo = fd_attribute_bo_new(program->state,
-			sizedwords * 4, shader->bin);
+			shader->sizedwords * 4, shader->bin);
 
 	return 0;
 }
@@ -130,6 +531,23 @@ static bool ishalf(struct fd_shader *shader, const char *name)
 	return 0;
 }
 
+/* name of the fragment shader output written to MRT 'n'.  Shaders which
+ * don't write any gl_FragDataN use gl_FragColor, which (like in GL) is
+ * broadcast to all the bound render targets, so for example fd_clear()'s
+ * solid program clears every MRT:
+ */
+static const char *mrtname(struct fd_shader *shader, uint32_t n)
+{
+	static const char *names[] = {
+			"gl_FragData0", "gl_FragData1", "gl_FragData2", "gl_FragData3",
+	};
+	uint32_t i;
+	for (i = 0; i < ARRAY_SIZE(names); i++)
+		if (getpos(shader, names[i], ~0) != ~0)
+			return names[n];
+	return "gl_FragColor";
+}
+
 static uint32_t instrlen(struct fd_shader *shader)
 {
 	/* the instructions length is in units of instruction groups
@@ -195,7 +613,8 @@ static void emit_vtx_fetch(struct fd_ringbuffer *ring,
 				COND(switchnext, A3XX_VFD_FETCH_INSTR_0_SWITCHNEXT) |
 				A3XX_VFD_FETCH_INSTR_0_INDEXCODE(i) |
 				A3XX_VFD_FETCH_INSTR_0_STEPRATE(1));
-		OUT_RELOC(ring, p->bo, s * first, 0);    /* VFD_FETCH[i].INSTR_1 */
+		/* VFD_FETCH[i].INSTR_1: */
+		OUT_RELOC(ring, p->bo, p->offset + (s * first), 0);
 
 		OUT_PKT0(ring, REG_A3XX_VFD_DECODE_INSTR(i), 1);
 		OUT_RING(ring, A3XX_VFD_DECODE_INSTR_WRITEMASK(regmask(a->num)) |
@@ -229,9 +648,10 @@ static struct fd_bo *get_buf(struct fd_shader *shader,
 	return NULL;
 }
 
-static void emit_uniconst(struct fd_ringbuffer *ring,
-		struct fd_shader *shader, struct fd_parameters *uniforms,
-		struct fd_parameters *bufs, enum adreno_state_block state_block)
+static void emit_uniconst(struct fd_program *program,
+		struct fd_ringbuffer *ring, struct fd_shader *shader,
+		struct fd_parameters *uniforms, struct fd_parameters *bufs,
+		enum adreno_state_block state_block)
 {
 	static uint32_t buf[512]; /* cheesy, but test code isn't multithreaded */
 	uint32_t i, j, k, sz = 0, base = ~0;
@@ -282,6 +702,32 @@ static void emit_uniconst(struct fd_ringbuffer *ring,
 	sz = ALIGN(sz, 4);
 	sz -= base;
 
+	/* if there are no buf addresses (which need relocs) in the consts,
+	 * load them indirectly from the upload buffer, rather than copying
+	 * them into the cmdstream:
+	 */
+	if (!shader->ir->bufs_count) {
+		struct fd_bo *bo;
+		uint32_t offset;
+		void *ptr;
+
+		ptr = fd_upload(program->state, sz * 4, &bo, &offset);
+		if (ptr) {
+			memcpy(ptr, buf, sz * 4);
+
+			OUT_PKT3(ring, CP_LOAD_STATE, 2);
+			OUT_RING(ring, CP_LOAD_STATE_0_DST_OFF(base/2) |
+					CP_LOAD_STATE_0_STATE_SRC(SS_INDIRECT) |
+					CP_LOAD_STATE_0_STATE_BLOCK(state_block) |
+					CP_LOAD_STATE_0_NUM_UNIT(sz/2));
+			OUT_RELOC(ring, bo, offset,
+					CP_LOAD_STATE_1_STATE_TYPE(ST_CONSTANTS));
+			return;
+		}
+
+		/* out of upload space, fall back to copying them: */
+	}
+
 	OUT_PKT3(ring, CP_LOAD_STATE, 2 + sz);
 	OUT_RING(ring, CP_LOAD_STATE_0_DST_OFF(base/2) |
 			CP_LOAD_STATE_0_STATE_SRC(SS_DIRECT) |
@@ -316,9 +762,8 @@ static void emit_global_mem(struct fd_ringbuffer *ring,
 	}
 }
 
-void fd_program_emit_state(struct fd_program *program, uint32_t first,
-		struct fd_parameters *uniforms, struct fd_parameters *attr,
-		struct fd_parameters *bufs, struct fd_ringbuffer *ring)
+static void emit_shader_state(struct fd_program *program,
+		struct fd_parameters *uniforms, struct fd_ringbuffer *ring)
 {
 	struct fd_shader *vs = get_shader(program, FD_SHADER_VERTEX);
 	struct fd_shader *fs = get_shader(program, FD_SHADER_FRAGMENT);
@@ -330,7 +775,6 @@ void fd_program_emit_state(struct fd_program *program, uint32_t first,
 
 	uint32_t posregid   = getpos(vs, "gl_Position", 0);
 	uint32_t psizeregid = getpos(vs, "gl_PointSize", (63 << 2));
-	uint32_t colorregid = getpos(fs, "gl_FragColor", 0);
 
 	uint32_t numvar = totalvar(fs);
 
@@ -481,11 +925,11 @@ void fd_program_emit_state(struct fd_program *program, uint32_t first,
 	OUT_RING(ring, 0x00000000);        /* SP_FS_OUTPUT_REG */
 
 	OUT_PKT0(ring, REG_A3XX_SP_FS_MRT_REG(0), 4);
-	OUT_RING(ring, A3XX_SP_FS_MRT_REG_REGID(colorregid) |  /* SP_FS_MRT[0].REG */
-			COND(ishalf(fs, "gl_FragColor"), A3XX_SP_FS_MRT_REG_HALF_PRECISION));
-	OUT_RING(ring, A3XX_SP_FS_MRT_REG_REGID(0));           /* SP_FS_MRT[1].REG */
-	OUT_RING(ring, A3XX_SP_FS_MRT_REG_REGID(0));           /* SP_FS_MRT[2].REG */
-	OUT_RING(ring, A3XX_SP_FS_MRT_REG_REGID(0));           /* SP_FS_MRT[3].REG */
+	for (i = 0; i < 4; i++) {
+		const char *name = mrtname(fs, i);
+		OUT_RING(ring, A3XX_SP_FS_MRT_REG_REGID(getpos(fs, name, 0)) |
+				COND(ishalf(fs, name), A3XX_SP_FS_MRT_REG_HALF_PRECISION));
+	}
 
 	OUT_PKT0(ring, REG_A3XX_VPC_ATTR, 2);
 	OUT_RING(ring, A3XX_VPC_ATTR_TOTALATTR(numvar) |
@@ -528,8 +972,37 @@ void fd_program_emit_state(struct fd_program *program, uint32_t first,
 	OUT_RING(ring, A3XX_VFD_CONTROL_1_MAXSTORAGE(1) | // XXX
 			A3XX_VFD_CONTROL_1_REGID4VTX(63 << 2) |
 			A3XX_VFD_CONTROL_1_REGID4INST(63 << 2));
+}
+
+/* note that the vertex fetch and const layout is determined by the
+ * shaders, so FD_PROGRAM_SHADER should not be emitted without also
+ * emitting FD_PROGRAM_VTX and FD_PROGRAM_CONST:
+ */
+void fd_program_emit_state(struct fd_program *program, uint32_t mask,
+		uint32_t first, struct fd_parameters *uniforms,
+		struct fd_parameters *attr, struct fd_parameters *bufs,
+		struct fd_ringbuffer *ring)
+{
+	struct fd_shader *vs = get_shader(program, FD_SHADER_VERTEX);
+	struct fd_shader *fs = get_shader(program, FD_SHADER_FRAGMENT);
+
+	if (mask & FD_PROGRAM_SHADER) {
+		struct fd_stateobj *obj = &program->stateobj[!uniforms];
+
+		if (!obj->sizedwords) {
+			emit_shader_state(program, uniforms,
+					fd_stateobj_begin(program->state, obj, 0x2000));
+			fd_stateobj_end(obj);
+		}
+
+		if (mask & FD_PROGRAM_IB)
+			fd_stateobj_emit_ib(program->state, obj, ring);
+		else
+			OUT_STATEOBJ(ring, obj);
+	}
 
-	emit_vtx_fetch(ring, vs, attr, first);
+	if (mask & FD_PROGRAM_VTX)
+		emit_vtx_fetch(ring, vs, attr, first);
 
 	/* we have this sometimes, not others.. perhaps we could be clever
 	 * and figure out actually when we need to invalidate cache:
@@ -541,9 +1014,9 @@ void fd_program_emit_state(struct fd_program *program, uint32_t first,
 			A3XX_UCHE_CACHE_INVALIDATE1_REG_ENTIRE_CACHE);
 
 	/* for RB_RESOLVE_PASS, I think the consts are not needed: */
-	if (uniforms) {
-		emit_uniconst(ring, vs, uniforms, bufs, SB_VERT_SHADER);
-		emit_uniconst(ring, fs, uniforms, bufs, SB_FRAG_SHADER);
+	if (uniforms && (mask & FD_PROGRAM_CONST)) {
+		emit_uniconst(program, ring, vs, uniforms, bufs, SB_VERT_SHADER);
+		emit_uniconst(program, ring, fs, uniforms, bufs, SB_FRAG_SHADER);
 	}
 }
 
@@ -622,6 +1095,6 @@ void fd_program_emit_compute_state(struct fd_program *program,
 			A3XX_UCHE_CACHE_INVALIDATE1_REG_OPCODE(INVALIDATE) |
 			A3XX_UCHE_CACHE_INVALIDATE1_REG_ENTIRE_CACHE);
 
-	emit_uniconst(ring, cs, uniforms, bufs, SB_FRAG_SHADER);
+	emit_uniconst(program, ring, cs, uniforms, bufs, SB_FRAG_SHADER);
 	emit_global_mem(ring, cs, bufs);
 }
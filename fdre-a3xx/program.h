@@ -36,7 +36,23 @@ enum fd_shader_type {
 
 struct fd_state;
 
+/* parts of the program state that fd_program_emit_state() can emit
+ * independently of each other:
+ */
+enum fd_program_state {
+	FD_PROGRAM_SHADER = 0x1,   /* shader/VPC/VFD control and instructions */
+	FD_PROGRAM_VTX    = 0x2,   /* vertex fetch (attributes) */
+	FD_PROGRAM_CONST  = 0x4,   /* uniforms/immediates/buf addresses */
+	FD_PROGRAM_ALL    = 0x7,
+
+	/* emitting into the top level cmds, rather than the draw cmds, so
+	 * the pre-baked shader state can be IB'd rather than copied:
+	 */
+	FD_PROGRAM_IB     = 0x8,
+};
+
 struct fd_program * fd_program_new(struct fd_state *state);
+void fd_program_del(struct fd_program *program);
 
 int fd_program_attach_asm(struct fd_program *program,
 		enum fd_shader_type type, const char *src);
@@ -46,9 +62,10 @@ struct ir3_sampler;
 struct ir3_sampler ** fd_program_samplers(struct fd_program *program,
 		enum fd_shader_type type, int *cnt);
 uint32_t fd_program_outloc(struct fd_program *program);
-void fd_program_emit_state(struct fd_program *program, uint32_t first,
-		struct fd_parameters *uniforms, struct fd_parameters *attr,
-		struct fd_parameters *bufs, struct fd_ringbuffer *ring);
+void fd_program_emit_state(struct fd_program *program, uint32_t mask,
+		uint32_t first, struct fd_parameters *uniforms,
+		struct fd_parameters *attr, struct fd_parameters *bufs,
+		struct fd_ringbuffer *ring);
 void fd_program_emit_compute_state(struct fd_program *program,
 		struct fd_parameters *uniforms, struct fd_parameters *attr,
 		struct fd_parameters *bufs, struct fd_ringbuffer *ring);
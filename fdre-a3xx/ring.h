@@ -25,6 +25,7 @@
 #define RING_H_
 
 #include <stdint.h>
+#include <string.h>
 
 #include <freedreno_drmif.h>
 #include <freedreno_ringbuffer.h>
@@ -114,4 +115,34 @@ OUT_IB(struct fd_ringbuffer *ring, struct fd_ringmarker *start,
 	OUT_RING(ring, fd_ringmarker_dwords(start, end));
 }
 
+/* A state object is a block of immutable, pre-baked state cmds.  Since
+ * a3xx only has two IB levels and the draw cmds are already IB'd per
+ * tile, from the draw cmds it has to be copied with OUT_STATEOBJ(), so
+ * the cmds are kept in ordinary (cached) cpu memory, and must not contain
+ * relocs.  From the top level cmds it can instead be IB'd, with
+ * fd_stateobj_emit_ib(), which copies it into a ringbuffer of its own
+ * the first time.  See fd_stateobj_begin()/fd_stateobj_end().
+ */
+struct fd_stateobj {
+	uint32_t *dwords;
+	uint32_t size;          /* allocated size of dwords, in bytes */
+	uint32_t sizedwords;    /* zero until baked */
+
+	/* wraps dwords while baking, so the usual OUT_xyz() can be used: */
+	struct fd_ringbuffer baking;
+
+	/* copy of the cmds for IB'ing, only created if needed: */
+	struct fd_ringbuffer *ring;
+	struct fd_ringmarker *start, *end;
+	bool in_ring;
+};
+
+static inline void
+OUT_STATEOBJ(struct fd_ringbuffer *ring, struct fd_stateobj *obj)
+{
+	BEGIN_RING(ring, obj->sizedwords);
+	memcpy(ring->cur, obj->dwords, obj->sizedwords * 4);
+	ring->cur += obj->sizedwords;
+}
+
 #endif /* RING_H_ */
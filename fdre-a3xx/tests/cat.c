@@ -328,7 +328,7 @@ void main(void)
 		fd_swap_buffers(state);
 	}
 
-	fd_flush(state);
+	fd_finish(state);
 
 	if (n == 1) {
 		fd_dump_bmp(surface, "lolscat.bmp");
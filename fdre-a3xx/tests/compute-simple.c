@@ -96,6 +96,7 @@ __kernel void simple(__global float *out, __global float *in)
 	fd_set_buf(state, "outbuf", outbuf);
 
 	fd_run_compute(state, 2, NULL, globalsize, localsize);
+	fd_finish(state);
 
 	fd_dump_hex_bo(outbuf, true);
 
@@ -326,7 +326,7 @@ int main(int argc, char **argv)
 		fd_swap_buffers(state);
 	}
 
-	fd_flush(state);
+	fd_finish(state);
 
 	if (n == 1) {
 		fd_dump_bmp(surface, "cube-textured.bmp");
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Check the GMEM bin layouts picked by fd_gmem_layout() against a table
+ * of expected layouts.  This doesn't touch the GPU, so unlike the rest
+ * of the tests it can run anywhere.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util.h"
+#include "gmem.h"
+
+#define KB 1024
+
+static const struct {
+	const char *name;
+	struct fd_gmem_params params;
+	/* expected: */
+	uint32_t nbins_x, nbins_y, bin_w, bin_h;
+	bool binning;
+} layouts[] = {
+#define LAYOUT(n, w, h, cpp, zcpp, gmem, bin, nx, ny, bw, bh, b) { \
+		.name = n, \
+		.params = { \
+			.width = w, .height = h, \
+			.cbuf_cpp = { cpp }, .zsbuf_cpp = zcpp, \
+			.gmem_size = gmem, .max_bin_w = 256, .binning = bin, \
+		}, \
+		.nbins_x = nx, .nbins_y = ny, .bin_w = bw, .bin_h = bh, \
+		.binning = b, \
+	}
+	/*     name                  w     h    cpp z  gmem      bin    nx ny  bw   bh  binning */
+	LAYOUT("tiny",               32,   32,  4, 0, 512*KB,   true,  1, 1,  32,  32, false),
+	LAYOUT("fits",               256,  256, 4, 0, 512*KB,   true,  1, 1, 256, 256, false),
+	LAYOUT("unaligned",          65,   33,  4, 0, 512*KB,   true,  1, 1,  96,  64, false),
+	LAYOUT("a320 800x600",       800,  600, 4, 0, 512*KB,   false, 5, 1, 160, 608, false),
+	LAYOUT("a320 800x600 z16",   800,  600, 4, 2, 512*KB,   false, 7, 1, 128, 608, false),
+	LAYOUT("a320 800x600 z24s8", 800,  600, 4, 4, 512*KB,   false, 9, 1,  96, 608, false),
+	LAYOUT("a320 800x600 rgb",   800,  600, 3, 0, 512*KB,   false, 4, 1, 224, 608, false),
+	LAYOUT("a330 800x600 z24s8", 800,  600, 4, 4, 1024*KB,  true,  5, 1, 160, 608, true),
+	LAYOUT("a330 1080p",         1920, 1080, 4, 0, 1024*KB, true,  8, 2, 256, 544, true),
+	LAYOUT("a330 1080p z24s8",   1920, 1080, 4, 4, 1024*KB, true,  9, 2, 224, 544, true),
+	LAYOUT("a330 1080p fp16",    1920, 1080, 8, 4, 1024*KB, true,  9, 3, 224, 384, true),
+	/* too tall for VSC_BIN_SIZE, so split in y to allow binning: */
+	LAYOUT("a330 tall",          256, 2000, 4, 0, 1024*KB,  true,  1, 3, 256, 672, true),
+	LAYOUT("a330 tall, no bin",  256, 2000, 4, 0, 1024*KB,  false, 1, 2, 256, 1024, false),
+#undef LAYOUT
+};
+
+/* the layout the old naive loop in attach_render_target() came up
+ * with, which the solver should never do worse than:
+ */
+static uint32_t naive_nbins(const struct fd_gmem_params *params)
+{
+	uint32_t nbins_x = 1, nbins_y = 1;
+	uint32_t bin_w = ALIGN(params->width, 32);
+	uint32_t bin_h = ALIGN(params->height, 32);
+	uint32_t gmem_size = params->gmem_size;
+	uint32_t cpp = params->cbuf_cpp[0];
+
+	if (params->zsbuf_cpp)
+		gmem_size /= 2;
+
+	while (bin_w > params->max_bin_w) {
+		nbins_x++;
+		bin_w = ALIGN(DIV_ROUND_UP(params->width, nbins_x), 32);
+	}
+
+	while ((bin_w * bin_h * cpp) > gmem_size) {
+		nbins_y++;
+		bin_h = ALIGN(DIV_ROUND_UP(params->height, nbins_y), 32);
+	}
+
+	return nbins_x * nbins_y;
+}
+
+static int check_layout(const char *name, const struct fd_gmem_params *params,
+		const struct fd_gmem_layout *layout)
+{
+	uint32_t npixels = layout->bin_w * layout->bin_h;
+	uint32_t end = 0, x, y;
+	int i, j, ret = 0;
+
+#define CHECK(cond) do { if (!(cond)) { \
+		printf("%s: %ux%u: check failed: %s\n", name, \
+				params->width, params->height, #cond); \
+		ret = -1; \
+	} } while (0)
+
+	CHECK(!(layout->bin_w % 32) && !(layout->bin_h % 32));
+	CHECK(layout->bin_w <= params->max_bin_w);
+	CHECK((layout->nbins_x * layout->bin_w) >= params->width);
+	CHECK((layout->nbins_y * layout->bin_h) >= params->height);
+	CHECK(((layout->nbins_x - 1) * layout->bin_w) < params->width);
+	CHECK(((layout->nbins_y - 1) * layout->bin_h) < params->height);
+	CHECK(!layout->binning || params->binning);
+
+	/* buffers should not overlap, and fit in gmem: */
+	for (i = 0; i < MAX_CBUFS; i++) {
+		if (!params->cbuf_cpp[i])
+			continue;
+		CHECK(!(layout->cbuf_base[i] % 0x4000));
+		CHECK(layout->cbuf_base[i] >= end);
+		end = layout->cbuf_base[i] + params->cbuf_cpp[i] * npixels;
+	}
+	if (params->zsbuf_cpp) {
+		CHECK(!(layout->zsbuf_base % 0x4000));
+		CHECK(layout->zsbuf_base >= end);
+		end = layout->zsbuf_base + params->zsbuf_cpp * npixels;
+	}
+	CHECK(end <= params->gmem_size);
+
+	/* each bin should be covered by exactly one pipe: */
+	for (y = 0; y < layout->nbins_y; y++) {
+		for (x = 0; x < layout->nbins_x; x++) {
+			int n = 0;
+			for (j = 0; j < MAX_PIPES; j++) {
+				if ((x >= layout->pipe[j].x) &&
+						(x < layout->pipe[j].x + layout->pipe[j].w) &&
+						(y >= layout->pipe[j].y) &&
+						(y < layout->pipe[j].y + layout->pipe[j].h))
+					n++;
+			}
+			CHECK(n == 1);
+		}
+	}
+
+	/* the naive loop only got it right if depth/stencil is no bigger
+	 * than color, and when it doesn't give up binning:
+	 */
+	if ((params->zsbuf_cpp <= params->cbuf_cpp[0]) && !layout->binning)
+		CHECK((layout->nbins_x * layout->nbins_y) <= naive_nbins(params));
+
+#undef CHECK
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct fd_gmem_layout layout;
+	struct fd_gmem_params params;
+	int i, fails = 0;
+
+	for (i = 0; i < ARRAY_SIZE(layouts); i++) {
+		const struct fd_gmem_params *p = &layouts[i].params;
+
+		if (fd_gmem_layout(p, &layout)) {
+			printf("%s: no layout\n", layouts[i].name);
+			fails++;
+			continue;
+		}
+
+		if ((layout.nbins_x != layouts[i].nbins_x) ||
+				(layout.nbins_y != layouts[i].nbins_y) ||
+				(layout.bin_w != layouts[i].bin_w) ||
+				(layout.bin_h != layouts[i].bin_h) ||
+				(layout.binning != layouts[i].binning)) {
+			printf("%s: got %ux%u bins of %ux%u%s, expected "
+					"%ux%u bins of %ux%u%s\n", layouts[i].name,
+					layout.nbins_x, layout.nbins_y,
+					layout.bin_w, layout.bin_h,
+					layout.binning ? " (binning)" : "",
+					layouts[i].nbins_x, layouts[i].nbins_y,
+					layouts[i].bin_w, layouts[i].bin_h,
+					layouts[i].binning ? " (binning)" : "");
+			fails++;
+		}
+
+		if (check_layout(layouts[i].name, p, &layout))
+			fails++;
+	}
+
+	/* and sweep over a range of sizes and formats, just checking that
+	 * the layouts are sane:
+	 */
+	for (i = 0; i < 2 * 3 * 3 * 16 * 16; i++) {
+		static const uint32_t cpps[] = { 2, 4, 8 };
+		static const uint32_t zcpps[] = { 0, 2, 4 };
+		int n = i;
+
+		memset(&params, 0, sizeof(params));
+		params.width = 1 + (n % 16) * 127;         n /= 16;
+		params.height = 1 + (n % 16) * 97;         n /= 16;
+		params.cbuf_cpp[0] = cpps[n % 3];          n /= 3;
+		params.zsbuf_cpp = zcpps[n % 3];           n /= 3;
+		params.gmem_size = (n % 2) ? 1024*KB : 512*KB;
+		params.max_bin_w = 256;
+		params.binning = !!(n % 2);
+
+		if (fd_gmem_layout(&params, &layout)) {
+			printf("sweep: %ux%u: no layout\n", params.width, params.height);
+			fails++;
+			continue;
+		}
+
+		if (check_layout("sweep", &params, &layout))
+			fails++;
+	}
+
+	printf("%d failures\n", fails);
+
+	return fails ? 1 : 0;
+}
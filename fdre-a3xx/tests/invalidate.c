@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Check that invalidating the color buffer skips the gmem2mem: the
+ * surface starts out green, and is cleared to red and then invalidated,
+ * so the red clear should never make it back to memory.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "freedreno.h"
+#include "redump.h"
+#include "ws.h"
+
+#define GREEN 0xff00ff00
+
+int main(int argc, char **argv)
+{
+	struct fd_state *state;
+	struct fd_surface *surface;
+	uint32_t *pixels;
+	uint32_t i, x, y, bad = 0;
+
+	DEBUG_MSG("----------------------------------------------------------------");
+	RD_START("fd-invalidate", "");
+
+	state = fd_init();
+	if (!state)
+		return -1;
+
+	surface = fd_surface_new(state, 64, 64);
+	if (!surface)
+		return -1;
+
+	pixels = malloc(surface->width * surface->height * 4);
+	for (i = 0; i < surface->width * surface->height; i++)
+		pixels[i] = GREEN;
+	fd_surface_upload(surface, pixels);
+	free(pixels);
+
+	fd_make_current(state, surface);
+
+	fd_clear_color(state, (float[]){ 1.0, 0.0, 0.0, 1.0 });
+	fd_clear(state, GL_COLOR_BUFFER_BIT);
+
+	/* re-binding the render target must not lose track of the
+	 * batch with the clear:
+	 */
+	fd_make_current(state, surface);
+
+	fd_invalidate(state, GL_COLOR_BUFFER_BIT);
+
+	fd_flush(state);
+	fd_finish(state);
+
+	pixels = fd_bo_map(surface->bo);
+	for (y = 0; y < surface->height; y++) {
+		for (x = 0; x < surface->width; x++) {
+			uint32_t p = pixels[(y * surface->pitch) + x];
+			if ((p != GREEN) && (bad++ < 8))
+				ERROR_MSG("pixel %u,%u: %08x", x, y, p);
+		}
+	}
+
+	if (bad)
+		ERROR_MSG("%u pixels resolved after invalidate", bad);
+
+	fd_fini(state);
+
+	RD_END();
+
+	return bad ? 1 : 0;
+}
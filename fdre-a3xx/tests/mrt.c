@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "freedreno.h"
+#include "redump.h"
+
+/* render a quad into four render targets at once, each MRT getting
+ * its own color, like the g-buffer pass of a deferred renderer:
+ */
+
+#define NR_CBUFS 4
+
+int main(int argc, char **argv)
+{
+	struct fd_state *state;
+	struct fd_surface *cbufs[NR_CBUFS];
+	int i;
+
+	float vertices[] = {
+			-0.45, -0.75, 0.0,
+			+0.45, -0.75, 0.0,
+			-0.45,  0.75, 0.0,
+			+0.45,  0.75, 0.0
+	};
+
+	float colors[] = {
+			1.0, 0.0, 0.0, 1.0,
+			0.0, 1.0, 0.0, 1.0,
+			0.0, 0.0, 1.0, 1.0,
+			1.0, 1.0, 1.0, 1.0,
+	};
+
+	const char *vertex_shader_asm =
+		"@attribute(r0.x)  aPosition                                      \n"
+		"@out(r0.x)        gl_Position                                    \n"
+		"(sy)(ss)end                                                      \n";
+	const char *fragment_shader_asm =
+		"@uniform(c0.x-c3.w) uColors                                      \n"
+		"@out(r0.x)          gl_FragData0                                 \n"
+		"@out(r1.x)          gl_FragData1                                 \n"
+		"@out(r2.x)          gl_FragData2                                 \n"
+		"@out(r3.x)          gl_FragData3                                 \n"
+		"(sy)(ss)(rpt3)mov.f32f32 r0.x, (r)c0.x                           \n"
+		"(rpt3)mov.f32f32 r1.x, (r)c1.x                                   \n"
+		"(rpt3)mov.f32f32 r2.x, (r)c2.x                                   \n"
+		"(rpt3)mov.f32f32 r3.x, (r)c3.x                                   \n"
+		"end                                                              \n";
+
+	DEBUG_MSG("----------------------------------------------------------------");
+	RD_START("fd-mrt", "");
+
+	state = fd_init();
+	if (!state)
+		return -1;
+
+	for (i = 0; i < NR_CBUFS; i++) {
+		cbufs[i] = fd_surface_new(state, 256, 256);
+		if (!cbufs[i])
+			return -1;
+	}
+
+	fd_make_current_mrt(state, cbufs, NR_CBUFS);
+
+	fd_vertex_shader_attach_asm(state, vertex_shader_asm);
+	fd_fragment_shader_attach_asm(state, fragment_shader_asm);
+
+	fd_link(state);
+
+	fd_clear_color(state, (float[]){ 0.5, 0.5, 0.5, 1.0 });
+	fd_clear(state, GL_COLOR_BUFFER_BIT);
+
+	fd_attribute_pointer(state, "aPosition", VFMT_FLOAT_32_32_32, 4, vertices);
+
+	fd_uniform_attach(state, "uColors", 4, NR_CBUFS, colors);
+
+	fd_draw_arrays(state, GL_TRIANGLE_STRIP, 0, 4);
+
+	fd_swap_buffers(state);
+
+	fd_finish(state);
+
+	for (i = 0; i < NR_CBUFS; i++) {
+		char name[32];
+		sprintf(name, "mrt%d.bmp", i);
+		fd_dump_bmp(cbufs[i], name);
+	}
+
+	sleep(1);
+
+	for (i = 1; i < NR_CBUFS; i++)
+		fd_surface_del(state, cbufs[i]);
+
+	fd_fini(state);
+
+	RD_END();
+
+	return 0;
+}
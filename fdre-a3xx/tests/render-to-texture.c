@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "freedreno.h"
+#include "redump.h"
+
+/* render to a texture, and then sample from it while rendering to the
+ * screen surface.  The render targets are switched back and forth
+ * without flushing in between, so the two batches are only flushed by
+ * fd_swap_buffers(), the texture's batch first since the other one
+ * samples from it.
+ */
+
+int main(int argc, char **argv)
+{
+	struct fd_state *state;
+	struct fd_surface *surface, *tex;
+	struct fd_program *flat_program, *tex_program;
+
+	float triangle[] = {
+			-0.75, -0.75, 0.0,
+			+0.75, -0.75, 0.0,
+			+0.00, +0.75, 0.0,
+	};
+
+	float quad[] = {
+			-0.75, -0.75, 0.0,
+			+0.75, -0.75, 0.0,
+			-0.75, +0.75, 0.0,
+			+0.75, +0.75, 0.0,
+	};
+
+	float texcoords[] = {
+			0.0f, 0.0f,
+			1.0f, 0.0f,
+			0.0f, 1.0f,
+			1.0f, 1.0f,
+	};
+
+	float color[] = {
+			0.0, 0.0, 1.0, 1.0
+	};
+
+	const char *flat_vertex_shader_asm =
+		"@attribute(r0.x)  aPosition                                      \n"
+		"(sy)(ss)end                                                      \n";
+	const char *flat_fragment_shader_asm =
+		"@uniform(hc0.x) uColor                                           \n"
+		"(sy)(ss)(rpt3)mov.f16f16 hr0.x, (r)hc0.x                         \n"
+		"end                                                              \n";
+
+	const char *tex_vertex_shader_asm =
+		"@attribute(r0.x)         aPosition                               \n"
+		"@attribute(r1.x-r1.y)    aTexCoord                               \n"
+		"@varying(r1.x-r1.y)      vTexCoord                               \n"
+		"(sy)(ss)end                                                      \n";
+	const char *tex_fragment_shader_asm =
+		"@varying(r1.x-r1.y)      vTexCoord                               \n"
+		"@sampler(0)              uTexture                                \n"
+		"(sy)(ss)(rpt1)bary.f (ei)r0.z, (r)0, r0.x                        \n"
+		"(rpt5)nop                                                        \n"
+		"sam (f16)(xyzw)hr0.x, r0.z, s#0, t#0                             \n"
+		"end                                                              \n";
+
+	DEBUG_MSG("----------------------------------------------------------------");
+	RD_START("fd-render-to-texture", "");
+
+	state = fd_init();
+	if (!state)
+		return -1;
+
+	surface = fd_surface_new(state, 256, 256);
+	if (!surface)
+		return -1;
+
+	tex = fd_surface_new(state, 64, 64);
+	if (!tex)
+		return -1;
+
+	flat_program = fd_program_new(state);
+	fd_program_attach_asm(flat_program, FD_SHADER_VERTEX,
+			flat_vertex_shader_asm);
+	fd_program_attach_asm(flat_program, FD_SHADER_FRAGMENT,
+			flat_fragment_shader_asm);
+
+	tex_program = fd_program_new(state);
+	fd_program_attach_asm(tex_program, FD_SHADER_VERTEX,
+			tex_vertex_shader_asm);
+	fd_program_attach_asm(tex_program, FD_SHADER_FRAGMENT,
+			tex_fragment_shader_asm);
+
+	/* start on the screen surface: */
+	fd_make_current(state, surface);
+
+	fd_clear_color(state, (float[]){ 0.5, 0.5, 0.5, 1.0 });
+	fd_clear(state, GL_COLOR_BUFFER_BIT);
+
+	/* switch to the texture, without flushing the screen's cmds: */
+	fd_make_current(state, tex);
+
+	fd_clear_color(state, (float[]){ 1.0, 0.0, 0.0, 1.0 });
+	fd_clear(state, GL_COLOR_BUFFER_BIT);
+
+	fd_set_program(state, flat_program);
+	fd_attribute_pointer(state, "aPosition", VFMT_FLOAT_32_32_32, 3, triangle);
+	fd_uniform_attach(state, "uColor", 4, 1, color);
+	fd_draw_arrays(state, GL_TRIANGLES, 0, 3);
+
+	/* and back to the screen, to draw a quad textured with it: */
+	fd_make_current(state, surface);
+
+	fd_set_program(state, tex_program);
+	fd_set_texture(state, "uTexture", tex);
+	fd_attribute_pointer(state, "aPosition", VFMT_FLOAT_32_32_32, 4, quad);
+	fd_attribute_pointer(state, "aTexCoord", VFMT_FLOAT_32_32, 4, texcoords);
+	fd_draw_arrays(state, GL_TRIANGLE_STRIP, 0, 4);
+
+	fd_swap_buffers(state);
+
+	fd_finish(state);
+
+	fd_dump_bmp(tex, "render-to-texture-tex.bmp");
+	fd_dump_bmp(surface, "render-to-texture.bmp");
+
+	sleep(1);
+
+	fd_surface_del(state, tex);
+
+	fd_fini(state);
+
+	RD_END();
+
+	return 0;
+}
@@ -112,7 +112,7 @@ int main(int argc, char **argv)
 
 	fd_swap_buffers(state);
 
-	fd_flush(state);
+	fd_finish(state);
 
 	fd_dump_bmp(surface, "strip-smoothed.bmp");
 
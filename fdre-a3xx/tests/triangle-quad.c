@@ -120,7 +120,7 @@ int main(int argc, char **argv)
 
 	fd_swap_buffers(state);
 
-	fd_flush(state);
+	fd_finish(state);
 
 	fd_query_read(state, &ctrs);
 	fd_query_dump(&ctrs);
@@ -138,6 +138,7 @@ static inline uint32_t DRAW(enum pc_di_primtype prim_type,
 #define enable_debug 1  /* TODO make dynamic */
 
 #define ALIGN(v,a) (((v) + (a) - 1) & ~((a) - 1))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
 #define INFO_MSG(fmt, ...) \
@@ -165,6 +166,7 @@ struct fd_param {
 	union {
 		struct {                  /* attributes */
 			struct fd_bo     *bo;
+			uint32_t          offset;
 			enum a3xx_vtx_fmt fmt;
 		};
 		struct fd_surface *tex;   /* textures */
@@ -119,11 +119,16 @@ static int post_surface(struct fd_winsys *ws, struct fd_surface *surface)
 		if (len > ws_dri2->dri2buf->pitch[0])
 			len = ws_dri2->dri2buf->pitch[0];
 
+		/* rendering is asynchronous, wait for it before copying: */
+		fd_bo_cpu_prep(surface->bo, ws->pipe, DRM_FREEDRENO_PREP_READ);
+
 		for (i = 0; i < surface->height; i++) {
 			memcpy(dstptr, srcptr, len);
 			dstptr += ws_dri2->dri2buf->pitch[0];
 			srcptr += len;
 		}
+
+		fd_bo_cpu_fini(surface->bo);
 	}
 
 	DRI2SwapBuffers(ws_dri2->dpy, ws_dri2->win, 0, 0, 0, &count);
@@ -110,11 +110,16 @@ static int post_surface(struct fd_winsys *ws, struct fd_surface *surface)
 		if (len > ws_fbdev->fix.line_length)
 			len = ws_fbdev->fix.line_length;
 
+		/* rendering is asynchronous, wait for it before copying: */
+		fd_bo_cpu_prep(surface->bo, ws->pipe, DRM_FREEDRENO_PREP_READ);
+
 		for (i = 0; i < surface->height; i++) {
 			memcpy(dstptr, srcptr, len);
 			dstptr += ws_fbdev->fix.line_length;
 			srcptr += len;
 		}
+
+		fd_bo_cpu_fini(surface->bo);
 	}
 
 	return 0;
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2014 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef INSTR_LATENCY_H_
+#define INSTR_LATENCY_H_
+
+/* The latency model shared by the pgmdump/cffdump cost estimate and
+ * the fdasm scheduler.  The result latencies, in cycles, are guessed:
+ */
+#define TEX_LATENCY  40     /* cat5, cat6, and a2xx fetches */
+#define SFU_LATENCY  10     /* cat4 */
+
+/* wait, at a sync point, for results issued before 'ready', returning
+ * the number of cycles stalled:
+ */
+static inline unsigned stall(unsigned *cycle, unsigned *ready)
+{
+	unsigned n = 0;
+	if (*ready > *cycle) {
+		n = *ready - *cycle;
+		*cycle = *ready;
+	}
+	*ready = 0;
+	return n;
+}
+
+#endif /* INSTR_LATENCY_H_ */
@@ -6,6 +6,16 @@
 --
 --   cffdump --script scripts/analyze.lua a320/quad-flat-*.rd a420/quad-flat-*.rd
 --
+-- or, to split the captures across 8 worker processes:
+--
+--   cffdump --jobs 8 --script scripts/analyze.lua a320/quad-flat-*.rd ...
+--
+-- The register state can also be captured once with --emit-state, and
+-- the analysis re-run against the snapshot without decoding again:
+--
+--   cffdump --emit-state quad-flat.snap a320/quad-flat-*.rd a420/quad-flat-*.rd
+--   cffdump --script scripts/analyze.lua quad-flat.snap
+--
 -- This is done by comparing unique register values.  Ie. for each
 -- generation, find the set of registers that have different values
 -- between equivalent draw calls.
@@ -108,6 +118,42 @@ function end_cmdstream()
   testname = nil
 end
 
+-- in --jobs mode, each worker hands back its results table, which
+-- is merged into the results table of the parent before finish():
+function partial()
+  return results
+end
+
+function merge(partial)
+  for gpuname,pgpu in pairs(partial) do
+    local gpu = results[gpuname]
+    if gpu == nil then
+      gpu = {["tests"] = {}, ["regvals"] = {}}
+      results[gpuname] = gpu
+    end
+    for testname,test in pairs(pgpu["tests"]) do
+      gpu["tests"][testname] = test
+    end
+    for regbase,pregvals in pairs(pgpu["regvals"]) do
+      local uniq_regvals = gpu["regvals"][regbase]
+      if uniq_regvals == nil then
+        uniq_regvals = {}
+        gpu["regvals"][regbase] = uniq_regvals
+      end
+      for regval,pdrawlist in pairs(pregvals) do
+        local drawlist = uniq_regvals[regval]
+        if drawlist == nil then
+          drawlist = {}
+          uniq_regvals[regval] = drawlist
+        end
+        for idx,draw in ipairs(pdrawlist) do
+          table.insert(drawlist, draw)
+        end
+      end
+    end
+  end
+end
+
 function print_draws(gpuname, gpu)
   io.write("  " .. gpuname .. "\n")
   for testname,test in pairs(gpu["tests"]) do
@@ -123,15 +169,15 @@ end
 -- TODO maybe we instead want a scheme that allows for some fuzzyness
 -- in the matching??
 function drawlistname(drawlist)
-  local name = nil
+  local sorted = {}
   for idx,draw in pairs(drawlist) do
-    if name == nil then
-      name = draw
-    else
-      name = name .. ":" .. draw
-    end
+    table.insert(sorted, draw)
+  end
+  if #sorted == 0 then
+    return nil
   end
-  return name
+  table.sort(sorted)
+  return table.concat(sorted, ":")
 end
 
 local rnntbl = {}
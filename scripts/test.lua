@@ -17,3 +17,26 @@ function finish()
   io.write("FINISH\n")
 end
 
+
+-- optional hooks, only called if defined:
+
+function start_ib(ibaddr, ibsize)
+  io.write(string.format("IB: %08x (%d dwords)\n", ibaddr, ibsize))
+end
+
+function end_ib()
+  io.write("END IB\n")
+end
+
+function set_bin(x1, y1, x2, y2)
+  io.write("BIN: " .. x1 .. "," .. y1 .. "-" .. x2 .. "," .. y2 .. "\n")
+end
+
+function load_state(state_block, state_type, num_unit, contents)
+  local len = contents and #contents or 0
+  io.write("LOAD_STATE: block=" .. state_block .. ", type=" .. state_type .. ", num_unit=" .. num_unit .. ", " .. len .. " bytes\n")
+end
+
+function buffer(gpuaddr, len)
+  io.write(string.format("BUFFER: %08x (%d bytes)\n", gpuaddr, len))
+end
@@ -0,0 +1,76 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#ifndef CFFDEC_H_
+#define CFFDEC_H_
+
+#include <stdint.h>
+
+/* Entry point to use the cffdump decoder as a library (ie. for rddiff),
+ * when cffdump.c is built with CFFDEC_LIBRARY defined.  The decoder
+ * tracks register state, and the shader/const state loaded with
+ * CP_LOAD_STATE (or CP_IM_LOAD_IMMEDIATE for a2xx shaders), and calls
+ * back at each draw with a view of the current state.
+ */
+
+enum cffdec_stage {
+	CFFDEC_VS,
+	CFFDEC_FS,
+	CFFDEC_NSTAGES,
+};
+
+struct cffdec_draw {
+	const char *primtype;
+	uint32_t nindx;
+	uint32_t bin_x1, bin_y1, bin_x2, bin_y2;
+	/* indexed by regbase, and bitmask of registers written: */
+	const uint32_t *regvals;
+	const uint8_t *written;
+	struct {
+		const uint32_t *shader;
+		uint32_t shader_sizedwords;
+		const uint32_t *consts;
+		uint32_t consts_sizedwords;
+	} stage[CFFDEC_NSTAGES];
+	/* incremented whenever shader/const state is loaded, so users can
+	 * skip re-hashing it when nothing changed:
+	 */
+	uint32_t load_seqno;
+};
+
+#define CFFDEC_NREGS (0x7fff + 1)
+
+/* note that the pointers in the draw are only valid during the callback: */
+typedef void (*cffdec_draw_cb)(void *priv, const struct cffdec_draw *draw);
+
+int cffdec_decode_file(const char *filename, cffdec_draw_cb cb, void *priv);
+
+/* gpu_id of the last decoded file: */
+unsigned cffdec_gpu_id(void);
+
+#endif /* CFFDEC_H_ */
@@ -28,13 +28,19 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <string.h>
 #include <assert.h>
 
 #include "redump.h"
 #include "disasm.h"
 #include "script.h"
+#include "snapshot.h"
+#include "shader-store.h"
+#include "shader-cost.h"
+#include "cffdec.h"
 #include "io.h"
 #include "rnnutil.h"
 
@@ -52,6 +58,16 @@ typedef enum {
 
 static bool needs_wfi = false;
 static bool dump_shaders = false;
+
+/* for the --dump-shaders index, the position of the current draw and
+ * hashes of the currently loaded shaders:
+ */
+static const char *cur_filename;
+static int cur_cmdstream, cur_draw;
+static uint64_t cur_shader_hash[2];
+
+/* estimated cost of the currently loaded vs/fs, reported per draw: */
+static struct shader_cost cur_cost[2];
 static bool no_color = false;
 static bool summary = false;
 static bool allregs = false;
@@ -68,11 +84,22 @@ int nquery;
 
 static char *script;
 
+/* # of worker processes for --jobs: */
+#define MAX_JOBS 256
+static int jobs = 1;
+
+/* for --emit-state, register-state snapshot being written: */
+static struct snapshot *emit_state;
+
+/* for cffdec_decode_file(), callback at each draw: */
+static cffdec_draw_cb draw_cb;
+static void *draw_cb_priv;
+
 static bool quiet(int lvl)
 {
-	if ((lvl >= 3) && (summary || querystrs || script))
+	if ((lvl >= 3) && (summary || querystrs || script || emit_state || draw_cb))
 		return true;
-	if ((lvl >= 2) && (querystrs || script))
+	if ((lvl >= 2) && (querystrs || script || emit_state || draw_cb))
 		return true;
 	return false;
 }
@@ -681,6 +708,16 @@ static void init_a4xx(void)
 	init_rnn("a4xx");
 }
 
+static void init_gpu(void)
+{
+	if (gpu_id >= 400)
+		init_a4xx();
+	else if (gpu_id >= 300)
+		init_a3xx();
+	else
+		init_a2xx();
+}
+
 static void init(void)
 {
 	if (!initialized) {
@@ -786,7 +823,75 @@ static void dump_domain(uint32_t *dwords, uint32_t sizedwords, int level,
 
 static uint32_t bin_x1, bin_x2, bin_y1, bin_y2;
 
-/* well, actually query and script.. */
+/* shader/const state, tracked only for draw_cb: */
+static struct {
+	uint32_t shader[4096];
+	uint32_t shader_sizedwords;
+	uint32_t consts[2048];
+	uint32_t consts_sizedwords;
+} loaded_state[CFFDEC_NSTAGES];
+static uint32_t loaded_seqno;
+
+static void clear_loaded_state(void)
+{
+	memset(loaded_state, 0, sizeof(loaded_state));
+	loaded_seqno++;
+}
+
+/* offset and size in dwords: */
+static void track_load_state(enum cffdec_stage stage, bool shader,
+		uint32_t offset, uint32_t *dwords, uint32_t sizedwords)
+{
+	uint32_t *dst, *dst_sizedwords, max;
+
+	if (shader) {
+		dst = loaded_state[stage].shader;
+		dst_sizedwords = &loaded_state[stage].shader_sizedwords;
+		max = ARRAY_SIZE(loaded_state[stage].shader);
+		/* a new program replaces the old one: */
+		if (offset == 0)
+			*dst_sizedwords = 0;
+	} else {
+		dst = loaded_state[stage].consts;
+		dst_sizedwords = &loaded_state[stage].consts_sizedwords;
+		max = ARRAY_SIZE(loaded_state[stage].consts);
+	}
+
+	if (offset >= max)
+		return;
+	sizedwords = min(sizedwords, max - offset);
+
+	memcpy(&dst[offset], dwords, sizedwords * 4);
+	*dst_sizedwords = max(*dst_sizedwords, offset + sizedwords);
+	loaded_seqno++;
+}
+
+static void do_draw_cb(const char *mode, uint32_t num_indices)
+{
+	struct cffdec_draw draw = {
+			.primtype = mode,
+			.nindx    = num_indices,
+			.bin_x1   = bin_x1,
+			.bin_y1   = bin_y1,
+			.bin_x2   = bin_x2,
+			.bin_y2   = bin_y2,
+			.regvals  = type0_reg_vals,
+			.written  = type0_reg_written,
+			.load_seqno = loaded_seqno,
+	};
+	int i;
+
+	for (i = 0; i < CFFDEC_NSTAGES; i++) {
+		draw.stage[i].shader = loaded_state[i].shader;
+		draw.stage[i].shader_sizedwords = loaded_state[i].shader_sizedwords;
+		draw.stage[i].consts = loaded_state[i].consts;
+		draw.stage[i].consts_sizedwords = loaded_state[i].consts_sizedwords;
+	}
+
+	draw_cb(draw_cb_priv, &draw);
+}
+
+/* well, actually query, script, and everything else done per draw.. */
 static void do_query(const char *mode, uint32_t num_indices)
 {
 	int i;
@@ -800,8 +905,21 @@ static void do_query(const char *mode, uint32_t num_indices)
 		}
 	}
 
-	if (num_indices > 0)
+	if (num_indices > 0) {
 		script_draw(mode, num_indices);
+		if (emit_state)
+			snapshot_draw(emit_state, mode, num_indices,
+					bin_x1, bin_y1, bin_x2, bin_y2,
+					type0_reg_vals, type0_reg_written);
+		if (draw_cb)
+			do_draw_cb(mode, num_indices);
+		if (dump_shaders)
+			shader_store_index("%s %d %d %s %016llx %016llx\n",
+					cur_filename, cur_cmdstream, cur_draw, mode,
+					(unsigned long long)cur_shader_hash[0],
+					(unsigned long long)cur_shader_hash[1]);
+		cur_draw++;
+	}
 }
 
 static void cp_im_loadi(uint32_t *dwords, uint32_t sizedwords, int level)
@@ -809,7 +927,9 @@ static void cp_im_loadi(uint32_t *dwords, uint32_t sizedwords, int level)
 	uint32_t start = dwords[1] >> 16;
 	uint32_t size  = dwords[1] & 0xffff;
 	const char *type = NULL, *ext = NULL;
+	struct disasm_a2xx_instr *instrs;
 	enum shader_t disasm_type;
+	int n;
 
 	switch (dwords[0]) {
 	case 0:
@@ -826,17 +946,45 @@ static void cp_im_loadi(uint32_t *dwords, uint32_t sizedwords, int level)
 		type = "<unknown>"; break;
 	}
 
+	if (draw_cb && ext)
+		track_load_state((disasm_type == SHADER_VERTEX) ? CFFDEC_VS : CFFDEC_FS,
+				true, 0, dwords + 2, sizedwords - 2);
+
 	printf("%s%s shader, start=%04x, size=%04x\n", levels[level], type, start, size);
-	disasm_a2xx(dwords + 2, sizedwords - 2, level+2, disasm_type);
+	n = disasm_a2xx_decoded(dwords + 2, sizedwords - 2, level+2,
+			disasm_type, &instrs);
+
+	if (ext)
+		shader_cost_a2xx(instrs, n,
+				&cur_cost[disasm_type == SHADER_FRAGMENT]);
+
+	free(instrs);
 
 	/* dump raw shader: */
-	if (ext && dump_shaders) {
-		static int n = 0;
-		char filename[8];
-		int fd;
-		sprintf(filename, "%04d.%s", n++, ext);
-		fd = open(filename, O_WRONLY| O_TRUNC | O_CREAT, 0644);
-		write(fd, dwords + 2, (sizedwords - 2) * 4);
+	if (ext && dump_shaders)
+		cur_shader_hash[disasm_type == SHADER_FRAGMENT] =
+				shader_store(dwords + 2, sizedwords - 2, ext);
+}
+
+/* size of the state loaded by CP_LOAD_STATE, in dwords: */
+static uint32_t load_state_sizedwords(enum adreno_state_block state_block_id,
+		enum adreno_state_type state_type, uint32_t num_unit)
+{
+	switch (state_block_id) {
+	case SB_FRAG_SHADER:
+	case SB_VERT_SHADER:
+		/* instruction groups of 4 64bit instrs, or pairs of dwords: */
+		if (state_type == ST_SHADER)
+			return num_unit * 4 * 2;
+		return num_unit * 2;
+	case SB_FRAG_TEX:
+	case SB_VERT_TEX:
+		/* samplers are 2 dwords, tex consts are 4 dwords: */
+		if (state_type == ST_SHADER)
+			return num_unit * 2;
+		return num_unit * 4;
+	default:
+		return num_unit;
 	}
 }
 
@@ -846,19 +994,50 @@ static void cp_load_state(uint32_t *dwords, uint32_t sizedwords, int level)
 	enum adreno_state_type state_type = dwords[1] & 0x3;
 	uint32_t num_unit = (dwords[0] >> 22) & 0x1ff;
 	uint32_t ext_src_addr = dwords[1] & 0xfffffffc;
+	uint32_t contents_sizedwords;
 	void *contents = NULL;
 	int i;
 
-	if (quiet(2))
-		return;
-
 	/* we could either have a ptr to other gpu buffer, or directly have
 	 * contents inline:
 	 */
-	if (ext_src_addr)
+	if (ext_src_addr) {
 		contents = hostptr(ext_src_addr);
-	else
+		contents_sizedwords = hostlen(ext_src_addr) / 4;
+	} else {
 		contents = dwords + 2;
+		contents_sizedwords = (sizedwords > 2) ? sizedwords - 2 : 0;
+	}
+
+	/* don't trust num_unit to stay within the buffer: */
+	contents_sizedwords = min(contents_sizedwords,
+			load_state_sizedwords(state_block_id, state_type, num_unit));
+
+	script_load_state(state_block_id, state_type, num_unit, contents,
+			contents_sizedwords);
+
+	if (draw_cb && contents && ((state_block_id == SB_VERT_SHADER) ||
+			(state_block_id == SB_FRAG_SHADER))) {
+		track_load_state((state_block_id == SB_VERT_SHADER) ? CFFDEC_VS : CFFDEC_FS,
+				state_type == ST_SHADER, (dwords[0] & 0xffff) * 2, contents,
+				contents_sizedwords);
+	}
+
+	/* dump raw shader (note, from contents, since it may come from an
+	 * external buffer rather than inline).  This is done even when
+	 * quiet, so the index has the shaders for every draw:
+	 */
+	if (dump_shaders && contents && (state_type == ST_SHADER)) {
+		if (state_block_id == SB_VERT_SHADER)
+			cur_shader_hash[0] = shader_store(contents,
+					contents_sizedwords, "vo3");
+		else if (state_block_id == SB_FRAG_SHADER)
+			cur_shader_hash[1] = shader_store(contents,
+					contents_sizedwords, "fo3");
+	}
+
+	if (quiet(2))
+		return;
 
 	if (!contents)
 		return;
@@ -867,41 +1046,31 @@ static void cp_load_state(uint32_t *dwords, uint32_t sizedwords, int level)
 	case SB_FRAG_SHADER:
 	case SB_VERT_SHADER:
 		if (state_type == ST_SHADER) {
+			const struct disasm_a3xx_instr *instrs;
 			enum shader_t disasm_type;
-			const char *ext = NULL;
+			int n;
 
 			/* shaders:
 			 *
 			 * note: num_unit seems to be # of instruction groups, where
 			 * an instruction group has 4 64bit instructions.
 			 */
-			if (state_block_id == SB_VERT_SHADER) {
-				ext = "vo3";
+			if (state_block_id == SB_VERT_SHADER)
 				disasm_type = SHADER_VERTEX;
-			} else {
-				ext = "fo3";
+			else
 				disasm_type = SHADER_FRAGMENT;
-			}
 
-			if (contents)
-				disasm_a3xx(contents, num_unit * 4 * 2, level+2, disasm_type);
-
-			/* dump raw shader: */
-			if (ext && dump_shaders) {
-				static int n = 0;
-				char filename[8];
-				int fd;
-				sprintf(filename, "%04d.%s", n++, ext);
-				fd = open(filename, O_WRONLY| O_TRUNC | O_CREAT, 0644);
-				write(fd, dwords + 2, (sizedwords - 2) * 4);
-			}
+			n = disasm_a3xx_decoded(contents, contents_sizedwords,
+					level+2, disasm_type, &instrs);
+			shader_cost_a3xx(instrs, n,
+					&cur_cost[disasm_type == SHADER_FRAGMENT]);
 		} else {
 			/* uniforms/consts:
 			 *
 			 * note: num_unit seems to be # of pairs of dwords??
 			 */
-			dump_float(contents, num_unit*2, level+1);
-			dump_hex(contents, num_unit*2, level+1);
+			dump_float(contents, contents_sizedwords, level+1);
+			dump_hex(contents, contents_sizedwords, level+1);
 		}
 		break;
 	case SB_VERT_MIPADDR:
@@ -973,6 +1142,8 @@ static void cp_set_bin(uint32_t *dwords, uint32_t sizedwords, int level)
 	bin_y1 = dwords[1] >> 16;
 	bin_x2 = dwords[2] & 0xffff;
 	bin_y2 = dwords[2] >> 16;
+
+	script_set_bin(bin_x1, bin_y1, bin_x2, bin_y2);
 }
 
 static void dump_tex_const(uint32_t *dwords, uint32_t sizedwords, uint32_t val, int level)
@@ -1119,6 +1290,11 @@ static void dump_register_summary(int level)
 	for (i = 0; i < 0x7fff; i++) {
 		uint32_t regbase = i;
 		uint32_t lastval = reg_val(regbase);
+		/* skip unwritten registers a byte of the bitmask at a time: */
+		if (!type0_reg_written[regbase/8]) {
+			i |= 7;
+			continue;
+		}
 		/* skip registers that have zero: */
 		if (!lastval && !allregs)
 			continue;
@@ -1136,6 +1312,18 @@ static void dump_register_summary(int level)
 //	clear_written();
 }
 
+static void dump_draw_cost(int level)
+{
+	int i;
+	for (i = 0; i < 2; i++) {
+		if (!cur_cost[i].ninstrs)
+			continue;
+		printf("%s%s cost:       ", levels[level], i ? "fs" : "vs");
+		shader_cost_print(stdout, &cur_cost[i]);
+		printf("\n");
+	}
+}
+
 static uint32_t draw_indx_common(uint32_t *dwords, int level)
 {
 	uint32_t prim_type     = dwords[1] & 0x1f;
@@ -1154,6 +1342,9 @@ static uint32_t draw_indx_common(uint32_t *dwords, int level)
 			source_select);
 	printl(2, "%snum_indices:   %d\n", levels[level], num_indices);
 
+	if ((num_indices > 0) && !quiet(2))
+		dump_draw_cost(level);
+
 	vertices += num_indices;
 
 	return num_indices;
@@ -1300,7 +1491,9 @@ static void cp_indirect(uint32_t *dwords, uint32_t sizedwords, int level)
 	}
 
 	if (ptr) {
+		script_start_ib(ibaddr, ibsize);
 		dump_commands(ptr, ibsize, level);
+		script_end_ib();
 	} else {
 		fprintf(stderr, "could not find: %08x (%d)\n", ibaddr, ibsize);
 	}
@@ -1470,6 +1663,7 @@ static void dump_commands(uint32_t *dwords, uint32_t sizedwords, int level)
 				if (name)
 					dump_domain(dwords+1, count-1, level+2, name);
 			}
+			script_packet(val, dwords+1, count-1);
 			if (type3_op[val].fxn)
 				type3_op[val].fxn(dwords+1, count-1, level+1);
 			if (!quiet(2))
@@ -1490,6 +1684,130 @@ static void dump_commands(uint32_t *dwords, uint32_t sizedwords, int level)
 }
 
 static int handle_file(const char *filename, int start, int end);
+static int handle_snapshot(const char *filename);
+
+int cffdec_decode_file(const char *filename, cffdec_draw_cb cb, void *priv)
+{
+	int ret;
+
+	no_color = true;
+	if (!rnn)
+		rnn = rnn_new(no_color);
+
+	draw_cb = cb;
+	draw_cb_priv = priv;
+
+	ret = handle_file(filename, 0, 0x7ffffff);
+
+	draw_cb = NULL;
+	draw_cb_priv = NULL;
+
+	return ret;
+}
+
+unsigned cffdec_gpu_id(void)
+{
+	return gpu_id;
+}
+
+#ifndef CFFDEC_LIBRARY
+
+/* In parallel mode, the files are split round-robin between worker
+ * processes.  Each worker runs the script (start_cmdstream/draw/
+ * end_cmdstream) over its subset, and writes back the result of the
+ * script's partial() fxn, which is handed to merge() in the parent
+ * before finish().  Note that workers are fork()'d rather than threads,
+ * since the decoder state (register values, buffers, etc) is global.
+ */
+static void kill_workers(pid_t *pids, int *fds, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		close(fds[i]);
+		kill(pids[i], SIGTERM);
+	}
+
+	for (i = 0; i < n; i++)
+		waitpid(pids[i], NULL, 0);
+}
+
+static int handle_files_parallel(char **files, int nfiles, int start, int end)
+{
+	pid_t pids[jobs];
+	int fds[jobs];
+	int i, j, ret = 0;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < jobs; i++) {
+		int p[2];
+
+		if (pipe(p)) {
+			fprintf(stderr, "pipe failed\n");
+			kill_workers(pids, fds, i);
+			return -1;
+		}
+
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			fprintf(stderr, "fork failed\n");
+			close(p[0]);
+			close(p[1]);
+			kill_workers(pids, fds, i);
+			return -1;
+		}
+
+		if (pids[i] == 0) {
+			close(p[0]);
+			for (j = i; j < nfiles; j += jobs) {
+				if (handle_file(files[j], start, end)) {
+					fprintf(stderr, "error reading: %s\n", files[j]);
+					fprintf(stderr, "continuing..\n");
+				}
+			}
+			ret = script_write_partial(p[1]);
+			close(p[1]);
+			exit(ret ? 1 : 0);
+		}
+
+		close(p[1]);
+		fds[i] = p[0];
+	}
+
+	/* merge results in worker order, so output is deterministic: */
+	for (i = 0; i < jobs; i++) {
+		char *buf = NULL;
+		size_t len = 0, sz = 0;
+		ssize_t n;
+		int status;
+
+		do {
+			if (len == sz) {
+				sz = sz ? (sz * 2) : 0x10000;
+				buf = realloc(buf, sz);
+			}
+			n = read(fds[i], buf + len, sz - len);
+			if (n > 0)
+				len += n;
+		} while (n > 0);
+
+		close(fds[i]);
+		waitpid(pids[i], &status, 0);
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "worker %d failed\n", i);
+			ret = -1;
+		} else if (script_merge(buf, len)) {
+			ret = -1;
+		}
+
+		free(buf);
+	}
+
+	return ret;
+}
 
 int main(int argc, char **argv)
 {
@@ -1559,6 +1877,28 @@ int main(int argc, char **argv)
 			continue;
 		}
 
+		if (!strcmp(argv[n], "--emit-state")) {
+			n++;
+			emit_state = snapshot_create(argv[n]);
+			if (!emit_state)
+				return 1;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--jobs") ||
+				!strcmp(argv[n], "-j")) {
+			n++;
+			jobs = (n < argc) ? atoi(argv[n]) : 0;
+			if ((jobs < 1) || (jobs > MAX_JOBS)) {
+				fprintf(stderr, "--jobs must be between 1 and %d\n",
+						MAX_JOBS);
+				return 1;
+			}
+			n++;
+			continue;
+		}
+
 		if (!strcmp(argv[n], "--query") ||
 				!strcmp(argv[n], "-q")) {
 			n++;
@@ -1574,6 +1914,26 @@ int main(int argc, char **argv)
 
 	rnn = rnn_new(no_color);
 
+	if ((jobs > 1) && !script) {
+		fprintf(stderr, "warning: --jobs is ignored without --script\n");
+	} else if (jobs > 1) {
+		/* the workers would all write to the same snapshot file and
+		 * shader store, interleaving their output:
+		 */
+		if (emit_state || dump_shaders) {
+			fprintf(stderr, "--jobs cannot be combined with --emit-state "
+					"or --dump-shaders\n");
+			return 1;
+		}
+		if (!script_can_merge()) {
+			fprintf(stderr, "%s: --jobs needs partial() and merge() fxns\n",
+					script);
+			return 1;
+		}
+		ret = handle_files_parallel(&argv[n], argc - n, start, end);
+		n = argc;
+	}
+
 	while (n < argc) {
 		ret = handle_file(argv[n], start, end);
 		if (ret) {
@@ -1592,9 +1952,17 @@ int main(int argc, char **argv)
 
 	script_finish();
 
+	if (dump_shaders)
+		shader_store_close();
+
+	if (emit_state)
+		snapshot_close(emit_state);
+
 	return 0;
 }
 
+#endif /* CFFDEC_LIBRARY */
+
 static int handle_file(const char *filename, int start, int end)
 {
 	enum rd_sect_type type = RD_NONE;
@@ -1603,9 +1971,19 @@ static int handle_file(const char *filename, int start, int end)
 	int draw = 0, got_gpu_id = 0;
 	int sz, i;
 
+	if (check_extension(filename, ".snap"))
+		return handle_snapshot(filename);
+
 	printf("Reading %s...\n", filename);
 
+	cur_filename = filename;
+	cur_cmdstream = cur_draw = 0;
+	cur_shader_hash[0] = cur_shader_hash[1] = 0;
+	memset(cur_cost, 0, sizeof(cur_cost));
+
 	script_start_cmdstream(filename);
+	if (emit_state)
+		snapshot_start_stream(emit_state, filename);
 
 	if (!strcmp(filename, "-"))
 		io = io_openfd(0);
@@ -1619,6 +1997,7 @@ static int handle_file(const char *filename, int start, int end)
 
 	clear_written();
 	clear_lastvals();
+	clear_loaded_state();
 
 	if (check_extension(filename, ".txt")) {
 		/* read in from hexdump.. this could probably be more flexibile,
@@ -1664,6 +2043,9 @@ static int handle_file(const char *filename, int start, int end)
 		printf("############################################################\n");
 		printf("vertices: %d\n", vertices);
 
+		if (emit_state)
+			snapshot_end_stream(emit_state, gpu_id);
+
 		return 0;
 	}
 
@@ -1695,6 +2077,7 @@ static int handle_file(const char *filename, int start, int end)
 			break;
 		case RD_BUFFER_CONTENTS:
 			buffers[nbuffers].hostptr = buf;
+			script_buffer(buffers[nbuffers].gpuaddr, buffers[nbuffers].len);
 			nbuffers++;
 			assert(nbuffers < ARRAY_SIZE(buffers));
 			buf = NULL;
@@ -1709,6 +2092,7 @@ static int handle_file(const char *filename, int start, int end)
 				printl(2, "vertices: %d\n", vertices);
 			}
 			draw++;
+			cur_cmdstream++;
 			for (i = 0; i < nbuffers; i++) {
 				free(buffers[i].hostptr);
 				buffers[i].hostptr = NULL;
@@ -1719,12 +2103,7 @@ static int handle_file(const char *filename, int start, int end)
 			if (!got_gpu_id) {
 				gpu_id = *((unsigned int *)buf);
 				printl(2, "gpu_id: %d\n", gpu_id);
-				if (gpu_id >= 400)
-					init_a4xx();
-				else if (gpu_id >= 300)
-					init_a3xx();
-				else
-					init_a2xx();
+				init_gpu();
 				got_gpu_id = 1;
 			}
 			break;
@@ -1734,8 +2113,78 @@ static int handle_file(const char *filename, int start, int end)
 	}
 
 	script_end_cmdstream();
+	if (emit_state && snapshot_end_stream(emit_state, gpu_id))
+		fprintf(stderr, "error writing state for: %s\n", filename);
 
 	io_close(io);
 
 	return 0;
 }
+
+/* replay a register-state snapshot (from --emit-state) through the
+ * script/query hooks, without decoding any cmdstream:
+ */
+static int handle_snapshot(const char *filename)
+{
+	struct snapshot *s = snapshot_open(filename);
+	struct snapshot_stream *stream;
+	uint32_t i, j;
+	int ret;
+
+	if (!s)
+		return -1;
+
+	while ((stream = snapshot_next_stream(s))) {
+		printf("Reading %s (from %s)...\n", stream->name, filename);
+
+		gpu_id = stream->gpu_id;
+		init_gpu();
+
+		memset(type0_reg_vals, 0, sizeof(type0_reg_vals));
+		clear_written();
+		clear_lastvals();
+
+		script_start_cmdstream(stream->name);
+		if (emit_state)
+			snapshot_start_stream(emit_state, stream->name);
+
+		for (i = 0; i < stream->ndraws; i++) {
+			struct snapshot_draw draw;
+
+			snapshot_get_draw(stream, i, &draw);
+
+			for (j = 0; j < draw.ndeltas; j++) {
+				uint32_t regbase = draw.regs[j];
+				type0_reg_vals[regbase] = draw.vals[j];
+				type0_reg_written[regbase/8] |= (1 << (regbase % 8));
+			}
+
+			if ((bin_x1 != draw.bin_x1) || (bin_y1 != draw.bin_y1) ||
+					(bin_x2 != draw.bin_x2) || (bin_y2 != draw.bin_y2)) {
+				bin_x1 = draw.bin_x1;
+				bin_y1 = draw.bin_y1;
+				bin_x2 = draw.bin_x2;
+				bin_y2 = draw.bin_y2;
+				script_set_bin(bin_x1, bin_y1, bin_x2, bin_y2);
+			}
+
+			do_query(draw.primtype, draw.nindx);
+
+			/* approximates what dump_register_summary() would do: */
+			for (j = 0; j < draw.ndeltas; j++)
+				lastvals[draw.regs[j]] = draw.vals[j];
+		}
+
+		script_end_cmdstream();
+		if (emit_state)
+			snapshot_end_stream(emit_state, gpu_id);
+
+		snapshot_stream_free(stream);
+	}
+
+	ret = snapshot_error(s) ? -1 : 0;
+
+	snapshot_close(s);
+
+	return ret;
+}
@@ -0,0 +1,138 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff.h"
+
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+/* Greedy forward pass, saving the furthest reaching x on each diagonal
+ * k for each edit count d, then backtrack through the saved V's to
+ * recover the matching snakes.  trace[d] holds V[-d..d], so memory is
+ * O(D^2) rather than O(N*M).
+ */
+static int myers(const uint64_t *a, int n, const uint64_t *b, int m,
+		int *a2b, int boff, int max_d)
+{
+	int maxd = min(n + m, max_d);
+	int offset = maxd + 1;
+	int *v, **trace;
+	int d, k, x, y, found = -1;
+
+	if ((n == 0) || (m == 0))
+		return n + m;
+
+	v = calloc(2 * maxd + 3, sizeof(*v));
+	trace = calloc(maxd + 1, sizeof(*trace));
+
+	for (d = 0; (d <= maxd) && (found < 0); d++) {
+		for (k = -d; k <= d; k += 2) {
+			if ((k == -d) || ((k != d) && (v[offset+k-1] < v[offset+k+1])))
+				x = v[offset+k+1];
+			else
+				x = v[offset+k-1] + 1;
+			y = x - k;
+			while ((x < n) && (y < m) && (a[x] == b[y])) {
+				x++;
+				y++;
+			}
+			v[offset+k] = x;
+			if ((x >= n) && (y >= m)) {
+				found = d;
+				break;
+			}
+		}
+
+		trace[d] = malloc((2 * d + 1) * sizeof(*trace[d]));
+		memcpy(trace[d], &v[offset-d], (2 * d + 1) * sizeof(*trace[d]));
+	}
+
+	if (found >= 0) {
+		x = n;
+		y = m;
+		for (d = found; d > 0; d--) {
+			int *vp = trace[d-1] + (d - 1);  /* vp[k] for k in -(d-1)..(d-1) */
+			int prev_k, prev_x, prev_y;
+
+			k = x - y;
+			if ((k == -d) || ((k != d) && (vp[k-1] < vp[k+1])))
+				prev_k = k + 1;
+			else
+				prev_k = k - 1;
+			prev_x = vp[prev_k];
+			prev_y = prev_x - prev_k;
+
+			while ((x > prev_x) && (y > prev_y)) {
+				x--;
+				y--;
+				a2b[x] = y + boff;
+			}
+
+			x = prev_x;
+			y = prev_y;
+		}
+
+		while ((x > 0) && (y > 0)) {
+			x--;
+			y--;
+			a2b[x] = y + boff;
+		}
+	}
+
+	for (d = 0; d <= maxd; d++)
+		free(trace[d]);
+	free(trace);
+	free(v);
+
+	return found;
+}
+
+int diff_align(const uint64_t *a, int na, const uint64_t *b, int nb,
+		int *a2b, int max_d)
+{
+	int pre = 0, suf = 0, i;
+
+	for (i = 0; i < na; i++)
+		a2b[i] = -1;
+
+	while ((pre < na) && (pre < nb) && (a[pre] == b[pre])) {
+		a2b[pre] = pre;
+		pre++;
+	}
+
+	while ((suf < (na - pre)) && (suf < (nb - pre)) &&
+			(a[na-1-suf] == b[nb-1-suf])) {
+		a2b[na-1-suf] = nb-1-suf;
+		suf++;
+	}
+
+	return myers(a + pre, na - pre - suf, b + pre, nb - pre - suf,
+			a2b + pre, pre, max_d);
+}
@@ -0,0 +1,67 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#ifndef DIFF_H_
+#define DIFF_H_
+
+#include <stdint.h>
+
+/* Align two sequences of (hashed) elements, using Myers' O(ND) diff
+ * algorithm, after stripping the common prefix and suffix.
+ *
+ * On return, a2b[i] is the index in b of the element matching a[i], or
+ * -1 if a[i] has no match (ie. deleted).  Elements of b not referenced
+ * from a2b are insertions.  The matches are monotonic, so both
+ * sequences can be walked in order.
+ *
+ * To keep time and memory bounded, if more than max_d edits are needed
+ * the part between the common prefix and suffix is left unmatched.
+ *
+ * Returns the number of edits, or -1 if max_d was exceeded.
+ */
+int diff_align(const uint64_t *a, int na, const uint64_t *b, int nb,
+		int *a2b, int max_d);
+
+/* FNV-1a style hashing of dwords, for building the sequences: */
+#define DIFF_HASH_INIT 0xcbf29ce484222325ULL
+
+static inline uint64_t
+diff_hash(uint64_t hash, uint32_t dword)
+{
+	return (hash ^ dword) * 0x100000001b3ULL;
+}
+
+static inline uint64_t
+diff_hash_dwords(uint64_t hash, const uint32_t *dwords, uint32_t sizedwords)
+{
+	while (sizedwords--)
+		hash = diff_hash(hash, *(dwords++));
+	return hash;
+}
+
+#endif /* DIFF_H_ */
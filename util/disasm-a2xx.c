@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include <string.h>
 
 #include "disasm.h"
@@ -53,6 +54,16 @@ static const char *levels[] = {
 
 enum debug_t debug;
 
+/* Printing is done from the decoded instructions, to ctx->out: */
+static void emit(struct disasm_a2xx_ctx *ctx, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(ctx->out, fmt, args);
+	va_end(args);
+}
+
 /*
  * ALU instructions:
  */
@@ -63,40 +74,42 @@ static const char chan_names[] = {
 		'0', '1', '?', '_',
 };
 
-static void print_srcreg(uint32_t num, uint32_t type,
+static void print_srcreg(struct disasm_a2xx_ctx *ctx, uint32_t num, uint32_t type,
 		uint32_t swiz, uint32_t negate, uint32_t abs)
 {
 	if (negate)
-		printf("-");
+		emit(ctx, "-");
 	if (abs)
-		printf("|");
-	printf("%c%u", type ? 'R' : 'C', num);
+		emit(ctx, "|");
+	emit(ctx, "%c%u", type ? 'R' : 'C', num);
 	if (swiz) {
 		int i;
-		printf(".");
+		emit(ctx, ".");
 		for (i = 0; i < 4; i++) {
-			printf("%c", chan_names[(swiz + i) & 0x3]);
+			emit(ctx, "%c", chan_names[(swiz + i) & 0x3]);
 			swiz >>= 2;
 		}
 	}
 	if (abs)
-		printf("|");
+		emit(ctx, "|");
 }
 
-static void print_dstreg(uint32_t num, uint32_t mask, uint32_t dst_exp)
+static void print_dstreg(struct disasm_a2xx_ctx *ctx, uint32_t num,
+		uint32_t mask, uint32_t dst_exp)
 {
-	printf("%s%u", dst_exp ? "export" : "R", num);
+	emit(ctx, "%s%u", dst_exp ? "export" : "R", num);
 	if (mask != 0xf) {
 		int i;
-		printf(".");
+		emit(ctx, ".");
 		for (i = 0; i < 4; i++) {
-			printf("%c", (mask & 0x1) ? chan_names[i] : '_');
+			emit(ctx, "%c", (mask & 0x1) ? chan_names[i] : '_');
 			mask >>= 1;
 		}
 	}
 }
 
-static void print_export_comment(uint32_t num, enum shader_t type)
+static void print_export_comment(struct disasm_a2xx_ctx *ctx, uint32_t num,
+		enum shader_t type)
 {
 	const char *name = NULL;
 	switch (type) {
@@ -116,7 +129,7 @@ static void print_export_comment(uint32_t num, enum shader_t type)
 	 * up the name of the varying..
 	 */
 	if (name) {
-		printf("\t; %s", name);
+		emit(ctx, "\t; %s", name);
 	}
 }
 
@@ -209,76 +222,77 @@ struct {
 #undef INSTR
 };
 
-static int disasm_alu(uint32_t *dwords, uint32_t alu_off,
-		int level, int sync, enum shader_t type)
+static int disasm_alu(struct disasm_a2xx_ctx *ctx, const uint32_t *dwords,
+		uint32_t alu_off, int level, int sync)
 {
+	enum shader_t type = ctx->type;
 	instr_alu_t *alu = (instr_alu_t *)dwords;
 
-	printf("%s", levels[level]);
-	if (debug & PRINT_RAW) {
-		printf("%02x: %08x %08x %08x\t", alu_off,
+	emit(ctx, "%s", levels[level]);
+	if (ctx->debug & PRINT_RAW) {
+		emit(ctx, "%02x: %08x %08x %08x\t", alu_off,
 				dwords[0], dwords[1], dwords[2]);
 	}
 
-	printf("   %sALU:\t", sync ? "(S)" : "   ");
+	emit(ctx, "   %sALU:\t", sync ? "(S)" : "   ");
 
-	printf("%s", vector_instructions[alu->vector_opc].name);
+	emit(ctx, "%s", vector_instructions[alu->vector_opc].name);
 
 	if (alu->pred_select & 0x2) {
 		/* seems to work similar to conditional execution in ARM instruction
 		 * set, so let's use a similar syntax for now:
 		 */
-		printf((alu->pred_select & 0x1) ? "EQ" : "NE");
+		emit(ctx, (alu->pred_select & 0x1) ? "EQ" : "NE");
 	}
 
-	printf("\t");
+	emit(ctx, "\t");
 
-	print_dstreg(alu->vector_dest, alu->vector_write_mask, alu->export_data);
-	printf(" = ");
+	print_dstreg(ctx, alu->vector_dest, alu->vector_write_mask, alu->export_data);
+	emit(ctx, " = ");
 	if (vector_instructions[alu->vector_opc].num_srcs == 3) {
-		print_srcreg(alu->src3_reg, alu->src3_sel, alu->src3_swiz,
+		print_srcreg(ctx, alu->src3_reg, alu->src3_sel, alu->src3_swiz,
 				alu->src3_reg_negate, alu->src3_reg_abs);
-		printf(", ");
+		emit(ctx, ", ");
 	}
-	print_srcreg(alu->src1_reg, alu->src1_sel, alu->src1_swiz,
+	print_srcreg(ctx, alu->src1_reg, alu->src1_sel, alu->src1_swiz,
 			alu->src1_reg_negate, alu->src1_reg_abs);
 	if (vector_instructions[alu->vector_opc].num_srcs > 1) {
-		printf(", ");
-		print_srcreg(alu->src2_reg, alu->src2_sel, alu->src2_swiz,
+		emit(ctx, ", ");
+		print_srcreg(ctx, alu->src2_reg, alu->src2_sel, alu->src2_swiz,
 				alu->src2_reg_negate, alu->src2_reg_abs);
 	}
 
 	if (alu->vector_clamp)
-		printf(" CLAMP");
+		emit(ctx, " CLAMP");
 
 	if (alu->export_data)
-		print_export_comment(alu->vector_dest, type);
+		print_export_comment(ctx, alu->vector_dest, type);
 
-	printf("\n");
+	emit(ctx, "\n");
 
 	if (alu->scalar_write_mask || !alu->vector_write_mask) {
 		/* 2nd optional scalar op: */
 
-		printf("%s", levels[level]);
-		if (debug & PRINT_RAW)
-			printf("                          \t");
+		emit(ctx, "%s", levels[level]);
+		if (ctx->debug & PRINT_RAW)
+			emit(ctx, "                          \t");
 
 		if (scalar_instructions[alu->scalar_opc].name) {
-			printf("\t    \t%s\t", scalar_instructions[alu->scalar_opc].name);
+			emit(ctx, "\t    \t%s\t", scalar_instructions[alu->scalar_opc].name);
 		} else {
-			printf("\t    \tOP(%u)\t", alu->scalar_opc);
+			emit(ctx, "\t    \tOP(%u)\t", alu->scalar_opc);
 		}
 
-		print_dstreg(alu->scalar_dest, alu->scalar_write_mask, alu->export_data);
-		printf(" = ");
-		print_srcreg(alu->src3_reg, alu->src3_sel, alu->src3_swiz,
+		print_dstreg(ctx, alu->scalar_dest, alu->scalar_write_mask, alu->export_data);
+		emit(ctx, " = ");
+		print_srcreg(ctx, alu->src3_reg, alu->src3_sel, alu->src3_swiz,
 				alu->src3_reg_negate, alu->src3_reg_abs);
 		// TODO ADD/MUL must have another src?!?
 		if (alu->scalar_clamp)
-			printf(" CLAMP");
+			emit(ctx, " CLAMP");
 		if (alu->export_data)
-			print_export_comment(alu->scalar_dest, type);
-		printf("\n");
+			print_export_comment(ctx, alu->scalar_dest, type);
+		emit(ctx, "\n");
 	}
 
 	return 0;
@@ -310,17 +324,18 @@ struct {
 #undef TYPE
 };
 
-static void print_fetch_dst(uint32_t dst_reg, uint32_t dst_swiz)
+static void print_fetch_dst(struct disasm_a2xx_ctx *ctx, uint32_t dst_reg,
+		uint32_t dst_swiz)
 {
 	int i;
-	printf("\tR%u.", dst_reg);
+	emit(ctx, "\tR%u.", dst_reg);
 	for (i = 0; i < 4; i++) {
-		printf("%c", chan_names[dst_swiz & 0x7]);
+		emit(ctx, "%c", chan_names[dst_swiz & 0x7]);
 		dst_swiz >>= 3;
 	}
 }
 
-static void print_fetch_vtx(instr_fetch_t *fetch)
+static void print_fetch_vtx(struct disasm_a2xx_ctx *ctx, instr_fetch_t *fetch)
 {
 	instr_fetch_vtx_t *vtx = &fetch->vtx;
 
@@ -328,35 +343,35 @@ static void print_fetch_vtx(instr_fetch_t *fetch)
 		/* seems to work similar to conditional execution in ARM instruction
 		 * set, so let's use a similar syntax for now:
 		 */
-		printf(vtx->pred_condition ? "EQ" : "NE");
+		emit(ctx, vtx->pred_condition ? "EQ" : "NE");
 	}
 
-	print_fetch_dst(vtx->dst_reg, vtx->dst_swiz);
-	printf(" = R%u.", vtx->src_reg);
-	printf("%c", chan_names[vtx->src_swiz & 0x3]);
+	print_fetch_dst(ctx, vtx->dst_reg, vtx->dst_swiz);
+	emit(ctx, " = R%u.", vtx->src_reg);
+	emit(ctx, "%c", chan_names[vtx->src_swiz & 0x3]);
 	if (fetch_types[vtx->format].name) {
-		printf(" %s", fetch_types[vtx->format].name);
+		emit(ctx, " %s", fetch_types[vtx->format].name);
 	} else  {
-		printf(" TYPE(0x%x)", vtx->format);
+		emit(ctx, " TYPE(0x%x)", vtx->format);
 	}
-	printf(" %s", vtx->format_comp_all ? "SIGNED" : "UNSIGNED");
+	emit(ctx, " %s", vtx->format_comp_all ? "SIGNED" : "UNSIGNED");
 	if (!vtx->num_format_all)
-		printf(" NORMALIZED");
-	printf(" STRIDE(%u)", vtx->stride);
+		emit(ctx, " NORMALIZED");
+	emit(ctx, " STRIDE(%u)", vtx->stride);
 	if (vtx->offset)
-		printf(" OFFSET(%u)", vtx->offset);
-	printf(" CONST(%u, %u)", vtx->const_index, vtx->const_index_sel);
+		emit(ctx, " OFFSET(%u)", vtx->offset);
+	emit(ctx, " CONST(%u, %u)", vtx->const_index, vtx->const_index_sel);
 	if (0) {
 		// XXX
-		printf(" src_reg_am=%u", vtx->src_reg_am);
-		printf(" dst_reg_am=%u", vtx->dst_reg_am);
-		printf(" num_format_all=%u", vtx->num_format_all);
-		printf(" signed_rf_mode_all=%u", vtx->signed_rf_mode_all);
-		printf(" exp_adjust_all=%u", vtx->exp_adjust_all);
+		emit(ctx, " src_reg_am=%u", vtx->src_reg_am);
+		emit(ctx, " dst_reg_am=%u", vtx->dst_reg_am);
+		emit(ctx, " num_format_all=%u", vtx->num_format_all);
+		emit(ctx, " signed_rf_mode_all=%u", vtx->signed_rf_mode_all);
+		emit(ctx, " exp_adjust_all=%u", vtx->exp_adjust_all);
 	}
 }
 
-static void print_fetch_tex(instr_fetch_t *fetch)
+static void print_fetch_tex(struct disasm_a2xx_ctx *ctx, instr_fetch_t *fetch)
 {
 	static const char *filter[] = {
 			[TEX_FILTER_POINT] = "POINT",
@@ -391,51 +406,51 @@ static void print_fetch_tex(instr_fetch_t *fetch)
 		/* seems to work similar to conditional execution in ARM instruction
 		 * set, so let's use a similar syntax for now:
 		 */
-		printf(tex->pred_condition ? "EQ" : "NE");
+		emit(ctx, tex->pred_condition ? "EQ" : "NE");
 	}
 
-	print_fetch_dst(tex->dst_reg, tex->dst_swiz);
-	printf(" = R%u.", tex->src_reg);
+	print_fetch_dst(ctx, tex->dst_reg, tex->dst_swiz);
+	emit(ctx, " = R%u.", tex->src_reg);
 	for (i = 0; i < 3; i++) {
-		printf("%c", chan_names[src_swiz & 0x3]);
+		emit(ctx, "%c", chan_names[src_swiz & 0x3]);
 		src_swiz >>= 2;
 	}
-	printf(" CONST(%u)", tex->const_idx);
+	emit(ctx, " CONST(%u)", tex->const_idx);
 	if (tex->fetch_valid_only)
-		printf(" VALID_ONLY");
+		emit(ctx, " VALID_ONLY");
 	if (tex->tx_coord_denorm)
-		printf(" DENORM");
+		emit(ctx, " DENORM");
 	if (tex->mag_filter != TEX_FILTER_USE_FETCH_CONST)
-		printf(" MAG(%s)", filter[tex->mag_filter]);
+		emit(ctx, " MAG(%s)", filter[tex->mag_filter]);
 	if (tex->min_filter != TEX_FILTER_USE_FETCH_CONST)
-		printf(" MIN(%s)", filter[tex->min_filter]);
+		emit(ctx, " MIN(%s)", filter[tex->min_filter]);
 	if (tex->mip_filter != TEX_FILTER_USE_FETCH_CONST)
-		printf(" MIP(%s)", filter[tex->mip_filter]);
+		emit(ctx, " MIP(%s)", filter[tex->mip_filter]);
 	if (tex->aniso_filter != ANISO_FILTER_USE_FETCH_CONST)
-		printf(" ANISO(%s)", aniso_filter[tex->aniso_filter]);
+		emit(ctx, " ANISO(%s)", aniso_filter[tex->aniso_filter]);
 	if (tex->arbitrary_filter != ARBITRARY_FILTER_USE_FETCH_CONST)
-		printf(" ARBITRARY(%s)", arbitrary_filter[tex->arbitrary_filter]);
+		emit(ctx, " ARBITRARY(%s)", arbitrary_filter[tex->arbitrary_filter]);
 	if (tex->vol_mag_filter != TEX_FILTER_USE_FETCH_CONST)
-		printf(" VOL_MAG(%s)", filter[tex->vol_mag_filter]);
+		emit(ctx, " VOL_MAG(%s)", filter[tex->vol_mag_filter]);
 	if (tex->vol_min_filter != TEX_FILTER_USE_FETCH_CONST)
-		printf(" VOL_MIN(%s)", filter[tex->vol_min_filter]);
+		emit(ctx, " VOL_MIN(%s)", filter[tex->vol_min_filter]);
 	if (!tex->use_comp_lod) {
-		printf(" LOD(%u)", tex->use_comp_lod);
-		printf(" LOD_BIAS(%u)", tex->lod_bias);
+		emit(ctx, " LOD(%u)", tex->use_comp_lod);
+		emit(ctx, " LOD_BIAS(%u)", tex->lod_bias);
 	}
 	if (tex->use_reg_lod) {
-		printf(" REG_LOD(%u)", tex->use_reg_lod);
+		emit(ctx, " REG_LOD(%u)", tex->use_reg_lod);
 	}
 	if (tex->use_reg_gradients)
-		printf(" USE_REG_GRADIENTS");
-	printf(" LOCATION(%s)", sample_loc[tex->sample_location]);
+		emit(ctx, " USE_REG_GRADIENTS");
+	emit(ctx, " LOCATION(%s)", sample_loc[tex->sample_location]);
 	if (tex->offset_x || tex->offset_y || tex->offset_z)
-		printf(" OFFSET(%u,%u,%u)", tex->offset_x, tex->offset_y, tex->offset_z);
+		emit(ctx, " OFFSET(%u,%u,%u)", tex->offset_x, tex->offset_y, tex->offset_z);
 }
 
 struct {
 	const char *name;
-	void (*fxn)(instr_fetch_t *cf);
+	void (*fxn)(struct disasm_a2xx_ctx *ctx, instr_fetch_t *cf);
 } fetch_instructions[] = {
 #define INSTR(opc, name, fxn) [opc] = { name, fxn }
 		INSTR(VTX_FETCH, "VERTEX", print_fetch_vtx),
@@ -451,20 +466,21 @@ struct {
 #undef INSTR
 };
 
-static int disasm_fetch(uint32_t *dwords, uint32_t alu_off, int level, int sync)
+static int disasm_fetch(struct disasm_a2xx_ctx *ctx, const uint32_t *dwords,
+		uint32_t alu_off, int level, int sync)
 {
 	instr_fetch_t *fetch = (instr_fetch_t *)dwords;
 
-	printf("%s", levels[level]);
-	if (debug & PRINT_RAW) {
-		printf("%02x: %08x %08x %08x\t", alu_off,
+	emit(ctx, "%s", levels[level]);
+	if (ctx->debug & PRINT_RAW) {
+		emit(ctx, "%02x: %08x %08x %08x\t", alu_off,
 				dwords[0], dwords[1], dwords[2]);
 	}
 
-	printf("   %sFETCH:\t", sync ? "(S)" : "   ");
-	printf("%s", fetch_instructions[fetch->opc].name);
-	fetch_instructions[fetch->opc].fxn(fetch);
-	printf("\n");
+	emit(ctx, "   %sFETCH:\t", sync ? "(S)" : "   ");
+	emit(ctx, "%s", fetch_instructions[fetch->opc].name);
+	fetch_instructions[fetch->opc].fxn(ctx, fetch);
+	emit(ctx, "\n");
 
 	return 0;
 }
@@ -495,46 +511,46 @@ static int cf_cond_exec(instr_cf_t *cf)
 			(cf->opc == COND_EXEC_PRED_CLEAN_END);
 }
 
-static void print_cf_nop(instr_cf_t *cf)
+static void print_cf_nop(struct disasm_a2xx_ctx *ctx, instr_cf_t *cf)
 {
 }
 
-static void print_cf_exec(instr_cf_t *cf)
+static void print_cf_exec(struct disasm_a2xx_ctx *ctx, instr_cf_t *cf)
 {
-	printf(" ADDR(0x%x) CNT(0x%x)", cf->exec.address, cf->exec.count);
+	emit(ctx, " ADDR(0x%x) CNT(0x%x)", cf->exec.address, cf->exec.count);
 	if (cf->exec.yeild)
-		printf(" YIELD");
+		emit(ctx, " YIELD");
 	if (cf->exec.vc)
-		printf(" VC(0x%x)", cf->exec.vc);
+		emit(ctx, " VC(0x%x)", cf->exec.vc);
 	if (cf->exec.bool_addr)
-		printf(" BOOL_ADDR(0x%x)", cf->exec.bool_addr);
+		emit(ctx, " BOOL_ADDR(0x%x)", cf->exec.bool_addr);
 	if (cf->exec.address_mode == ABSOLUTE_ADDR)
-		printf(" ABSOLUTE_ADDR");
+		emit(ctx, " ABSOLUTE_ADDR");
 	if (cf_cond_exec(cf))
-		printf(" COND(%d)", cf->exec.condition);
+		emit(ctx, " COND(%d)", cf->exec.condition);
 }
 
-static void print_cf_loop(instr_cf_t *cf)
+static void print_cf_loop(struct disasm_a2xx_ctx *ctx, instr_cf_t *cf)
 {
-	printf(" ADDR(0x%x) LOOP_ID(%d)", cf->loop.address, cf->loop.loop_id);
+	emit(ctx, " ADDR(0x%x) LOOP_ID(%d)", cf->loop.address, cf->loop.loop_id);
 	if (cf->loop.address_mode == ABSOLUTE_ADDR)
-		printf(" ABSOLUTE_ADDR");
+		emit(ctx, " ABSOLUTE_ADDR");
 }
 
-static void print_cf_jmp_call(instr_cf_t *cf)
+static void print_cf_jmp_call(struct disasm_a2xx_ctx *ctx, instr_cf_t *cf)
 {
-	printf(" ADDR(0x%x) DIR(%d)", cf->jmp_call.address, cf->jmp_call.direction);
+	emit(ctx, " ADDR(0x%x) DIR(%d)", cf->jmp_call.address, cf->jmp_call.direction);
 	if (cf->jmp_call.force_call)
-		printf(" FORCE_CALL");
+		emit(ctx, " FORCE_CALL");
 	if (cf->jmp_call.predicated_jmp)
-		printf(" COND(%d)", cf->jmp_call.condition);
+		emit(ctx, " COND(%d)", cf->jmp_call.condition);
 	if (cf->jmp_call.bool_addr)
-		printf(" BOOL_ADDR(0x%x)", cf->jmp_call.bool_addr);
+		emit(ctx, " BOOL_ADDR(0x%x)", cf->jmp_call.bool_addr);
 	if (cf->jmp_call.address_mode == ABSOLUTE_ADDR)
-		printf(" ABSOLUTE_ADDR");
+		emit(ctx, " ABSOLUTE_ADDR");
 }
 
-static void print_cf_alloc(instr_cf_t *cf)
+static void print_cf_alloc(struct disasm_a2xx_ctx *ctx, instr_cf_t *cf)
 {
 	static const char *bufname[] = {
 			[SQ_NO_ALLOC] = "NO ALLOC",
@@ -542,16 +558,16 @@ static void print_cf_alloc(instr_cf_t *cf)
 			[SQ_PARAMETER_PIXEL] = "PARAM/PIXEL",
 			[SQ_MEMORY] = "MEMORY",
 	};
-	printf(" %s SIZE(0x%x)", bufname[cf->alloc.buffer_select], cf->alloc.size);
+	emit(ctx, " %s SIZE(0x%x)", bufname[cf->alloc.buffer_select], cf->alloc.size);
 	if (cf->alloc.no_serial)
-		printf(" NO_SERIAL");
+		emit(ctx, " NO_SERIAL");
 	if (cf->alloc.alloc_mode) // ???
-		printf(" ALLOC_MODE");
+		emit(ctx, " ALLOC_MODE");
 }
 
 struct {
 	const char *name;
-	void (*fxn)(instr_cf_t *cf);
+	void (*fxn)(struct disasm_a2xx_ctx *ctx, instr_cf_t *cf);
 } cf_instructions[] = {
 #define INSTR(opc, fxn) [opc] = { #opc, fxn }
 		INSTR(NOP, print_cf_nop),
@@ -573,17 +589,17 @@ struct {
 #undef INSTR
 };
 
-static void print_cf(instr_cf_t *cf, int level)
+static void print_cf(struct disasm_a2xx_ctx *ctx, instr_cf_t *cf, int level)
 {
-	printf("%s", levels[level]);
-	if (debug & PRINT_RAW) {
+	emit(ctx, "%s", levels[level]);
+	if (ctx->debug & PRINT_RAW) {
 		uint16_t *words = (uint16_t *)cf;
-		printf("    %04x %04x %04x            \t",
+		emit(ctx, "    %04x %04x %04x            \t",
 				words[0], words[1], words[2]);
 	}
-	printf("%s", cf_instructions[cf->opc].name);
-	cf_instructions[cf->opc].fxn(cf);
-	printf("\n");
+	emit(ctx, "%s", cf_instructions[cf->opc].name);
+	cf_instructions[cf->opc].fxn(ctx, cf);
+	emit(ctx, "\n");
 }
 
 /*
@@ -593,39 +609,188 @@ static void print_cf(instr_cf_t *cf, int level)
  *   2) ALU and FETCH instructions
  */
 
-int disasm_a2xx(uint32_t *dwords, int sizedwords, int level, enum shader_t type)
+void disasm_a2xx_init(struct disasm_a2xx_ctx *ctx, enum debug_t debug,
+		enum shader_t type)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->debug = debug;
+	ctx->type = type;
+}
+
+/* Register tracking, by register number (the a2xx registers are
+ * always vec4), for read-before-write (input), used, and consts:
+ */
+static void track_src(struct disasm_a2xx_ctx *ctx, uint32_t num, uint32_t sel)
+{
+	if (!sel) {
+		disasm_regmask_set(&ctx->regs.cnst, num, 1, 1);
+		return;
+	}
+	if (!disasm_regmask_get(&ctx->regs.used, num, 1))
+		disasm_regmask_set(&ctx->regs.rbw, num, 1, 1);
+	disasm_regmask_set(&ctx->regs.war, num, 1, 0);
+	disasm_regmask_set(&ctx->regs.used, num, 1, 1);
+}
+
+static void track_dst(struct disasm_a2xx_ctx *ctx, uint32_t num)
 {
-	instr_cf_t *cfs = (instr_cf_t *)dwords;
-	int idx, max_idx;
+	disasm_regmask_set(&ctx->regs.war, num, 1, 1);
+	disasm_regmask_set(&ctx->regs.used, num, 1, 1);
+}
+
+static void decode_alu(struct disasm_a2xx_ctx *ctx,
+		struct disasm_a2xx_instr *instr)
+{
+	instr_alu_t *alu = (instr_alu_t *)instr->dwords;
+	uint32_t num_srcs = vector_instructions[alu->vector_opc].num_srcs;
+
+	instr->opc = alu->vector_opc;
+	instr->scalar_opc = alu->scalar_opc;
+	instr->has_scalar = alu->scalar_write_mask || !alu->vector_write_mask;
+
+	if (num_srcs == 3)
+		track_src(ctx, alu->src3_reg, alu->src3_sel);
+	track_src(ctx, alu->src1_reg, alu->src1_sel);
+	if (num_srcs > 1)
+		track_src(ctx, alu->src2_reg, alu->src2_sel);
+	if (instr->has_scalar)
+		track_src(ctx, alu->src3_reg, alu->src3_sel);
+
+	if (!alu->export_data) {
+		if (alu->vector_write_mask)
+			track_dst(ctx, alu->vector_dest);
+		if (alu->scalar_write_mask)
+			track_dst(ctx, alu->scalar_dest);
+	}
+}
+
+static void decode_fetch(struct disasm_a2xx_ctx *ctx,
+		struct disasm_a2xx_instr *instr)
+{
+	instr_fetch_t *fetch = (instr_fetch_t *)instr->dwords;
+
+	instr->opc = fetch->opc;
+
+	/* src/dst are in the same place for vtx and tex fetches: */
+	track_src(ctx, fetch->tex.src_reg, 1);
+	track_dst(ctx, fetch->tex.dst_reg);
+}
+
+/*
+ * The adreno shader microcode consists of two parts:
+ *   1) A CF (control-flow) program, at the header of the compiled shader,
+ *      which refers to ALU/FETCH instructions that follow it by address.
+ *   2) ALU and FETCH instructions
+ */
+
+int disasm_a2xx_decode(struct disasm_a2xx_ctx *ctx, const uint32_t *dwords,
+		int sizedwords, struct disasm_a2xx_instr *instrs, int max_instrs)
+{
+	const instr_cf_t *cfs = (const instr_cf_t *)dwords;
+	int idx, max_idx, n = 0;
+
+	memset(&ctx->regs, 0, sizeof(ctx->regs));
 
 	for (idx = 0; ; idx++) {
-		instr_cf_t *cf = &cfs[idx];
-		if (cf_exec(cf)) {
+		const instr_cf_t *cf = &cfs[idx];
+		if (cf_exec((instr_cf_t *)cf)) {
 			max_idx = 2 * cf->exec.address;
 			break;
 		}
 	}
 
-	for (idx = 0; idx < max_idx; idx++) {
-		instr_cf_t *cf = &cfs[idx];
+	for (idx = 0; (idx < max_idx) && (n < max_instrs); idx++) {
+		const instr_cf_t *cf = &cfs[idx];
+		struct disasm_a2xx_instr *instr = &instrs[n++];
 
-		print_cf(cf, level);
+		memset(instr, 0, sizeof(*instr));
+		memcpy(instr->dwords, cf, sizeof(*cf));
+		instr->type = DISASM_A2XX_CF;
+		instr->off = idx;
+		instr->opc = cf->opc;
 
-		if (cf_exec(cf)) {
+		if (cf_exec((instr_cf_t *)cf)) {
 			uint32_t sequence = cf->exec.serialize;
 			uint32_t i;
-			for (i = 0; i < cf->exec.count; i++) {
+			for (i = 0; (i < cf->exec.count) && (n < max_instrs); i++) {
 				uint32_t alu_off = (cf->exec.address + i);
+
+				instr = &instrs[n++];
+				memset(instr, 0, sizeof(*instr));
+				memcpy(instr->dwords, dwords + alu_off * 3, 3 * 4);
+				instr->off = alu_off;
+				instr->sync = !!(sequence & 0x2);
+
 				if (sequence & 0x1) {
-					disasm_fetch(dwords + alu_off * 3, alu_off, level, sequence & 0x2);
+					instr->type = DISASM_A2XX_FETCH;
+					decode_fetch(ctx, instr);
 				} else {
-					disasm_alu(dwords + alu_off * 3, alu_off, level, sequence & 0x2, type);
+					instr->type = DISASM_A2XX_ALU;
+					decode_alu(ctx, instr);
 				}
 				sequence >>= 2;
 			}
 		}
 	}
 
+	return n;
+}
+
+void disasm_a2xx_print(struct disasm_a2xx_ctx *ctx, FILE *out,
+		const struct disasm_a2xx_instr *instrs, int ninstrs, int level)
+{
+	int i;
+
+	ctx->out = out;
+
+	for (i = 0; i < ninstrs; i++) {
+		const struct disasm_a2xx_instr *instr = &instrs[i];
+
+		switch (instr->type) {
+		case DISASM_A2XX_CF:
+			print_cf(ctx, (instr_cf_t *)instr->dwords, level);
+			break;
+		case DISASM_A2XX_FETCH:
+			disasm_fetch(ctx, instr->dwords, instr->off, level, instr->sync);
+			break;
+		case DISASM_A2XX_ALU:
+			disasm_alu(ctx, instr->dwords, instr->off, level, instr->sync);
+			break;
+		}
+	}
+
+	ctx->out = NULL;
+}
+
+int disasm_a2xx_decoded(uint32_t *dwords, int sizedwords, int level,
+		enum shader_t type, struct disasm_a2xx_instr **instrsp)
+{
+	struct disasm_a2xx_instr *instrs;
+	struct disasm_a2xx_ctx ctx;
+	int n, max_instrs;
+
+	/* CF instrs are 1.5 dwords, and ALU/FETCH are 3, so this is enough
+	 * for any well formed shader:
+	 */
+	max_instrs = (2 * sizedwords / 3) + 2;
+
+	disasm_a2xx_init(&ctx, debug, type);
+
+	instrs = malloc(max_instrs * sizeof(*instrs));
+	n = disasm_a2xx_decode(&ctx, dwords, sizedwords, instrs, max_instrs);
+	disasm_a2xx_print(&ctx, stdout, instrs, n, level);
+
+	if (instrsp)
+		*instrsp = instrs;
+	else
+		free(instrs);
+
+	return n;
+}
+
+int disasm_a2xx(uint32_t *dwords, int sizedwords, int level, enum shader_t type)
+{
+	disasm_a2xx_decoded(dwords, sizedwords, level, type, NULL);
 	return 0;
 }
 
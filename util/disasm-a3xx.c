@@ -24,10 +24,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include <string.h>
 #include <assert.h>
 
 #include "disasm.h"
+#include "diff.h"
 #include "instr-a3xx.h"
 
 typedef enum {
@@ -68,7 +70,23 @@ static const char *type[] = {
 		[TYPE_S8]  = "s8",
 };
 
-static void print_reg(reg_t reg, bool full, bool r, bool c, bool im,
+/* All the decoder state lives in the ctx.  When decoding, ctx->instr is
+ * the decoded instruction being filled in and nothing is printed.  When
+ * printing, ctx->out is set and ctx->instr is NULL.
+ */
+static void emit(struct disasm_a3xx_ctx *ctx, const char *fmt, ...)
+{
+	va_list args;
+
+	if (!ctx->out)
+		return;
+
+	va_start(args, fmt);
+	vfprintf(ctx->out, fmt, args);
+	va_end(args);
+}
+
+static void print_reg(struct disasm_a3xx_ctx *ctx, reg_t reg, bool full, bool r, bool c, bool im,
 		bool neg, bool abs, bool addr_rel)
 {
 	const char type = c ? 'c' : 'r';
@@ -77,33 +95,33 @@ static void print_reg(reg_t reg, bool full, bool r, bool c, bool im,
 	// by libllvm-a3xx for easy diffing..
 
 	if (abs && neg)
-		printf("(absneg)");
+		emit(ctx, "(absneg)");
 	else if (neg)
-		printf("(neg)");
+		emit(ctx, "(neg)");
 	else if (abs)
-		printf("(abs)");
+		emit(ctx, "(abs)");
 
 	if (r)
-		printf("(r)");
+		emit(ctx, "(r)");
 
 	if (im) {
-		printf("%d", reg.iim_val);
+		emit(ctx, "%d", reg.iim_val);
 	} else if (addr_rel) {
 		/* I would just use %+d but trying to make it diff'able with
 		 * libllvm-a3xx...
 		 */
 		if (reg.iim_val < 0)
-			printf("%s%c<a0.x - %d>", full ? "" : "h", type, -reg.iim_val);
+			emit(ctx, "%s%c<a0.x - %d>", full ? "" : "h", type, -reg.iim_val);
 		else if (reg.iim_val > 0)
-			printf("%s%c<a0.x + %d>", full ? "" : "h", type, reg.iim_val);
+			emit(ctx, "%s%c<a0.x + %d>", full ? "" : "h", type, reg.iim_val);
 		else
-			printf("%s%c<a0.x>", full ? "" : "h", type);
+			emit(ctx, "%s%c<a0.x>", full ? "" : "h", type);
 	} else if ((reg.num == REG_A0) && !c) {
-		printf("a0.%c", component[reg.comp]);
+		emit(ctx, "a0.%c", component[reg.comp]);
 	} else if ((reg.num == REG_P0) && !c) {
-		printf("p0.%c", component[reg.comp]);
+		emit(ctx, "p0.%c", component[reg.comp]);
 	} else {
-		printf("%s%c%d.%c", full ? "" : "h", type, reg.num, component[reg.comp]);
+		emit(ctx, "%s%c%d.%c", full ? "" : "h", type, reg.num, component[reg.comp]);
 	}
 }
 
@@ -111,35 +129,20 @@ static void print_reg(reg_t reg, bool full, bool r, bool c, bool im,
  * write-after-read (output.. but not 100%)..
  */
 
-#define MAX_REG 4096
+#define MAX_REG DISASM_MAX_REG
 
-typedef struct {
-	uint8_t full[MAX_REG/8];
-	uint8_t half[MAX_REG/8];
-} regmask_t;
+typedef struct disasm_regmask regmask_t;
 
 static void regmask_set(regmask_t *regmask, unsigned num, bool full, unsigned val)
 {
-	unsigned i = num / 8;
-	unsigned j = num % 8;
 	assert(num < MAX_REG);
-	if (full) {
-		regmask->full[i] = (regmask->full[i] & ~(1 << j)) | (val << j);
-	} else {
-		regmask->half[i] = (regmask->half[i] & ~(1 << j)) | (val << j);
-	}
+	disasm_regmask_set(regmask, num, full, val);
 }
 
 static unsigned regmask_get(regmask_t *regmask, unsigned num, bool full)
 {
-	unsigned i = num / 8;
-	unsigned j = num % 8;
 	assert(num < MAX_REG);
-	if (full) {
-		return (regmask->full[i] >> j) & 0x1;
-	} else {
-		return (regmask->half[i] >> j) & 0x1;
-	}
+	return disasm_regmask_get(regmask, num, full);
 }
 
 static unsigned regidx(reg_t reg)
@@ -155,14 +158,7 @@ static reg_t idxreg(unsigned idx)
 	};
 }
 
-static struct {
-	regmask_t used;
-	regmask_t rbw;      /* read before write */
-	regmask_t war;      /* write after read */
-	regmask_t cnst;     /* used consts */
-} regs;
-
-static void print_regs(regmask_t *regmask, bool full)
+static void print_regs(struct disasm_a3xx_ctx *ctx, regmask_t *regmask, bool full)
 {
 	int num, max = 0, cnt = 0;
 	int first, last;
@@ -171,9 +167,9 @@ static void print_regs(regmask_t *regmask, bool full)
 	{
 		if (first != MAX_REG) {
 			if (first == last) {
-				printf(" %d", first);
+				emit(ctx, " %d", first);
 			} else {
-				printf(" %d-%d", first, last);
+				emit(ctx, " %d-%d", first, last);
 			}
 		}
 	}
@@ -194,197 +190,240 @@ static void print_regs(regmask_t *regmask, bool full)
 
 	print_sequence();
 
-	printf(" (cnt=%d, max=%d)", cnt, max);
+	emit(ctx, " (cnt=%d, max=%d)", cnt, max);
 }
 
-static void print_reg_stats(int level)
+void disasm_a3xx_print_reg_stats(struct disasm_a3xx_ctx *ctx, FILE *out,
+		int level)
 {
-	printf("%sRegister Stats:\n", levels[level]);
-	printf("%s- used (half):", levels[level]);
-	print_regs(&regs.used, false);
-	printf("\n");
-	printf("%s- used (full):", levels[level]);
-	print_regs(&regs.used, true);
-	printf("\n");
-	printf("%s- input (half):", levels[level]);
-	print_regs(&regs.rbw, false);
-	printf("\n");
-	printf("%s- input (full):", levels[level]);
-	print_regs(&regs.rbw, true);
-	printf("\n");
-	printf("%s- const (half):", levels[level]);
-	print_regs(&regs.cnst, false);
-	printf("\n");
-	printf("%s- const (full):", levels[level]);
-	print_regs(&regs.cnst, true);
-	printf("\n");
-	printf("%s- output (half):", levels[level]);
-	print_regs(&regs.war, false);
-	printf("  (estimated)\n");
-	printf("%s- output (full):", levels[level]);
-	print_regs(&regs.war, true);
-	printf("  (estimated)\n");
+	ctx->out = out;
+
+	emit(ctx, "%sRegister Stats:\n", levels[level]);
+	emit(ctx, "%s- used (half):", levels[level]);
+	print_regs(ctx, &ctx->regs.used, false);
+	emit(ctx, "\n");
+	emit(ctx, "%s- used (full):", levels[level]);
+	print_regs(ctx, &ctx->regs.used, true);
+	emit(ctx, "\n");
+	emit(ctx, "%s- input (half):", levels[level]);
+	print_regs(ctx, &ctx->regs.rbw, false);
+	emit(ctx, "\n");
+	emit(ctx, "%s- input (full):", levels[level]);
+	print_regs(ctx, &ctx->regs.rbw, true);
+	emit(ctx, "\n");
+	emit(ctx, "%s- const (half):", levels[level]);
+	print_regs(ctx, &ctx->regs.cnst, false);
+	emit(ctx, "\n");
+	emit(ctx, "%s- const (full):", levels[level]);
+	print_regs(ctx, &ctx->regs.cnst, true);
+	emit(ctx, "\n");
+	emit(ctx, "%s- output (half):", levels[level]);
+	print_regs(ctx, &ctx->regs.war, false);
+	emit(ctx, "  (estimated)\n");
+	emit(ctx, "%s- output (full):", levels[level]);
+	print_regs(ctx, &ctx->regs.war, true);
+	emit(ctx, "  (estimated)\n");
+
+	ctx->out = NULL;
 }
 
 /* we have to process the dst register after src to avoid tripping up
  * the read-before-write detection
  */
-static unsigned last_dst;
-static bool last_dst_full;
-static bool last_dst_valid = false;
-
-/* current instruction repeat flag: */
-static unsigned repeat;
-/* current instruction repeat indx/offset (for --expand): */
-static unsigned repeatidx;
-
-static void process_reg_dst(void)
+static void process_reg_dst(struct disasm_a3xx_ctx *ctx)
 {
 	int i;
 
-	if (!last_dst_valid)
+	if (!ctx->last_dst_valid)
 		return;
 
-	for (i = 0; i <= repeat; i++) {
-		unsigned dst = last_dst + i;
+	for (i = 0; i <= ctx->repeat; i++) {
+		unsigned dst = ctx->last_dst + i;
 
-		regmask_set(&regs.war, dst, last_dst_full, 1);
-		regmask_set(&regs.used, dst, last_dst_full, 1);
+		regmask_set(&ctx->regs.war, dst, ctx->last_dst_full, 1);
+		regmask_set(&ctx->regs.used, dst, ctx->last_dst_full, 1);
 	}
 
-	last_dst_valid = false;
+	ctx->last_dst_valid = false;
+}
+
+static struct disasm_a3xx_reg decoded_reg(reg_t reg, bool full, bool r,
+		bool c, bool im, bool neg, bool abs, bool addr_rel)
+{
+	struct disasm_a3xx_reg dreg = {
+			.num = (im || addr_rel) ? 0 : regidx(reg),
+			.iim_val = (im || addr_rel) ? reg.iim_val : 0,
+	};
+
+	if (full)     dreg.flags |= DISASM_REG_FULL;
+	if (r)        dreg.flags |= DISASM_REG_R;
+	if (c)        dreg.flags |= DISASM_REG_CONST;
+	if (im)       dreg.flags |= DISASM_REG_IMMED;
+	if (neg)      dreg.flags |= DISASM_REG_NEG;
+	if (abs)      dreg.flags |= DISASM_REG_ABS;
+	if (addr_rel) dreg.flags |= DISASM_REG_REL;
+
+	return dreg;
+}
+
+static void record_src(struct disasm_a3xx_ctx *ctx, struct disasm_a3xx_reg dreg)
+{
+	struct disasm_a3xx_instr *instr = ctx->instr;
+	if (instr && (instr->nsrc < DISASM_A3XX_MAX_SRC))
+		instr->src[instr->nsrc++] = dreg;
 }
 
-static void print_reg_dst(reg_t reg, bool full, bool addr_rel)
+static void print_reg_dst(struct disasm_a3xx_ctx *ctx, reg_t reg, bool full, bool addr_rel)
 {
-	/* presumably the special registers a0.c and p0.c don't count.. */
-	if (!(addr_rel || (reg.num == 61) || (reg.num == 62))) {
-		last_dst = regidx(reg);
-		last_dst_full = full;
-		last_dst_valid = true;
+	if (ctx->instr) {
+		ctx->instr->dst = decoded_reg(reg, full, false, false, false,
+				false, false, addr_rel);
+		ctx->instr->has_dst = true;
+
+		/* presumably the special registers a0.c and p0.c don't count.. */
+		if (!(addr_rel || (reg.num == 61) || (reg.num == 62))) {
+			ctx->last_dst = regidx(reg);
+			ctx->last_dst_full = full;
+			ctx->last_dst_valid = true;
+		}
 	}
-	reg = idxreg(regidx(reg) + repeatidx);
-	print_reg(reg, full, false, false, false, false, false, addr_rel);
+	reg = idxreg(regidx(reg) + ctx->repeatidx);
+	print_reg(ctx, reg, full, false, false, false, false, false, addr_rel);
 }
 
-static void print_reg_src(reg_t reg, bool full, bool r, bool c, bool im,
+static void print_reg_src(struct disasm_a3xx_ctx *ctx, reg_t reg, bool full, bool r, bool c, bool im,
 		bool neg, bool abs, bool addr_rel)
 {
-	/* presumably the special registers a0.c and p0.c don't count.. */
-	if (!(addr_rel || c || im || (reg.num == 61) || (reg.num == 62))) {
+	if (!ctx->instr) {
+		/* printing, nothing to track */
+	} else if (!(addr_rel || c || im || (reg.num == 61) || (reg.num == 62))) {
+		/* presumably the special registers a0.c and p0.c don't count.. */
 		int i, num = regidx(reg);
-		for (i = 0; i <= repeat; i++) {
+		for (i = 0; i <= ctx->repeat; i++) {
 			unsigned src = num + i;
 
-			if (!regmask_get(&regs.used, src, full))
-				regmask_set(&regs.rbw, src, full, 1);
+			if (!regmask_get(&ctx->regs.used, src, full))
+				regmask_set(&ctx->regs.rbw, src, full, 1);
 
-			regmask_set(&regs.war, src, full, 0);
-			regmask_set(&regs.used, src, full, 1);
+			regmask_set(&ctx->regs.war, src, full, 0);
+			regmask_set(&ctx->regs.used, src, full, 1);
 
 			if (!r)
 				break;
 		}
 	} else if (c) {
 		int i, num = regidx(reg);
-		for (i = 0; i <= repeat; i++) {
+		for (i = 0; i <= ctx->repeat; i++) {
 			unsigned src = num + i;
 
-			regmask_set(&regs.cnst, src, full, 1);
+			regmask_set(&ctx->regs.cnst, src, full, 1);
 
 			if (!r)
 				break;
 		}
 	}
 
+	record_src(ctx, decoded_reg(reg, full, r, c, im, neg, abs, addr_rel));
+
 	if (r)
-		reg = idxreg(regidx(reg) + repeatidx);
+		reg = idxreg(regidx(reg) + ctx->repeatidx);
 
-	print_reg(reg, full, r, c, im, neg, abs, addr_rel);
+	print_reg(ctx, reg, full, r, c, im, neg, abs, addr_rel);
 }
 
 
-static void print_instr_cat0(instr_t *instr)
+static void print_instr_cat0(struct disasm_a3xx_ctx *ctx, instr_t *instr)
 {
 	instr_cat0_t *cat0 = &instr->cat0;
 
 	switch (cat0->opc) {
 	case OPC_KILL:
-		printf(" %sp0.%c", cat0->inv ? "!" : "",
+		emit(ctx, " %sp0.%c", cat0->inv ? "!" : "",
 				component[cat0->comp]);
 		break;
 	case OPC_BR:
-		printf(" %sp0.%c, #%d", cat0->inv ? "!" : "",
+		emit(ctx, " %sp0.%c, #%d", cat0->inv ? "!" : "",
 				component[cat0->comp], cat0->immed);
 		break;
 	case OPC_JUMP:
 	case OPC_CALL:
-		printf(" #%d", cat0->immed);
+		emit(ctx, " #%d", cat0->immed);
 		break;
 	}
 
-	if ((debug & PRINT_VERBOSE) && (cat0->dummy1|cat0->dummy2|cat0->dummy3|cat0->dummy4))
-		printf("\t{0: %x,%x,%x,%x}", cat0->dummy1, cat0->dummy2, cat0->dummy3, cat0->dummy4);
+	if ((ctx->debug & PRINT_VERBOSE) && (cat0->dummy1|cat0->dummy2|cat0->dummy3|cat0->dummy4))
+		emit(ctx, "\t{0: %x,%x,%x,%x}", cat0->dummy1, cat0->dummy2, cat0->dummy3, cat0->dummy4);
 }
 
-static void print_instr_cat1(instr_t *instr)
+static void print_instr_cat1(struct disasm_a3xx_ctx *ctx, instr_t *instr)
 {
 	instr_cat1_t *cat1 = &instr->cat1;
 
 	if (cat1->ul)
-		printf("(ul)");
+		emit(ctx, "(ul)");
 
 	if (cat1->src_type == cat1->dst_type) {
 		if ((cat1->src_type == TYPE_S16) && (((reg_t)cat1->dst).num == REG_A0)) {
 			/* special case (nmemonic?): */
-			printf("mova");
+			emit(ctx, "mova");
 		} else {
-			printf("mov.%s%s", type[cat1->src_type], type[cat1->dst_type]);
+			emit(ctx, "mov.%s%s", type[cat1->src_type], type[cat1->dst_type]);
 		}
 	} else {
-		printf("cov.%s%s", type[cat1->src_type], type[cat1->dst_type]);
+		emit(ctx, "cov.%s%s", type[cat1->src_type], type[cat1->dst_type]);
 	}
 
-	printf(" ");
+	emit(ctx, " ");
 
 	if (cat1->even)
-		printf("(even)");
+		emit(ctx, "(even)");
 
 	if (cat1->pos_inf)
-		printf("(pos_infinity)");
+		emit(ctx, "(pos_infinity)");
 
-	print_reg_dst((reg_t)(cat1->dst), type_size(cat1->dst_type) == 32,
+	print_reg_dst(ctx, (reg_t)(cat1->dst), type_size(cat1->dst_type) == 32,
 			cat1->dst_rel);
 
-	printf(", ");
+	emit(ctx, ", ");
 
 	/* ugg, have to special case this.. vs print_reg().. */
 	if (cat1->src_im) {
+		record_src(ctx, (struct disasm_a3xx_reg){
+				.flags = DISASM_REG_IMMED |
+					((type_size(cat1->src_type) == 32) ? DISASM_REG_FULL : 0),
+				.iim_val = cat1->iim_val,
+		});
 		if (type_float(cat1->src_type))
-			printf("(%f)", cat1->fim_val);
+			emit(ctx, "(%f)", cat1->fim_val);
 		else
-			printf("%d", cat1->iim_val);
+			emit(ctx, "%d", cat1->iim_val);
 	} else if (cat1->src_rel && !cat1->src_c) {
 		/* I would just use %+d but trying to make it diff'able with
 		 * libllvm-a3xx...
 		 */
 		char type = cat1->src_rel_c ? 'c' : 'r';
+		record_src(ctx, (struct disasm_a3xx_reg){
+				.flags = DISASM_REG_REL |
+					(cat1->src_rel_c ? DISASM_REG_CONST : 0) |
+					((type_size(cat1->src_type) == 32) ? DISASM_REG_FULL : 0),
+				.iim_val = cat1->off,
+		});
 		if (cat1->off < 0)
-			printf("%c<a0.x - %d>", type, -cat1->off);
+			emit(ctx, "%c<a0.x - %d>", type, -cat1->off);
 		else if (cat1->off > 0)
-			printf("%c<a0.x + %d>", type, cat1->off);
+			emit(ctx, "%c<a0.x + %d>", type, cat1->off);
 		else
-			printf("c<a0.x>");
+			emit(ctx, "c<a0.x>");
 	} else {
-		print_reg_src((reg_t)(cat1->src), type_size(cat1->src_type) == 32,
+		print_reg_src(ctx, (reg_t)(cat1->src), type_size(cat1->src_type) == 32,
 				cat1->src_r, cat1->src_c, cat1->src_im, false, false, false);
 	}
 
-	if ((debug & PRINT_VERBOSE) && (cat1->must_be_0))
-		printf("\t{1: %x}", cat1->must_be_0);
+	if ((ctx->debug & PRINT_VERBOSE) && (cat1->must_be_0))
+		emit(ctx, "\t{1: %x}", cat1->must_be_0);
 }
 
-static void print_instr_cat2(instr_t *instr)
+static void print_instr_cat2(struct disasm_a3xx_ctx *ctx, instr_t *instr)
 {
 	instr_cat2_t *cat2 = &instr->cat2;
 	static const char *cond[] = {
@@ -404,26 +443,26 @@ static void print_instr_cat2(instr_t *instr)
 	case OPC_CMPV_F:
 	case OPC_CMPV_U:
 	case OPC_CMPV_S:
-		printf(".%s", cond[cat2->cond]);
+		emit(ctx, ".%s", cond[cat2->cond]);
 		break;
 	}
 
-	printf(" ");
+	emit(ctx, " ");
 	if (cat2->ei)
-		printf("(ei)");
-	print_reg_dst((reg_t)(cat2->dst), cat2->full ^ cat2->dst_half, false);
-	printf(", ");
+		emit(ctx, "(ei)");
+	print_reg_dst(ctx, (reg_t)(cat2->dst), cat2->full ^ cat2->dst_half, false);
+	emit(ctx, ", ");
 
 	if (cat2->c1.src1_c) {
-		print_reg_src((reg_t)(cat2->c1.src1), cat2->full, cat2->src1_r,
+		print_reg_src(ctx, (reg_t)(cat2->c1.src1), cat2->full, cat2->src1_r,
 				cat2->c1.src1_c, cat2->src1_im, cat2->src1_neg,
 				cat2->src1_abs, false);
 	} else if (cat2->rel1.src1_rel) {
-		print_reg_src((reg_t)(cat2->rel1.src1), cat2->full, cat2->src1_r,
+		print_reg_src(ctx, (reg_t)(cat2->rel1.src1), cat2->full, cat2->src1_r,
 				cat2->rel1.src1_c, cat2->src1_im, cat2->src1_neg,
 				cat2->src1_abs, cat2->rel1.src1_rel);
 	} else {
-		print_reg_src((reg_t)(cat2->src1), cat2->full, cat2->src1_r,
+		print_reg_src(ctx, (reg_t)(cat2->src1), cat2->full, cat2->src1_r,
 				false, cat2->src1_im, cat2->src1_neg,
 				cat2->src1_abs, false);
 	}
@@ -446,17 +485,17 @@ static void print_instr_cat2(instr_t *instr)
 		/* these only have one src reg */
 		break;
 	default:
-		printf(", ");
+		emit(ctx, ", ");
 		if (cat2->c2.src2_c) {
-			print_reg_src((reg_t)(cat2->c2.src2), cat2->full, cat2->src2_r,
+			print_reg_src(ctx, (reg_t)(cat2->c2.src2), cat2->full, cat2->src2_r,
 					cat2->c2.src2_c, cat2->src2_im, cat2->src2_neg,
 					cat2->src2_abs, false);
 		} else if (cat2->rel2.src2_rel) {
-			print_reg_src((reg_t)(cat2->rel2.src2), cat2->full, cat2->src2_r,
+			print_reg_src(ctx, (reg_t)(cat2->rel2.src2), cat2->full, cat2->src2_r,
 					cat2->rel2.src2_c, cat2->src2_im, cat2->src2_neg,
 					cat2->src2_abs, cat2->rel2.src2_rel);
 		} else {
-			print_reg_src((reg_t)(cat2->src2), cat2->full, cat2->src2_r,
+			print_reg_src(ctx, (reg_t)(cat2->src2), cat2->full, cat2->src2_r,
 					false, cat2->src2_im, cat2->src2_neg,
 					cat2->src2_abs, false);
 		}
@@ -464,7 +503,7 @@ static void print_instr_cat2(instr_t *instr)
 	}
 }
 
-static void print_instr_cat3(instr_t *instr)
+static void print_instr_cat3(struct disasm_a3xx_ctx *ctx, instr_t *instr)
 {
 	instr_cat3_t *cat3 = &instr->cat3;
 	bool full = true;
@@ -483,69 +522,69 @@ static void print_instr_cat3(instr_t *instr)
 		break;
 	}
 
-	printf(" ");
-	print_reg_dst((reg_t)(cat3->dst), full ^ cat3->dst_half, false);
-	printf(", ");
+	emit(ctx, " ");
+	print_reg_dst(ctx, (reg_t)(cat3->dst), full ^ cat3->dst_half, false);
+	emit(ctx, ", ");
 	if (cat3->c1.src1_c) {
-		print_reg_src((reg_t)(cat3->c1.src1), full,
+		print_reg_src(ctx, (reg_t)(cat3->c1.src1), full,
 				cat3->src1_r, cat3->c1.src1_c, false, cat3->src1_neg,
 				false, false);
 	} else if (cat3->rel1.src1_rel) {
-		print_reg_src((reg_t)(cat3->rel1.src1), full,
+		print_reg_src(ctx, (reg_t)(cat3->rel1.src1), full,
 				cat3->src1_r, cat3->rel1.src1_c, false, cat3->src1_neg,
 				false, cat3->rel1.src1_rel);
 	} else {
-		print_reg_src((reg_t)(cat3->src1), full,
+		print_reg_src(ctx, (reg_t)(cat3->src1), full,
 				cat3->src1_r, false, false, cat3->src1_neg,
 				false, false);
 	}
-	printf(", ");
-	print_reg_src((reg_t)cat3->src2, full,
+	emit(ctx, ", ");
+	print_reg_src(ctx, (reg_t)cat3->src2, full,
 			cat3->src2_r, cat3->src2_c, false, cat3->src2_neg,
 			false, false);
-	printf(", ");
+	emit(ctx, ", ");
 	if (cat3->c2.src3_c) {
-		print_reg_src((reg_t)(cat3->c2.src3), full,
+		print_reg_src(ctx, (reg_t)(cat3->c2.src3), full,
 				cat3->src3_r, cat3->c2.src3_c, false, cat3->src3_neg,
 				false, false);
 	} else if (cat3->rel2.src3_rel) {
-		print_reg_src((reg_t)(cat3->rel2.src3), full,
+		print_reg_src(ctx, (reg_t)(cat3->rel2.src3), full,
 				cat3->src3_r, cat3->rel2.src3_c, false, cat3->src3_neg,
 				false, cat3->rel2.src3_rel);
 	} else {
-		print_reg_src((reg_t)(cat3->src3), full,
+		print_reg_src(ctx, (reg_t)(cat3->src3), full,
 				cat3->src3_r, false, false, cat3->src3_neg,
 				false, false);
 	}
 }
 
-static void print_instr_cat4(instr_t *instr)
+static void print_instr_cat4(struct disasm_a3xx_ctx *ctx, instr_t *instr)
 {
 	instr_cat4_t *cat4 = &instr->cat4;
 
-	printf(" ");
-	print_reg_dst((reg_t)(cat4->dst), cat4->full ^ cat4->dst_half, false);
-	printf(", ");
+	emit(ctx, " ");
+	print_reg_dst(ctx, (reg_t)(cat4->dst), cat4->full ^ cat4->dst_half, false);
+	emit(ctx, ", ");
 
 	if (cat4->c.src_c) {
-		print_reg_src((reg_t)(cat4->c.src), cat4->full,
+		print_reg_src(ctx, (reg_t)(cat4->c.src), cat4->full,
 				cat4->src_r, cat4->c.src_c, cat4->src_im,
 				cat4->src_neg, cat4->src_abs, false);
 	} else if (cat4->rel.src_rel) {
-		print_reg_src((reg_t)(cat4->rel.src), cat4->full,
+		print_reg_src(ctx, (reg_t)(cat4->rel.src), cat4->full,
 				cat4->src_r, cat4->rel.src_c, cat4->src_im,
 				cat4->src_neg, cat4->src_abs, cat4->rel.src_rel);
 	} else {
-		print_reg_src((reg_t)(cat4->src), cat4->full,
+		print_reg_src(ctx, (reg_t)(cat4->src), cat4->full,
 				cat4->src_r, false, cat4->src_im,
 				cat4->src_neg, cat4->src_abs, false);
 	}
 
-	if ((debug & PRINT_VERBOSE) && (cat4->dummy1|cat4->dummy2))
-		printf("\t{4: %x,%x}", cat4->dummy1, cat4->dummy2);
+	if ((ctx->debug & PRINT_VERBOSE) && (cat4->dummy1|cat4->dummy2))
+		emit(ctx, "\t{4: %x,%x}", cat4->dummy1, cat4->dummy2);
 }
 
-static void print_instr_cat5(instr_t *instr)
+static void print_instr_cat5(struct disasm_a3xx_ctx *ctx, instr_t *instr)
 {
 	static const struct {
 		bool src1, src2, samp, tex;
@@ -582,64 +621,64 @@ static void print_instr_cat5(instr_t *instr)
 	instr_cat5_t *cat5 = &instr->cat5;
 	int i;
 
-	if (cat5->is_3d)   printf(".3d");
-	if (cat5->is_a)    printf(".a");
-	if (cat5->is_o)    printf(".o");
-	if (cat5->is_p)    printf(".p");
-	if (cat5->is_s)    printf(".s");
-	if (cat5->is_s2en) printf(".s2en");
+	if (cat5->is_3d)   emit(ctx, ".3d");
+	if (cat5->is_a)    emit(ctx, ".a");
+	if (cat5->is_o)    emit(ctx, ".o");
+	if (cat5->is_p)    emit(ctx, ".p");
+	if (cat5->is_s)    emit(ctx, ".s");
+	if (cat5->is_s2en) emit(ctx, ".s2en");
 
-	printf(" ");
+	emit(ctx, " ");
 
 	switch (cat5->opc) {
 	case OPC_DSXPP_1:
 	case OPC_DSYPP_1:
 		break;
 	default:
-		printf("(%s)", type[cat5->type]);
+		emit(ctx, "(%s)", type[cat5->type]);
 		break;
 	}
 
-	printf("(");
+	emit(ctx, "(");
 	for (i = 0; i < 4; i++)
 		if (cat5->wrmask & (1 << i))
-			printf("%c", "xyzw"[i]);
-	printf(")");
+			emit(ctx, "%c", "xyzw"[i]);
+	emit(ctx, ")");
 
-	print_reg_dst((reg_t)(cat5->dst), type_size(cat5->type) == 32, false);
+	print_reg_dst(ctx, (reg_t)(cat5->dst), type_size(cat5->type) == 32, false);
 
 	if (info[cat5->opc].src1) {
-		printf(", ");
-		print_reg_src((reg_t)(cat5->src1), cat5->full, false, false, false,
+		emit(ctx, ", ");
+		print_reg_src(ctx, (reg_t)(cat5->src1), cat5->full, false, false, false,
 				false, false, false);
 	}
 
 	if (cat5->is_s2en) {
-		printf(", ");
-		print_reg_src((reg_t)(cat5->s2en.src2), cat5->full, false, false, false,
+		emit(ctx, ", ");
+		print_reg_src(ctx, (reg_t)(cat5->s2en.src2), cat5->full, false, false, false,
 				false, false, false);
-		printf(", ");
-		print_reg_src((reg_t)(cat5->s2en.src3), false, false, false, false,
+		emit(ctx, ", ");
+		print_reg_src(ctx, (reg_t)(cat5->s2en.src3), false, false, false, false,
 				false, false, false);
 	} else {
 		if (cat5->is_o || info[cat5->opc].src2) {
-			printf(", ");
-			print_reg_src((reg_t)(cat5->norm.src2), cat5->full,
+			emit(ctx, ", ");
+			print_reg_src(ctx, (reg_t)(cat5->norm.src2), cat5->full,
 					false, false, false, false, false, false);
 		}
 		if (info[cat5->opc].samp)
-			printf(", s#%d", cat5->norm.samp);
+			emit(ctx, ", s#%d", cat5->norm.samp);
 		if (info[cat5->opc].tex)
-			printf(", t#%d", cat5->norm.tex);
+			emit(ctx, ", t#%d", cat5->norm.tex);
 	}
 
-	if (debug & PRINT_VERBOSE) {
+	if (ctx->debug & PRINT_VERBOSE) {
 		if (cat5->is_s2en) {
-			if ((debug & PRINT_VERBOSE) && (cat5->s2en.dummy1|cat5->s2en.dummy2|cat5->dummy2))
-				printf("\t{5: %x,%x,%x}", cat5->s2en.dummy1, cat5->s2en.dummy2, cat5->dummy2);
+			if ((ctx->debug & PRINT_VERBOSE) && (cat5->s2en.dummy1|cat5->s2en.dummy2|cat5->dummy2))
+				emit(ctx, "\t{5: %x,%x,%x}", cat5->s2en.dummy1, cat5->s2en.dummy2, cat5->dummy2);
 		} else {
-			if ((debug & PRINT_VERBOSE) && (cat5->norm.dummy1|cat5->dummy2))
-				printf("\t{5: %x,%x}", cat5->norm.dummy1, cat5->dummy2);
+			if ((ctx->debug & PRINT_VERBOSE) && (cat5->norm.dummy1|cat5->dummy2))
+				emit(ctx, "\t{5: %x,%x}", cat5->norm.dummy1, cat5->dummy2);
 		}
 	}
 }
@@ -649,11 +688,11 @@ static int32_t u2i(uint32_t val, int nbits)
 	return ((val >> (nbits-1)) * ~((1 << nbits) - 1)) | val;
 }
 
-static void print_instr_cat6(instr_t *instr)
+static void print_instr_cat6(struct disasm_a3xx_ctx *ctx, instr_t *instr)
 {
 	instr_cat6_t *cat6 = &instr->cat6;
 
-	printf(".%s ", type[cat6->type]);
+	emit(ctx, ".%s ", type[cat6->type]);
 
 	switch (cat6->opc) {
 	case OPC_LDG:
@@ -662,36 +701,36 @@ static void print_instr_cat6(instr_t *instr)
 	case OPC_LDLW:
 	case OPC_LDLV:
 		/* load instructions: */
-		print_reg_dst((reg_t)(cat6->a.dst), type_size(cat6->type) == 32, false);
-		printf(",");
+		print_reg_dst(ctx, (reg_t)(cat6->a.dst), type_size(cat6->type) == 32, false);
+		emit(ctx, ",");
 		switch (cat6->opc) {
 		case OPC_LDG:
-			printf("g");
+			emit(ctx, "g");
 			break;
 		case OPC_LDP:
-			printf("p");
+			emit(ctx, "p");
 			break;
 		case OPC_LDL:
 		case OPC_LDLW:
 		case OPC_LDLV:
-			printf("l");
+			emit(ctx, "l");
 			break;
 		}
-		printf("[");
-		print_reg_src((reg_t)(cat6->a.src), true,
+		emit(ctx, "[");
+		print_reg_src(ctx, (reg_t)(cat6->a.src), true,
 				false, false, false, false, false, false);
 		if (cat6->a.off)
-			printf("%+d", cat6->a.off);
-		printf("]");
+			emit(ctx, "%+d", cat6->a.off);
+		emit(ctx, "]");
 		break;
 	case OPC_PREFETCH:
 		/* similar to load instructions: */
-		printf("g[");
-		print_reg_src((reg_t)(cat6->a.src), true,
+		emit(ctx, "g[");
+		print_reg_src(ctx, (reg_t)(cat6->a.src), true,
 				false, false, false, false, false, false);
 		if (cat6->a.off)
-			printf("%+d", cat6->a.off);
-		printf("]");
+			emit(ctx, "%+d", cat6->a.off);
+		emit(ctx, "]");
 		break;
 	case OPC_STG:
 	case OPC_STP:
@@ -700,23 +739,23 @@ static void print_instr_cat6(instr_t *instr)
 		/* store instructions: */
 		switch (cat6->opc) {
 		case OPC_STG:
-			printf("g");
+			emit(ctx, "g");
 			break;
 		case OPC_STP:
-			printf("p");
+			emit(ctx, "p");
 			break;
 		case OPC_STL:
 		case OPC_STLW:
-			printf("l");
+			emit(ctx, "l");
 			break;
 		}
-		printf("[");
-		print_reg_dst((reg_t)(cat6->b.dst), true, false);
+		emit(ctx, "[");
+		print_reg_dst(ctx, (reg_t)(cat6->b.dst), true, false);
 		if (cat6->b.off || cat6->b.off_hi)
-			printf("%+d", u2i((cat6->b.off_hi << 8) | cat6->b.off, 13));
-		printf("]");
-		printf(",");
-		print_reg_src((reg_t)(cat6->b.src), type_size(cat6->type) == 32,
+			emit(ctx, "%+d", u2i((cat6->b.off_hi << 8) | cat6->b.off, 13));
+		emit(ctx, "]");
+		emit(ctx, ",");
+		print_reg_src(ctx, (reg_t)(cat6->b.src), type_size(cat6->type) == 32,
 				false, false, false, false, false, false);
 
 		break;
@@ -724,36 +763,36 @@ static void print_instr_cat6(instr_t *instr)
 		/* sti has same encoding as other store instructions, but
 		 * slightly different syntax:
 		 */
-		print_reg_dst((reg_t)(cat6->b.dst), false /* XXX is it always half? */, false);
+		print_reg_dst(ctx, (reg_t)(cat6->b.dst), false /* XXX is it always half? */, false);
 		if (cat6->b.off || cat6->b.off_hi)
-			printf("%+d", u2i((cat6->b.off_hi << 8) | cat6->b.off, 13));
-		printf(",");
-		print_reg_src((reg_t)(cat6->b.src), type_size(cat6->type) == 32,
+			emit(ctx, "%+d", u2i((cat6->b.off_hi << 8) | cat6->b.off, 13));
+		emit(ctx, ",");
+		print_reg_src(ctx, (reg_t)(cat6->b.src), type_size(cat6->type) == 32,
 				false, false, false, false, false, false);
 		break;
 	}
 
-	printf(", %d", cat6->iim_val);
+	emit(ctx, ", %d", cat6->iim_val);
 
-	if (debug & PRINT_VERBOSE) {
+	if (ctx->debug & PRINT_VERBOSE) {
 		switch (cat6->opc) {
 		case OPC_LDG:
 		case OPC_LDP:
 			/* load instructions: */
 			if (cat6->a.dummy1|cat6->a.dummy2|cat6->a.dummy3)
-				printf("\t{6: %x,%x,%x}", cat6->a.dummy1, cat6->a.dummy2, cat6->a.dummy3);
+				emit(ctx, "\t{6: %x,%x,%x}", cat6->a.dummy1, cat6->a.dummy2, cat6->a.dummy3);
 			if ((cat6->a.must_be_one1 != 1) || (cat6->a.must_be_one2 != 1))
-				printf("{?? %d,%d ??}", cat6->a.must_be_one1, cat6->a.must_be_one2);
+				emit(ctx, "{?? %d,%d ??}", cat6->a.must_be_one1, cat6->a.must_be_one2);
 			break;
 		case OPC_STG:
 		case OPC_STP:
 		case OPC_STI:
 			/* store instructions: */
 			if (cat6->b.dummy1|cat6->b.dummy2)
-				printf("\t{6: %x,%x}", cat6->b.dummy1, cat6->b.dummy2);
+				emit(ctx, "\t{6: %x,%x}", cat6->b.dummy1, cat6->b.dummy2);
 			if ((cat6->b.must_be_one1 != 1) || (cat6->b.must_be_one2 != 1) ||
 					(cat6->b.must_be_zero1 != 0))
-				printf("{?? %d,%d,%d ??}", cat6->b.must_be_one1, cat6->b.must_be_one2,
+				emit(ctx, "{?? %d,%d,%d ??}", cat6->b.must_be_one1, cat6->b.must_be_one2,
 						cat6->b.must_be_zero1);
 			break;
 		}
@@ -767,7 +806,7 @@ struct opc_info {
 	uint16_t cat;
 	uint16_t opc;
 	const char *name;
-	void (*print)(instr_t *instr);
+	void (*print)(struct disasm_a3xx_ctx *ctx, instr_t *instr);
 } opcs[1 << (3+NOPC_BITS)] = {
 #define OPC(cat, opc, name) [((cat) << NOPC_BITS) | (opc)] = { (cat), (opc), #name, print_instr_cat##cat }
 	/* category 0: */
@@ -931,6 +970,85 @@ struct opc_info {
 
 #define GETINFO(instr) (&(opcs[((instr)->opc_cat << NOPC_BITS) | getopc(instr)]))
 
+const char *disasm_a3xx_opc_name(unsigned cat, unsigned opc)
+{
+	if ((cat >= 8) || (opc >= (1 << NOPC_BITS)))
+		return NULL;
+	return opcs[(cat << NOPC_BITS) | opc].name;
+}
+
+/*
+ * Bulk statistics:
+ *
+ * Rather than going through the per-category bitfield structs, classify
+ * the whole shader in a few tight loops over the 2nd dword of each
+ * instruction, which has all the fields needed.  The opcode is always
+ * in the bits below opc_cat, but its width depends on the category:
+ */
+static const struct {
+	uint8_t shift, mask;
+} opc_field[8] = {
+		[0] = { 23, 0x0f },
+		[1] = {  0, 0x00 },
+		[2] = { 21, 0x3f },
+		[3] = { 23, 0x0f },
+		[4] = { 21, 0x3f },
+		[5] = { 22, 0x1f },
+		[6] = { 22, 0x1f },
+		[7] = {  0, 0x00 },
+};
+
+int disasm_a3xx_stats(const uint32_t *dwords, int sizedwords,
+		struct disasm_a3xx_stats *stats)
+{
+	uint32_t sy = 0, ss = 0, jp = 0, ul = 0, rpt = 0, expanded = 0;
+	int i, n = sizedwords / 2;
+
+	/* find the end first, so the remaining loops have no early exit: */
+	for (i = 0; i < n; i++) {
+		if ((dwords[(2 * i) + 1] & 0xe7800000) == (OPC_END << 23)) {
+			n = i + 1;
+			break;
+		}
+	}
+
+	/* flags, branch-free so the compiler can vectorize it: */
+	for (i = 0; i < n; i++) {
+		uint32_t hi  = dwords[(2 * i) + 1];
+		uint32_t cat = hi >> 29;
+		uint32_t alu = cat <= 4;           /* cat0-cat4 have rpt/ss */
+		uint32_t r   = alu * ((hi >> 8) & 0x7);
+
+		sy  += (hi >> 28) & 0x1;
+		jp  += (hi >> 27) & 0x1;
+		ss  += alu & (hi >> 12);
+		ul  += alu & (cat >= 2) & (hi >> 13);
+		rpt += (r != 0);
+		expanded += 1 + r;
+	}
+
+	/* opcode histogram: */
+	for (i = 0; i < n; i++) {
+		uint32_t hi  = dwords[(2 * i) + 1];
+		uint32_t cat = hi >> 29;
+		uint32_t opc = (hi >> opc_field[cat].shift) & opc_field[cat].mask;
+
+		stats->cat[cat]++;
+		stats->opc[(cat << NOPC_BITS) | opc]++;
+	}
+
+	stats->nshaders++;
+	stats->ninstrs += n;
+	stats->nexpanded += expanded;
+	stats->sy += sy;
+	stats->ss += ss;
+	stats->jp += jp;
+	stats->ul += ul;
+	stats->rpt += rpt;
+
+	return n;
+}
+
 static uint32_t getopc(instr_t *instr)
 {
 	switch (instr->opc_cat) {
@@ -945,21 +1063,22 @@ static uint32_t getopc(instr_t *instr)
 	}
 }
 
-static bool print_instr(uint32_t *dwords, int level, int n)
+static bool print_instr(struct disasm_a3xx_ctx *ctx, const uint32_t *dwords,
+		int level, int n)
 {
 	instr_t *instr = (instr_t *)dwords;
 	uint32_t opc = getopc(instr);
 	const char *name;
 
-	printf("%s%04d[%08xx_%08xx] ", levels[level], n, dwords[1], dwords[0]);
+	emit(ctx, "%s%04d[%08xx_%08xx] ", levels[level], n, dwords[1], dwords[0]);
 
 #if 0
 	/* print unknown bits: */
-	if (debug & PRINT_RAW)
-		printf("[%08xx_%08xx] ", dwords[1] & 0x001ff800, dwords[0] & 0x00000000);
+	if (ctx->debug & PRINT_RAW)
+		emit(ctx, "[%08xx_%08xx] ", dwords[1] & 0x001ff800, dwords[0] & 0x00000000);
 
-	if (debug & PRINT_VERBOSE)
-		printf("%d,%02d ", instr->opc_cat, opc);
+	if (ctx->debug & PRINT_VERBOSE)
+		emit(ctx, "%d,%02d ", instr->opc_cat, opc);
 #endif
 
 	/* NOTE: order flags are printed is a bit fugly.. but for now I
@@ -968,67 +1087,211 @@ static bool print_instr(uint32_t *dwords, int level, int n)
 	 */
 
 	if (instr->sync)
-		printf("(sy)");
+		emit(ctx, "(sy)");
 	if (instr->ss && (instr->opc_cat <= 4))
-		printf("(ss)");
+		emit(ctx, "(ss)");
 	if (instr->jmp_tgt)
-		printf("(jp)");
+		emit(ctx, "(jp)");
 	if (instr->repeat && (instr->opc_cat <= 4)) {
-		printf("(rpt%d)", instr->repeat);
-		repeat = instr->repeat;
+		emit(ctx, "(rpt%d)", instr->repeat);
+		ctx->repeat = instr->repeat;
 	} else {
-		repeat = 0;
+		ctx->repeat = 0;
 	}
 	if (instr->ul && ((2 <= instr->opc_cat) && (instr->opc_cat <= 4)))
-		printf("(ul)");
+		emit(ctx, "(ul)");
 
 	name = GETINFO(instr)->name;
 
+	if (ctx->instr) {
+		struct disasm_a3xx_instr *dinstr = ctx->instr;
+
+		memset(dinstr, 0, sizeof(*dinstr));
+		dinstr->dwords[0] = dwords[0];
+		dinstr->dwords[1] = dwords[1];
+		dinstr->name = name;
+		dinstr->cat = instr->opc_cat;
+		dinstr->opc = opc;
+		dinstr->repeat = ctx->repeat;
+		if (instr->sync)
+			dinstr->flags |= DISASM_A3XX_SY;
+		if (instr->ss && (instr->opc_cat <= 4))
+			dinstr->flags |= DISASM_A3XX_SS;
+		if (instr->jmp_tgt)
+			dinstr->flags |= DISASM_A3XX_JP;
+		if (instr->ul && ((2 <= instr->opc_cat) && (instr->opc_cat <= 4)))
+			dinstr->flags |= DISASM_A3XX_UL;
+	}
+
 	if (name) {
-		printf("%s", name);
-		GETINFO(instr)->print(instr);
+		emit(ctx, "%s", name);
+		GETINFO(instr)->print(ctx, instr);
 	} else {
-		printf("unknown(%d,%d)", instr->opc_cat, opc);
+		emit(ctx, "unknown(%d,%d)", instr->opc_cat, opc);
 	}
 
-	printf("\n");
+	emit(ctx, "\n");
 
-	process_reg_dst();
+	if (ctx->instr)
+		process_reg_dst(ctx);
 
-	if ((instr->opc_cat <= 4) && (debug & EXPAND_REPEAT)) {
+	if ((instr->opc_cat <= 4) && (ctx->debug & EXPAND_REPEAT) && ctx->out) {
 		int i;
 		for (i = 0; i < instr->repeat; i++) {
-			repeatidx = i + 1;
-			printf("%s%04d[                   ] ", levels[level], n);
+			ctx->repeatidx = i + 1;
+			emit(ctx, "%s%04d[                   ] ", levels[level], n);
 
 			if (name) {
-				printf("%s", name);
-				GETINFO(instr)->print(instr);
+				emit(ctx, "%s", name);
+				GETINFO(instr)->print(ctx, instr);
 			} else {
-				printf("unknown(%d,%d)", instr->opc_cat, opc);
+				emit(ctx, "unknown(%d,%d)", instr->opc_cat, opc);
 			}
 
-			printf("\n");
+			emit(ctx, "\n");
 		}
-		repeatidx = 0;
+		ctx->repeatidx = 0;
 	}
 
 	return (instr->opc_cat == 0) && (opc == OPC_END);
 }
 
-int disasm_a3xx(uint32_t *dwords, int sizedwords, int level, enum shader_t type)
+void disasm_a3xx_init(struct disasm_a3xx_ctx *ctx, enum debug_t debug)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->debug = debug;
+}
+
+int disasm_a3xx_decode(struct disasm_a3xx_ctx *ctx, const uint32_t *dwords,
+		int sizedwords, struct disasm_a3xx_instr *instrs, int max_instrs)
 {
 	bool end = false;
+	int i, n = 0;
+
+	assert((sizedwords % 2) == 0);
+
+	memset(&ctx->regs, 0, sizeof(ctx->regs));
+	ctx->out = NULL;
+	ctx->last_dst_valid = false;
+
+	for (i = 0; (i < sizedwords) && (n < max_instrs) && !end; i += 2) {
+		ctx->instr = &instrs[n++];
+		end = print_instr(ctx, &dwords[i], 0, i/2);
+	}
+
+	ctx->instr = NULL;
+
+	return n;
+}
+
+void disasm_a3xx_print(struct disasm_a3xx_ctx *ctx, FILE *out,
+		const struct disasm_a3xx_instr *instrs, int ninstrs, int level)
+{
 	int i;
 
+	ctx->out = out;
+	ctx->instr = NULL;
+
+	for (i = 0; i < ninstrs; i++)
+		print_instr(ctx, instrs[i].dwords, level, i);
+
+	ctx->out = NULL;
+}
+
+/* Disassembly is cached by hash of the shader binary (plus everything
+ * else that affects the output), so a shader which is loaded at every
+ * draw is only decoded once per run:
+ */
+struct disasm_cache_entry {
+	uint64_t hash;
+	uint32_t *dwords;
+	int sizedwords, level;
+	enum shader_t type;
+	enum debug_t debug;
+	char *text;
+	size_t len;
+	struct disasm_a3xx_instr *instrs;
+	int ninstrs;
+	struct disasm_cache_entry *next;
+};
+
+#define DISASM_CACHE_SIZE 256
+static struct disasm_cache_entry *disasm_cache[DISASM_CACHE_SIZE];
+
+static struct disasm_cache_entry * disasm_cache_lookup(uint64_t hash,
+		uint32_t *dwords, int sizedwords, int level, enum shader_t type)
+{
+	struct disasm_cache_entry *entry;
+
+	for (entry = disasm_cache[hash % DISASM_CACHE_SIZE];
+			entry; entry = entry->next) {
+		if ((entry->hash == hash) && (entry->sizedwords == sizedwords) &&
+				(entry->level == level) && (entry->type == type) &&
+				(entry->debug == debug) &&
+				!memcmp(entry->dwords, dwords, sizedwords * 4))
+			return entry;
+	}
+
+	return NULL;
+}
+
+int disasm_a3xx_decoded(uint32_t *dwords, int sizedwords, int level,
+		enum shader_t type, const struct disasm_a3xx_instr **instrsp)
+{
+	struct disasm_cache_entry *entry, **head;
+	struct disasm_a3xx_instr *instrs;
+	struct disasm_a3xx_ctx ctx;
+	uint64_t hash;
+	FILE *out;
+	int n;
+
 	assert((sizedwords % 2) == 0);
 
-	memset(&regs, 0, sizeof(regs));
+	hash = diff_hash_dwords(DIFF_HASH_INIT, dwords, sizedwords);
+	entry = disasm_cache_lookup(hash, dwords, sizedwords, level, type);
+	if (entry) {
+		fwrite(entry->text, 1, entry->len, stdout);
+		if (instrsp)
+			*instrsp = entry->instrs;
+		return entry->ninstrs;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	entry->hash = hash;
+	entry->dwords = malloc(sizedwords * 4);
+	memcpy(entry->dwords, dwords, sizedwords * 4);
+	entry->sizedwords = sizedwords;
+	entry->level = level;
+	entry->type = type;
+	entry->debug = debug;
+
+	disasm_a3xx_init(&ctx, debug);
+
+	instrs = malloc((sizedwords / 2) * sizeof(*instrs));
+	n = disasm_a3xx_decode(&ctx, dwords, sizedwords, instrs, sizedwords / 2);
+
+	out = open_memstream(&entry->text, &entry->len);
+	disasm_a3xx_print(&ctx, out, instrs, n, level);
+	disasm_a3xx_print_reg_stats(&ctx, out, level);
+	fclose(out);
+
+	entry->instrs = instrs;
+	entry->ninstrs = n;
 
-	for (i = 0; i < sizedwords && !end; i += 2)
-		end = print_instr(&dwords[i], level, i/2);
+	head = &disasm_cache[hash % DISASM_CACHE_SIZE];
+	entry->next = *head;
+	*head = entry;
 
-	print_reg_stats(level);
+	fwrite(entry->text, 1, entry->len, stdout);
 
+	if (instrsp)
+		*instrsp = entry->instrs;
+
+	return n;
+}
+
+int disasm_a3xx(uint32_t *dwords, int sizedwords, int level, enum shader_t type)
+{
+	disasm_a3xx_decoded(dwords, sizedwords, level, type, NULL);
 	return 0;
 }
@@ -24,6 +24,9 @@
 #ifndef DISASM_H_
 #define DISASM_H_
 
+#include <stdio.h>
+#include <stdint.h>
+
 enum shader_t {
 	SHADER_VERTEX,
 	SHADER_FRAGMENT,
@@ -37,8 +40,203 @@ enum debug_t {
 	EXPAND_REPEAT  = 0x4,
 };
 
+/* Print the disassembly to stdout, using the global debug flags: */
 int disasm_a2xx(uint32_t *dwords, int sizedwords, int level, enum shader_t type);
 int disasm_a3xx(uint32_t *dwords, int sizedwords, int level, enum shader_t type);
 void disasm_set_debug(enum debug_t debug);
 
+/*
+ * Context based API:
+ *
+ * The decoders fill in a caller supplied array of decoded instructions,
+ * plus register stats in the context, without any global state or
+ * allocation, so they can be used from multiple threads and for
+ * analysis without parsing text.  Printing is layered on top of the
+ * decoded instructions.
+ */
+
+/* Register usage, indexed by (4 * num) + comp for a3xx, or by register
+ * number for a2xx (which only uses the full mask):
+ */
+#define DISASM_MAX_REG 4096
+
+struct disasm_regmask {
+	uint8_t full[DISASM_MAX_REG/8];
+	uint8_t half[DISASM_MAX_REG/8];
+};
+
+static inline void
+disasm_regmask_set(struct disasm_regmask *regmask, unsigned num,
+		int full, unsigned val)
+{
+	uint8_t *mask = full ? regmask->full : regmask->half;
+	unsigned i = num / 8;
+	unsigned j = num % 8;
+	mask[i] = (mask[i] & ~(1 << j)) | (val << j);
+}
+
+static inline unsigned
+disasm_regmask_get(const struct disasm_regmask *regmask, unsigned num, int full)
+{
+	const uint8_t *mask = full ? regmask->full : regmask->half;
+	return (mask[num / 8] >> (num % 8)) & 0x1;
+}
+
+/* number of registers set in the mask, optionally returning the highest: */
+static inline int
+disasm_regmask_count(const struct disasm_regmask *regmask, int full, int *max)
+{
+	int num, cnt = 0;
+
+	if (max)
+		*max = 0;
+
+	for (num = 0; num < DISASM_MAX_REG; num++) {
+		if (disasm_regmask_get(regmask, num, full)) {
+			if (max)
+				*max = num;
+			cnt++;
+		}
+	}
+
+	return cnt;
+}
+
+struct disasm_regstats {
+	struct disasm_regmask used;
+	struct disasm_regmask rbw;      /* read before write (inputs) */
+	struct disasm_regmask war;      /* write after read (outputs, estimated) */
+	struct disasm_regmask cnst;     /* used consts */
+};
+
+/*
+ * a3xx:
+ */
+
+#define DISASM_A3XX_MAX_SRC 3
+
+enum disasm_a3xx_reg_flags {
+	DISASM_REG_FULL   = 0x01,
+	DISASM_REG_R      = 0x02,   /* (r), incremented by repeat */
+	DISASM_REG_CONST  = 0x04,
+	DISASM_REG_IMMED  = 0x08,
+	DISASM_REG_NEG    = 0x10,
+	DISASM_REG_ABS    = 0x20,
+	DISASM_REG_REL    = 0x40,   /* relative to a0.x, iim_val is the offset */
+};
+
+struct disasm_a3xx_reg {
+	uint16_t num;                   /* (4 * num) + comp */
+	uint8_t flags;
+	int32_t iim_val;                /* immediate value, or offset if relative */
+};
+
+enum disasm_a3xx_instr_flags {
+	DISASM_A3XX_SY    = 0x01,
+	DISASM_A3XX_SS    = 0x02,
+	DISASM_A3XX_JP    = 0x04,
+	DISASM_A3XX_UL    = 0x08,
+};
+
+struct disasm_a3xx_instr {
+	uint32_t dwords[2];
+	const char *name;               /* NULL for unknown opcodes */
+	uint8_t cat, opc;
+	uint8_t flags;
+	uint8_t repeat;
+	uint8_t has_dst, nsrc;
+	struct disasm_a3xx_reg dst;
+	struct disasm_a3xx_reg src[DISASM_A3XX_MAX_SRC];
+};
+
+struct disasm_a3xx_ctx {
+	enum debug_t debug;
+	struct disasm_regstats regs;
+
+	/* private decoder/printer state: */
+	FILE *out;
+	struct disasm_a3xx_instr *instr;
+	unsigned last_dst, last_dst_full, last_dst_valid;
+	unsigned repeat, repeatidx;
+};
+
+void disasm_a3xx_init(struct disasm_a3xx_ctx *ctx, enum debug_t debug);
+/* decode up to max_instrs instructions (stopping at end), returning the
+ * number decoded:
+ */
+int disasm_a3xx_decode(struct disasm_a3xx_ctx *ctx, const uint32_t *dwords,
+		int sizedwords, struct disasm_a3xx_instr *instrs, int max_instrs);
+void disasm_a3xx_print(struct disasm_a3xx_ctx *ctx, FILE *out,
+		const struct disasm_a3xx_instr *instrs, int ninstrs, int level);
+void disasm_a3xx_print_reg_stats(struct disasm_a3xx_ctx *ctx, FILE *out,
+		int level);
+
+/* like disasm_a3xx(), but also returns the decoded instructions (and the
+ * number of them).  They belong to the disasm cache, so stay valid until
+ * exit and must not be freed:
+ */
+int disasm_a3xx_decoded(uint32_t *dwords, int sizedwords, int level,
+		enum shader_t type, const struct disasm_a3xx_instr **instrs);
+
+/* Opcode/category/flag histograms, from a bulk decode of the shader
+ * which doesn't do any formatting.  The counts are accumulated, so one
+ * stats struct can be used for many shaders.  Returns the number of
+ * instructions (up to and including end).
+ */
+#define DISASM_A3XX_NOPC (8 << 6)
+
+struct disasm_a3xx_stats {
+	uint32_t nshaders;
+	uint32_t ninstrs;
+	uint32_t nexpanded;             /* counting (rptN) as N+1 instrs */
+	uint32_t cat[8];
+	uint32_t opc[DISASM_A3XX_NOPC]; /* indexed by (cat << 6) | opc */
+	uint32_t sy, ss, jp, ul, rpt;   /* # of instrs with each flag */
+};
+
+int disasm_a3xx_stats(const uint32_t *dwords, int sizedwords,
+		struct disasm_a3xx_stats *stats);
+const char *disasm_a3xx_opc_name(unsigned cat, unsigned opc);
+
+/*
+ * a2xx:
+ */
+
+enum disasm_a2xx_instr_type {
+	DISASM_A2XX_CF,
+	DISASM_A2XX_ALU,
+	DISASM_A2XX_FETCH,
+};
+
+struct disasm_a2xx_instr {
+	uint32_t dwords[3];             /* CF instrs only use the first 48 bits */
+	uint8_t type;                   /* enum disasm_a2xx_instr_type */
+	uint8_t sync;
+	uint16_t off;                   /* CF index, or ALU/FETCH address */
+	uint8_t opc;                    /* CF, vector or fetch opcode */
+	uint8_t scalar_opc, has_scalar;
+};
+
+struct disasm_a2xx_ctx {
+	enum debug_t debug;
+	enum shader_t type;
+	struct disasm_regstats regs;
+
+	/* private printer state: */
+	FILE *out;
+};
+
+void disasm_a2xx_init(struct disasm_a2xx_ctx *ctx, enum debug_t debug,
+		enum shader_t type);
+int disasm_a2xx_decode(struct disasm_a2xx_ctx *ctx, const uint32_t *dwords,
+		int sizedwords, struct disasm_a2xx_instr *instrs, int max_instrs);
+void disasm_a2xx_print(struct disasm_a2xx_ctx *ctx, FILE *out,
+		const struct disasm_a2xx_instr *instrs, int ninstrs, int level);
+
+/* like disasm_a2xx(), but also returns the decoded instructions (and the
+ * number of them), which the caller must free():
+ */
+int disasm_a2xx_decoded(uint32_t *dwords, int sizedwords, int level,
+		enum shader_t type, struct disasm_a2xx_instr **instrs);
+
 #endif /* DISASM_H_ */
@@ -21,18 +21,30 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include <string.h>
+#include <poll.h>
+#include <signal.h>
+#include <ftw.h>
 
 #include "redump.h"
 #include "disasm.h"
+#include "diff.h"
 #include "io.h"
+#include "shader-store.h"
+#include "shader-cost.h"
+
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
 
 struct pgm_header {
 	uint32_t size;
@@ -246,6 +258,19 @@ static int full_dump = 1;
 static int dump_shaders = 0;
 static int gpu_id;
 
+/* for --stats, print a cost estimate per shader and accumulate a3xx opcode
+ * histograms instead of disassembling:
+ */
+static int stats_only = 0;
+static struct disasm_a3xx_stats stats;
+
+/* for --batch, in the worker processes, metrics for each shader found
+ * are written to batch_fd instead of disassembling:
+ */
+static int batch_fd = -1;
+static void batch_shader(const uint32_t *dwords, uint32_t sizedwords,
+		int gen, enum shader_t type);
+
 char *find_sect_end(char *buf, int sz)
 {
 	uint8_t *ptr = (uint8_t *)buf;
@@ -542,17 +567,59 @@ static void dump_short_summary(struct state *state, int nconsts,
 	printf("\n");
 }
 
+/* number of the program within the input file, for the shader index: */
+static int program_num;
+
 static void dump_raw_shader(uint32_t *dwords, uint32_t sizedwords, int n, char *ext)
 {
-	static char filename[256];
-	int fd;
+	uint64_t hash;
 
 	if (!dump_shaders)
 		return;
 
-	sprintf(filename, "%.*s-%d.%s", strlen(infile)-3, infile, n, ext);
-	fd = open(filename, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-	write(fd, dwords, sizedwords * 4);
+	hash = shader_store(dwords, sizedwords, ext);
+	shader_store_index("%s %d %d %s %016llx\n", infile, program_num, n, ext,
+			(unsigned long long)hash);
+}
+
+/* for --stats, a cost estimate line per shader: */
+static void print_cost(struct shader_cost *cost, enum shader_t type)
+{
+	static const char *names[] = {
+			[SHADER_VERTEX]   = "vertex",
+			[SHADER_FRAGMENT] = "fragment",
+			[SHADER_COMPUTE]  = "compute",
+	};
+	printf("%s: %s shader cost: ", infile, names[type]);
+	shader_cost_print(stdout, cost);
+	printf("\n");
+}
+
+static int disasm_shader_a2xx(uint32_t *dwords, int sizedwords, int level,
+		enum shader_t type)
+{
+	if (batch_fd >= 0) {
+		batch_shader(dwords, sizedwords, 2, type);
+		return 0;
+	}
+
+	if (stats_only) {
+		struct disasm_a2xx_ctx ctx;
+		struct disasm_a2xx_instr *instrs;
+		struct shader_cost cost;
+		int n, max_instrs = (2 * sizedwords / 3) + 2;
+
+		instrs = malloc(max_instrs * sizeof(*instrs));
+		disasm_a2xx_init(&ctx, 0, type);
+		n = disasm_a2xx_decode(&ctx, dwords, sizedwords, instrs, max_instrs);
+		shader_cost_a2xx(instrs, n, &cost);
+		free(instrs);
+
+		print_cost(&cost, type);
+		return 0;
+	}
+
+	return disasm_a2xx(dwords, sizedwords, level, type);
 }
 
 static void dump_shaders_a2xx(struct state *state)
@@ -591,7 +658,7 @@ static void dump_shaders_a2xx(struct state *state)
 		} else {
 			dump_short_summary(state, vs_hdr->unknown1 - 1, constants);
 		}
-		disasm_a2xx((uint32_t *)(ptr + 32), (sect_size - 32) / 4, level+1, SHADER_VERTEX);
+		disasm_shader_a2xx((uint32_t *)(ptr + 32), (sect_size - 32) / 4, level+1, SHADER_VERTEX);
 		dump_raw_shader((uint32_t *)(ptr + 32), (sect_size - 32) / 4, i, "vo");
 		free(ptr);
 
@@ -642,7 +709,7 @@ static void dump_shaders_a2xx(struct state *state)
 		} else {
 			dump_short_summary(state, fs_hdr->unknown1 - 1, constants);
 		}
-		disasm_a2xx((uint32_t *)(ptr + 32), (sect_size - 32) / 4, level+1, SHADER_FRAGMENT);
+		disasm_shader_a2xx((uint32_t *)(ptr + 32), (sect_size - 32) / 4, level+1, SHADER_FRAGMENT);
 		dump_raw_shader((uint32_t *)(ptr + 32), (sect_size - 32) / 4, i, "fo");
 		free(ptr);
 
@@ -654,6 +721,71 @@ static void dump_shaders_a2xx(struct state *state)
 	}
 }
 
+static int disasm_shader_a3xx(uint32_t *dwords, int sizedwords, int level,
+		enum shader_t type)
+{
+	if (batch_fd >= 0) {
+		batch_shader(dwords, sizedwords, 3, type);
+		return 0;
+	}
+
+	if (stats_only) {
+		struct disasm_a3xx_ctx ctx;
+		struct disasm_a3xx_instr *instrs;
+		struct shader_cost cost;
+		int n;
+
+		sizedwords &= ~1;
+
+		instrs = malloc((sizedwords / 2) * sizeof(*instrs));
+		disasm_a3xx_init(&ctx, 0);
+		n = disasm_a3xx_decode(&ctx, dwords, sizedwords, instrs, sizedwords / 2);
+		shader_cost_a3xx(instrs, n, &cost);
+		free(instrs);
+
+		print_cost(&cost, type);
+		disasm_a3xx_stats(dwords, sizedwords, &stats);
+		return 0;
+	}
+
+	return disasm_a3xx(dwords, sizedwords, level, type);
+}
+
+static void print_stats(void)
+{
+	int cat, opc;
+
+	if (!stats.ninstrs)
+		return;
+
+	printf("shaders: %u\n", stats.nshaders);
+	printf("instructions: %u (%u with rpt expanded)\n",
+			stats.ninstrs, stats.nexpanded);
+	printf("flags: (sy)=%u (ss)=%u (jp)=%u (ul)=%u (rpt)=%u\n",
+			stats.sy, stats.ss, stats.jp, stats.ul, stats.rpt);
+
+	for (cat = 0; cat < 8; cat++) {
+		if (!stats.cat[cat])
+			continue;
+		printf("cat%d: %u (%.1f%%)\n", cat, stats.cat[cat],
+				100.0 * stats.cat[cat] / stats.ninstrs);
+		for (opc = 0; opc < 64; opc++) {
+			uint32_t cnt = stats.opc[(cat << 6) | opc];
+			const char *name = disasm_a3xx_opc_name(cat, opc);
+			char unknown[32];
+			if (!cnt)
+				continue;
+			if (cat == 1) {
+				name = "mov/cov";
+			} else if (!name) {
+				sprintf(unknown, "unknown(%d,%d)", cat, opc);
+				name = unknown;
+			}
+			printf("\t%-16s %u\n", name, cnt);
+		}
+	}
+}
+
 static void dump_shaders_a3xx(struct state *state)
 {
 	int i, j;
@@ -732,7 +864,7 @@ printf("hdr_size=%d\n", hdr_size);
 			instrs_size -= 32;
 		}
 
-		disasm_a3xx((uint32_t *)instrs, instrs_size / 4, level+1, SHADER_VERTEX);
+		disasm_shader_a3xx((uint32_t *)instrs, instrs_size / 4, level+1, SHADER_VERTEX);
 		dump_raw_shader((uint32_t *)instrs, instrs_size / 4, i, "vo3");
 		free(vs_hdr);
 	}
@@ -811,7 +943,7 @@ printf("hdr_size=%d\n", hdr_size);
 				instrs_size -= 32;
 			}
 		}
-		disasm_a3xx((uint32_t *)instrs, instrs_size / 4, level+1, SHADER_FRAGMENT);
+		disasm_shader_a3xx((uint32_t *)instrs, instrs_size / 4, level+1, SHADER_FRAGMENT);
 		dump_raw_shader((uint32_t *)instrs, instrs_size / 4, i, "fo3");
 		free(fs_hdr);
 	}
@@ -1008,6 +1140,8 @@ void dump_program(struct state *state)
 		dump_shaders_a2xx(state);
 	}
 
+	program_num++;
+
 	if (!full_dump)
 		return;
 
@@ -1035,14 +1169,515 @@ void dump_program(struct state *state)
 		free (state->uniformblocks[i].members);
 }
 
+static int handle_file(const char *filename);
+
+/*
+ * Batch mode:
+ *
+ * Walk directories of .rd/.rd.gz captures, split round-robin between
+ * forked worker processes.  The workers find every shader, both from
+ * RD_PROGRAM sections and from CP_LOAD_STATE/CP_IM_LOAD_IMMEDIATE in
+ * the cmdstream, and send a metrics record for each back over a pipe.
+ * The parent dedups by shader hash (the same hash used for
+ * --dump-shaders), gen and stage, and writes a CSV (or JSON) table to stdout.
+ */
+
+struct shader_metrics {
+	uint64_t hash;
+	int32_t  file, seq;         /* where the shader was first seen */
+	uint16_t gen;               /* 2 (a2xx) or 3 (a3xx) */
+	uint16_t type;              /* enum shader_t */
+	uint32_t sizedwords;
+	uint32_t instrs, expanded;
+	uint32_t full_gprs, half_gprs, consts;
+	uint32_t sy, ss, cycles;
+	uint32_t count;             /* # of times seen (only in the parent) */
+};
+
+static int batch_file, batch_seq;
+static int batch_json = 0;
+static int batch_jobs = 0;
+
+/* number of vec4 registers with any component set, for a3xx masks: */
+static uint32_t count_vec4(const struct disasm_regmask *regmask, int full)
+{
+	uint32_t num, cnt = 0;
+	for (num = 0; num < DISASM_MAX_REG; num += 4) {
+		cnt += disasm_regmask_get(regmask, num + 0, full) |
+				disasm_regmask_get(regmask, num + 1, full) |
+				disasm_regmask_get(regmask, num + 2, full) |
+				disasm_regmask_get(regmask, num + 3, full);
+	}
+	return cnt;
+}
+
+/* highest register used, +1, ie. the # of registers to allocate: */
+static uint32_t max_reg(const struct disasm_regmask *regmask, int full, int vec4)
+{
+	int max;
+	if (!disasm_regmask_count(regmask, full, &max))
+		return 0;
+	return (vec4 ? (max / 4) : max) + 1;
+}
+
+static void batch_shader(const uint32_t *dwords, uint32_t sizedwords,
+		int gen, enum shader_t type)
+{
+	struct shader_metrics m = {
+			.hash = diff_hash_dwords(DIFF_HASH_INIT, dwords, sizedwords),
+			.file = batch_file,
+			.seq  = batch_seq++,
+			.gen  = gen,
+			.type = type,
+			.sizedwords = sizedwords,
+	};
+	struct shader_cost cost;
+	int n;
+
+	if (!sizedwords)
+		return;
+
+	if (gen == 3) {
+		struct disasm_a3xx_ctx ctx;
+		struct disasm_a3xx_instr *instrs;
+
+		sizedwords &= ~1;
+
+		instrs = malloc((sizedwords / 2) * sizeof(*instrs));
+		disasm_a3xx_init(&ctx, 0);
+		n = disasm_a3xx_decode(&ctx, dwords, sizedwords, instrs, sizedwords / 2);
+		shader_cost_a3xx(instrs, n, &cost);
+		free(instrs);
+
+		m.full_gprs = max_reg(&ctx.regs.used, 1, 1);
+		m.half_gprs = max_reg(&ctx.regs.used, 0, 1);
+		m.consts = count_vec4(&ctx.regs.cnst, 1) +
+				count_vec4(&ctx.regs.cnst, 0);
+	} else {
+		struct disasm_a2xx_ctx ctx;
+		struct disasm_a2xx_instr *instrs;
+		int max_instrs = (2 * sizedwords / 3) + 2;
+
+		instrs = malloc(max_instrs * sizeof(*instrs));
+		disasm_a2xx_init(&ctx, 0, type);
+		n = disasm_a2xx_decode(&ctx, dwords, sizedwords, instrs, max_instrs);
+		shader_cost_a2xx(instrs, n, &cost);
+		free(instrs);
+
+		m.full_gprs = max_reg(&ctx.regs.used, 1, 0);
+		m.consts = disasm_regmask_count(&ctx.regs.cnst, 1, NULL);
+	}
+
+	m.instrs   = cost.ninstrs;
+	m.expanded = cost.nexpanded;
+	m.sy       = cost.sy;
+	m.ss       = cost.ss;
+	m.cycles   = cost.cycles;
+
+	/* records are smaller than PIPE_BUF, so the write is atomic: */
+	if (write(batch_fd, &m, sizeof(m)) != sizeof(m)) {
+		fprintf(stderr, "error writing to parent\n");
+		exit(1);
+	}
+}
+
+/* gpu buffers from the capture, for finding shaders in the cmdstream: */
+static struct {
+	void *hostptr;
+	uint32_t gpuaddr, len;
+} buffers[512];
+static int nbuffers;
+
+static void *hostptr(uint32_t gpuaddr, uint32_t *len)
+{
+	int i;
+	for (i = 0; gpuaddr && (i < nbuffers); i++) {
+		if ((buffers[i].gpuaddr <= gpuaddr) &&
+				(gpuaddr < (buffers[i].gpuaddr + buffers[i].len))) {
+			*len = buffers[i].len + buffers[i].gpuaddr - gpuaddr;
+			return buffers[i].hostptr + (gpuaddr - buffers[i].gpuaddr);
+		}
+	}
+	*len = 0;
+	return NULL;
+}
+
+static void free_buffers(void)
+{
+	int i;
+	for (i = 0; i < nbuffers; i++)
+		free(buffers[i].hostptr);
+	nbuffers = 0;
+}
+
+static void scan_cmdstream(uint32_t *dwords, uint32_t sizedwords, int depth);
+
+static void scan_packet(uint32_t opc, uint32_t *dwords, uint32_t sizedwords,
+		int depth)
+{
+	uint32_t len;
+	void *ptr;
+
+	switch (opc) {
+	case CP_INDIRECT_BUFFER_PFE:
+	case CP_INDIRECT_BUFFER_PFD:
+		if ((sizedwords < 2) || (depth > 4))
+			break;
+		ptr = hostptr(dwords[0], &len);
+		if (ptr)
+			scan_cmdstream(ptr, min(dwords[1], len / 4), depth + 1);
+		break;
+	case CP_IM_LOAD_IMMEDIATE:
+		if ((sizedwords < 2) || (dwords[0] > 1))
+			break;
+		batch_shader(dwords + 2, sizedwords - 2, 2,
+				dwords[0] ? SHADER_FRAGMENT : SHADER_VERTEX);
+		break;
+	case CP_LOAD_STATE: {
+		enum adreno_state_block block;
+		uint32_t num_unit, ext_src_addr;
+
+		if (sizedwords < 2)
+			break;
+
+		block = (dwords[0] >> 19) & 0x7;
+		num_unit = (dwords[0] >> 22) & 0x1ff;
+		ext_src_addr = dwords[1] & 0xfffffffc;
+
+		if (((dwords[1] & 0x3) != ST_SHADER) ||
+				((block != SB_VERT_SHADER) && (block != SB_FRAG_SHADER)))
+			break;
+
+		if (ext_src_addr) {
+			ptr = hostptr(ext_src_addr, &len);
+			len /= 4;
+		} else {
+			ptr = dwords + 2;
+			len = sizedwords - 2;
+		}
+
+		if (ptr)
+			batch_shader(ptr, min(num_unit * 4 * 2, len), 3,
+					(block == SB_VERT_SHADER) ? SHADER_VERTEX : SHADER_FRAGMENT);
+		break;
+	}
+	}
+}
+
+static void scan_cmdstream(uint32_t *dwords, uint32_t sizedwords, int depth)
+{
+	while (sizedwords > 0) {
+		uint32_t count;
+
+		switch (dwords[0] >> 30) {
+		case 0x0:
+			count = (dwords[0] >> 16) + 2;
+			break;
+		case 0x1:
+			count = 3;
+			break;
+		case 0x2:
+			count = 1;
+			break;
+		default:
+			count = ((dwords[0] >> 16) & 0x3fff) + 2;
+			if (count <= sizedwords)
+				scan_packet((dwords[0] >> 8) & 0xff, dwords + 1,
+						count - 1, depth);
+			break;
+		}
+
+		if (count > sizedwords)
+			break;
+
+		dwords += count;
+		sizedwords -= count;
+	}
+}
+
+static char **batch_files;
+static int nbatch_files;
+
+static int collect_file(const char *path, const struct stat *sb,
+		int typeflag, struct FTW *ftwbuf)
+{
+	if ((typeflag == FTW_F) && (check_extension(path, ".rd") ||
+			check_extension(path, ".rd.gz"))) {
+		if (!(nbatch_files % 256))
+			batch_files = realloc(batch_files,
+					(nbatch_files + 256) * sizeof(batch_files[0]));
+		batch_files[nbatch_files++] = strdup(path);
+	}
+	return 0;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int cmp_metrics(const void *a, const void *b)
+{
+	const struct shader_metrics *ma = a, *mb = b;
+	if (ma->file != mb->file)
+		return ma->file - mb->file;
+	return ma->seq - mb->seq;
+}
+
+static void batch_worker(int idx, int fd)
+{
+	int default_gpu_id = gpu_id;
+	int j;
+
+	batch_fd = fd;
+
+	/* the normal dump output isn't wanted: */
+	if (!freopen("/dev/null", "w", stdout))
+		exit(1);
+
+	for (j = idx; j < nbatch_files; j += batch_jobs) {
+		batch_file = j;
+		batch_seq = 0;
+		gpu_id = default_gpu_id;
+		if (handle_file(batch_files[j]))
+			fprintf(stderr, "error reading: %s\n", batch_files[j]);
+		free_buffers();
+	}
+
+	close(fd);
+	exit(0);
+}
+
+/* file paths can contain anything, so quote them as needed: */
+static void print_csv_str(const char *str)
+{
+	const char *p;
+
+	if (!strpbrk(str, "\",\\\n\r")) {
+		printf("%s", str);
+		return;
+	}
+
+	putchar('"');
+	for (p = str; *p; p++) {
+		if (*p == '"')
+			putchar('"');
+		putchar(*p);
+	}
+	putchar('"');
+}
+
+static void print_json_str(const char *str)
+{
+	const unsigned char *p;
+
+	putchar('"');
+	for (p = (const unsigned char *)str; *p; p++) {
+		if ((*p == '"') || (*p == '\\'))
+			printf("\\%c", *p);
+		else if (*p < 0x20)
+			printf("\\u%04x", *p);
+		else
+			putchar(*p);
+	}
+	putchar('"');
+}
+
+static void print_metrics(struct shader_metrics *m, int first)
+{
+	static const char *types[] = {
+			[SHADER_VERTEX]   = "vert",
+			[SHADER_FRAGMENT] = "frag",
+			[SHADER_COMPUTE]  = "comp",
+	};
+	const char *type = (m->type < ARRAY_SIZE(types)) ? types[m->type] : "?";
+
+	if (batch_json) {
+		printf("%s\n  {\"hash\": \"%016llx\", \"gpu\": \"a%dxx\", \"type\": \"%s\", "
+				"\"sizedwords\": %u, \"instrs\": %u, \"expanded\": %u, "
+				"\"full_gprs\": %u, \"half_gprs\": %u, \"consts\": %u, "
+				"\"sy\": %u, \"ss\": %u, \"cycles\": %u, \"count\": %u, "
+				"\"file\": ", first ? "" : ",",
+				(unsigned long long)m->hash, m->gen, type, m->sizedwords,
+				m->instrs, m->expanded, m->full_gprs, m->half_gprs,
+				m->consts, m->sy, m->ss, m->cycles, m->count);
+		print_json_str(batch_files[m->file]);
+		printf("}");
+	} else {
+		printf("%016llx,a%dxx,%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,",
+				(unsigned long long)m->hash, m->gen, type, m->sizedwords,
+				m->instrs, m->expanded, m->full_gprs, m->half_gprs,
+				m->consts, m->sy, m->ss, m->cycles, m->count);
+		print_csv_str(batch_files[m->file]);
+		printf("\n");
+	}
+}
+
+/* the same dwords are a different shader for another gen or stage: */
+static int same_shader(const struct shader_metrics *a,
+		const struct shader_metrics *b)
+{
+	return (a->hash == b->hash) && (a->gen == b->gen) && (a->type == b->type);
+}
+
+/* on error, stop and reap the workers started so far: */
+static void kill_workers(pid_t *pids, struct pollfd *fds, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		close(fds[i].fd);
+		kill(pids[i], SIGTERM);
+	}
+
+	for (i = 0; i < n; i++)
+		waitpid(pids[i], NULL, 0);
+}
+
+static int handle_batch(char **paths)
+{
+	int jobs = batch_jobs;
+	pid_t pids[jobs];
+	struct pollfd fds[jobs];
+	struct shader_metrics *metrics = NULL, **table;
+	size_t len = 0, alloc = 0;
+	int i, n, nmetrics, nopen, tablesize, nunique = 0;
+
+	for (; *paths; paths++) {
+		if (nftw(*paths, collect_file, 16, 0)) {
+			fprintf(stderr, "could not walk: %s\n", *paths);
+			return -1;
+		}
+	}
+
+	/* so the output doesn't depend on directory order: */
+	qsort(batch_files, nbatch_files, sizeof(batch_files[0]), cmp_str);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < jobs; i++) {
+		int p[2];
+
+		if (pipe(p)) {
+			fprintf(stderr, "pipe failed\n");
+			kill_workers(pids, fds, i);
+			return -1;
+		}
+
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			fprintf(stderr, "fork failed\n");
+			close(p[0]);
+			close(p[1]);
+			kill_workers(pids, fds, i);
+			return -1;
+		}
+
+		if (pids[i] == 0) {
+			close(p[0]);
+			for (n = 0; n < i; n++)
+				close(fds[n].fd);
+			batch_worker(i, p[1]);
+		}
+
+		close(p[1]);
+		fds[i].fd = p[0];
+		fds[i].events = POLLIN;
+	}
+
+	/* records are written atomically, so the pipes only ever hold whole
+	 * records, and reads of a multiple of the record size return whole
+	 * records:
+	 */
+	nopen = jobs;
+	while (nopen > 0) {
+		if (poll(fds, jobs, -1) < 0)
+			break;
+		for (i = 0; i < jobs; i++) {
+			ssize_t ret;
+
+			if (fds[i].fd < 0 || !fds[i].revents)
+				continue;
+
+			if ((alloc - len) < (64 * sizeof(*metrics))) {
+				alloc = max(2 * alloc, 1024 * sizeof(*metrics));
+				metrics = realloc(metrics, alloc);
+			}
+
+			ret = read(fds[i].fd, (char *)metrics + len,
+					((alloc - len) / sizeof(*metrics)) * sizeof(*metrics));
+			if (ret > 0) {
+				len += ret;
+			} else {
+				close(fds[i].fd);
+				fds[i].fd = -1;
+				nopen--;
+			}
+		}
+	}
+
+	for (i = 0; i < jobs; i++)
+		waitpid(pids[i], NULL, 0);
+
+	nmetrics = len / sizeof(*metrics);
+	qsort(metrics, nmetrics, sizeof(*metrics), cmp_metrics);
+
+	/* dedup, keeping the first occurrence, with an open addressed
+	 * hash table:
+	 */
+	tablesize = 1024;
+	while (tablesize < (2 * nmetrics))
+		tablesize *= 2;
+	table = calloc(tablesize, sizeof(*table));
+
+	if (batch_json)
+		printf("[");
+	else
+		printf("hash,gpu,type,sizedwords,instrs,expanded,full_gprs,"
+				"half_gprs,consts,sy,ss,cycles,count,file\n");
+
+	for (i = 0; i < nmetrics; i++) {
+		struct shader_metrics *m = &metrics[i];
+		uint32_t idx = (m->hash ^ (m->gen << 4) ^ m->type) & (tablesize - 1);
+
+		while (table[idx] && !same_shader(table[idx], m))
+			idx = (idx + 1) & (tablesize - 1);
+
+		if (table[idx]) {
+			table[idx]->count++;
+		} else {
+			table[idx] = m;
+			m->count = 1;
+		}
+	}
+
+	/* and print in order of first occurrence: */
+	for (i = 0; i < nmetrics; i++) {
+		if (metrics[i].count) {
+			print_metrics(&metrics[i], !nunique);
+			nunique++;
+		}
+	}
+
+	if (batch_json)
+		printf("\n]\n");
+
+	fprintf(stderr, "%d files, %d shaders, %d unique\n",
+			nbatch_files, nmetrics, nunique);
+
+	free(table);
+	free(metrics);
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
-	enum rd_sect_type type = RD_NONE;
 	enum debug_t debug = 0;
-	void *buf = NULL;
-	int sz, i;
-	struct io *io;
+	int ret = 0;
 	int raw_program = 0;
+	int batch = 0;
 
 	/* lame argument parsing: */
 
@@ -1072,6 +1707,36 @@ int main(int argc, char **argv)
 			argc--;
 			continue;
 		}
+		if ((argc > 1) && !strcmp(argv[1], "--stats")) {
+			/* per-shader cost estimates and opcode histograms (a3xx)
+			 * rather than disassembly, for any number of input files:
+			 */
+			stats_only = 1;
+			full_dump = 0;
+			argv++;
+			argc--;
+			continue;
+		}
+		if ((argc > 1) && !strcmp(argv[1], "--batch")) {
+			/* table of per-shader metrics for directories of captures: */
+			batch = 1;
+			full_dump = 0;
+			argv++;
+			argc--;
+			continue;
+		}
+		if ((argc > 2) && (!strcmp(argv[1], "--jobs") || !strcmp(argv[1], "-j"))) {
+			batch_jobs = atoi(argv[2]);
+			argv += 2;
+			argc -= 2;
+			continue;
+		}
+		if ((argc > 1) && !strcmp(argv[1], "--json")) {
+			batch_json = 1;
+			argv++;
+			argc--;
+			continue;
+		}
 		if ((argc > 1) && !strcmp(argv[1], "--raw")) {
 			raw_program = 1;
 			argv++;
@@ -1087,25 +1752,36 @@ int main(int argc, char **argv)
 		break;
 	}
 
-	if (argc != 2) {
+	if ((argc < 2) || ((argc != 2) && !(stats_only || batch))) {
 		fprintf(stderr, "usage: pgmdump [--verbose] [--short] [--dump-shaders] testlog.rd\n");
+		fprintf(stderr, "       pgmdump --stats file1.fo3 [file2.rd ...]\n");
+		fprintf(stderr, "       pgmdump --batch [--jobs N] [--json] dir1 [dir2 ...]\n");
 		return -1;
 	}
 
 	disasm_set_debug(debug);
 
-	infile = argv[1];
-
-	io = io_open(infile);
-	if (!io) {
-		fprintf(stderr, "could not open: %s\n", infile);
-		return -1;
+	if (batch) {
+		if (batch_jobs <= 0)
+			batch_jobs = max(1, sysconf(_SC_NPROCESSORS_ONLN));
+		return handle_batch(argv + 1);
 	}
 
 	if (raw_program)
 	{
+		struct io *io;
+		void *buf;
+		int sz;
+
+		infile = argv[1];
+
+		io = io_open(infile);
+		if (!io) {
+			fprintf(stderr, "could not open: %s\n", infile);
+			return -1;
+		}
+
 		io_readn(io, &sz, 4);
-		free(buf);
 
 		/* note: allow hex dumps to go a bit past the end of the buffer..
 		 * might see some garbage, but better than missing the last few bytes..
@@ -1125,37 +1801,100 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	for (argv++; *argv; argv++) {
+		ret = handle_file(*argv);
+		if (ret && stats_only) {
+			fprintf(stderr, "error reading: %s\n", *argv);
+			fprintf(stderr, "continuing..\n");
+			ret = 0;
+		}
+	}
+
+	if (stats_only)
+		print_stats();
+
+	shader_store_close();
+
+	return ret;
+}
+
+/* read the rest of the file, growing the buffer as needed (the size
+ * of compressed input isn't known up front):
+ */
+static int read_all(struct io *io, void **bufp)
+{
+	char *buf = NULL;
+	int ret, sz = 0, alloc = 0;
+
+	do {
+		if ((alloc - sz) < 4096) {
+			alloc = max(2 * alloc, 64 * 1024);
+			buf = realloc(buf, alloc);
+		}
+		ret = io_readn(io, buf + sz, alloc - sz);
+		if (ret < 0)
+			break;
+		sz += ret;
+	} while (ret > 0);
+
+	/* allow hex dumps to go a bit past the end of the buffer: */
+	memset(buf + sz, 0, min(alloc - sz, 4));
+
+	*bufp = buf;
+
+	return (ret < 0) ? ret : sz;
+}
+
+static int handle_file(const char *filename)
+{
+	enum rd_sect_type type = RD_NONE;
+	void *buf = NULL;
+	int sz;
+	struct io *io;
+
+	infile = filename;
+
+	io = io_open(infile);
+	if (!io) {
+		fprintf(stderr, "could not open: %s\n", infile);
+		return -1;
+	}
+
 	/* figure out what sort of input we are dealing with: */
 	if (!(check_extension(infile, ".rd") || check_extension(infile, ".rd.gz"))) {
 		int (*disasm)(uint32_t *dwords, int sizedwords, int level, enum shader_t type);
 		enum shader_t shader = 0;
 		int ret;
 		if (check_extension(infile, ".vo")) {
-			disasm = disasm_a2xx;
+			disasm = disasm_shader_a2xx;
 			shader = SHADER_VERTEX;
 		} else if (check_extension(infile, ".fo")) {
-			disasm = disasm_a2xx;
+			disasm = disasm_shader_a2xx;
 			shader = SHADER_FRAGMENT;
 		} else if (check_extension(infile, ".vo3")) {
-			disasm = disasm_a3xx;
+			disasm = disasm_shader_a3xx;
 			shader = SHADER_VERTEX;
 		} else if (check_extension(infile, ".fo3")) {
-			disasm = disasm_a3xx;
+			disasm = disasm_shader_a3xx;
 			shader = SHADER_FRAGMENT;
 		} else if (check_extension(infile, ".co3")) {
-			disasm = disasm_a3xx;
+			disasm = disasm_shader_a3xx;
 			shader = SHADER_COMPUTE;
 		} else {
 			fprintf(stderr, "invalid input file: %s\n", infile);
+			io_close(io);
 			return -1;
 		}
-		buf = calloc(1, 100 * 1024);
-		ret = io_readn(io, buf, 100 * 1024);
+		ret = read_all(io, &buf);
+		io_close(io);
 		if (ret < 0) {
 			fprintf(stderr, "error: %m");
+			free(buf);
 			return -1;
 		}
-		return disasm(buf, ret/4, 0, shader);
+		ret = disasm(buf, ret/4, 0, shader);
+		free(buf);
+		return ret;
 	}
 
 	while ((io_readn(io, &type, sizeof(type)) > 0) && (io_readn(io, &sz, 4) > 0)) {
@@ -1193,9 +1932,34 @@ int main(int argc, char **argv)
 			gpu_id = *((unsigned int *)buf);
 			printf("gpu_id: %d\n", gpu_id);
 			break;
+		case RD_GPUADDR:
+			if ((batch_fd < 0) || (nbuffers >= ARRAY_SIZE(buffers)))
+				break;
+			buffers[nbuffers].gpuaddr = ((uint32_t *)buf)[0];
+			buffers[nbuffers].len = ((uint32_t *)buf)[1];
+			break;
+		case RD_BUFFER_CONTENTS:
+			if ((batch_fd < 0) || (nbuffers >= ARRAY_SIZE(buffers)))
+				break;
+			/* keep the contents, rather than freeing: */
+			buffers[nbuffers].len = min(buffers[nbuffers].len, sz);
+			buffers[nbuffers++].hostptr = buf;
+			buf = NULL;
+			break;
+		case RD_CMDSTREAM_ADDR:
+			if (batch_fd >= 0) {
+				uint32_t len;
+				void *ptr = hostptr(((uint32_t *)buf)[0], &len);
+				if (ptr)
+					scan_cmdstream(ptr, min(((uint32_t *)buf)[1], len / 4), 0);
+				free_buffers();
+			}
+			break;
 		}
 	}
 
+	free(buf);
+
 	io_close(io);
 
 	return 0;
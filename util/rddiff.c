@@ -0,0 +1,548 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+/* rddiff - compare the state at each draw of two .rd captures
+ *
+ * The draws of each capture are decoded with the cffdump decoder, and
+ * the two sequences aligned by (primtype, index count).  For each pair
+ * of aligned draws, a hash of the full state (registers, shaders and
+ * constants) is compared first, and only if they differ are the
+ * registers (decoded via rnn), shaders and constants compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "redump.h"
+#include "disasm.h"
+#include "rnnutil.h"
+#include "cffdec.h"
+#include "diff.h"
+
+#define MAX_DIFF_EDITS 4096
+
+static int verbose;
+static int all;
+
+/* a deduplicated shader or constant block: */
+struct blob {
+	uint64_t hash;
+	uint32_t sizedwords;
+	uint32_t *dwords;
+	struct blob *next;
+};
+
+static struct blob *blobs[4096];
+
+static struct blob * get_blob(const uint32_t *dwords, uint32_t sizedwords)
+{
+	uint64_t hash = diff_hash_dwords(DIFF_HASH_INIT, dwords, sizedwords);
+	struct blob **head = &blobs[hash % ARRAY_SIZE(blobs)];
+	struct blob *blob;
+
+	for (blob = *head; blob; blob = blob->next) {
+		if ((blob->hash == hash) && (blob->sizedwords == sizedwords) &&
+				!memcmp(blob->dwords, dwords, sizedwords * 4))
+			return blob;
+	}
+
+	blob = calloc(1, sizeof(*blob));
+	blob->hash = hash;
+	blob->sizedwords = sizedwords;
+	blob->dwords = malloc(sizedwords * 4);
+	memcpy(blob->dwords, dwords, sizedwords * 4);
+	blob->next = *head;
+	*head = blob;
+
+	return blob;
+}
+
+struct draw {
+	const char *primtype;
+	uint32_t nindx;
+	uint64_t key;        /* used to align draws */
+	uint64_t hash;       /* hash of the complete state */
+	uint32_t delta_start, delta_end;
+	struct blob *shader[CFFDEC_NSTAGES];
+	struct blob *consts[CFFDEC_NSTAGES];
+};
+
+struct capture {
+	const char *filename;
+	unsigned gpu_id;
+
+	struct draw *draws;
+	uint32_t ndraws, maxdraws;
+
+	/* registers written or changed at each draw: */
+	uint32_t *delta_reg, *delta_val;
+	uint32_t ndeltas, maxdeltas;
+
+	/* state while decoding, and again while comparing: */
+	uint32_t vals[CFFDEC_NREGS];
+	uint8_t written[CFFDEC_NREGS / 8];
+	uint32_t written_list[CFFDEC_NREGS];
+	uint32_t nwritten;
+	uint64_t reghash;
+	uint32_t load_seqno;
+	struct blob *shader[CFFDEC_NSTAGES];
+	struct blob *consts[CFFDEC_NSTAGES];
+};
+
+static int is_written(struct capture *cap, uint32_t regbase)
+{
+	return !!(cap->written[regbase/8] & (1 << (regbase % 8)));
+}
+
+/* the register hash is a sum of per-register hashes, so it does not
+ * depend on the order registers are first written in, and can be
+ * updated incrementally:
+ */
+static uint64_t reg_hash(uint32_t regbase, uint32_t val)
+{
+	return diff_hash(diff_hash(DIFF_HASH_INIT, regbase), val);
+}
+
+static void set_reg(struct capture *cap, uint32_t regbase, uint32_t val)
+{
+	if (is_written(cap, regbase)) {
+		cap->reghash -= reg_hash(regbase, cap->vals[regbase]);
+	} else {
+		cap->written[regbase/8] |= (1 << (regbase % 8));
+		cap->written_list[cap->nwritten++] = regbase;
+	}
+	cap->vals[regbase] = val;
+	cap->reghash += reg_hash(regbase, val);
+}
+
+static void reset_state(struct capture *cap)
+{
+	memset(cap->vals, 0, sizeof(cap->vals));
+	memset(cap->written, 0, sizeof(cap->written));
+	cap->nwritten = 0;
+	cap->reghash = 0;
+}
+
+static void add_delta(struct capture *cap, uint32_t regbase, uint32_t val)
+{
+	if (cap->ndeltas == cap->maxdeltas) {
+		cap->maxdeltas = cap->maxdeltas ? (cap->maxdeltas * 2) : 0x10000;
+		cap->delta_reg = realloc(cap->delta_reg,
+				cap->maxdeltas * sizeof(cap->delta_reg[0]));
+		cap->delta_val = realloc(cap->delta_val,
+				cap->maxdeltas * sizeof(cap->delta_val[0]));
+	}
+	cap->delta_reg[cap->ndeltas] = regbase;
+	cap->delta_val[cap->ndeltas] = val;
+	cap->ndeltas++;
+}
+
+static void draw_cb(void *priv, const struct cffdec_draw *cd)
+{
+	struct capture *cap = priv;
+	struct draw *draw;
+	uint32_t i, regbase;
+	uint64_t hash;
+
+	if (cap->ndraws == cap->maxdraws) {
+		cap->maxdraws = cap->maxdraws ? (cap->maxdraws * 2) : 1024;
+		cap->draws = realloc(cap->draws, cap->maxdraws * sizeof(cap->draws[0]));
+	}
+
+	draw = &cap->draws[cap->ndraws++];
+	draw->primtype = cd->primtype;
+	draw->nindx = cd->nindx;
+	draw->delta_start = cap->ndeltas;
+
+	/* registers are never un-written, so only need to look at bytes of
+	 * the written bitmask that are non-zero:
+	 */
+	for (i = 0; i < sizeof(cap->written); i++) {
+		uint8_t mask = cd->written[i];
+		for (regbase = i * 8; mask; regbase++, mask >>= 1) {
+			if (!(mask & 1))
+				continue;
+			if (is_written(cap, regbase) &&
+					(cap->vals[regbase] == cd->regvals[regbase]))
+				continue;
+			set_reg(cap, regbase, cd->regvals[regbase]);
+			add_delta(cap, regbase, cd->regvals[regbase]);
+		}
+	}
+
+	draw->delta_end = cap->ndeltas;
+
+	if ((cap->ndraws == 1) || (cd->load_seqno != cap->load_seqno)) {
+		for (i = 0; i < CFFDEC_NSTAGES; i++) {
+			cap->shader[i] = get_blob(cd->stage[i].shader,
+					cd->stage[i].shader_sizedwords);
+			cap->consts[i] = get_blob(cd->stage[i].consts,
+					cd->stage[i].consts_sizedwords);
+		}
+		cap->load_seqno = cd->load_seqno;
+	}
+
+	hash = cap->reghash;
+	for (i = 0; i < CFFDEC_NSTAGES; i++) {
+		draw->shader[i] = cap->shader[i];
+		draw->consts[i] = cap->consts[i];
+		hash = diff_hash(hash, cap->shader[i]->hash);
+		hash = diff_hash(hash, cap->shader[i]->hash >> 32);
+		hash = diff_hash(hash, cap->consts[i]->hash);
+		hash = diff_hash(hash, cap->consts[i]->hash >> 32);
+	}
+	draw->hash = hash;
+
+	hash = DIFF_HASH_INIT;
+	for (i = 0; draw->primtype && draw->primtype[i]; i++)
+		hash = diff_hash(hash, draw->primtype[i]);
+	draw->key = diff_hash(hash, draw->nindx);
+}
+
+static struct capture * load_capture(const char *filename)
+{
+	struct capture *cap = calloc(1, sizeof(*cap));
+
+	cap->filename = filename;
+
+	if (cffdec_decode_file(filename, draw_cb, cap)) {
+		fprintf(stderr, "error reading: %s\n", filename);
+		return NULL;
+	}
+
+	cap->gpu_id = cffdec_gpu_id();
+
+	return cap;
+}
+
+/* re-apply the register deltas for a draw, while walking the aligned
+ * draws:
+ */
+static void apply_draw(struct capture *cap, struct draw *draw)
+{
+	uint32_t i;
+	for (i = draw->delta_start; i < draw->delta_end; i++)
+		set_reg(cap, cap->delta_reg[i], cap->delta_val[i]);
+}
+
+static struct rnn *rnn;
+
+static void print_reg(const char *prefix, uint32_t regbase, uint32_t val,
+		int written)
+{
+	struct rnndecaddrinfo *info;
+
+	if (!written) {
+		printf("%s<not written>\n", prefix);
+		return;
+	}
+
+	info = rnn_reginfo(rnn, regbase);
+	if (info && info->typeinfo) {
+		char *decoded = rnndec_decodeval(rnn->vc, info->typeinfo, val, info->width);
+		printf("%s%08x: %s\n", prefix, val, decoded);
+		free(decoded);
+	} else {
+		printf("%s%08x\n", prefix, val);
+	}
+	if (info) {
+		free(info->name);
+		free(info);
+	}
+}
+
+/* values at the last compared pair of draws, so a difference that
+ * persists across many draws is only reported once (unless there
+ * were identical draws in between):
+ */
+static uint32_t last_a[CFFDEC_NREGS], last_b[CFFDEC_NREGS];
+static uint8_t last_differs[CFFDEC_NREGS / 8];
+static int last_identical = 1;
+
+static int compare_reg(struct capture *a, struct capture *b, uint32_t regbase)
+{
+	int wa = is_written(a, regbase), wb = is_written(b, regbase);
+	uint32_t va = wa ? a->vals[regbase] : 0;
+	uint32_t vb = wb ? b->vals[regbase] : 0;
+	int differs = (wa != wb) || (va != vb);
+	int reported = 0;
+
+	if (differs && (all || last_identical ||
+			!(last_differs[regbase/8] & (1 << (regbase % 8))) ||
+			(last_a[regbase] != va) || (last_b[regbase] != vb))) {
+		printf("\t%s:\n", rnn_regname(rnn, regbase, 1));
+		print_reg("\t\t< ", regbase, va, wa);
+		print_reg("\t\t> ", regbase, vb, wb);
+		reported = 1;
+	}
+
+	last_a[regbase] = va;
+	last_b[regbase] = vb;
+	if (differs)
+		last_differs[regbase/8] |= (1 << (regbase % 8));
+	else
+		last_differs[regbase/8] &= ~(1 << (regbase % 8));
+
+	return reported;
+}
+
+static void disasm(struct blob *blob, unsigned gpu_id, int stage)
+{
+	enum shader_t type = (stage == CFFDEC_VS) ? SHADER_VERTEX : SHADER_FRAGMENT;
+	if (gpu_id >= 300)
+		disasm_a3xx(blob->dwords, blob->sizedwords, 2, type);
+	else
+		disasm_a2xx(blob->dwords, blob->sizedwords, 2, type);
+}
+
+static const char *stage_names[] = {
+		[CFFDEC_VS] = "vertex",
+		[CFFDEC_FS] = "fragment",
+};
+
+static struct blob *last_shader[CFFDEC_NSTAGES][2];
+static struct blob *last_consts[CFFDEC_NSTAGES][2];
+
+static int compare_shader(struct capture *a, struct capture *b,
+		struct draw *da, struct draw *db, int stage)
+{
+	struct blob *sa = da->shader[stage], *sb = db->shader[stage];
+
+	if ((sa == sb) || (!all && !last_identical && (last_shader[stage][0] == sa) &&
+			(last_shader[stage][1] == sb)))
+		goto out;
+
+	printf("\t%s shader: %016llx (%u dwords) vs %016llx (%u dwords)\n",
+			stage_names[stage],
+			(unsigned long long)sa->hash, sa->sizedwords,
+			(unsigned long long)sb->hash, sb->sizedwords);
+	if (verbose) {
+		printf("\t<\n");
+		disasm(sa, a->gpu_id, stage);
+		printf("\t>\n");
+		disasm(sb, b->gpu_id, stage);
+	}
+
+	last_shader[stage][0] = sa;
+	last_shader[stage][1] = sb;
+
+	return 1;
+
+out:
+	last_shader[stage][0] = sa;
+	last_shader[stage][1] = sb;
+	return 0;
+}
+
+static int compare_consts(struct draw *da, struct draw *db, int stage)
+{
+	struct blob *ca = da->consts[stage], *cb = db->consts[stage];
+	uint32_t i, n = max(ca->sizedwords, cb->sizedwords);
+
+	if ((ca == cb) || (!all && !last_identical && (last_consts[stage][0] == ca) &&
+			(last_consts[stage][1] == cb))) {
+		last_consts[stage][0] = ca;
+		last_consts[stage][1] = cb;
+		return 0;
+	}
+
+	printf("\t%s consts:\n", stage_names[stage]);
+	for (i = 0; i < n; i++) {
+		uint32_t va = (i < ca->sizedwords) ? ca->dwords[i] : 0;
+		uint32_t vb = (i < cb->sizedwords) ? cb->dwords[i] : 0;
+		union { uint32_t u; float f; } fa = { va }, fb = { vb };
+		if ((va == vb) && (i < ca->sizedwords) && (i < cb->sizedwords))
+			continue;
+		printf("\t\tc%u.%c: %08x (%f) vs %08x (%f)\n", i / 4, "xyzw"[i % 4],
+				va, fa.f, vb, fb.f);
+	}
+
+	last_consts[stage][0] = ca;
+	last_consts[stage][1] = cb;
+
+	return 1;
+}
+
+static int compare_draws(struct capture *a, struct capture *b,
+		uint32_t ia, uint32_t ib)
+{
+	struct draw *da = &a->draws[ia], *db = &b->draws[ib];
+	int reported = 0;
+	uint32_t i, regbase;
+
+	printf("draw %u/%u: %s (%u indices)\n", ia, ib,
+			da->primtype ? da->primtype : "?", da->nindx);
+
+	for (i = 0; i < a->nwritten; i++)
+		reported += compare_reg(a, b, a->written_list[i]);
+	for (i = 0; i < b->nwritten; i++) {
+		regbase = b->written_list[i];
+		if (!is_written(a, regbase))
+			reported += compare_reg(a, b, regbase);
+	}
+
+	for (i = 0; i < CFFDEC_NSTAGES; i++) {
+		reported += compare_shader(a, b, da, db, i);
+		reported += compare_consts(da, db, i);
+	}
+
+	if (!reported)
+		printf("\t(same differences as previous draw)\n");
+
+	last_identical = 0;
+
+	return reported;
+}
+
+static void only_in(struct capture *cap, uint32_t idx)
+{
+	struct draw *draw = &cap->draws[idx];
+	printf("draw %u: %s (%u indices) only in %s\n", idx,
+			draw->primtype ? draw->primtype : "?", draw->nindx,
+			cap->filename);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [--verbose] [--all] [--no-color] a.rd b.rd\n", name);
+	fprintf(stderr, "\t--verbose   - disassemble differing shaders\n");
+	fprintf(stderr, "\t--all       - report differences at every draw, rather\n");
+	fprintf(stderr, "\t              than only when they change\n");
+	fprintf(stderr, "\t--no-color  - do not use ANSI colors\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct capture *a, *b;
+	uint64_t *ka, *kb;
+	int *a2b;
+	int no_color = 0, n = 1, edits;
+	uint32_t i, ib = 0, identical = 0, differing = 0, only_a = 0, only_b = 0;
+
+	while (n < argc) {
+		if (!strcmp(argv[n], "--verbose")) {
+			verbose = 1;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--all")) {
+			all = 1;
+			n++;
+			continue;
+		}
+
+		if (!strcmp(argv[n], "--no-color")) {
+			no_color = 1;
+			n++;
+			continue;
+		}
+
+		break;
+	}
+
+	if ((argc - n) != 2)
+		usage(argv[0]);
+
+	a = load_capture(argv[n]);
+	b = load_capture(argv[n+1]);
+	if (!a || !b)
+		return 1;
+
+	if ((a->gpu_id / 100) != (b->gpu_id / 100))
+		fprintf(stderr, "warning: comparing different generations: %u vs %u\n",
+				a->gpu_id, b->gpu_id);
+
+	rnn = rnn_new(no_color);
+	if (a->gpu_id >= 400)
+		rnn_load(rnn, "a4xx");
+	else if (a->gpu_id >= 300)
+		rnn_load(rnn, "a3xx");
+	else
+		rnn_load(rnn, "a2xx");
+
+	/* align the draws: */
+	ka = malloc((a->ndraws + 1) * sizeof(*ka));
+	kb = malloc((b->ndraws + 1) * sizeof(*kb));
+	a2b = malloc((a->ndraws + 1) * sizeof(*a2b));
+	for (i = 0; i < a->ndraws; i++)
+		ka[i] = a->draws[i].key;
+	for (i = 0; i < b->ndraws; i++)
+		kb[i] = b->draws[i].key;
+
+	edits = diff_align(ka, a->ndraws, kb, b->ndraws, a2b, MAX_DIFF_EDITS);
+	if (edits < 0)
+		fprintf(stderr, "warning: too many differences to align all draws\n");
+
+	/* and walk the aligned draws, re-applying the register deltas to
+	 * reconstruct the state for comparison:
+	 */
+	reset_state(a);
+	reset_state(b);
+
+	for (i = 0; i < a->ndraws; i++) {
+		int j = a2b[i];
+
+		if (j >= 0) {
+			for (; ib < j; ib++) {
+				apply_draw(b, &b->draws[ib]);
+				only_in(b, ib);
+				only_b++;
+			}
+			apply_draw(a, &a->draws[i]);
+			apply_draw(b, &b->draws[ib]);
+			if (a->draws[i].hash == b->draws[ib].hash) {
+				last_identical = 1;
+				identical++;
+			} else {
+				compare_draws(a, b, i, ib);
+				differing++;
+			}
+			ib++;
+		} else {
+			apply_draw(a, &a->draws[i]);
+			only_in(a, i);
+			only_a++;
+		}
+	}
+
+	for (; ib < b->ndraws; ib++) {
+		only_in(b, ib);
+		only_b++;
+	}
+
+	printf("\n%s: %u draws, %s: %u draws\n", a->filename, a->ndraws,
+			b->filename, b->ndraws);
+	printf("identical: %u, differing: %u, only in %s: %u, only in %s: %u\n",
+			identical, differing, a->filename, only_a, b->filename, only_b);
+
+	return (differing || only_a || only_b) ? 1 : 0;
+}
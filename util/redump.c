@@ -31,6 +31,11 @@
 #include <string.h>
 
 #include "redump.h"
+#include "diff.h"
+
+#define MAX_DIFF_EDITS 8192
+
+static int page_size = 4096;
 
 static const uint32_t patterns[] = {
 		/* these should be ordered by most inclusive pattern, ie. most 'f's */
@@ -135,7 +140,6 @@ struct context {
 
 struct context ctxts[64];
 int nctxts;
-typedef int offsets_t[ARRAY_SIZE(ctxts)];
 
 static void handle_string(struct context *ctx)
 {
@@ -160,238 +164,309 @@ static int find_gpuaddr(struct context *ctx, uint32_t dword)
 	return -1;
 }
 
-static int find_pattern(uint32_t dword, int i, offsets_t offsets)
+/* the aligned cmdstreams, one row per line of output, holding the
+ * dword index for each context (or -1 for a gap):
+ */
+typedef int row_t[ARRAY_SIZE(ctxts)];
+
+/* find a pattern matching the dwords of all the contexts which have
+ * one in the row (skipping gaps):
+ */
+static uint32_t find_pattern(row_t row)
 {
-	int j, k;
+	int j, k, first;
+
+	for (first = 0; first < nctxts; first++)
+		if (row[first] >= 0)
+			break;
+
+	if (first == nctxts)
+		return 0;
+
 	for (j = 0; j < ARRAY_SIZE(patterns); j++) {
 		int found = 1;
 		uint32_t pattern = patterns[j];
-		for (k = 0; k < nctxts; k++) {
-			uint32_t other_dword = ctxts[k].buf[i - offsets[k]];
-			if ((dword & pattern) != (other_dword & pattern)) {
+		uint32_t dword = ctxts[first].buf[row[first]];
+		for (k = first + 1; k < nctxts; k++) {
+			if (row[k] < 0)
+				continue;
+			if ((dword & pattern) != (ctxts[k].buf[row[k]] & pattern)) {
 				found = 0;
 				break;
 			}
 		}
 		if (found)
-			return j;
+			return pattern;
 	}
-	return -1;
+	return 0;
 }
 
-static int find_rank(int i, offsets_t offsets)
+/* key used to align the cmdstreams, where gpu addresses in different
+ * contexts are considered equal if they are the n'th gpuaddr of their
+ * context:
+ */
+static uint64_t dword_key(struct context *ctx, uint32_t dword)
 {
-	int j, k, rank = 0;
-	uint32_t dword;
-
-	/* check if we are past the end: */
-	for (k = 0; k < nctxts; k++)
-		if (i >= (ctxts[k].sz/ 4 + offsets[k]))
-			return 0;
+	int j = find_gpuaddr(ctx, dword);
+	if (j >= 0)
+		return (1ULL << 32) | j;
+	return dword;
+}
 
-	dword = ctxts[0].buf[i - offsets[0]];
+static row_t *rows;
+static int nrows, maxrows;
 
-	j = find_gpuaddr(&ctxts[0], dword);
-	if (j >= 0) {
-		/* highest rank, if all are gpuaddr: */
-		rank = ARRAY_SIZE(patterns);
-		for (k = 0; k < nctxts; k++) {
-			struct context *ctx = &ctxts[k];
-			if (j != find_gpuaddr(ctx, ctx->buf[i - offsets[k]])) {
-				rank = 0;
-				break;
-			}
-		}
-	} else {
-		/* followed by pattern match.. in order of priority */
-		/* TODO we need some fuzziness for partial match here.. */
-		j = find_pattern(dword, i, offsets);
-		if (j >= 0)
-			rank = ARRAY_SIZE(patterns) - 1 - j;
+static int *new_row(void)
+{
+	if (nrows == maxrows) {
+		maxrows = maxrows ? (maxrows * 2) : 1024;
+		rows = realloc(rows, maxrows * sizeof(rows[0]));
 	}
-
-	return rank + find_rank(i + 1, offsets) / 2;
+	return rows[nrows++];
 }
 
-static int adjust_offsets_recursive(struct context *ctx, int i,
-		offsets_t offsets, int n, int max_sz)
+/* Align each context's cmdstream to the first context's (a star
+ * alignment, using a Myers diff over the dword keys).  Dwords without
+ * a match in the first context either pair up positionally with its
+ * unmatched dwords (ie. a changed value), or become rows of their own
+ * with gaps in the other contexts (ie. inserted dwords).
+ */
+static void align_cmdstreams(void)
 {
-	int rank;
+	uint64_t *keys[ARRAY_SIZE(ctxts)];
+	int *a2b[ARRAY_SIZE(ctxts)], *nextj[ARRAY_SIZE(ctxts)];
+	int len[ARRAY_SIZE(ctxts)] = {0}, pos[ARRAY_SIZE(ctxts)];
+	int limit[ARRAY_SIZE(ctxts)];
+	int i, k, r, *row;
 
-	rank = find_rank(i, offsets);
+	nrows = 0;
 
-	if (n < nctxts) {
-		int new_rank;
-		offsets_t new_offsets;
-		memcpy(new_offsets, offsets, sizeof(offsets_t));
-
-		if ((ctxts[n].sz/4 + offsets[n]) < max_sz)
-			new_offsets[n] += 1;
-		new_rank = adjust_offsets_recursive(ctx, i, new_offsets, n+1, max_sz);
-		if (new_rank > rank) {
-			rank = new_rank;
-			memcpy(offsets, new_offsets, sizeof(offsets_t));
-		}
+	for (k = 0; k < nctxts; k++) {
+		struct context *ctx = &ctxts[k];
+		len[k] = ctx->buf ? (ctx->sz / 4) : 0;
+		pos[k] = 0;
+		keys[k] = malloc((len[k] + 1) * sizeof(keys[k][0]));
+		for (i = 0; i < len[k]; i++)
+			keys[k][i] = dword_key(ctx, ctx->buf[i]);
 	}
 
-	return rank;
-}
+	for (k = 1; k < nctxts; k++) {
+		a2b[k] = malloc((len[0] + 1) * sizeof(a2b[k][0]));
+		nextj[k] = malloc((len[0] + 1) * sizeof(nextj[k][0]));
+		if (diff_align(keys[0], len[0], keys[k], len[k], a2b[k], MAX_DIFF_EDITS) < 0)
+			fprintf(stderr, "too many differences, cmdstreams only partially aligned\n");
 
-static void adjust_offsets(struct context *ctx, int i, offsets_t offsets)
-{
-	int k;
-	int max_sz = 0;
+		/* next matched dword in ctx k, for each dword in ctx 0: */
+		nextj[k][len[0]] = len[k];
+		for (r = len[0] - 1; r >= 0; r--)
+			nextj[k][r] = (a2b[k][r] >= 0) ? a2b[k][r] : nextj[k][r+1];
+	}
 
-	for (k = 0; k < nctxts; k++)
-		if (ctxts[k].sz > max_sz)
-			max_sz = ctxts[k].sz;
+	for (r = 0; r <= len[0]; r++) {
+		int nins = 0;
+
+		/* first, rows for dwords inserted before the next match: */
+		for (k = 1; k < nctxts; k++) {
+			if (r == len[0])
+				limit[k] = len[k];
+			else if (a2b[k][r] >= 0)
+				limit[k] = a2b[k][r];
+			else
+				limit[k] = pos[k];
+			nins = max(nins, limit[k] - pos[k]);
+		}
 
-	/* convert to dwords: */
-	max_sz /= 4;
+		for (i = 0; i < nins; i++) {
+			row = new_row();
+			row[0] = -1;
+			for (k = 1; k < nctxts; k++)
+				row[k] = (pos[k] < limit[k]) ? pos[k]++ : -1;
+		}
 
-	adjust_offsets_recursive(ctx, i, offsets, 0, max_sz);
-}
+		if (r == len[0])
+			break;
 
-static void handle_hexdump(struct context *ctx)
-{
-	uint32_t *dwords = ctx->buf;
-	int i, j, k;
-	offsets_t offsets = {0};
-	int offset = 0;
-	int idx = -1;
+		/* then the row for the dword in ctx 0: */
+		row = new_row();
+		row[0] = r;
+		for (k = 1; k < nctxts; k++) {
+			if ((a2b[k][r] >= 0) || (pos[k] < nextj[k][r]))
+				row[k] = pos[k]++;
+			else
+				row[k] = -1;
+		}
+	}
 
-	/* figure out idx: */
 	for (k = 0; k < nctxts; k++) {
-		if (&ctxts[k] == ctx) {
-			idx = k;
-			break;
+		free(keys[k]);
+		if (k > 0) {
+			free(a2b[k]);
+			free(nextj[k]);
 		}
 	}
+}
 
-	for (i = 0; i < ctx->sz/4; i++) {
-		int found = 0;
-		uint32_t dword;
-		uint32_t pattern = 0;
-		uint32_t known_pattern = 0;
-		uint32_t known_pattern_color = 0;
-		uint32_t pmasks[32];
-		uint32_t pcolors[32];
-		const char *pnames[32];
-		int nparams = 0;
-
-		/* adjust offsets for fuzzy matching: */
-		adjust_offsets(ctx, i + offset, offsets);
-		j = offsets[idx] - offset;
-		while (j--)
-			printf("<font face=\"monospace\" color=\"#000000\">........</font><br>");
-		offset = offsets[idx];
-
-		dword = dwords[i];
-
-		/* check for gpu address: */
-		j = find_gpuaddr(ctx, dword);
-		if (j >= 0) {
-			printf("<font face=\"monospace\">%04x: <font color=\"#%06x\"><b>%08x</b></font> (gpuaddr)</font><br>",
-					i, gpuaddr_colors[j], dword);
-			continue;
-		}
+static void print_dword(struct context *ctx, int i, uint32_t pattern)
+{
+	uint32_t dword = ctx->buf[i];
+	uint32_t known_pattern = 0;
+	uint32_t known_pattern_color = 0;
+	uint32_t pmasks[32];
+	uint32_t pcolors[32];
+	const char *pnames[32];
+	int nparams = 0;
+	int j, k;
 
-		/* check for similarity with other ctxts: */
-		j = find_pattern(dword, i + offset, offsets);
-		if (j >= 0)
-			pattern = patterns[j];
+	/* check for gpu address: */
+	j = find_gpuaddr(ctx, dword);
+	if (j >= 0) {
+		printf("%04x: <font color=\"#%06x\"><b>%08x</b></font> (gpuaddr)\n",
+				i, gpuaddr_colors[j], dword);
+		return;
+	}
 
-		/* check for known patterns: */
-		for (j = 0; j < ARRAY_SIZE(known_patterns); j++) {
-			if (known_patterns[j].val == (dword & known_patterns[j].mask)) {
-				known_pattern = known_patterns[j].mask;
-				known_pattern_color = known_patterns[j].color;
-				break;
-			}
+	/* check for known patterns: */
+	for (j = 0; j < ARRAY_SIZE(known_patterns); j++) {
+		if (known_patterns[j].val == (dword & known_patterns[j].mask)) {
+			known_pattern = known_patterns[j].mask;
+			known_pattern_color = known_patterns[j].color;
+			break;
 		}
+	}
 
-		/* check for recognized params: */
-		if (!known_pattern) {
-			for (j = 0; j < ctx->nparams; j++) {
-				struct param *param = &ctx->params[j];
-				int alignedlen = ALIGN(param->bitlen, 8);
-				uint64_t m = (uint64_t)(1 << param->bitlen) - 1;
-				uint32_t val = param->val;
-				/* ignore param vals of zero, to easy for false match: */
-				if (!val)
-					continue;
-				do {
-					if ((dword & m) == val) {
-						int n = nparams++;
-						pmasks[n]  = m;
-						pcolors[n] = param_colors[param->type];
-						pnames[n]  = param_names[param->type];
-						break;
-					}
-					m <<= alignedlen;
-					val <<= alignedlen;
-				} while (m & (uint64_t)0xffffffff);
-			}
+	/* check for recognized params: */
+	if (!known_pattern) {
+		for (j = 0; j < ctx->nparams; j++) {
+			struct param *param = &ctx->params[j];
+			int alignedlen = ALIGN(param->bitlen, 8);
+			uint64_t m = (uint64_t)(1 << param->bitlen) - 1;
+			uint32_t val = param->val;
+			/* ignore param vals of zero, to easy for false match: */
+			if (!val)
+				continue;
+			do {
+				if ((dword & m) == val) {
+					int n = nparams++;
+					pmasks[n]  = m;
+					pcolors[n] = param_colors[param->type];
+					pnames[n]  = param_names[param->type];
+					break;
+				}
+				m <<= alignedlen;
+				val <<= alignedlen;
+			} while (m & (uint64_t)0xffffffff);
 		}
+	}
+
+	/* common case, all bytes match the other contexts: */
+	if ((pattern == 0xffffffff) && !known_pattern && !nparams) {
+		printf("%04x: <font color=\"#0000ff\">%08x</font>\n", i, dword);
+		return;
+	}
 
-		if (pattern || known_pattern || nparams) {
-			uint32_t mask = 0xff000000;
-			uint32_t shift = 24;
+	if (pattern || known_pattern || nparams) {
+		uint32_t mask = 0xff000000;
+		uint32_t shift = 24;
 
-			printf("<font face=\"monospace\">%04x: ", i);
+		printf("%04x: ", i);
 
-			for (k = 0; k < 4; k++, mask >>= 8, shift -= 8) {
-				uint32_t color = 0;
+		for (k = 0; k < 4; k++, mask >>= 8, shift -= 8) {
+			uint32_t color = 0;
 
-				if (pattern & mask)
-					color = 0x0000ff;
+			if (pattern & mask)
+				color = 0x0000ff;
 
-				if (known_pattern & mask)
-					color = known_pattern_color;
+			if (known_pattern & mask)
+				color = known_pattern_color;
 
-				for (j = 0; j < nparams; j++) {
-					if (mask & pmasks[j]) {
-						color = pcolors[j];
-						printf("<b>");
-						break;
-					}
+			for (j = 0; j < nparams; j++) {
+				if (mask & pmasks[j]) {
+					color = pcolors[j];
+					printf("<b>");
+					break;
 				}
+			}
 
+			if (color)
 				printf("<font color=\"#%06x\">%02x</font>",
 						color, (dword & mask) >> shift);
+			else
+				printf("%02x", (dword & mask) >> shift);
 
-				for (j = 0; j < nparams; j++) {
-					if (mask & pmasks[j]) {
-						printf("</b>");
-						break;
-					}
+			for (j = 0; j < nparams; j++) {
+				if (mask & pmasks[j]) {
+					printf("</b>");
+					break;
 				}
 			}
-			if (nparams > 0) {
-				printf(" (");
-				for (j = 0; j < nparams; j++) {
-					if (j != 0)
-						printf(", ");
-					printf("%s", pnames[j]);
-				}
-				printf("?)");
+		}
+		if (nparams > 0) {
+			printf(" (");
+			for (j = 0; j < nparams; j++) {
+				if (j != 0)
+					printf(", ");
+				printf("%s", pnames[j]);
 			}
-			printf("</font><br>");
-			continue;
+			printf("?)");
 		}
-
-		printf("<font face=\"monospace\" color=\"#000000\">%04x: %08x</font><br>", i, dword);
+		printf("\n");
+		return;
 	}
+
+	printf("%04x: %08x\n", i, dword);
 }
 
-static void handle_context(struct context *ctx)
+/* Cmdstreams are handled for all contexts at once, since they need to
+ * be aligned.  Long cmdstreams are split into pages, each in its own
+ * (collapsed, other than the first) <details>, so the browser does not
+ * need to lay out the whole thing at once.
+ */
+static void handle_cmdstreams(void)
 {
-	/* ignore for now */
+	uint32_t *row_patterns;
+	int i, k, page;
+
+	align_cmdstreams();
+
+	row_patterns = malloc(page_size * sizeof(row_patterns[0]));
+
+	for (page = 0; page < nrows; page += page_size) {
+		int end = min(page + page_size, nrows);
+
+		for (i = page; i < end; i++)
+			row_patterns[i - page] = find_pattern(rows[i]);
+
+		printf("<tr><th>cmdstream</th><td colspan=\"%d\">", nctxts);
+		if (nrows > page_size) {
+			printf("<details%s><summary>rows %d-%d of %d</summary>",
+					page ? "" : " open", page, end - 1, nrows);
+		}
+		printf("<table><tr>");
+
+		for (k = 0; k < nctxts; k++) {
+			printf("<td valign=\"top\"><pre>");
+			for (i = page; i < end; i++) {
+				int idx = rows[i][k];
+				if (idx < 0)
+					printf("........\n");
+				else
+					print_dword(&ctxts[k], idx, row_patterns[i - page]);
+			}
+			printf("</pre></td>");
+		}
+
+		printf("</tr></table>");
+		if (nrows > page_size)
+			printf("</details>");
+		printf("</td></tr>\n");
+	}
+
+	free(row_patterns);
 }
 
-static void handle_cmdstream(struct context *ctx)
+static void handle_context(struct context *ctx)
 {
-	handle_hexdump(ctx);
+	/* ignore for now */
 }
 
 static void handle_param(struct context *ctx)
@@ -420,7 +495,6 @@ static void (*sect_handlers[])(struct context *ctx) = {
 	[RD_CMD]  = handle_string,
 	[RD_GPUADDR] = handle_gpuaddr,
 	[RD_CONTEXT] = handle_context,
-	[RD_CMDSTREAM] = handle_cmdstream,
 	[RD_PARAM] = handle_param,
 	[RD_FLUSH] = handle_flush,
 };
@@ -440,7 +514,25 @@ int main(int argc, char **argv)
 	int i, n;
 
 	for (i = 1; i < argc; i++) {
-		struct context *ctx = &ctxts[nctxts++];
+		struct context *ctx;
+
+		if (!strcmp(argv[i], "--page-size")) {
+			i++;
+			if (i >= argc) {
+				fprintf(stderr, "usage: %s [--page-size N] "
+						"testlog1.rd testlog2.rd..\n", argv[0]);
+				return -1;
+			}
+			page_size = max(atoi(argv[i]), 1);
+			continue;
+		}
+
+		if (nctxts == ARRAY_SIZE(ctxts)) {
+			fprintf(stderr, "too many files\n");
+			return -1;
+		}
+
+		ctx = &ctxts[nctxts++];
 		ctx->fd = open(argv[i], O_RDONLY);
 		if (ctx->fd < 0) {
 			fprintf(stderr, "could not open: %s\n", argv[i]);
@@ -486,16 +578,23 @@ int main(int argc, char **argv)
 			break;
 		}
 
+		for (i = 0, n = 0; i < nctxts; i++)
+			if (ctxts[i].sz > 0)
+				n++;
+
+		if (row_type == RD_CMDSTREAM) {
+			handle_cmdstreams();
+			continue;
+		}
+
 		printf("<tr><th>%s</th>", sect_names[row_type]);
 
-		for (i = 0, n = 0; i < nctxts; i++) {
+		for (i = 0; i < nctxts; i++) {
 			struct context *ctx = &ctxts[i];
 
 			printf("<td>");
-			if (ctx->sz > 0) {
+			if ((ctx->sz > 0) && sect_handlers[row_type])
 				sect_handlers[row_type](ctx);
-				n++;
-			}
 			printf("</td>");
 		}
 
@@ -31,6 +31,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
@@ -41,6 +43,16 @@
 
 static lua_State *L;
 
+/* which optional hooks the script defines: */
+static struct {
+	int packet;
+	int start_ib, end_ib;
+	int set_bin;
+	int load_state;
+	int buffer;
+	int partial, merge;
+} hooks;
+
 /* does not return */
 static void error(const char *fmt)
 {
@@ -143,6 +155,15 @@ static const struct luaL_Reg l_regs[] = {
 	{NULL, NULL}  /* sentinel */
 };
 
+static int has_function(const char *name)
+{
+	int ret;
+	lua_getglobal(L, name);
+	ret = lua_isfunction(L, -1);
+	lua_pop(L, 1);
+	return ret;
+}
+
 /* called at start to load the script: */
 int script_load(const char *file)
 {
@@ -163,6 +184,15 @@ int script_load(const char *file)
 	if (ret)
 		error("%s\n");
 
+	hooks.packet     = has_function("packet");
+	hooks.start_ib   = has_function("start_ib");
+	hooks.end_ib     = has_function("end_ib");
+	hooks.set_bin    = has_function("set_bin");
+	hooks.load_state = has_function("load_state");
+	hooks.buffer     = has_function("buffer");
+	hooks.partial    = has_function("partial");
+	hooks.merge      = has_function("merge");
+
 	return 0;
 }
 
@@ -198,9 +228,101 @@ void script_draw(const char *primtype, uint32_t nindx)
 		error("error running function `f': %s\n");
 }
 
-/* maybe at some point it is interesting to add additional script
- * hooks for CP_EVENT_WRITE, etc?
- */
+/* called for each type-3 packet: */
+void script_packet(uint32_t opcode, uint32_t *dwords, uint32_t sizedwords)
+{
+	if (!hooks.packet)
+		return;
+
+	lua_getglobal(L, "packet");
+	lua_pushnumber(L, opcode);
+	lua_pushlstring(L, (const char *)dwords, sizedwords * 4);
+
+	/* do the call (2 arguments, 0 result) */
+	if (lua_pcall(L, 2, 0, 0) != 0)
+		error("error running function `f': %s\n");
+}
+
+/* called on entry to an indirect buffer: */
+void script_start_ib(uint32_t ibaddr, uint32_t ibsize)
+{
+	if (!hooks.start_ib)
+		return;
+
+	lua_getglobal(L, "start_ib");
+	lua_pushnumber(L, ibaddr);
+	lua_pushnumber(L, ibsize);
+
+	/* do the call (2 arguments, 0 result) */
+	if (lua_pcall(L, 2, 0, 0) != 0)
+		error("error running function `f': %s\n");
+}
+
+/* called on exit from an indirect buffer: */
+void script_end_ib(void)
+{
+	if (!hooks.end_ib)
+		return;
+
+	lua_getglobal(L, "end_ib");
+
+	/* do the call (0 arguments, 0 result) */
+	if (lua_pcall(L, 0, 0, 0) != 0)
+		error("error running function `f': %s\n");
+}
+
+/* called at each CP_SET_BIN: */
+void script_set_bin(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2)
+{
+	if (!hooks.set_bin)
+		return;
+
+	lua_getglobal(L, "set_bin");
+	lua_pushnumber(L, x1);
+	lua_pushnumber(L, y1);
+	lua_pushnumber(L, x2);
+	lua_pushnumber(L, y2);
+
+	/* do the call (4 arguments, 0 result) */
+	if (lua_pcall(L, 4, 0, 0) != 0)
+		error("error running function `f': %s\n");
+}
+
+/* called at each CP_LOAD_STATE: */
+void script_load_state(uint32_t state_block, uint32_t state_type,
+		uint32_t num_unit, const void *contents, uint32_t sizedwords)
+{
+	if (!hooks.load_state)
+		return;
+
+	lua_getglobal(L, "load_state");
+	lua_pushnumber(L, state_block);
+	lua_pushnumber(L, state_type);
+	lua_pushnumber(L, num_unit);
+	if (contents)
+		lua_pushlstring(L, contents, sizedwords * 4);
+	else
+		lua_pushnil(L);
+
+	/* do the call (4 arguments, 0 result) */
+	if (lua_pcall(L, 4, 0, 0) != 0)
+		error("error running function `f': %s\n");
+}
+
+/* called when a buffer is registered: */
+void script_buffer(uint32_t gpuaddr, uint32_t len)
+{
+	if (!hooks.buffer)
+		return;
+
+	lua_getglobal(L, "buffer");
+	lua_pushnumber(L, gpuaddr);
+	lua_pushnumber(L, len);
+
+	/* do the call (2 arguments, 0 result) */
+	if (lua_pcall(L, 2, 0, 0) != 0)
+		error("error running function `f': %s\n");
+}
 
 /* called at end of each cmdstream file: */
 void script_end_cmdstream(void)
@@ -229,4 +351,141 @@ void script_finish(void)
 
 	lua_close(L);
 	L = NULL;
+	memset(&hooks, 0, sizeof(hooks));
+}
+
+/* Serialize the value at the top of the stack as a lua expression, so
+ * the parent can reconstruct it with a plain load.  Only nil, booleans,
+ * numbers, strings and (non-recursive) tables of those are supported.
+ */
+static int serialize(FILE *f, int depth)
+{
+	size_t i, len;
+	const char *str;
+
+	if (depth > 64) {
+		fprintf(stderr, "partial result nested too deeply\n");
+		return -1;
+	}
+
+	switch (lua_type(L, -1)) {
+	case LUA_TNIL:
+		fprintf(f, "nil");
+		break;
+	case LUA_TBOOLEAN:
+		fprintf(f, lua_toboolean(L, -1) ? "true" : "false");
+		break;
+	case LUA_TNUMBER: {
+		double val = lua_tonumber(L, -1);
+		if (isnan(val))
+			fprintf(f, "(0/0)");
+		else if (isinf(val))
+			fprintf(f, (val < 0) ? "(-1/0)" : "(1/0)");
+		else
+			fprintf(f, "%.17g", val);
+		break;
+	}
+	case LUA_TSTRING:
+		str = lua_tolstring(L, -1, &len);
+		fprintf(f, "\"");
+		for (i = 0; i < len; i++) {
+			unsigned char c = str[i];
+			if ((c == '"') || (c == '\\'))
+				fprintf(f, "\\%c", c);
+			else if ((c < 0x20) || (c >= 0x7f))
+				fprintf(f, "\\%03u", c);
+			else
+				fputc(c, f);
+		}
+		fprintf(f, "\"");
+		break;
+	case LUA_TTABLE:
+		fprintf(f, "{");
+		lua_pushnil(L);
+		while (lua_next(L, -2)) {
+			/* key at -2, value at -1: */
+			fprintf(f, "[");
+			lua_pushvalue(L, -2);
+			if (serialize(f, depth + 1))
+				return -1;
+			lua_pop(L, 1);
+			fprintf(f, "]=");
+			if (serialize(f, depth + 1))
+				return -1;
+			lua_pop(L, 1);
+			fprintf(f, ",");
+		}
+		fprintf(f, "}");
+		break;
+	default:
+		fprintf(stderr, "cannot serialize %s in partial result\n",
+				lua_typename(L, lua_type(L, -1)));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* does the script define partial() and merge(), needed for --jobs? */
+int script_can_merge(void)
+{
+	return hooks.partial && hooks.merge;
+}
+
+/* called in each worker after its last cmdstream file: */
+int script_write_partial(int fd)
+{
+	char *buf = NULL;
+	size_t len = 0, off = 0;
+	FILE *f;
+	int ret;
+
+	if (!L)
+		return 0;
+
+	lua_getglobal(L, "partial");
+
+	/* do the call (0 arguments, 1 result) */
+	if (lua_pcall(L, 0, 1, 0) != 0)
+		error("error running function `f': %s\n");
+
+	f = open_memstream(&buf, &len);
+	fprintf(f, "return ");
+	ret = serialize(f, 0);
+	fclose(f);
+	lua_pop(L, 1);
+
+	while (!ret && (off < len)) {
+		ssize_t n = write(fd, buf + off, len - off);
+		if (n < 0)
+			ret = -1;
+		else
+			off += n;
+	}
+
+	free(buf);
+
+	return ret;
+}
+
+/* called in the parent for each worker's result: */
+int script_merge(const char *buf, size_t len)
+{
+	if (!L)
+		return 0;
+
+	lua_getglobal(L, "merge");
+
+	if (luaL_loadbuffer(L, buf, len, "partial") ||
+			lua_pcall(L, 0, 1, 0)) {
+		fprintf(stderr, "bad partial result: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 2);
+		return -1;
+	}
+
+	/* do the call (1 arguments, 0 result) */
+	if (lua_pcall(L, 1, 0, 0) != 0)
+		error("error running function `f': %s\n");
+
+	return 0;
 }
@@ -30,6 +30,7 @@
 #define SCRIPT_H_
 
 #include <stdint.h>
+#include <stddef.h>
 
 
 // XXX make script support optional
@@ -48,16 +49,60 @@ void script_start_cmdstream(const char *name);
  */
 void script_draw(const char *primtype, uint32_t nindx);
 
-/* maybe at some point it is interesting to add additional script
- * hooks for CP_EVENT_WRITE, etc?
+/* The remaining hooks are optional, and only called if the script
+ * defines the corresponding global function.  Which ones are present
+ * is determined once at script_load() time, so a script which does
+ * not define them costs nothing but a flag check.
  */
 
+/* called for each type-3 packet, with the opcode and payload (not
+ * including the packet header), calls script packet fxn:
+ */
+void script_packet(uint32_t opcode, uint32_t *dwords, uint32_t sizedwords);
+
+/* called on entry/exit of an indirect buffer (CP_INDIRECT_BUFFER, etc),
+ * calls script start_ib/end_ib fxns:
+ */
+void script_start_ib(uint32_t ibaddr, uint32_t ibsize);
+void script_end_ib(void);
+
+/* called at each CP_SET_BIN, calls script set_bin fxn: */
+void script_set_bin(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2);
+
+/* called at each CP_LOAD_STATE, calls script load_state fxn with the
+ * state contents (ie. shader instructions) passed as a string:
+ */
+void script_load_state(uint32_t state_block, uint32_t state_type,
+		uint32_t num_unit, const void *contents, uint32_t sizedwords);
+
+/* called when a buffer's contents are registered, calls script buffer
+ * fxn:
+ */
+void script_buffer(uint32_t gpuaddr, uint32_t len);
+
 /* called at end of each cmdstream file: */
 void script_end_cmdstream(void);
 
 /* called after last cmdstream file: */
 void script_finish(void);
 
+/* for parallel (--jobs) mode, where each worker process runs the
+ * script over a subset of the cmdstream files:
+ */
+
+/* returns true if the script defines both the partial and merge fxns: */
+int script_can_merge(void);
+
+/* called in each worker after its last cmdstream file, calls script
+ * partial fxn and writes the serialized result to fd:
+ */
+int script_write_partial(int fd);
+
+/* called in the parent for each worker's serialized result (before
+ * script_finish()), calls script merge fxn:
+ */
+int script_merge(const char *buf, size_t len);
+
 #else
 // TODO no-op stubs..
 #endif
@@ -0,0 +1,169 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "shader-cost.h"
+#include "adreno_common.xml.h"
+#include "adreno_pm4.xml.h"
+#include "a2xx.xml.h"
+#include "instr-a2xx.h"
+#include "instr-a3xx.h"
+#include "instr-latency.h"
+
+void shader_cost_a3xx(const struct disasm_a3xx_instr *instrs, int n,
+		struct shader_cost *cost)
+{
+	unsigned cycle = 0, tex_ready = 0, sfu_ready = 0;
+	int i;
+
+	memset(cost, 0, sizeof(*cost));
+
+	for (i = 0; i < n; i++) {
+		const struct disasm_a3xx_instr *instr = &instrs[i];
+		unsigned cnt = 1 + instr->repeat;
+
+		if (instr->flags & DISASM_A3XX_SY) {
+			cost->sy++;
+			cost->sy_stall += stall(&cycle, &tex_ready);
+		}
+		if (instr->flags & DISASM_A3XX_SS) {
+			cost->ss++;
+			cost->ss_stall += stall(&cycle, &sfu_ready);
+		}
+
+		switch (instr->cat) {
+		case 0:
+			if (instr->opc == OPC_NOP)
+				cost->nop += cnt;
+			else
+				cost->flow += cnt;
+			break;
+		case 1:
+		case 2:
+		case 3:
+			cost->alu += cnt;
+			break;
+		case 4:
+			cost->sfu += cnt;
+			sfu_ready = cycle + cnt + SFU_LATENCY;
+			break;
+		case 5:
+			cost->tex += cnt;
+			tex_ready = cycle + cnt + TEX_LATENCY;
+			break;
+		case 6:
+			cost->mem += cnt;
+			tex_ready = cycle + cnt + TEX_LATENCY;
+			break;
+		}
+
+		cycle += cnt;
+		cost->ninstrs++;
+		cost->nexpanded += cnt;
+	}
+
+	cost->cycles = cycle;
+}
+
+static int scalar_sfu(uint32_t opc)
+{
+	switch (opc) {
+	case EXP_IEEE:
+	case LOG_CLAMP:
+	case LOG_IEEE:
+	case RECIP_CLAMP:
+	case RECIP_FF:
+	case RECIP_IEEE:
+	case RECIPSQ_CLAMP:
+	case RECIPSQ_FF:
+	case RECIPSQ_IEEE:
+	case SQRT_IEEE:
+	case SIN:
+	case COS:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+void shader_cost_a2xx(const struct disasm_a2xx_instr *instrs, int n,
+		struct shader_cost *cost)
+{
+	unsigned cycle = 0, fetch_ready = 0;
+	int i;
+
+	memset(cost, 0, sizeof(*cost));
+
+	for (i = 0; i < n; i++) {
+		const struct disasm_a2xx_instr *instr = &instrs[i];
+
+		/* the CF program is run by the sequencer, alongside: */
+		if (instr->type == DISASM_A2XX_CF) {
+			cost->flow++;
+			continue;
+		}
+
+		if (instr->sync) {
+			cost->sy++;
+			cost->sy_stall += stall(&cycle, &fetch_ready);
+		}
+
+		if (instr->type == DISASM_A2XX_FETCH) {
+			if (instr->opc == VTX_FETCH)
+				cost->mem++;
+			else
+				cost->tex++;
+			fetch_ready = cycle + 1 + TEX_LATENCY;
+		} else {
+			/* vector and scalar ops are co-issued: */
+			cost->alu++;
+			if (instr->has_scalar && scalar_sfu(instr->scalar_opc))
+				cost->sfu++;
+		}
+
+		cycle++;
+		cost->ninstrs++;
+		cost->nexpanded++;
+	}
+
+	cost->cycles = cycle;
+}
+
+void shader_cost_print(FILE *out, const struct shader_cost *cost)
+{
+	fprintf(out, "%u instrs (%u expanded), alu=%u sfu=%u tex=%u mem=%u "
+			"flow=%u nop=%u, (sy)=%u stall=%u, (ss)=%u stall=%u, ~%u cycles",
+			cost->ninstrs, cost->nexpanded, cost->alu, cost->sfu,
+			cost->tex, cost->mem, cost->flow, cost->nop,
+			cost->sy, cost->sy_stall, cost->ss, cost->ss_stall,
+			cost->cycles);
+}
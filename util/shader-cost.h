@@ -0,0 +1,61 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#ifndef SHADER_COST_H_
+#define SHADER_COST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "disasm.h"
+
+/* A static, rough, cost estimate for a shader, from the decoded
+ * instructions.  The instruction counts are with (rptN) expanded.
+ *
+ * The cycle estimate assumes one instruction issued per cycle, plus
+ * stalls where a (sy) or (ss) (or (S) on a2xx) waits for an earlier
+ * tex/mem or SFU result which, with fixed guessed latencies, isn't
+ * ready yet.  It ignores flow control, so it is only good for
+ * comparing shaders, not for predicting real timings.
+ */
+struct shader_cost {
+	unsigned ninstrs;       /* as encoded */
+	unsigned nexpanded;     /* with (rptN) expanded */
+	unsigned alu, sfu, tex, mem, flow, nop;
+	unsigned sy, ss;        /* # of sync points */
+	unsigned sy_stall, ss_stall;
+	unsigned cycles;
+};
+
+void shader_cost_a3xx(const struct disasm_a3xx_instr *instrs, int ninstrs,
+		struct shader_cost *cost);
+void shader_cost_a2xx(const struct disasm_a2xx_instr *instrs, int ninstrs,
+		struct shader_cost *cost);
+void shader_cost_print(FILE *out, const struct shader_cost *cost);
+
+#endif /* SHADER_COST_H_ */
@@ -0,0 +1,126 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "diff.h"
+#include "shader-store.h"
+
+#define STORE_HASH_SIZE 1024
+
+/* shaders written (or found) so far in this run.  The same dwords can
+ * be stored with different extensions (ie. as a vertex and a fragment
+ * shader), which are different files, so both are part of the key:
+ */
+static struct stored_shader {
+	uint64_t hash;
+	char *ext;
+	struct stored_shader *next;
+} *stored[STORE_HASH_SIZE];
+
+static FILE *index_file;
+
+static int is_stored(uint64_t hash, const char *ext)
+{
+	struct stored_shader *s;
+	for (s = stored[hash % STORE_HASH_SIZE]; s; s = s->next)
+		if ((s->hash == hash) && !strcmp(s->ext, ext))
+			return 1;
+	return 0;
+}
+
+static void mark_stored(uint64_t hash, const char *ext)
+{
+	struct stored_shader *s = malloc(sizeof(*s));
+	s->hash = hash;
+	s->ext = strdup(ext);
+	s->next = stored[hash % STORE_HASH_SIZE];
+	stored[hash % STORE_HASH_SIZE] = s;
+}
+
+uint64_t shader_store(const uint32_t *dwords, uint32_t sizedwords,
+		const char *ext)
+{
+	uint64_t hash = diff_hash_dwords(DIFF_HASH_INIT, dwords, sizedwords);
+	char filename[32 + strlen(ext)];
+	int fd;
+
+	if (is_stored(hash, ext))
+		return hash;
+
+	mark_stored(hash, ext);
+
+	sprintf(filename, "%016llx.%s", (unsigned long long)hash, ext);
+
+	/* written by an earlier run: */
+	if (!access(filename, F_OK))
+		return hash;
+
+	fd = open(filename, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "could not open: %s\n", filename);
+		return hash;
+	}
+
+	if (write(fd, dwords, sizedwords * 4) != (sizedwords * 4))
+		fprintf(stderr, "error writing: %s\n", filename);
+
+	close(fd);
+
+	return hash;
+}
+
+void shader_store_index(const char *fmt, ...)
+{
+	va_list args;
+
+	if (!index_file) {
+		index_file = fopen("shaders.idx", "a");
+		if (!index_file) {
+			fprintf(stderr, "could not open: shaders.idx\n");
+			return;
+		}
+		setlinebuf(index_file);
+	}
+
+	va_start(args, fmt);
+	vfprintf(index_file, fmt, args);
+	va_end(args);
+}
+
+void shader_store_close(void)
+{
+	if (index_file)
+		fclose(index_file);
+	index_file = NULL;
+}
@@ -0,0 +1,50 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#ifndef SHADER_STORE_H_
+#define SHADER_STORE_H_
+
+#include <stdint.h>
+
+/* Content-hash keyed store of shader binaries, for --dump-shaders.
+ *
+ * Each unique shader binary is written once, to "<hash>.<ext>" in the
+ * current directory, where hash is the 64bit hash of the dwords (the
+ * same hash rddiff uses).  Shaders already written by a previous run
+ * are not re-written.
+ *
+ * The index (shaders.idx) records where each shader was seen, one line
+ * per entry, in whatever format the caller chooses.
+ */
+uint64_t shader_store(const uint32_t *dwords, uint32_t sizedwords,
+		const char *ext);
+void shader_store_index(const char *fmt, ...)
+		__attribute__((format(printf, 1, 2)));
+void shader_store_close(void);
+
+#endif /* SHADER_STORE_H_ */
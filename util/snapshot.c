@@ -0,0 +1,379 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "io.h"
+
+#define ALIGN(v,a) (((v) + (a) - 1) & ~((a) - 1))
+
+/* growable column of dwords: */
+struct column {
+	uint32_t *data;
+	uint32_t count, size;
+};
+
+static void column_append(struct column *col, uint32_t val)
+{
+	if (col->count == col->size) {
+		col->size = col->size ? (col->size * 2) : 1024;
+		col->data = realloc(col->data, col->size * sizeof(col->data[0]));
+	}
+	col->data[col->count++] = val;
+}
+
+struct snapshot {
+	/* writing: */
+	FILE *f;
+	char *name;
+	char **primtypes;
+	uint32_t nprimtypes;
+	struct column primtype, nindx, bin, delta_end, delta_reg, delta_val;
+	uint32_t vals[SNAPSHOT_NREGS];
+	uint8_t written[SNAPSHOT_NREGS / 8];
+
+	/* reading: */
+	struct io *io;
+	int error;
+};
+
+static void write_padded(FILE *f, const void *buf, uint32_t len, uint32_t padded)
+{
+	static const char zeros[4];
+	fwrite(buf, 1, len, f);
+	fwrite(zeros, 1, padded - len, f);
+}
+
+struct snapshot * snapshot_create(const char *filename)
+{
+	struct snapshot_file_hdr hdr = {
+			.magic = SNAPSHOT_MAGIC,
+			.version = SNAPSHOT_VERSION,
+	};
+	struct snapshot *s = calloc(1, sizeof(*s));
+
+	s->f = fopen(filename, "w");
+	if (!s->f) {
+		fprintf(stderr, "could not open: %s\n", filename);
+		free(s);
+		return NULL;
+	}
+
+	fwrite(&hdr, sizeof(hdr), 1, s->f);
+
+	return s;
+}
+
+void snapshot_start_stream(struct snapshot *s, const char *name)
+{
+	free(s->name);
+	s->name = strdup(name);
+	memset(s->vals, 0, sizeof(s->vals));
+	memset(s->written, 0, sizeof(s->written));
+}
+
+static uint32_t primtype_idx(struct snapshot *s, const char *primtype)
+{
+	uint32_t i;
+
+	if (!primtype)
+		primtype = "";
+
+	for (i = 0; i < s->nprimtypes; i++)
+		if (!strcmp(s->primtypes[i], primtype))
+			return i;
+
+	s->primtypes = realloc(s->primtypes,
+			(s->nprimtypes + 1) * sizeof(s->primtypes[0]));
+	s->primtypes[i] = strdup(primtype);
+	s->nprimtypes++;
+
+	return i;
+}
+
+void snapshot_draw(struct snapshot *s, const char *primtype, uint32_t nindx,
+		uint32_t bin_x1, uint32_t bin_y1, uint32_t bin_x2, uint32_t bin_y2,
+		const uint32_t *regvals, const uint8_t *written)
+{
+	uint32_t i, regbase;
+
+	column_append(&s->primtype, primtype_idx(s, primtype));
+	column_append(&s->nindx, nindx);
+	column_append(&s->bin, bin_x1 | (bin_y1 << 16));
+	column_append(&s->bin, bin_x2 | (bin_y2 << 16));
+
+	/* registers are never un-written within a cmdstream, so compare a
+	 * byte of the written bitmask at a time to skip untouched ranges:
+	 */
+	for (i = 0; i < sizeof(s->written); i++) {
+		uint8_t mask = written[i];
+		if (!mask)
+			continue;
+		for (regbase = i * 8; mask; regbase++, mask >>= 1) {
+			uint8_t bit = 1 << (regbase % 8);
+			if (!(mask & 1))
+				continue;
+			if ((s->written[i] & bit) && (s->vals[regbase] == regvals[regbase]))
+				continue;
+			s->written[i] |= bit;
+			s->vals[regbase] = regvals[regbase];
+			column_append(&s->delta_reg, regbase);
+			column_append(&s->delta_val, regvals[regbase]);
+		}
+	}
+
+	column_append(&s->delta_end, s->delta_reg.count);
+}
+
+static void write_column(FILE *f, struct column *col)
+{
+	fwrite(col->data, sizeof(col->data[0]), col->count, f);
+	col->count = 0;
+}
+
+int snapshot_end_stream(struct snapshot *s, uint32_t gpu_id)
+{
+	uint32_t name_len = strlen(s->name) + 1;
+	uint32_t primtypes_len = 0;
+	uint32_t i;
+	struct snapshot_stream_hdr hdr;
+
+	for (i = 0; i < s->nprimtypes; i++)
+		primtypes_len += strlen(s->primtypes[i]) + 1;
+
+	hdr.name_len      = ALIGN(name_len, 4);
+	hdr.gpu_id        = gpu_id;
+	hdr.ndraws        = s->nindx.count;
+	hdr.ndeltas       = s->delta_reg.count;
+	hdr.nprimtypes    = s->nprimtypes;
+	hdr.primtypes_len = ALIGN(primtypes_len, 4);
+
+	fwrite(&hdr, sizeof(hdr), 1, s->f);
+	write_padded(s->f, s->name, name_len, hdr.name_len);
+	for (i = 0; i < s->nprimtypes; i++)
+		fwrite(s->primtypes[i], 1, strlen(s->primtypes[i]) + 1, s->f);
+	write_padded(s->f, "", 0, hdr.primtypes_len - primtypes_len);
+
+	write_column(s->f, &s->primtype);
+	write_column(s->f, &s->nindx);
+	write_column(s->f, &s->bin);
+	write_column(s->f, &s->delta_end);
+	write_column(s->f, &s->delta_reg);
+	write_column(s->f, &s->delta_val);
+
+	for (i = 0; i < s->nprimtypes; i++)
+		free(s->primtypes[i]);
+	free(s->primtypes);
+	s->primtypes = NULL;
+	s->nprimtypes = 0;
+
+	return ferror(s->f) ? -1 : 0;
+}
+
+void snapshot_close(struct snapshot *s)
+{
+	if (s->f)
+		fclose(s->f);
+	if (s->io)
+		io_close(s->io);
+	free(s->primtype.data);
+	free(s->nindx.data);
+	free(s->bin.data);
+	free(s->delta_end.data);
+	free(s->delta_reg.data);
+	free(s->delta_val.data);
+	free(s->name);
+	free(s);
+}
+
+struct snapshot * snapshot_open(const char *filename)
+{
+	struct snapshot_file_hdr hdr;
+	struct snapshot *s = calloc(1, sizeof(*s));
+
+	s->io = io_open(filename);
+	if (!s->io) {
+		fprintf(stderr, "could not open: %s\n", filename);
+		free(s);
+		return NULL;
+	}
+
+	if ((io_readn(s->io, &hdr, sizeof(hdr)) != sizeof(hdr)) ||
+			(hdr.magic != SNAPSHOT_MAGIC)) {
+		fprintf(stderr, "%s: not a snapshot file\n", filename);
+		snapshot_close(s);
+		return NULL;
+	}
+
+	if (hdr.version != SNAPSHOT_VERSION) {
+		fprintf(stderr, "%s: unsupported snapshot version: %u\n",
+				filename, hdr.version);
+		snapshot_close(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+/* the file is not trusted, check that all the indices and strings
+ * stay within the stream's buffer:
+ */
+static int validate_stream(struct snapshot_stream *stream,
+		uint32_t name_len, const char *p, uint32_t primtypes_len)
+{
+	uint32_t i, remaining = primtypes_len;
+
+	if (!name_len || !memchr(stream->name, 0, name_len))
+		return -1;
+
+	for (i = 0; i < stream->nprimtypes; i++) {
+		const char *end = memchr(p, 0, remaining);
+		if (!end)
+			return -1;
+		stream->primtypes[i] = p;
+		remaining -= end + 1 - p;
+		p = end + 1;
+	}
+
+	for (i = 0; i < stream->ndraws; i++) {
+		if (stream->primtype[i] >= stream->nprimtypes)
+			return -1;
+		if (stream->delta_end[i] > stream->ndeltas)
+			return -1;
+		if (i && (stream->delta_end[i] < stream->delta_end[i - 1]))
+			return -1;
+	}
+
+	for (i = 0; i < stream->ndeltas; i++)
+		if (stream->delta_reg[i] >= SNAPSHOT_NREGS)
+			return -1;
+
+	return 0;
+}
+
+/* returns NULL at end of file, or on error (see snapshot_error()): */
+struct snapshot_stream * snapshot_next_stream(struct snapshot *s)
+{
+	struct snapshot_stream_hdr hdr;
+	struct snapshot_stream *stream;
+	uint64_t sz;
+	int ret;
+	char *p;
+
+	ret = io_readn(s->io, &hdr, sizeof(hdr));
+	if (ret != sizeof(hdr)) {
+		if (ret) {
+			fprintf(stderr, "truncated snapshot\n");
+			s->error = 1;
+		}
+		return NULL;
+	}
+
+	/* all the variable sized data is read in a single buffer, the
+	 * size is computed in 64b so a bogus header can't overflow it:
+	 */
+	sz = (uint64_t)hdr.name_len + hdr.primtypes_len +
+			(5 * (uint64_t)hdr.ndraws * sizeof(uint32_t)) +  /* primtype, nindx, bin, delta_end */
+			(2 * (uint64_t)hdr.ndeltas * sizeof(uint32_t));  /* delta_reg, delta_val */
+
+	if ((sz > SNAPSHOT_MAX_STREAM_SIZE) ||
+			(hdr.nprimtypes > hdr.primtypes_len) ||
+			(hdr.name_len % 4) || (hdr.primtypes_len % 4)) {
+		fprintf(stderr, "corrupt snapshot\n");
+		s->error = 1;
+		return NULL;
+	}
+
+	stream = calloc(1, sizeof(*stream));
+	stream->buf = malloc(sz);
+	stream->primtypes = calloc(hdr.nprimtypes, sizeof(stream->primtypes[0]));
+
+	if (io_readn(s->io, stream->buf, sz) != sz) {
+		fprintf(stderr, "truncated snapshot\n");
+		snapshot_stream_free(stream);
+		s->error = 1;
+		return NULL;
+	}
+
+	stream->gpu_id     = hdr.gpu_id;
+	stream->ndraws     = hdr.ndraws;
+	stream->ndeltas    = hdr.ndeltas;
+	stream->nprimtypes = hdr.nprimtypes;
+
+	p = stream->buf;
+	stream->name = p;
+	p += hdr.name_len + hdr.primtypes_len;
+
+	stream->primtype  = (uint32_t *)p;  p += hdr.ndraws * sizeof(uint32_t);
+	stream->nindx     = (uint32_t *)p;  p += hdr.ndraws * sizeof(uint32_t);
+	stream->bin       = (uint32_t *)p;  p += 2 * hdr.ndraws * sizeof(uint32_t);
+	stream->delta_end = (uint32_t *)p;  p += hdr.ndraws * sizeof(uint32_t);
+	stream->delta_reg = (uint32_t *)p;  p += hdr.ndeltas * sizeof(uint32_t);
+	stream->delta_val = (uint32_t *)p;
+
+	if (validate_stream(stream, hdr.name_len, stream->name + hdr.name_len,
+			hdr.primtypes_len)) {
+		fprintf(stderr, "corrupt snapshot\n");
+		snapshot_stream_free(stream);
+		s->error = 1;
+		return NULL;
+	}
+
+	return stream;
+}
+
+int snapshot_error(struct snapshot *s)
+{
+	return s->error;
+}
+
+void snapshot_get_draw(struct snapshot_stream *stream, uint32_t n,
+		struct snapshot_draw *draw)
+{
+	uint32_t start = n ? stream->delta_end[n - 1] : 0;
+
+	draw->primtype = stream->primtypes[stream->primtype[n]];
+	draw->nindx    = stream->nindx[n];
+	draw->bin_x1   = stream->bin[2 * n] & 0xffff;
+	draw->bin_y1   = stream->bin[2 * n] >> 16;
+	draw->bin_x2   = stream->bin[2 * n + 1] & 0xffff;
+	draw->bin_y2   = stream->bin[2 * n + 1] >> 16;
+	draw->ndeltas  = stream->delta_end[n] - start;
+	draw->regs     = &stream->delta_reg[start];
+	draw->vals     = &stream->delta_val[start];
+}
+
+void snapshot_stream_free(struct snapshot_stream *stream)
+{
+	free(stream->primtypes);
+	free(stream->buf);
+	free(stream);
+}
@@ -0,0 +1,114 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright (C) 2014 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *    Rob Clark <robclark@freedesktop.org>
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stdint.h>
+
+/* Register-state snapshot, written by cffdump --emit-state, so analysis
+ * can be re-run without decoding the cmdstream again.
+ *
+ * The file is a header followed by one chunk per cmdstream file.  Each
+ * chunk has a header, the cmdstream name, a table of primtype names,
+ * and then the per-draw data stored column-wise:
+ *
+ *   primtype[ndraws]   - index into primtype name table
+ *   nindx[ndraws]      - number of indices
+ *   bin[ndraws][2]     - bin x1/y1 and x2/y2, packed like CP_SET_BIN
+ *   delta_end[ndraws]  - end of draw's range in delta_reg/delta_val
+ *   delta_reg[ndeltas] - register (written, or value changed) since
+ *   delta_val[ndeltas]   previous draw, and its new value
+ *
+ * So the register state at draw n is the result of applying the deltas
+ * for draws 0..n in order.  Strings are NUL terminated and padded to a
+ * multiple of 4 bytes, everything else is uint32_t.
+ */
+
+#define SNAPSHOT_MAGIC   0x53534446    /* "FDSS" */
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_NREGS   (0x7fff + 1)
+
+/* sanity limit on the size of a single stream's data when reading: */
+#define SNAPSHOT_MAX_STREAM_SIZE  0x40000000
+
+struct snapshot_file_hdr {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct snapshot_stream_hdr {
+	uint32_t name_len;        /* in bytes, including padding */
+	uint32_t gpu_id;
+	uint32_t ndraws;
+	uint32_t ndeltas;
+	uint32_t nprimtypes;
+	uint32_t primtypes_len;   /* in bytes, including padding */
+};
+
+/* a single cmdstream's worth of draws, as read back from the file: */
+struct snapshot_stream {
+	char *name;
+	uint32_t gpu_id;
+	uint32_t ndraws, ndeltas, nprimtypes;
+	const char **primtypes;
+	uint32_t *primtype, *nindx, *bin, *delta_end;
+	uint32_t *delta_reg, *delta_val;
+	void *buf;
+};
+
+/* a draw, as returned by snapshot_get_draw(): */
+struct snapshot_draw {
+	const char *primtype;
+	uint32_t nindx;
+	uint32_t bin_x1, bin_y1, bin_x2, bin_y2;
+	/* registers changed since the previous draw: */
+	uint32_t ndeltas;
+	const uint32_t *regs, *vals;
+};
+
+struct snapshot;
+
+/* writing: */
+struct snapshot * snapshot_create(const char *filename);
+void snapshot_start_stream(struct snapshot *s, const char *name);
+void snapshot_draw(struct snapshot *s, const char *primtype, uint32_t nindx,
+		uint32_t bin_x1, uint32_t bin_y1, uint32_t bin_x2, uint32_t bin_y2,
+		const uint32_t *regvals, const uint8_t *written);
+int snapshot_end_stream(struct snapshot *s, uint32_t gpu_id);
+void snapshot_close(struct snapshot *s);
+
+/* reading: */
+struct snapshot * snapshot_open(const char *filename);
+struct snapshot_stream * snapshot_next_stream(struct snapshot *s);
+int snapshot_error(struct snapshot *s);
+void snapshot_get_draw(struct snapshot_stream *stream, uint32_t n,
+		struct snapshot_draw *draw);
+void snapshot_stream_free(struct snapshot_stream *stream);
+
+#endif /* SNAPSHOT_H_ */